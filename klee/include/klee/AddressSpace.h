@@ -149,6 +149,12 @@ public:
     /// \return A writeable ObjectState (\a os or a copy).
     ObjectStatePtr getWriteable(const ObjectStateConstPtr &os);
 
+    /// \brief Replace an object by an identical one shared with other address spaces.
+    ///
+    /// The shared object must not be owned by any address space, so that
+    /// the next write to it in any of them makes a private copy.
+    void shareObject(const ObjectStateConstPtr &os, const ObjectStatePtr &shared);
+
     using Concretizer = std::function<uint8_t(const ref<Expr> &, const ObjectStateConstPtr &, size_t)>;
 
     bool read(uintptr_t address, uint8_t *buffer, size_t size, Concretizer c, AddressTranslator tr = nullptr);
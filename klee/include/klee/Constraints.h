@@ -35,6 +35,7 @@
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/Support/raw_ostream.h>
 #include <map>
+#include <memory>
 #include <vector>
 #include "klee/Expr.h"
 #include "klee/Internal/ADT/ImmutableMap.h"
@@ -47,8 +48,11 @@
 #include <boost/weak_ptr.hpp>
 
 namespace klee {
+class Assignment;
+class CanonicalPath;
 class ConditionIterator;
 class ConditionNode;
+class ConstraintPartition;
 } // namespace klee
 
 namespace std {
@@ -76,15 +80,52 @@ public:
         return depth_;
     }
 
+    /// Hash of the whole path from the root to this node, computed once
+    /// when the node is created.
+    unsigned hash() const {
+        return hash_;
+    }
+
+    /// Independent constraint partition of the path ending at this node,
+    /// computed lazily by the independent solver.
+    const std::shared_ptr<const ConstraintPartition> &partition() const {
+        return partition_;
+    }
+
+    void setPartition(const std::shared_ptr<const ConstraintPartition> &partition) const {
+        partition_ = partition;
+    }
+
+    /// An assignment known to satisfy the path ending at this node,
+    /// recorded by the counterexample cache.
+    const std::shared_ptr<Assignment> &model() const {
+        return model_;
+    }
+
+    void setModel(const std::shared_ptr<Assignment> &model) const {
+        model_ = model;
+    }
+
+    /// Name-independent digest of the path ending at this node,
+    /// computed lazily by the persistent query store.
+    const std::shared_ptr<const CanonicalPath> &canonical() const {
+        return canonical_;
+    }
+
+    void setCanonical(const std::shared_ptr<const CanonicalPath> &canonical) const {
+        canonical_ = canonical;
+    }
+
 protected:
     // Use weak_ptr here to enable automatic deallocation of nodes when they're
     // no longer referenced from a ConstraintManager.
     typedef std::map<ref<Expr>, weak_ptr<ConditionNode>> AdjancencyMap;
 
-    ConditionNode() : depth_(0) {
+    ConditionNode() : depth_(0), hash_(0) {
     }
     ConditionNode(const ConditionNodeRef parent, const ref<Expr> expr)
-        : parent_(parent), expr_(expr), depth_(parent->depth_ + 1) {
+        : parent_(parent), expr_(expr), depth_(parent->depth_ + 1),
+          hash_(parent->hash_ * Expr::MAGIC_HASH_CONSTANT + expr->hash()) {
     }
 
     ConditionNodeRef getOrCreate(const ref<Expr> expr) {
@@ -102,6 +143,10 @@ private:
     const ConditionNodeRef parent_;
     const ref<Expr> expr_;
     size_t depth_;
+    unsigned hash_;
+    mutable std::shared_ptr<const ConstraintPartition> partition_;
+    mutable std::shared_ptr<Assignment> model_;
+    mutable std::shared_ptr<const CanonicalPath> canonical_;
 
     friend class ConstraintManager;
 
@@ -147,6 +192,10 @@ public:
         head_ = root_;
     }
 
+    /// Creates a manager for the path that ends at head in the tree rooted at root.
+    ConstraintManager(const ConditionNodeRef &root, const ConditionNodeRef &head) : head_(head), root_(root) {
+    }
+
     ConstraintManager(const ConstraintManager &other) {
         root_ = other.root_;
         head_ = other.head_;
@@ -101,6 +101,13 @@ protected:
 
     void executeInstruction(ExecutionState &state, KInstruction *ki);
 
+    /// Executes the pre-decoded form of the instruction.
+    /// Returns false if some operands are symbolic.
+    bool executeFastInstruction(ExecutionState &state, KInstruction *ki);
+
+    /// Pre-decodes the instructions of functions that are called often
+    void countFunctionCall(KFunction *kf);
+
     void initializeGlobalObject(ExecutionState &state, const ObjectStatePtr &os, const llvm::Constant *c,
                                 unsigned offset);
     void initializeGlobals(ExecutionState &state);
@@ -131,6 +138,18 @@ protected:
     /// allows plugins to kill states and exit to the CPU loop safely.
     virtual void notifyFork(ExecutionState &originalState, ref<Expr> &condition, Executor::StatePair &targets);
 
+    /// Returns true if a deferrable fork() may leave the feasibility check
+    /// of the branched state to deferFork() instead of solving it right away.
+    virtual bool canDeferFork(ExecutionState &current);
+
+    /// Called by fork() with a branched state whose feasibility is not known
+    /// yet. The state has neither its branch constraint nor concrete values
+    /// and is not in the state set. The executor becomes responsible for
+    /// adding the constraint and the state once the constraints are known to
+    /// be satisfiable, or for deleting it otherwise.
+    virtual void deferFork(ExecutionState &current, ExecutionState *branchedState,
+                           const ConstraintManager &constraints, const ref<Expr> &condition);
+
     const Cell &eval(KInstruction *ki, unsigned index, ExecutionState &state) const;
 
     // delete the state (called internally by terminateState and updateStates)
@@ -155,8 +174,11 @@ public:
     // keepConditionTrueInCurrentState makes sure original state will have condition equal true.
     // This is useful when forking one state with several different values.
     // NOTE: In concolic mode it will recompute initial values for current state, do not use it for seed state.
+    //
+    // deferrable is set by the branch instruction handler, whose callers do not need both states
+    // right away. The feasibility check of the branched state may then be left to deferFork().
     virtual StatePair fork(ExecutionState &current, const ref<Expr> &condition,
-                           bool keepConditionTrueInCurrentState = false);
+                           bool keepConditionTrueInCurrentState = false, bool deferrable = false);
 
     // Unconditional fork
     virtual StatePair fork(ExecutionState &current);
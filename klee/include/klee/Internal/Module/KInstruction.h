@@ -21,6 +21,58 @@ namespace klee {
 class Executor;
 class KModule;
 class KFunction;
+struct KInstruction;
+
+/// Pre-decoded form of an integer instruction whose operands and result
+/// fit in 64 bits. When all operands are concrete, the executor computes
+/// the result directly, without creating intermediate expressions.
+struct KFastInstruction {
+    enum Opcode : uint8_t {
+        Add,
+        Sub,
+        Mul,
+        UDiv,
+        SDiv,
+        URem,
+        SRem,
+        And,
+        Or,
+        Xor,
+        Shl,
+        LShr,
+        AShr,
+        ICmp,
+        Trunc,
+        ZExt,
+        SExt,
+        Select
+    };
+
+    Opcode opcode;
+
+    /// llvm::CmpInst::Predicate of ICmp instructions
+    uint8_t predicate;
+
+    uint8_t numOperands;
+
+    /// Width of the result and of the last operand
+    unsigned width;
+    unsigned operandWidth;
+
+    /// Register index of each operand, -1 for constants
+    int registers[3];
+
+    /// Folded value of constant operands
+    uint64_t constants[3];
+
+    /// Returns null if the instruction has no pre-decoded form
+    static KFastInstruction *create(const KModule &module, const KInstruction *ki);
+
+    /// Computes the result from concrete operands. Returns false when
+    /// the result is undefined (e.g., division by zero or oversized shift),
+    /// the interpreter must handle these cases.
+    bool evaluate(const uint64_t *operands, uint64_t &result) const;
+};
 
 /// KInstruction - Intermediate instruction representation used
 /// during execution.
@@ -38,6 +90,10 @@ struct KInstruction {
     /// The function that owns this instruction
     KFunction *owner;
 
+    /// Set when the owner function becomes hot, null if the
+    /// instruction has no pre-decoded form
+    KFastInstruction *fast = nullptr;
+
 public:
     virtual ~KInstruction();
 };
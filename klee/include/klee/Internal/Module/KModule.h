@@ -17,6 +17,7 @@
 #include <memory>
 #include <set>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "Cell.h"
@@ -55,6 +56,9 @@ private:
     KBasicBlockEntries basicBlockEntry;
     llvm::DenseMap<const llvm::Instruction *, KInstruction *> instrMap;
 
+    /// Number of calls, used to decide when to pre-decode the instructions
+    uint64_t callCount;
+
     KFunction(const KFunction &);
     KFunction &operator=(const KFunction &);
 
@@ -89,6 +93,13 @@ public:
 
     KInstruction *getInstruction(const llvm::Instruction *instr) const;
 
+    uint64_t incrementCallCount() {
+        return ++callCount;
+    }
+
+    /// Pre-decodes the instructions that have a fast form, see KFastInstruction
+    void createFastInstructions(const KModule &module);
+
     unsigned getBbEntry(llvm::BasicBlock *bb) const {
         auto it = basicBlockEntry.find(bb);
         assert(it != basicBlockEntry.end());
@@ -115,6 +126,9 @@ private:
     std::map<const llvm::Constant *, KConstant *> constantMap;
     std::vector<Cell> constantTable;
 
+    /// Ids of the constants freed with the last function that used them
+    std::vector<unsigned> freeConstantIds;
+
     KModule(llvm::Module *_module);
     KModule() {
     }
@@ -132,6 +146,11 @@ private:
 
     KConstant *getKConstant(const llvm::Constant *c) const;
 
+    void freeConstant(KConstant *kc);
+
+    /// Adds the addresses of the functions referenced by the constant that are not bound yet
+    void bindFunctionAddresses(GlobalAddresses &globalAddresses, const llvm::Constant *c);
+
 public:
     ~KModule();
 
@@ -170,6 +189,9 @@ public:
     /// Remove function from KModule and call removeFromParend on it
     void removeFunction(llvm::Function *f, bool keepDeclaration = false);
 
+    /// Same as removeFunction, for many functions at once
+    void removeFunctions(const std::unordered_set<llvm::Function *> &functions, bool keepDeclaration = false);
+
     Expr::Width getWidthForLLVMType(llvm::Type *type) const;
 
     ref<klee::ConstantExpr> evalConstant(const GlobalAddresses &globalAddresses, const llvm::Constant *c,
@@ -22,7 +22,9 @@
 #include <string>
 #include <vector>
 
+#include <array>
 #include <boost/intrusive_ptr.hpp>
+#include <memory>
 
 namespace klee {
 
@@ -69,6 +71,10 @@ private:
 
     static const unsigned FAST_CONCRETE_BUFFER_SIZE = sizeof(uint64_t);
 
+    static const unsigned KNOWN_SYMBOLICS_CHUNK_SIZE = 64;
+    typedef std::array<ref<Expr>, KNOWN_SYMBOLICS_CHUNK_SIZE> KnownSymbolicsChunk;
+    typedef std::shared_ptr<KnownSymbolicsChunk> KnownSymbolicsChunkPtr;
+
     unsigned m_copyOnWriteOwner;
 
     mutable std::atomic<unsigned> m_refCount;
@@ -117,7 +123,13 @@ private:
     // mutable because may need flushed during read of const§
     mutable BitArrayPtr m_flushMask;
 
-    std::vector<ref<Expr>> m_knownSymbolics;
+    /// True if m_concreteMask still belongs to the object this one was
+    /// copied from. It is copied on the first change of a bit.
+    bool m_sharedConcreteMask;
+
+    /// The symbolic values of the bytes, in chunks of KNOWN_SYMBOLICS_CHUNK_SIZE.
+    /// Copies of the object share the chunks until they write to them.
+    std::vector<KnownSymbolicsChunkPtr> m_knownSymbolics;
 
     // mutable because we may need flush during read of const
     mutable UpdateListPtr m_updates;
@@ -132,6 +144,8 @@ private:
 
     ObjectState(const ObjectState &os);
 
+    ObjectState(const ObjectState &os, const BitArrayPtr &concreteMask, const ConcreteBufferPtr &concreteBuffer);
+
 public:
     ~ObjectState();
 
@@ -301,16 +315,32 @@ private:
         return m_flushMask && !m_flushMask->get(offset);
     }
 
+    inline const ref<Expr> &getKnownSymbolic(unsigned offset) const {
+        return (*m_knownSymbolics[offset / KNOWN_SYMBOLICS_CHUNK_SIZE])[offset % KNOWN_SYMBOLICS_CHUNK_SIZE];
+    }
+
     inline bool isByteKnownSymbolic(unsigned offset) const {
-        return m_knownSymbolics.size() > 0 && m_knownSymbolics[offset].get();
+        if (m_knownSymbolics.empty()) {
+            return false;
+        }
+        auto &chunk = m_knownSymbolics[offset / KNOWN_SYMBOLICS_CHUNK_SIZE];
+        return chunk && (*chunk)[offset % KNOWN_SYMBOLICS_CHUNK_SIZE].get();
     }
 
     inline void markByteConcrete(unsigned offset) {
-        if (m_concreteMask) {
+        if (m_concreteMask && !m_concreteMask->get(m_bufferOffset + offset)) {
+            unshareConcreteMask();
             m_concreteMask->set(m_bufferOffset + offset);
         }
     }
 
+    void unshareConcreteMask() {
+        if (m_sharedConcreteMask) {
+            m_concreteMask = BitArray::create(m_concreteMask);
+            m_sharedConcreteMask = false;
+        }
+    }
+
     void markByteSymbolic(unsigned offset);
 
     void markByteFlushed(unsigned offset);
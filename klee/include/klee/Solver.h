@@ -14,9 +14,11 @@
 #include "SolverImpl.h"
 
 #include <memory>
+#include <mutex>
 #include <vector>
 
 namespace klee {
+class Assignment;
 class ConstraintManager;
 class Expr;
 class SolverImpl;
@@ -34,17 +36,22 @@ public:
     const ConstraintManager &constraints;
     ref<Expr> expr;
 
-    Query(const ConstraintManager &_constraints, ref<Expr> _expr) : constraints(_constraints), expr(_expr) {
+    /// Concrete inputs of the state that asks the query, if any. Solvers
+    /// may prefer them when several solutions exist.
+    const Assignment *concolics;
+
+    Query(const ConstraintManager &_constraints, ref<Expr> _expr, const Assignment *_concolics = nullptr)
+        : constraints(_constraints), expr(_expr), concolics(_concolics) {
     }
 
     /// withExpr - Return a copy of the query with the given expression.
     Query withExpr(ref<Expr> _expr) const {
-        return Query(constraints, _expr);
+        return Query(constraints, _expr, concolics);
     }
 
     /// withFalse - Return a copy of the query with a false expression.
     Query withFalse() const {
-        return Query(constraints, ConstantExpr::alloc(0, Expr::Bool));
+        return Query(constraints, ConstantExpr::alloc(0, Expr::Bool), concolics);
     }
 
     /// negateExpr - Return a copy of the query with the expression negated.
@@ -180,9 +187,39 @@ using Z3SolverPtr = std::shared_ptr<Z3Solver>;
 
 class Z3Solver : public Solver {
 public:
-    static Z3SolverPtr createResetSolver();
-    static Z3SolverPtr createStackSolver();
-    static Z3SolverPtr createAssumptionSolver();
+    /// How arrays are encoded, ARRAY_DEFAULT uses -z3-array-cons-mode
+    enum ArrayMode { ARRAY_DEFAULT, ARRAY_ITE, ARRAY_STORES, ARRAY_ASSERTS };
+
+    static Z3SolverPtr createResetSolver(ArrayMode mode = ARRAY_DEFAULT);
+    static Z3SolverPtr createStackSolver(ArrayMode mode = ARRAY_DEFAULT);
+    static Z3SolverPtr createAssumptionSolver(ArrayMode mode = ARRAY_DEFAULT);
+
+    /// Cancels the check in progress, which then fails.
+    /// This may be called from any thread.
+    void interrupt();
+
+    /// Makes the solver hold the given lock whenever it accesses KLEE
+    /// expressions. Several solvers sharing the same lock may then run
+    /// on different threads, only their Z3 checks overlap.
+    void setExprLock(std::mutex *lock);
+
+    /// Translates the query on the calling thread and checks it on the
+    /// solver's background thread, which is started by the first call and
+    /// reused by the next ones. Only one check may be in progress at a time,
+    /// and the solver must not be used for anything else until
+    /// finishCheck() returns.
+    void startCheck(const Query &query);
+
+    /// Returns true once the check started by startCheck() has completed
+    bool isCheckDone();
+
+    /// Waits for the check started by startCheck() and returns its result,
+    /// like computeInitialValues() would.
+    bool finishCheck(const ArrayVec &objects, std::vector<std::vector<unsigned char>> &values, bool &hasSolution);
+
+    /// Stops the background thread, e.g., before the process forks.
+    /// The next startCheck() starts a new one.
+    void stopChecks();
 
 private:
     Z3Solver(SolverImplPtr &impl);
@@ -208,7 +245,11 @@ SolverPtr createValidatingSolver(SolverPtr &s, SolverPtr &oracle);
 /// memory (without eviction).
 ///
 /// \param s - The underlying solver to use.
-SolverPtr createCachingSolver(SolverPtr &s);
+/// \param storePath - If not empty, the path of an on-disk cache that is
+/// shared between runs and between instances of the same run.
+/// \param storeSize - The size in bytes of the on-disk cache, including its
+/// index. Results are no longer added once it is full.
+SolverPtr createCachingSolver(SolverPtr &s, const std::string &storePath = "", uint64_t storeSize = 0);
 
 /// createCexCachingSolver - Create a counterexample caching solver. This is a
 /// more sophisticated cache which records counterexamples for a constraint
@@ -243,6 +284,15 @@ SolverPtr createSMTLIBLoggingSolver(SolverPtr &s, const std::string &path, int m
 
 SolverPtr createTimingSolver(SolverPtr &s);
 
+/// createZ3PortfolioSolver - Create a solver that races several Z3
+/// configurations on worker threads and returns the first answer.
+/// The solver learns which configuration wins for which query shape and
+/// sends later queries of that shape to the winner only.
+///
+/// \param solvers - The configurations to race, the first one is used alone
+/// for queries that are too small to be worth racing.
+SolverPtr createZ3PortfolioSolver(const std::vector<Z3SolverPtr> &solvers);
+
 /// createDummySolver - Create a dummy solver implementation which always
 /// fails.
 SolverPtr createDummySolver();
@@ -48,6 +48,10 @@ public:
     }
     virtual SolverPtr createEndSolver() = 0;
     virtual SolverPtr decorateSolver(SolverPtr &end_solver) = 0;
+
+    /// Creates a Z3 solver with the configuration of the end solver, for
+    /// checks that run in the background with Z3Solver::startCheck()
+    virtual Z3SolverPtr createBackgroundSolver() = 0;
 };
 
 using SolverFactoryPtr = std::shared_ptr<SolverFactory>;
@@ -55,6 +59,7 @@ using SolverFactoryPtr = std::shared_ptr<SolverFactory>;
 class DefaultSolverFactory : public SolverFactory {
 private:
     std::filesystem::path m_outputDir;
+    std::string m_defaultPersistentCache;
     DefaultSolverFactory(const std::filesystem::path &outputDir);
 
     std::filesystem::path getOutputFileName(const std::string &fileName) const;
@@ -62,6 +67,12 @@ private:
 public:
     virtual SolverPtr createEndSolver();
     virtual SolverPtr decorateSolver(SolverPtr &end_solver);
+    virtual Z3SolverPtr createBackgroundSolver();
+
+    /// Validity cache file to use when -persistent-query-cache is not set
+    void setDefaultPersistentCache(const std::string &path) {
+        m_defaultPersistentCache = path;
+    }
 
     static SolverFactoryPtr create(const std::filesystem::path &outputDir) {
         return SolverFactoryPtr(new DefaultSolverFactory(outputDir));
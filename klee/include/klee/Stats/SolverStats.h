@@ -16,11 +16,14 @@ namespace klee {
 namespace stats {
 
 extern StatisticPtr cexCacheTime;
+extern StatisticPtr cexCacheHits;
+extern StatisticPtr cexCacheMisses;
 extern StatisticPtr queries;
 extern StatisticPtr queriesInvalid;
 extern StatisticPtr queriesValid;
 extern StatisticPtr queryCacheHits;
 extern StatisticPtr queryCacheMisses;
+extern StatisticPtr queryPersistentCacheHits;
 extern StatisticPtr queryConstructTime;
 extern StatisticPtr queryConstructs;
 extern StatisticPtr queryCounterexamples;
@@ -0,0 +1,57 @@
+///
+/// Copyright (C) 2020, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#ifndef KLEE_UTIL_ACTIVITY_H
+#define KLEE_UTIL_ACTIVITY_H
+
+#include <atomic>
+#include <inttypes.h>
+
+namespace klee {
+
+/// Coarse description of what the execution thread is doing.
+/// Sampling profilers read it from signal handlers.
+enum class Activity : uint8_t { Other, ConcreteCode, SymbolicCode, Solver, PluginCallback, StateSwitch, Count };
+
+inline std::atomic<Activity> g_activity{Activity::Other};
+
+/// Sets the current activity and restores the previous one when leaving the scope
+class ActivityScope {
+    Activity m_previous;
+
+public:
+    explicit ActivityScope(Activity activity) : m_previous(g_activity.load(std::memory_order_relaxed)) {
+        g_activity.store(activity, std::memory_order_relaxed);
+    }
+
+    ~ActivityScope() {
+        g_activity.store(m_previous, std::memory_order_relaxed);
+    }
+
+    ActivityScope(const ActivityScope &) = delete;
+    ActivityScope &operator=(const ActivityScope &) = delete;
+};
+
+} // namespace klee
+
+#endif
@@ -10,6 +10,7 @@
 #ifndef KLEE_UTIL_ASSIGNMENT_H
 #define KLEE_UTIL_ASSIGNMENT_H
 
+#include <algorithm>
 #include <map>
 
 #include "klee/util/ExprEvaluator.h"
@@ -38,7 +39,7 @@ private:
     }
 
     Assignment(ArrayVec &objects, std::vector<std::vector<unsigned char>> &values, bool _allowFreeValues = false)
-        : allowFreeValues(_allowFreeValues) {
+        : allowFreeValues(_allowFreeValues), cacheHits(0), cacheMisses(0) {
         auto valIt = values.begin();
         for (const auto &it : objects) {
             auto os = it;
@@ -56,6 +57,16 @@ public:
         bindings.insert(std::make_pair(object, value));
     }
 
+    /// Returns the bytes of the given array, unbound bytes are zero
+    std::vector<unsigned char> getValue(const ArrayPtr &array) const {
+        std::vector<unsigned char> ret(array->getSize(), 0);
+        auto it = bindings.find(array);
+        if (it != bindings.end()) {
+            std::copy_n(it->second.begin(), std::min(ret.size(), it->second.size()), ret.begin());
+        }
+        return ret;
+    }
+
     void clear() {
         bindings.clear();
         expressionCache.clear();
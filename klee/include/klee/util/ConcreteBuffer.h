@@ -44,6 +44,7 @@
 #include <klee/util/PtrUtils.h>
 
 #include <klee/util/PagePool.h>
+#include <klee/util/PageSwap.h>
 
 namespace klee {
 
@@ -55,11 +56,17 @@ typedef boost::intrusive_ptr<ConcreteBuffer> ConcreteBufferPtr;
  * Allows to share a common concrete buffer between different
  * ObjectStates (e.g., when splitting a big object into
  * smaller ones).
+ *
+ * Page-sized buffers can be moved to the swap file. Their
+ * contents are read back on the next access.
  */
 class ConcreteBuffer {
     std::atomic<uint32_t> m_refCount;
-    uint8_t *m_buffer;
+
+    /// Null while the buffer is swapped out
+    mutable uint8_t *m_buffer;
     unsigned m_size;
+    mutable PageSwap::Slot m_swapSlot;
 
     uint8_t *osAlloc(unsigned size) const {
         void *ret = (uint8_t *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
@@ -88,16 +95,25 @@ class ConcreteBuffer {
         }
     }
 
+    void swapIn() const {
+        m_buffer = PagePool::get()->alloc();
+        PageSwap::get()->read(m_swapSlot, m_buffer);
+    }
+
     ConcreteBuffer(size_t size) : m_refCount(0), m_buffer(allocateBuffer(size)), m_size(size) {
         memset(m_buffer, 0, size);
     }
 
     ConcreteBuffer(const ConcreteBufferPtr &b) : m_buffer(allocateBuffer(b->m_size)), m_size(b->m_size) {
-        memcpy(m_buffer, b->m_buffer, b->m_size);
+        memcpy(m_buffer, b->get(), b->m_size);
     }
 
     ~ConcreteBuffer() {
-        if (m_size == PAGE_SIZE) {
+        if (!m_buffer) {
+            if (auto swap = PageSwap::get()) {
+                swap->release(m_swapSlot);
+            }
+        } else if (m_size == PAGE_SIZE) {
             PagePool::get()->free(m_buffer);
         } else if ((m_size % PAGE_SIZE) == 0) {
             osFree(m_buffer, m_size);
@@ -118,9 +134,33 @@ public:
     }
 
     inline uint8_t *get() const {
+        if (!m_buffer) {
+            swapIn();
+        }
         return m_buffer;
     }
 
+    /// Moves the contents of a page-sized buffer to the swap file.
+    /// Pointers returned by get() are invalid afterwards.
+    bool swapOut() {
+        auto swap = PageSwap::get();
+        if (!swap || !m_buffer || m_size != PAGE_SIZE) {
+            return false;
+        }
+
+        if (!swap->write(m_buffer, m_swapSlot)) {
+            return false;
+        }
+
+        PagePool::get()->free(m_buffer);
+        m_buffer = nullptr;
+        return true;
+    }
+
+    inline bool isSwappedOut() const {
+        return !m_buffer;
+    }
+
     unsigned size() const {
         return m_size;
     }
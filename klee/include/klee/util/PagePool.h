@@ -25,15 +25,46 @@
 
 #include <atomic>
 #include <boost/intrusive_ptr.hpp>
-#include <map>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include <klee/util/BitArray.h>
 #include <klee/util/PtrUtils.h>
 
 namespace klee {
 
+/// How the chunks of the page pool are backed
+enum class PagePoolBacking {
+    /// Regular 4KB pages
+    Default,
+
+    /// Transparent huge pages, requested with madvise(MADV_HUGEPAGE)
+    TransparentHuge,
+
+    /// Explicit huge pages from the hugetlbfs pool (MAP_HUGETLB).
+    /// Falls back to regular pages when the pool is exhausted.
+    ExplicitHuge
+};
+
+struct PagePoolOptions {
+    PagePoolBacking backing;
+
+    /// Keep separate chunks for each NUMA node and allocate
+    /// pages from the node of the calling CPU
+    bool numaAware;
+
+    /// Number of fully free chunks kept mapped for reuse. Their memory
+    /// is returned to the OS with madvise(MADV_DONTNEED).
+    unsigned reserveChunks;
+
+    PagePoolOptions() : backing(PagePoolBacking::Default), numaAware(false), reserveChunks(4) {
+    }
+
+    /// Options set on the command line
+    static PagePoolOptions get();
+};
+
 class Pages;
 typedef boost::intrusive_ptr<Pages> PagesPtr;
 
@@ -41,16 +72,31 @@ class Pages {
     static unsigned const PAGE_SIZE = 0x1000;
     std::atomic<uint32_t> m_refCount;
     BitArrayPtr m_pageStatus;
+
+    /// Indices of freed pages, the next page to allocate is at the back
+    std::vector<uint16_t> m_freeList;
+
+    /// Pages starting from this one were never allocated
+    unsigned m_firstUnused;
+
     uint8_t *m_buffer;
     size_t m_size;
+    size_t m_mappedSize;
+    unsigned m_node;
+
+    /// Position in the list of chunks with free pages of the pool, -1 if not there
+    int m_poolIndex;
 
 private:
-    Pages(unsigned numPages);
+    Pages(unsigned numPages, PagePoolBacking backing, unsigned node);
     ~Pages();
 
+    void map(PagePoolBacking backing);
+
 public:
-    static PagesPtr create(unsigned numPages) {
-        return PagesPtr(new Pages(numPages));
+    static PagesPtr create(unsigned numPages, PagePoolBacking backing = PagePoolBacking::Default,
+                           unsigned node = 0) {
+        return PagesPtr(new Pages(numPages, backing, node));
     }
 
     inline uint8_t *getBuffer() const {
@@ -61,6 +107,9 @@ public:
 
     void free(uint8_t *addr);
 
+    /// Returns the memory of the chunk to the OS, the chunk must be empty
+    void release();
+
     inline bool empty() const {
         return m_pageStatus->isAllOnes();
     }
@@ -73,6 +122,12 @@ public:
         return m_pageStatus->getSetBitCount();
     }
 
+    inline unsigned getNode() const {
+        return m_node;
+    }
+
+    friend class PagePool;
+
     INTRUSIVE_PTR_FRIENDS(Pages)
 };
 
@@ -81,15 +136,6 @@ INTRUSIVE_PTR_ADD_REL(Pages)
 struct PagePoolDesc {
     static const uint64_t POOL_PAGE_COUNT;
     static const uint64_t POOL_PAGE_SIZE;
-
-    uintptr_t addr;
-
-    PagePoolDesc() : addr(0) {
-    }
-
-    bool operator()(uintptr_t a, uintptr_t b) const {
-        return a + POOL_PAGE_SIZE <= b;
-    }
 };
 
 class PagePool;
@@ -103,29 +149,54 @@ typedef boost::intrusive_ptr<PagePool> PagePoolPtr;
 /// class uses mmap to allocate larger chunks at once and maintains
 /// a bitmap to return individual pages to callers.
 ///
+/// Chunks are aligned on their size, so that the chunk of a page
+/// is found with a hash lookup. Allocating and freeing a page
+/// takes constant time.
+///
 class PagePool {
     std::atomic<uint32_t> m_refCount;
-    std::map<uintptr_t, PagesPtr, PagePoolDesc> m_map;
-    std::unordered_map<uintptr_t, PagesPtr> m_freePages;
+    PagePoolOptions m_options;
+
+    /// All chunks that have allocated pages, indexed by start address
+    std::unordered_map<uintptr_t, PagesPtr> m_map;
+
+    /// Chunks that have free pages, for each NUMA node
+    std::vector<std::vector<PagesPtr>> m_freePages;
+
+    /// Empty chunks whose memory was returned to the OS
+    std::vector<PagesPtr> m_reserve;
+
     PagesPtr m_cachedPages;
 
+    /// NUMA node of each CPU, or -1 if it is not known yet
+    mutable std::vector<int> m_cpuNodes;
+
     static PagePoolPtr s_pool;
 
-    PagePool() : m_refCount(0) {
+    PagePool(const PagePoolOptions &options) : m_refCount(0), m_options(options) {
     }
 
-    PagesPtr allocatePages();
+    unsigned getCurrentNode() const;
+
+    PagesPtr allocatePages(unsigned node);
+
+    void addFreePages(const PagesPtr &pages);
+    void removeFreePages(const PagesPtr &pages);
 
 public:
-    static PagePoolPtr create() {
-        return PagePoolPtr(new PagePool());
+    static PagePoolPtr create(const PagePoolOptions &options = PagePoolOptions()) {
+        return PagePoolPtr(new PagePool(options));
     }
 
     uint8_t *alloc();
 
     void free(uint8_t *_ptr);
 
-    static PagePoolPtr get() {
+    /// The global pool is created on first use, after the command line is parsed
+    static const PagePoolPtr &get() {
+        if (!s_pool) {
+            s_pool = create(PagePoolOptions::get());
+        }
         return s_pool;
     }
 
@@ -133,6 +204,10 @@ public:
         return m_map.size();
     }
 
+    inline unsigned getReserveCount() const {
+        return m_reserve.size();
+    }
+
     unsigned getFreePages() const;
 
     INTRUSIVE_PTR_FRIENDS(PagePool)
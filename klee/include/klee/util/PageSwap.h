@@ -0,0 +1,122 @@
+///
+/// Copyright (C) 2020, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+#ifndef KLEE_UTIL_PAGESWAP_H
+#define KLEE_UTIL_PAGESWAP_H
+
+#include <inttypes.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace klee {
+
+///
+/// \brief The PageSwap class stores 4KB pages in a memory-mapped swap file.
+///
+/// The file is unlinked as soon as it is created and mapped shared, so the
+/// kernel writes its pages back to disk under memory pressure instead of
+/// keeping them in RAM.
+///
+/// Forked processes inherit the mapping. Pages written before the fork
+/// stay readable in both processes, but the file is frozen: its slots are
+/// never reused, and each process writes new pages to a file of its own.
+///
+class PageSwap {
+public:
+    static const unsigned PAGE_SIZE = 0x1000;
+
+    struct File {
+        uint8_t *map;
+        uint64_t slotCount;
+
+        /// Slots starting from this one were never used
+        uint64_t firstUnused;
+        std::vector<uint64_t> freeSlots;
+
+        /// Set in both processes after a fork
+        bool frozen;
+
+        File(uint8_t *map, uint64_t slotCount)
+            : map(map), slotCount(slotCount), firstUnused(0), frozen(false) {
+        }
+
+        ~File();
+    };
+
+    typedef std::shared_ptr<File> FilePtr;
+
+    /// Location of a swapped out page
+    struct Slot {
+        FilePtr file;
+        uint64_t index;
+
+        Slot() : index(0) {
+        }
+
+        explicit operator bool() const {
+            return file != nullptr;
+        }
+    };
+
+private:
+    std::string m_directory;
+    uint64_t m_maxSize;
+    FilePtr m_file;
+    uint64_t m_swappedPages;
+
+    static std::unique_ptr<PageSwap> s_swap;
+
+    PageSwap(const std::string &directory, uint64_t maxSize)
+        : m_directory(directory), m_maxSize(maxSize), m_swappedPages(0) {
+    }
+
+    FilePtr createFile();
+
+public:
+    /// Enables swapping to a file in the given directory
+    static void initialize(const std::string &directory, uint64_t maxSize);
+
+    /// Returns null if swapping is disabled
+    static PageSwap *get() {
+        return s_swap.get();
+    }
+
+    /// Copies the page to a free slot. Returns false if the swap file is full.
+    bool write(const uint8_t *page, Slot &slot);
+
+    /// Copies the page back and releases its slot
+    void read(Slot &slot, uint8_t *page);
+
+    void release(Slot &slot);
+
+    /// Must be called in both processes after fork()
+    void onProcessFork();
+
+    inline uint64_t getSwappedPages() const {
+        return m_swappedPages;
+    }
+};
+
+} // namespace klee
+
+#endif
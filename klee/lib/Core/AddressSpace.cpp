@@ -167,6 +167,16 @@ ObjectStatePtr AddressSpace::getWriteable(const ObjectStateConstPtr &os) {
     return ret;
 }
 
+void AddressSpace::shareObject(const ObjectStateConstPtr &os, const ObjectStatePtr &shared) {
+    assert(os->getKey() == shared->getKey());
+    assert(!isOwnedByUs(shared));
+
+    addressSpaceChange(os->getKey(), os, shared);
+
+    objects = objects.replace(std::make_pair(os->getKey(), shared));
+    m_cache.add(shared);
+}
+
 bool AddressSpace::splitMemoryObject(IAddressSpaceNotification &state, const ObjectStateConstPtr &originalObject,
                                      ResolutionList &rl) {
     static const unsigned PAGE_SIZE = 0x1000;
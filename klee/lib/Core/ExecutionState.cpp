@@ -350,6 +350,16 @@ void ExecutionState::printStack(std::stringstream &msg) const {
 bool ExecutionState::getSymbolicSolution(std::vector<std::pair<std::string, std::vector<unsigned char>>> &res) {
     for (unsigned i = 0; i != symbolics.size(); ++i) {
         auto &arr = symbolics[i];
+
+        // Concolic values are usually bound for the whole array
+        auto binding = concolics->bindings.find(arr);
+        if (binding != concolics->bindings.end() && binding->second.size() >= arr->getSize()) {
+            const auto &values = binding->second;
+            res.push_back(std::make_pair(arr->getName(),
+                                         std::vector<unsigned char>(values.begin(), values.begin() + arr->getSize())));
+            continue;
+        }
+
         std::vector<unsigned char> data;
         for (unsigned s = 0; s < arr->getSize(); ++s) {
             ref<Expr> e = concolics->evaluate(arr, s);
@@ -496,7 +506,7 @@ ref<Expr> ExecutionState::toUnique(ref<Expr> &e) {
 
 bool ExecutionState::solve(const ConstraintManager &mgr, Assignment &assignment) {
     std::vector<std::vector<unsigned char>> concreteObjects;
-    Query q(mgr, ConstantExpr::alloc(0, Expr::Bool));
+    Query q(mgr, ConstantExpr::alloc(0, Expr::Bool), concolics.get());
 
     if (!solver()->getInitialValues(q, symbolics, concreteObjects)) {
         return false;
@@ -76,6 +76,11 @@ cl::opt<bool> SimplifySymIndices("simplify-sym-indices", cl::init(true));
 cl::opt<bool> SuppressExternalWarnings("suppress-external-warnings", cl::init(true));
 
 cl::opt<bool> NoExternals("no-externals", cl::desc("Do not allow external functin calls"));
+
+cl::opt<unsigned> FastInstructionThreshold("fast-instruction-threshold",
+                                           cl::desc("Pre-decode the instructions of a function after this many calls, "
+                                                    "so that concrete operands skip expression building (0=off)"),
+                                           cl::init(16));
 } // namespace
 
 namespace klee {
@@ -300,7 +305,7 @@ void Executor::notifyBranch(ExecutionState &state) {
 }
 
 Executor::StatePair Executor::fork(ExecutionState &current, const ref<Expr> &condition_,
-                                   bool keepConditionTrueInCurrentState) {
+                                   bool keepConditionTrueInCurrentState, bool deferrable) {
     auto condition = current.simplifyExpr(condition_);
 
     // If we are passed a constant, no need to do anything
@@ -348,15 +353,14 @@ Executor::StatePair Executor::fork(ExecutionState &current, const ref<Expr> &con
     }
 
     // Build constraints for branched state
+    ref<Expr> branchedCondition = conditionIsTrue ? Expr::createIsZero(condition) : condition;
     ConstraintManager tmpConstraints = current.constraints();
-    if (conditionIsTrue) {
-        tmpConstraints.addConstraint(Expr::createIsZero(condition));
-    } else {
-        tmpConstraints.addConstraint(condition);
-    }
+    tmpConstraints.addConstraint(branchedCondition);
+
+    bool deferred = deferrable && canDeferFork(current);
 
     AssignmentPtr concolics = Assignment::create(true);
-    if (!current.solve(tmpConstraints, *concolics)) {
+    if (!deferred && !current.solve(tmpConstraints, *concolics)) {
         if (conditionIsTrue) {
             return StatePair(&current, nullptr);
         } else {
@@ -368,30 +372,26 @@ Executor::StatePair Executor::fork(ExecutionState &current, const ref<Expr> &con
     ExecutionState *branchedState;
     notifyBranch(current);
     branchedState = current.clone();
-    addedStates.insert(branchedState);
 
-    *klee::stats::forks += 1;
+    if (deferred) {
+        deferFork(current, branchedState, tmpConstraints, branchedCondition);
+    } else {
+        addedStates.insert(branchedState);
 
-    // Update concrete values for the branched state
-    branchedState->concolics = concolics;
+        *klee::stats::forks += 1;
 
-    // Add constraint to both states
-    if (conditionIsTrue) {
-        if (!current.addConstraint(condition)) {
-            abort();
-        }
-        if (!branchedState->addConstraint(Expr::createIsZero(condition))) {
-            abort();
-        }
-    } else {
-        if (!current.addConstraint(Expr::createIsZero(condition))) {
-            abort();
-        }
-        if (!branchedState->addConstraint(condition)) {
+        // Update concrete values for the branched state
+        branchedState->concolics = concolics;
+
+        if (!branchedState->addConstraint(branchedCondition)) {
             abort();
         }
     }
 
+    if (!current.addConstraint(conditionIsTrue ? condition : Expr::createIsZero(condition))) {
+        abort();
+    }
+
     // Classify states
     ExecutionState *trueState, *falseState;
     if (conditionIsTrue) {
@@ -426,6 +426,15 @@ void Executor::notifyFork(ExecutionState &originalState, ref<Expr> &condition, E
     pabort("Must go through S2E");
 }
 
+bool Executor::canDeferFork(ExecutionState &current) {
+    return false;
+}
+
+void Executor::deferFork(ExecutionState &current, ExecutionState *branchedState, const ConstraintManager &constraints,
+                         const ref<Expr> &condition) {
+    pabort("Fork checks cannot be deferred");
+}
+
 const Cell &Executor::eval(KInstruction *ki, unsigned index, ExecutionState &state) const {
     assert(index < ki->inst->getNumOperands());
     int vnumber = ki->operands[index];
@@ -617,6 +626,7 @@ void Executor::executeCall(ExecutionState &state, KInstruction *ki, Function *f,
         // instead of the actual instruction, since we can't make a KInstIterator
         // from just an instruction (unlike LLVM).
         auto kf = kmodule->getKFunction(f);
+        countFunctionCall(kf);
         state.pushFrame(state.prevPC, kf);
         state.pc = kf->getInstructions();
 
@@ -718,9 +728,58 @@ Function *Executor::getTargetFunction(Value *calledVal) {
     }
 }
 
+void Executor::countFunctionCall(KFunction *kf) {
+    if (FastInstructionThreshold && kf->incrementCallCount() == FastInstructionThreshold) {
+        kf->createFastInstructions(*kmodule);
+    }
+}
+
+bool Executor::executeFastInstruction(ExecutionState &state, KInstruction *ki) {
+    const KFastInstruction *fi = ki->fast;
+    const auto &locals = state.stack.back().locals;
+
+    // A concrete condition is enough to pick the value, which may be symbolic
+    if (fi->opcode == KFastInstruction::Select) {
+        auto cond = dyn_cast<ConstantExpr>(eval(ki, 0, state).value);
+        if (!cond) {
+            return false;
+        }
+
+        state.bindLocal(ki, eval(ki, cond->isTrue() ? 1 : 2, state).value);
+        return true;
+    }
+
+    uint64_t operands[3];
+    for (unsigned i = 0; i < fi->numOperands; ++i) {
+        if (fi->registers[i] < 0) {
+            operands[i] = fi->constants[i];
+            continue;
+        }
+
+        auto ce = dyn_cast<ConstantExpr>(locals[fi->registers[i]].value);
+        if (!ce) {
+            return false;
+        }
+
+        operands[i] = ce->getZExtValue();
+    }
+
+    uint64_t result;
+    if (!fi->evaluate(operands, result)) {
+        return false;
+    }
+
+    state.bindLocal(ki, ConstantExpr::create(result, fi->width));
+    return true;
+}
+
 void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     *klee::stats::instructions += 1;
 
+    if (ki->fast && executeFastInstruction(state, ki)) {
+        return;
+    }
+
     Instruction *i = ki->inst;
     switch (i->getOpcode()) {
         // Control flow
@@ -787,7 +846,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
                 // FIXME: Find a way that we don't have this hidden dependency.
                 assert(bi->getCondition() == bi->getOperand(0) && "Wrong operand index!");
                 ref<Expr> cond = eval(ki, 0, state).value;
-                Executor::StatePair branches = fork(state, cond);
+                Executor::StatePair branches = fork(state, cond, false, true);
 
                 if (branches.first) {
                     branches.first->transferToBasicBlock(bi->getSuccessor(0), bi->getParent());
@@ -36,7 +36,7 @@ ObjectState::ObjectState() {
 ObjectState::ObjectState(uint64_t address, uint64_t size, bool fixed)
     : m_copyOnWriteOwner(0), m_refCount(0), m_address(address), m_size(size), m_fixed(fixed), m_splittable(false),
       m_readOnly(false), m_notifyOnConcretenessChange(false), m_isMemoryPage(false), m_isSharedConcrete(false),
-      m_bufferOffset(0), m_updates(nullptr) {
+      m_bufferOffset(0), m_sharedConcreteMask(false), m_updates(nullptr) {
 
     if (!m_fixed) {
         if (m_address) {
@@ -53,10 +53,19 @@ ObjectState::ObjectState(uint64_t address, uint64_t size, bool fixed)
     }
 }
 
-ObjectState::ObjectState(const ObjectState &os) {
+ObjectState::ObjectState(const ObjectState &os)
+    : ObjectState(os, os.m_concreteMask,
+                  os.m_concreteBuffer ? ConcreteBuffer::create(os.m_concreteBuffer) : ConcreteBufferPtr()) {
+    // The concrete mask is shared with the original until it changes.
+    // The original is not owned by anyone anymore, so it will not change.
+    m_sharedConcreteMask = m_concreteMask != nullptr;
+}
+
+ObjectState::ObjectState(const ObjectState &os, const BitArrayPtr &concreteMask,
+                         const ConcreteBufferPtr &concreteBuffer) {
     assert(!os.m_readOnly && "no need to copy read only object?");
 
-    this->m_concreteMask = os.m_concreteMask ? BitArray::create(os.m_concreteMask) : nullptr;
+    this->m_concreteMask = concreteMask;
     this->m_copyOnWriteOwner = os.m_copyOnWriteOwner;
     this->m_refCount = 0;
     this->m_address = os.m_address;
@@ -69,14 +78,13 @@ ObjectState::ObjectState(const ObjectState &os) {
     this->m_notifyOnConcretenessChange = os.m_notifyOnConcretenessChange;
     this->m_isMemoryPage = os.m_isMemoryPage;
     this->m_isSharedConcrete = os.m_isSharedConcrete;
-
-    this->m_concreteBuffer = nullptr;
-    if (os.m_concreteBuffer) {
-        this->m_concreteBuffer = ConcreteBuffer::create(os.m_concreteBuffer);
-    }
+    this->m_concreteBuffer = concreteBuffer;
     memcpy(this->m_fastConcreteBuffer, os.m_fastConcreteBuffer, sizeof(m_fastConcreteBuffer));
     this->m_bufferOffset = os.m_bufferOffset;
     this->m_flushMask = os.m_flushMask ? BitArray::create(os.m_flushMask) : nullptr;
+    this->m_sharedConcreteMask = false;
+
+    // Only the chunk pointers are copied, setKnownSymbolic() copies a chunk before changing it
     this->m_knownSymbolics = os.m_knownSymbolics;
     this->m_updates = os.m_updates ? UpdateList::create(os.m_updates->getRoot(), os.m_updates->getHead()) : nullptr;
 }
@@ -105,6 +113,9 @@ ObjectStatePtr ObjectState::split(unsigned offset, unsigned newSize) const {
     assert(m_readOnly == false);
     assert(m_size > FAST_CONCRETE_BUFFER_SIZE);
 
+    // All pieces must share the same concrete mask
+    assert(!m_sharedConcreteMask);
+
     auto ret = new ObjectState();
 
     ret->m_concreteMask = m_concreteMask;
@@ -124,11 +135,13 @@ ObjectStatePtr ObjectState::split(unsigned offset, unsigned newSize) const {
     memcpy(ret->m_fastConcreteBuffer, m_fastConcreteBuffer, sizeof(m_fastConcreteBuffer));
     ret->m_bufferOffset = offset;
     ret->m_flushMask = m_flushMask;
+    ret->m_sharedConcreteMask = false;
 
     if (m_knownSymbolics.size() > 0) {
-        ret->m_knownSymbolics.resize(newSize);
         for (unsigned i = 0; i < newSize; i++) {
-            ret->m_knownSymbolics[i] = m_knownSymbolics[i + offset];
+            if (isByteKnownSymbolic(i + offset)) {
+                ret->setKnownSymbolic(i, getKnownSymbolic(i + offset));
+            }
         }
     }
 
@@ -140,16 +153,13 @@ ObjectStatePtr ObjectState::split(unsigned offset, unsigned newSize) const {
 void ObjectState::initializeConcreteMask() {
     if (!m_concreteMask) {
         m_concreteMask = BitArray::create(m_size, true);
+    } else {
+        unshareConcreteMask();
     }
 }
 
 ObjectStatePtr ObjectState::copy(const BitArrayPtr &_concreteMask, const ConcreteBufferPtr &_concreteStore) const {
-    ObjectState *ret = new ObjectState(*this);
-
-    ret->m_concreteMask = _concreteMask;
-    ret->m_concreteBuffer = _concreteStore;
-
-    return ObjectStatePtr(ret);
+    return ObjectStatePtr(new ObjectState(*this, _concreteMask, _concreteStore));
 }
 
 /***/
@@ -242,7 +252,7 @@ void ObjectState::flushRangeForRead(unsigned rangeBase, unsigned rangeSize) cons
                 getUpdates()->extend(ConstantExpr::create(offset, Expr::Int32), ConstantExpr::create(byte, Expr::Int8));
             } else {
                 assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
-                getUpdates()->extend(ConstantExpr::create(offset, Expr::Int32), m_knownSymbolics[offset]);
+                getUpdates()->extend(ConstantExpr::create(offset, Expr::Int32), getKnownSymbolic(offset));
             }
 
             m_flushMask->unset(offset);
@@ -263,7 +273,7 @@ void ObjectState::flushRangeForWrite(unsigned rangeBase, unsigned rangeSize) {
                 markByteSymbolic(offset);
             } else {
                 assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
-                getUpdates()->extend(ConstantExpr::create(offset, Expr::Int32), m_knownSymbolics[offset]);
+                getUpdates()->extend(ConstantExpr::create(offset, Expr::Int32), getKnownSymbolic(offset));
                 setKnownSymbolic(offset, 0);
             }
 
@@ -313,7 +323,11 @@ uint8_t *ObjectState::getConcreteBuffer(bool allowSymbolic) {
 void ObjectState::markByteSymbolic(unsigned offset) {
     if (!m_concreteMask) {
         m_concreteMask = BitArray::create(m_size, true);
+    } else if (!m_concreteMask->get(m_bufferOffset + offset)) {
+        return;
     }
+
+    unshareConcreteMask();
     m_concreteMask->unset(m_bufferOffset + offset);
 }
 
@@ -326,14 +340,27 @@ void ObjectState::markByteFlushed(unsigned offset) {
 }
 
 inline void ObjectState::setKnownSymbolic(unsigned offset, const ref<Expr> &value) {
-    if (m_knownSymbolics.size() > 0) {
-        m_knownSymbolics[offset] = value;
-    } else {
-        if (value) {
-            m_knownSymbolics.resize(m_size);
-            m_knownSymbolics[offset] = value;
+    if (m_knownSymbolics.empty()) {
+        if (!value) {
+            return;
         }
+        m_knownSymbolics.resize((m_size + KNOWN_SYMBOLICS_CHUNK_SIZE - 1) / KNOWN_SYMBOLICS_CHUNK_SIZE);
     }
+
+    auto &chunk = m_knownSymbolics[offset / KNOWN_SYMBOLICS_CHUNK_SIZE];
+    if (!chunk) {
+        if (!value) {
+            return;
+        }
+        chunk = std::make_shared<KnownSymbolicsChunk>();
+    } else if ((*chunk)[offset % KNOWN_SYMBOLICS_CHUNK_SIZE].get() == value.get()) {
+        return;
+    } else if (chunk.use_count() > 1) {
+        // The chunk is shared with other copies of this object
+        chunk = std::make_shared<KnownSymbolicsChunk>(*chunk);
+    }
+
+    (*chunk)[offset % KNOWN_SYMBOLICS_CHUNK_SIZE] = value;
 }
 
 /***/
@@ -346,7 +373,7 @@ ref<Expr> ObjectState::read8(unsigned offset) const {
             auto byte = getConcreteBuffer(true)[offset];
             return ConstantExpr::create(byte, Expr::Int8);
         } else if (isByteKnownSymbolic(offset)) {
-            return m_knownSymbolics[offset];
+            return getKnownSymbolic(offset);
         } else {
             assert(isByteFlushed(offset) && "unflushed byte without cache value");
             return ReadExpr::create(getUpdates(), ConstantExpr::create(offset, Expr::Int32));
@@ -8,6 +8,10 @@
 //===----------------------------------------------------------------------===//
 
 #include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Module/Cell.h"
+#include "klee/Internal/Module/KModule.h"
+
+#include "llvm/IR/Instructions.h"
 
 using namespace llvm;
 using namespace klee;
@@ -16,4 +20,248 @@ using namespace klee;
 
 KInstruction::~KInstruction() {
     delete[] operands;
+    delete fast;
+}
+
+/***/
+
+static bool hasFastType(const KModule &module, Type *type) {
+    if (!type->isIntegerTy() && !type->isPointerTy()) {
+        return false;
+    }
+
+    return module.getWidthForLLVMType(type) <= 64;
+}
+
+static inline int64_t signExtend(uint64_t value, unsigned width) {
+    if (width == 64) {
+        return (int64_t) value;
+    }
+    return ((int64_t) (value << (64 - width))) >> (64 - width);
+}
+
+static inline uint64_t truncate(uint64_t value, unsigned width) {
+    if (width == 64) {
+        return value;
+    }
+    return value & ((1ull << width) - 1);
+}
+
+KFastInstruction *KFastInstruction::create(const KModule &module, const KInstruction *ki) {
+    Instruction *inst = ki->inst;
+    Opcode opcode;
+
+    switch (inst->getOpcode()) {
+        case Instruction::Add:
+            opcode = Add;
+            break;
+        case Instruction::Sub:
+            opcode = Sub;
+            break;
+        case Instruction::Mul:
+            opcode = Mul;
+            break;
+        case Instruction::UDiv:
+            opcode = UDiv;
+            break;
+        case Instruction::SDiv:
+            opcode = SDiv;
+            break;
+        case Instruction::URem:
+            opcode = URem;
+            break;
+        case Instruction::SRem:
+            opcode = SRem;
+            break;
+        case Instruction::And:
+            opcode = And;
+            break;
+        case Instruction::Or:
+            opcode = Or;
+            break;
+        case Instruction::Xor:
+            opcode = Xor;
+            break;
+        case Instruction::Shl:
+            opcode = Shl;
+            break;
+        case Instruction::LShr:
+            opcode = LShr;
+            break;
+        case Instruction::AShr:
+            opcode = AShr;
+            break;
+        case Instruction::ICmp:
+            opcode = ICmp;
+            break;
+        case Instruction::Trunc:
+            opcode = Trunc;
+            break;
+        case Instruction::ZExt:
+            opcode = ZExt;
+            break;
+        case Instruction::SExt:
+            opcode = SExt;
+            break;
+        case Instruction::Select:
+            opcode = Select;
+            break;
+        default:
+            return nullptr;
+    }
+
+    // Vectors, floats, and wide integers go through the interpreter
+    unsigned numOperands = inst->getNumOperands();
+    if (numOperands > 3 || !hasFastType(module, inst->getType())) {
+        return nullptr;
+    }
+
+    for (unsigned i = 0; i < numOperands; ++i) {
+        if (ki->operands[i] == -1 || !hasFastType(module, inst->getOperand(i)->getType())) {
+            return nullptr;
+        }
+    }
+
+    auto fi = new KFastInstruction();
+    fi->opcode = opcode;
+    fi->predicate = opcode == ICmp ? (unsigned) cast<ICmpInst>(inst)->getPredicate() : 0;
+    fi->numOperands = numOperands;
+    fi->width = module.getWidthForLLVMType(inst->getType());
+    fi->operandWidth = module.getWidthForLLVMType(inst->getOperand(numOperands - 1)->getType());
+
+    for (unsigned i = 0; i < numOperands; ++i) {
+        int vnumber = ki->operands[i];
+        if (vnumber >= 0) {
+            fi->registers[i] = vnumber;
+            fi->constants[i] = 0;
+            continue;
+        }
+
+        auto ce = dyn_cast<klee::ConstantExpr>(module.getConstant(-vnumber - 2).value);
+        if (!ce) {
+            delete fi;
+            return nullptr;
+        }
+
+        fi->registers[i] = -1;
+        fi->constants[i] = ce->getZExtValue();
+    }
+
+    return fi;
+}
+
+bool KFastInstruction::evaluate(const uint64_t *operands, uint64_t &result) const {
+    uint64_t a = operands[0];
+    uint64_t b = numOperands > 1 ? operands[1] : 0;
+
+    switch (opcode) {
+        case Add:
+            result = a + b;
+            break;
+        case Sub:
+            result = a - b;
+            break;
+        case Mul:
+            result = a * b;
+            break;
+        case UDiv:
+            if (!b) {
+                return false;
+            }
+            result = a / b;
+            break;
+        case SDiv:
+        case SRem: {
+            int64_t sa = signExtend(a, operandWidth);
+            int64_t sb = signExtend(b, operandWidth);
+            if (!sb || (sa == INT64_MIN && sb == -1)) {
+                return false;
+            }
+            result = opcode == SDiv ? sa / sb : sa % sb;
+        } break;
+        case URem:
+            if (!b) {
+                return false;
+            }
+            result = a % b;
+            break;
+        case And:
+            result = a & b;
+            break;
+        case Or:
+            result = a | b;
+            break;
+        case Xor:
+            result = a ^ b;
+            break;
+        case Shl:
+            if (b >= operandWidth) {
+                return false;
+            }
+            result = a << b;
+            break;
+        case LShr:
+            if (b >= operandWidth) {
+                return false;
+            }
+            result = a >> b;
+            break;
+        case AShr:
+            if (b >= operandWidth) {
+                return false;
+            }
+            result = signExtend(a, operandWidth) >> b;
+            break;
+        case ICmp: {
+            int64_t sa = signExtend(a, operandWidth);
+            int64_t sb = signExtend(b, operandWidth);
+            switch (predicate) {
+                case ICmpInst::ICMP_EQ:
+                    result = a == b;
+                    break;
+                case ICmpInst::ICMP_NE:
+                    result = a != b;
+                    break;
+                case ICmpInst::ICMP_UGT:
+                    result = a > b;
+                    break;
+                case ICmpInst::ICMP_UGE:
+                    result = a >= b;
+                    break;
+                case ICmpInst::ICMP_ULT:
+                    result = a < b;
+                    break;
+                case ICmpInst::ICMP_ULE:
+                    result = a <= b;
+                    break;
+                case ICmpInst::ICMP_SGT:
+                    result = sa > sb;
+                    break;
+                case ICmpInst::ICMP_SGE:
+                    result = sa >= sb;
+                    break;
+                case ICmpInst::ICMP_SLT:
+                    result = sa < sb;
+                    break;
+                case ICmpInst::ICMP_SLE:
+                    result = sa <= sb;
+                    break;
+                default:
+                    return false;
+            }
+        } break;
+        case Trunc:
+        case ZExt:
+            result = a;
+            break;
+        case SExt:
+            result = signExtend(a, operandWidth);
+            break;
+        case Select:
+            result = a ? operands[1] : operands[2];
+            break;
+    }
+
+    result = truncate(result, width);
+    return true;
 }
@@ -78,6 +78,9 @@ public:
     /// if not applicable/unavailable.
     KInstruction *ki;
 
+    /// Number of instruction operands that refer to this constant.
+    unsigned users;
+
     KConstant(llvm::Constant *, unsigned, KInstruction *);
 };
 
@@ -85,12 +88,24 @@ KConstant::KConstant(llvm::Constant *_ct, unsigned _id, KInstruction *_ki) {
     ct = _ct;
     id = _id;
     ki = _ki;
+    users = 0;
 }
 
 //////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////
 
+/// Calls and invokes store the called value followed by the arguments in
+/// KInstruction::operands, other instructions store all their operands
+static bool hasCallOperands(const Instruction *inst) {
+    return isa<CallInst>(inst) || isa<InvokeInst>(inst);
+}
+
+/// Number of entries of KInstruction::operands
+static unsigned getNumOperands(const Instruction *inst) {
+    return hasCallOperands(inst) ? cast<CallBase>(inst)->arg_size() + 1 : inst->getNumOperands();
+}
+
 // what a hack
 static Function *getStubFunctionForCtorList(Module *m, GlobalVariable *gv, std::string name) {
     assert(!gv->isDeclaration() && !gv->hasInternalLinkage() &&
@@ -363,18 +378,44 @@ KFunction *KModule::updateModuleWithFunction(llvm::Function *f) {
 }
 
 void KModule::removeFunction(llvm::Function *f, bool keepDeclaration) {
-    std::map<llvm::Function *, KFunction *>::iterator it = functionMap.find(f);
-    assert(it != functionMap.end());
+    removeFunctions({f}, keepDeclaration);
+}
 
-    KFunction *kf = it->second;
-    functions.erase(std::find(functions.begin(), functions.end(), kf));
-    functionMap.erase(f);
-    delete kf;
+void KModule::removeFunctions(const std::unordered_set<llvm::Function *> &toRemove, bool keepDeclaration) {
+    auto removed = [&](KFunction *kf) { return toRemove.count(kf->getFunction()) > 0; };
+    functions.erase(std::remove_if(functions.begin(), functions.end(), removed), functions.end());
+
+    for (auto f : toRemove) {
+        auto it = functionMap.find(f);
+        assert(it != functionMap.end());
+        KFunction *kf = it->second;
+
+        // Constants may be shared with other functions, only those that no other function uses are freed
+        for (auto ki : kf->getInstructions()) {
+            unsigned numOperands = getNumOperands(ki->inst);
+            for (unsigned i = 0; i < numOperands; ++i) {
+                int vnumber = ki->operands[i];
+                if (vnumber >= -1) {
+                    continue;
+                }
 
-    if (keepDeclaration) {
-        f->deleteBody();
-    } else {
-        f->eraseFromParent();
+                auto kc = getKConstant(constants[-vnumber - 2]);
+                if (--kc->users == 0) {
+                    freeConstant(kc);
+                } else if (kc->ki && kc->ki->owner == kf) {
+                    kc->ki = nullptr;
+                }
+            }
+        }
+
+        functionMap.erase(it);
+        delete kf;
+
+        if (keepDeclaration) {
+            f->deleteBody();
+        } else {
+            f->eraseFromParent();
+        }
     }
 }
 
@@ -388,14 +429,35 @@ KConstant *KModule::getKConstant(const Constant *c) const {
 
 unsigned KModule::getConstantID(Constant *c, KInstruction *ki) {
     KConstant *kc = getKConstant(c);
-    if (kc)
-        return kc->id;
+    if (!kc) {
+        unsigned id;
+        if (!freeConstantIds.empty()) {
+            id = freeConstantIds.back();
+            freeConstantIds.pop_back();
+            constants[id] = c;
+        } else {
+            id = constants.size();
+            constants.push_back(c);
+        }
 
-    unsigned id = constants.size();
-    kc = new KConstant(c, id, ki);
-    constantMap.insert(std::make_pair(c, kc));
-    constants.push_back(c);
-    return id;
+        kc = new KConstant(c, id, ki);
+        constantMap.insert(std::make_pair(c, kc));
+    }
+
+    ++kc->users;
+    return kc->id;
+}
+
+/// Frees a constant that no function uses anymore. Its id is reused by the next new constant.
+void KModule::freeConstant(KConstant *kc) {
+    constantMap.erase(kc->ct);
+    constants[kc->id] = nullptr;
+    if (kc->id < constantTable.size()) {
+        constantTable[kc->id].value = ref<Expr>();
+    }
+
+    freeConstantIds.push_back(kc->id);
+    delete kc;
 }
 
 Expr::Width KModule::getWidthForLLVMType(llvm::Type *type) const {
@@ -465,30 +527,17 @@ void KModule::bindModuleConstants(const GlobalAddresses &globalAddresses) {
 
     constantTable.resize(constants.size());
     for (unsigned i = 0; i < constants.size(); ++i) {
-        Cell &c = constantTable[i];
-        c.value = evalConstant(globalAddresses, constants[i]);
+        if (constants[i]) {
+            Cell &c = constantTable[i];
+            c.value = evalConstant(globalAddresses, constants[i]);
+        }
     }
 }
 
-KFunction *KModule::bindFunctionConstants(GlobalAddresses &globalAddresses, llvm::Function *function) {
-    auto kf = getKFunction(function);
-    if (kf) {
-        return kf;
-    }
-
-    unsigned cIndex = constants.size();
-    kf = updateModuleWithFunction(function);
-
-    for (auto i : kf->getInstructions()) {
-        bindInstructionConstants(globalAddresses, i);
-    }
-
-    // Update global functions (new functions can be added while creating added function)
-    // TODO: optimize this, we shouldn't have to go over all functions again and again
-    for (auto &it : *module) {
-        auto f = &it;
+void KModule::bindFunctionAddresses(GlobalAddresses &globalAddresses, const llvm::Constant *c) {
+    if (auto f = dyn_cast<Function>(c)) {
         if (globalAddresses.find(f) != globalAddresses.end()) {
-            continue;
+            return;
         }
 
         klee::ref<klee::ConstantExpr> addr(0);
@@ -503,13 +552,60 @@ KFunction *KModule::bindFunctionConstants(GlobalAddresses &globalAddresses, llvm
         }
 
         globalAddresses.insert(std::make_pair(f, addr));
+        return;
+    }
+
+    // Global variables and aliases are bound when the executor starts
+    if (isa<GlobalValue>(c)) {
+        return;
+    }
+
+    // Block addresses also have the basic block as an operand
+    for (auto &op : c->operands()) {
+        if (auto opc = dyn_cast<Constant>(op)) {
+            bindFunctionAddresses(globalAddresses, opc);
+        }
+    }
+}
+
+KFunction *KModule::bindFunctionConstants(GlobalAddresses &globalAddresses, llvm::Function *function) {
+    auto kf = getKFunction(function);
+    if (kf) {
+        return kf;
     }
 
+    kf = updateModuleWithFunction(function);
+
+    // The new constants of the function are those that are not evaluated yet. They may
+    // reuse the ids of freed constants, so they are not necessarily at the end of the table.
     constantTable.resize(constants.size());
 
-    for (unsigned i = cIndex; i < constants.size(); ++i) {
-        Cell &c = constantTable[i];
-        c.value = evalConstant(globalAddresses, constants[i]);
+    std::vector<unsigned> newConstants;
+    for (auto ki : kf->getInstructions()) {
+        unsigned numOperands = getNumOperands(ki->inst);
+        for (unsigned i = 0; i < numOperands; ++i) {
+            int vnumber = ki->operands[i];
+            if (vnumber < -1 && !constantTable[-vnumber - 2].value.get()) {
+                newConstants.push_back(-vnumber - 2);
+            }
+        }
+    }
+
+    // New functions can be added while creating the added function (e.g., helper declarations).
+    // Only the ones it references need an address, and these are all in its new constants.
+    for (auto id : newConstants) {
+        bindFunctionAddresses(globalAddresses, constants[id]);
+    }
+
+    for (auto i : kf->getInstructions()) {
+        bindInstructionConstants(globalAddresses, i);
+    }
+
+    for (auto id : newConstants) {
+        Cell &c = constantTable[id];
+        if (!c.value.get()) {
+            c.value = evalConstant(globalAddresses, constants[id]);
+        }
     }
 
     return kf;
@@ -785,7 +881,8 @@ static int getOperandNum(Value *v, std::map<Instruction *, unsigned> &registerMa
     }
 }
 
-KFunction::KFunction(llvm::Function *_function, KModule *km) : function(_function), numArgs(function->arg_size()) {
+KFunction::KFunction(llvm::Function *_function, KModule *km)
+    : function(_function), numArgs(function->arg_size()), callCount(0) {
 
     legacy::FunctionPassManager pm(_function->getParent());
     pm.add(new IntrinsicFunctionCleanerPass());
@@ -835,7 +932,7 @@ KFunction::KFunction(llvm::Function *_function, KModule *km) : function(_functio
             ki->inst = &*it;
             ki->dest = registerMap[&*it];
 
-            if (isa<CallInst>(it) || isa<InvokeInst>(it)) {
+            if (hasCallOperands(&*it)) {
                 const CallBase &cs = cast<CallBase>(*it);
                 Value *val = cs.getCalledOperand();
 
@@ -881,6 +978,14 @@ KInstruction *KFunction::getInstruction(const llvm::Instruction *instr) const {
     return (*it).second;
 }
 
+void KFunction::createFastInstructions(const KModule &module) {
+    for (auto ki : instructions) {
+        if (!ki->fast) {
+            ki->fast = KFastInstruction::create(module, ki);
+        }
+    }
+}
+
 KFunction::~KFunction() {
     for (auto it : instructions) {
         delete it;
@@ -17,6 +17,8 @@
 
 #include "klee/Stats/SolverStats.h"
 
+#include "PersistentQueryStore.h"
+
 #include <unordered_map>
 
 using namespace klee;
@@ -46,12 +48,7 @@ private:
 
     struct CacheEntryHash {
         unsigned operator()(const CacheEntry &ce) const {
-            unsigned result = ce.query->hash();
-
-            for (ConstraintManager::const_iterator it = ce.constraints.begin(); it != ce.constraints.end(); ++it)
-                result ^= ce.constraints.toExpr((*it))->hash();
-
-            return result;
+            return (ce.constraints.head()->hash() * Expr::MAGIC_HASH_CONSTANT) ^ ce.query->hash();
         }
     };
 
@@ -60,8 +57,11 @@ private:
     SolverPtr solver;
     cache_map cache;
 
+    // Optional on-disk cache, consulted when the in-memory cache misses
+    PersistentQueryStorePtr store;
+
 private:
-    CachingSolver(SolverPtr &s) : solver(s) {
+    CachingSolver(SolverPtr &s, PersistentQueryStorePtr &store) : solver(s), store(store) {
     }
 
 public:
@@ -75,12 +75,10 @@ public:
         return solver->impl->computeValue(query, result);
     }
     bool computeInitialValues(const Query &query, const ArrayVec &objects,
-                              std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
-        return solver->impl->computeInitialValues(query, objects, values, hasSolution);
-    }
+                              std::vector<std::vector<unsigned char>> &values, bool &hasSolution);
 
-    static SolverImplPtr create(SolverPtr &s) {
-        return SolverImplPtr(new CachingSolver(s));
+    static SolverImplPtr create(SolverPtr &s, PersistentQueryStorePtr store) {
+        return SolverImplPtr(new CachingSolver(s, store));
     }
 };
 
@@ -100,6 +98,22 @@ ref<Expr> CachingSolver::canonicalizeQuery(ref<Expr> originalQuery, bool &negati
     }
 }
 
+/// The store is shared with other runs, its records are not trusted
+/// to hold one of the values of the enumeration
+static bool isPartialValidity(int32_t value) {
+    switch (value) {
+        case IncompleteSolver::MustBeTrue:
+        case IncompleteSolver::MustBeFalse:
+        case IncompleteSolver::MayBeTrue:
+        case IncompleteSolver::MayBeFalse:
+        case IncompleteSolver::TrueOrFalse:
+        case IncompleteSolver::None:
+            return true;
+        default:
+            return false;
+    }
+}
+
 /** @returns true on a cache hit, false of a cache miss.  Reference
     value result only valid on a cache hit. */
 bool CachingSolver::cacheLookup(const Query &query, IncompleteSolver::PartialValidity &result) {
@@ -114,6 +128,16 @@ bool CachingSolver::cacheLookup(const Query &query, IncompleteSolver::PartialVal
         return true;
     }
 
+    uint32_t stored;
+    if (store && store->lookup(store->getDigest(query.constraints, canonicalQuery), stored) &&
+        isPartialValidity((int32_t) stored)) {
+        ++*stats::queryPersistentCacheHits;
+        auto cachedResult = (IncompleteSolver::PartialValidity) (int32_t) stored;
+        cache.insert(std::make_pair(ce, cachedResult));
+        result = (negationUsed ? IncompleteSolver::negatePartialValidity(cachedResult) : cachedResult);
+        return true;
+    }
+
     return false;
 }
 
@@ -126,7 +150,11 @@ void CachingSolver::cacheInsert(const Query &query, IncompleteSolver::PartialVal
     IncompleteSolver::PartialValidity cachedResult =
         (negationUsed ? IncompleteSolver::negatePartialValidity(result) : result);
 
-    cache.insert(std::make_pair(ce, cachedResult));
+    cache[ce] = cachedResult;
+
+    if (store) {
+        store->insert(store->getDigest(query.constraints, canonicalQuery), (uint32_t) cachedResult);
+    }
 }
 
 bool CachingSolver::computeValidity(const Query &query, Validity &result) {
@@ -231,8 +259,64 @@ bool CachingSolver::computeTruth(const Query &query, bool &isValid) {
     return true;
 }
 
+/// Counterexamples are only cached on disk, the counterexample
+/// caching solver below takes care of the in-memory reuse.
+bool CachingSolver::computeInitialValues(const Query &query, const ArrayVec &objects,
+                                         std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+    if (!store) {
+        return solver->impl->computeInitialValues(query, objects, values, hasSolution);
+    }
+
+    auto key = store->getDigest(query.constraints, query.expr, objects);
+
+    // The record holds a flag telling whether there is a solution,
+    // followed by the values of the objects in order
+    llvm::ArrayRef<uint8_t> data;
+    if (store->lookup(key, data) && !data.empty()) {
+        size_t expected = 1;
+        if (data[0]) {
+            for (auto &object : objects) {
+                expected += object->getSize();
+            }
+        }
+
+        if (data.size() == expected) {
+            ++*stats::queryPersistentCacheHits;
+            hasSolution = data[0];
+            values.clear();
+            if (hasSolution) {
+                auto it = data.begin() + 1;
+                for (auto &object : objects) {
+                    values.emplace_back(it, it + object->getSize());
+                    it += object->getSize();
+                }
+            }
+            return true;
+        }
+    }
+
+    if (!solver->impl->computeInitialValues(query, objects, values, hasSolution)) {
+        return false;
+    }
+
+    std::vector<uint8_t> record(1, hasSolution);
+    if (hasSolution) {
+        for (auto &value : values) {
+            record.insert(record.end(), value.begin(), value.end());
+        }
+    }
+
+    store->insert(key, record);
+    return true;
+}
+
 ///
 
-SolverPtr klee::createCachingSolver(SolverPtr &_solver) {
-    return Solver::create(CachingSolver::create(_solver));
+SolverPtr klee::createCachingSolver(SolverPtr &_solver, const std::string &storePath, uint64_t storeSize) {
+    PersistentQueryStorePtr store;
+    if (!storePath.empty()) {
+        store = PersistentQueryStore::open(storePath, storeSize ? storeSize : PersistentQueryStore::DEFAULT_SIZE);
+    }
+
+    return Solver::create(CachingSolver::create(_solver, store));
 }
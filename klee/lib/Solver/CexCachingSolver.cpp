@@ -22,6 +22,9 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include <list>
+#include <unordered_map>
+
 using namespace klee;
 using namespace llvm;
 
@@ -33,6 +36,16 @@ cl::opt<bool> CexCacheTryAll("cex-cache-try-all",
                              cl::init(false));
 
 cl::opt<bool> CexCacheExperimental("cex-cache-exp", cl::init(false));
+
+cl::opt<unsigned> CexCachePathWalk("cex-cache-path-walk",
+                                   cl::desc("Number of constraints to walk back along the path of a query "
+                                            "looking for a known model (default=32)"),
+                                   cl::init(32));
+
+cl::opt<unsigned> CexCachePathEntries("cex-cache-path-entries",
+                                      cl::desc("Number of query results cached per path, least recently used "
+                                               "ones are dropped first (default=65536)"),
+                                      cl::init(65536));
 } // namespace
 
 ///
@@ -48,13 +61,46 @@ struct AssignmentLessThan {
 class CexCachingSolver : public SolverImpl {
     typedef std::set<AssignmentPtr, AssignmentLessThan> assignmentsTable_ty;
 
+    /// Exact lookup key: a path and the negated query expression
+    struct PathKey {
+        ConditionNodeRef head;
+        ref<Expr> expr;
+
+        bool operator==(const PathKey &b) const {
+            return head == b.head && *expr.get() == *b.expr.get();
+        }
+    };
+
+    struct PathKeyHash {
+        unsigned operator()(const PathKey &key) const {
+            return (key.head->hash() * Expr::MAGIC_HASH_CONSTANT) ^ key.expr->hash();
+        }
+    };
+
+    // Cached entries keep their path alive, the least recently used ones are dropped first
+    typedef std::list<PathKey> pathCacheLru_ty;
+    typedef std::unordered_map<PathKey, std::pair<AssignmentPtr, pathCacheLru_ty::iterator>, PathKeyHash>
+        pathCache_ty;
+
     SolverPtr solver;
 
     MapOfSets<ref<Expr>, AssignmentPtr> cache;
     // memo table
     assignmentsTable_ty assignmentsTable;
 
-    bool searchForAssignment(KeyType &key, AssignmentPtr &result);
+    // Results of previous queries, looked up in constant time before
+    // building the constraint set needed for the subset/superset search.
+    pathCache_ty pathCache;
+    pathCacheLru_ty pathCacheLru;
+
+    bool lookupPathCache(const PathKey &key, AssignmentPtr &result);
+    void insertPathCache(const PathKey &key, const AssignmentPtr &result);
+
+    bool searchForAssignment(KeyType &key, const Assignment *concolics, AssignmentPtr &result);
+
+    bool lookupConcolics(const Query &query, AssignmentPtr &result);
+
+    bool lookupPathModel(const Query &query, AssignmentPtr &result);
 
     bool lookupAssignment(const Query &query, KeyType &key, AssignmentPtr &result);
 
@@ -84,6 +130,84 @@ public:
 
 ///
 
+/// Evaluates expressions under a candidate assignment. Arrays that the
+/// candidate does not bind take the concrete values of the state that asks
+/// the query, so that reused models agree with its concolic inputs.
+///
+/// This does not use Assignment::evaluate(), which would fill the expression
+/// cache of the assignment that many queries share.
+class CandidateEvaluator : public ExprEvaluator {
+    const Assignment *m_candidate;
+    const Assignment *m_concolics;
+
+    static bool getByte(const Assignment *a, const ArrayPtr &array, unsigned index, unsigned char &value) {
+        if (!a) {
+            return false;
+        }
+
+        auto it = a->bindings.find(array);
+        if (it == a->bindings.end() || index >= it->second.size()) {
+            return false;
+        }
+
+        value = it->second[index];
+        return true;
+    }
+
+protected:
+    ref<Expr> getInitialValue(const ArrayPtr &array, unsigned index) {
+        unsigned char value = 0;
+        if (!getByte(m_candidate, array, index, value)) {
+            getByte(m_concolics, array, index, value);
+        }
+        return ConstantExpr::alloc(value, Expr::Int8);
+    }
+
+public:
+    CandidateEvaluator(const Assignment *candidate, const Assignment *concolics)
+        : m_candidate(candidate), m_concolics(concolics) {
+    }
+};
+
+template <typename InputIterator>
+static bool satisfies(const Assignment *a, const Assignment *concolics, InputIterator begin, InputIterator end) {
+    CandidateEvaluator evaluator(a, concolics);
+    for (; begin != end; ++begin) {
+        if (!evaluator.visit(*begin)->isTrue()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Binds the arrays of the given expressions that the candidate leaves
+/// free to the values used when checking it, so that the result is a model
+/// of the expressions no matter which state reuses it later.
+template <typename InputIterator>
+static AssignmentPtr complete(const AssignmentPtr &a, const Assignment *concolics, InputIterator begin,
+                              InputIterator end) {
+    ArrayVec objects;
+    findSymbolicObjects(begin, end, objects);
+
+    AssignmentPtr ret = a;
+    for (auto &object : objects) {
+        if (a && a->bindings.count(object)) {
+            continue;
+        }
+
+        if (ret == a) {
+            ret = Assignment::create();
+            if (a) {
+                ret->bindings = a->bindings;
+            }
+        }
+
+        ret->add(object, concolics ? concolics->getValue(object) : std::vector<unsigned char>(object->getSize(), 0));
+    }
+
+    return ret;
+}
+
 struct NullAssignment {
     bool operator()(AssignmentPtr &a) const {
         return !a;
@@ -98,23 +222,26 @@ struct NonNullAssignment {
 
 struct NullOrSatisfyingAssignment {
     KeyType &key;
+    const Assignment *concolics;
 
-    NullOrSatisfyingAssignment(KeyType &_key) : key(_key) {
+    NullOrSatisfyingAssignment(KeyType &_key, const Assignment *_concolics) : key(_key), concolics(_concolics) {
     }
 
     bool operator()(AssignmentPtr &a) const {
-        return !a || a->satisfies(key.begin(), key.end());
+        return !a || satisfies(a.get(), concolics, key.begin(), key.end());
     }
 };
 
 /// searchForAssignment - Look for a cached solution for a query.
 ///
 /// \param key - The query to look up.
+/// \param concolics - Concrete inputs of the state, used for the arrays that
+/// cached assignments found by evaluation do not bind.
 /// \param result [out] - The cached result, if the lookup is succesful. This is
 /// either a satisfying assignment (for a satisfiable query), or 0 (for an
 /// unsatisfiable query).
 /// \return - True if a cached result was found.
-bool CexCachingSolver::searchForAssignment(KeyType &key, AssignmentPtr &result) {
+bool CexCachingSolver::searchForAssignment(KeyType &key, const Assignment *concolics, AssignmentPtr &result) {
     AssignmentPtr *lookup = cache.lookup(key);
     if (lookup) {
         result = *lookup;
@@ -141,8 +268,8 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, AssignmentPtr &result)
         // of them satisfies the query.
         for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), ie = assignmentsTable.end(); it != ie; ++it) {
             AssignmentPtr a = *it;
-            if (a->satisfies(key.begin(), key.end())) {
-                result = a;
+            if (satisfies(a.get(), concolics, key.begin(), key.end())) {
+                result = complete(a, concolics, key.begin(), key.end());
                 return true;
             }
         }
@@ -159,7 +286,11 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, AssignmentPtr &result)
         // satisfiable subsets to see if they solve the current query and return
         // them if so. This is cheap and frequently succeeds.
         if (!lookup) {
-            lookup = cache.findSubset(key, NullOrSatisfyingAssignment(key));
+            lookup = cache.findSubset(key, NullOrSatisfyingAssignment(key, concolics));
+            if (lookup && *lookup) {
+                result = complete(*lookup, concolics, key.begin(), key.end());
+                return true;
+            }
         }
 
         // If either lookup succeeded, then we have a cached solution.
@@ -192,15 +323,159 @@ bool CexCachingSolver::lookupAssignment(const Query &query, KeyType &key, Assign
         key.insert(neg);
     }
 
-    return searchForAssignment(key, result);
+    return searchForAssignment(key, query.concolics, result);
+}
+
+/// lookupConcolics - Check whether the concrete inputs of the state that
+/// asks the query are a solution.
+///
+/// In concolic mode, the values the state already runs with are the
+/// preferred solution. Other cached models may also satisfy the query,
+/// but would change inputs that the query does not need to change.
+///
+/// \param query - The query to look up.
+/// \param result [out] - The concrete inputs, if they satisfy the query.
+/// \return True if the concrete inputs are a solution.
+bool CexCachingSolver::lookupConcolics(const Query &query, AssignmentPtr &result) {
+    if (!query.concolics) {
+        return false;
+    }
+
+    ref<Expr> neg = Expr::createIsZero(query.expr);
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(neg)) {
+        if (CE->isFalse()) {
+            return false;
+        }
+    }
+
+    std::vector<ref<Expr>> exprs;
+    exprs.push_back(neg);
+    for (auto node = query.constraints.head(); node != query.constraints.root(); node = node->parent()) {
+        exprs.push_back(node->expr());
+    }
+
+    if (!satisfies(nullptr, query.concolics, exprs.begin(), exprs.end())) {
+        return false;
+    }
+
+    result = complete(nullptr, query.concolics, exprs.begin(), exprs.end());
+    return true;
+}
+
+/// lookupPathModel - Look for a cached solution among the models of the
+/// query's path.
+///
+/// Most queries extend a path that was solved before. The model of the
+/// closest ancestor that has one satisfies all constraints up to that
+/// ancestor, so it only has to be checked against the constraints added
+/// since and the query.
+///
+/// \param query - The query to look up.
+/// \param result [out] - A satisfying assignment, if the lookup is successful.
+/// \return True if a satisfying assignment was found.
+bool CexCachingSolver::lookupPathModel(const Query &query, AssignmentPtr &result) {
+    ref<Expr> neg = Expr::createIsZero(query.expr);
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(neg)) {
+        if (CE->isFalse()) {
+            return false;
+        }
+    }
+
+    ConditionNodeRef head = query.constraints.head();
+    ConditionNodeRef root = query.constraints.root();
+    if (head == root) {
+        return false;
+    }
+
+    std::vector<ref<Expr>> added;
+    AssignmentPtr model;
+    for (auto node = head; node != root && added.size() <= CexCachePathWalk; node = node->parent()) {
+        model = node->model();
+        if (model) {
+            break;
+        }
+        added.push_back(node->expr());
+    }
+
+    if (!model) {
+        return false;
+    }
+
+    if (!satisfies(model.get(), query.concolics, added.begin(), added.end())) {
+        return false;
+    }
+
+    // Still a model of the whole path, which shortens later walks
+    model = complete(model, query.concolics, added.begin(), added.end());
+    head->setModel(model);
+
+    if (!satisfies(model.get(), query.concolics, &neg, &neg + 1)) {
+        return false;
+    }
+
+    result = complete(model, query.concolics, &neg, &neg + 1);
+    return true;
+}
+
+bool CexCachingSolver::lookupPathCache(const PathKey &key, AssignmentPtr &result) {
+    auto it = pathCache.find(key);
+    if (it == pathCache.end()) {
+        return false;
+    }
+
+    pathCacheLru.splice(pathCacheLru.begin(), pathCacheLru, it->second.second);
+    result = it->second.first;
+    return true;
+}
+
+void CexCachingSolver::insertPathCache(const PathKey &key, const AssignmentPtr &result) {
+    if (!CexCachePathEntries) {
+        return;
+    }
+
+    auto it = pathCache.find(key);
+    if (it != pathCache.end()) {
+        it->second.first = result;
+        pathCacheLru.splice(pathCacheLru.begin(), pathCacheLru, it->second.second);
+        return;
+    }
+
+    if (pathCache.size() >= CexCachePathEntries) {
+        pathCache.erase(pathCacheLru.back());
+        pathCacheLru.pop_back();
+    }
+
+    pathCacheLru.push_front(key);
+    pathCache.emplace(key, std::make_pair(result, pathCacheLru.begin()));
 }
 
 bool CexCachingSolver::getAssignment(const Query &query, AssignmentPtr &result) {
+    PathKey pathKey = {query.constraints.head(), Expr::createIsZero(query.expr)};
+    if (lookupConcolics(query, result)) {
+        ++*stats::cexCacheHits;
+        return true;
+    }
+
+    if (lookupPathCache(pathKey, result)) {
+        ++*stats::cexCacheHits;
+        return true;
+    }
+
+    if (lookupPathModel(query, result)) {
+        ++*stats::cexCacheHits;
+        insertPathCache(pathKey, result);
+        return true;
+    }
+
     KeyType key;
     if (lookupAssignment(query, key, result)) {
+        ++*stats::cexCacheHits;
+        insertPathCache(pathKey, result);
         return true;
     }
 
+    ++*stats::cexCacheMisses;
+
     ArrayVec objects;
     findSymbolicObjects(key.begin(), key.end(), objects);
 
@@ -223,6 +498,11 @@ bool CexCachingSolver::getAssignment(const Query &query, AssignmentPtr &result)
         if (DebugCexCacheCheckBinding) {
             assert(binding->satisfies(key.begin(), key.end()));
         }
+
+        // A model of the query is also a model of its path
+        if (query.constraints.head() != query.constraints.root()) {
+            query.constraints.head()->setModel(binding);
+        }
     } else {
         binding = nullptr;
         // return false;
@@ -230,6 +510,7 @@ bool CexCachingSolver::getAssignment(const Query &query, AssignmentPtr &result)
 
     result = binding;
     cache.insert(key, binding);
+    insertPathCache(pathKey, binding);
 
     return true;
 }
@@ -247,7 +528,7 @@ bool CexCachingSolver::computeValidity(const Query &query, Validity &result) {
         return false;
     }
     assert(a && "computeValidity() must have assignment");
-    ref<Expr> q = a->evaluate(query.expr);
+    ref<Expr> q = CandidateEvaluator(a.get(), query.concolics).visit(query.expr);
     assert(isa<ConstantExpr>(q) && "assignment evaluation did not result in constant");
 
     if (cast<ConstantExpr>(q)->isTrue()) {
@@ -300,7 +581,7 @@ bool CexCachingSolver::computeValue(const Query &query, ref<Expr> &result) {
     }
     assert(a && "computeValue() must have assignment");
 
-    result = a->evaluate(query.expr);
+    result = CandidateEvaluator(a.get(), query.concolics).visit(query.expr);
     assert(isa<ConstantExpr>(result) && "assignment evaluation did not result in constant");
     return true;
 }
@@ -319,16 +600,19 @@ bool CexCachingSolver::computeInitialValues(const Query &query, const ArrayVec &
     }
 
     // FIXME: We should use smarter assignment for result so we don't
-    // need redundant copy.
+    // need redundant copy. Objects the query does not constrain keep
+    // the concrete values of the state.
     values = std::vector<std::vector<unsigned char>>(objects.size());
     for (unsigned i = 0; i < objects.size(); ++i) {
         auto &os = objects[i];
         Assignment::bindings_ty::iterator it = a->bindings.find(os);
 
-        if (it == a->bindings.end()) {
-            values[i] = std::vector<unsigned char>(os->getSize(), 0);
-        } else {
+        if (it != a->bindings.end()) {
             values[i] = it->second;
+        } else if (query.concolics) {
+            values[i] = query.concolics->getValue(os);
+        } else {
+            values[i] = std::vector<unsigned char>(os->getSize(), 0);
         }
     }
 
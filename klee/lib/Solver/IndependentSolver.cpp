@@ -11,13 +11,19 @@
 
 #include "klee/Constraints.h"
 #include "klee/Expr.h"
+#include "klee/Internal/ADT/ImmutableMap.h"
+#include "klee/Internal/ADT/ImmutableSet.h"
 #include "klee/SolverImpl.h"
 
+#include "klee/util/Assignment.h"
 #include "klee/util/ExprUtil.h"
 
+#include <atomic>
 #include <iostream>
 #include <map>
 #include <ostream>
+#include <set>
+#include <unordered_set>
 #include <vector>
 
 using namespace klee;
@@ -27,6 +33,8 @@ template <class T> class DenseSet {
     typedef std::set<T> set_ty;
     set_ty s;
 
+    friend class FactorElements;
+
 public:
     DenseSet() {
     }
@@ -51,7 +59,7 @@ public:
         return modified;
     }
 
-    bool intersects(const DenseSet &b) {
+    bool intersects(const DenseSet &b) const {
         for (typename set_ty::iterator it = s.begin(), ie = s.end(); it != ie; ++it)
             if (b.s.count(*it))
                 return true;
@@ -83,6 +91,8 @@ class IndependentElementSet {
     elements_ty elements;
     std::unordered_set<ArrayPtr, ArrayHash> wholeObjects;
 
+    friend class FactorElements;
+
 public:
     IndependentElementSet() {
     }
@@ -147,8 +157,15 @@ public:
         os << "}";
     }
 
+    void getArrays(std::vector<ArrayPtr> &arrays) const {
+        arrays.insert(arrays.end(), wholeObjects.begin(), wholeObjects.end());
+        for (const auto &it : elements) {
+            arrays.push_back(it.first);
+        }
+    }
+
     // more efficient when this is the smaller set
-    bool intersects(const IndependentElementSet &b) {
+    bool intersects(const IndependentElementSet &b) const {
         for (auto array : wholeObjects) {
             if (b.wholeObjects.count(array) || b.elements.find(array) != b.elements.end())
                 return true;
@@ -183,7 +200,7 @@ public:
                 }
             }
         }
-        for (auto it : elements) {
+        for (const auto &it : b.elements) {
             auto &array = it.first;
             if (!wholeObjects.count(array)) {
                 auto it2 = elements.find(array);
@@ -253,13 +270,213 @@ static IndependentElementSet getIndependentConstraints(const Query &query, std::
     return eltsClosure;
 }
 
+///
+/// Persistent version of IndependentElementSet.
+///
+/// Factors are cached on every ConditionNode of a path, so each new version of
+/// a factor must share its element sets with the previous one instead of
+/// copying them.
+///
+class FactorElements {
+    typedef ImmutableSet<unsigned> indices_ty;
+    typedef ImmutableMap<ArrayPtr, indices_ty, ArrayLt> elements_ty;
+    typedef ImmutableSet<ArrayPtr, ArrayLt> whole_ty;
+
+    elements_ty elements;
+    whole_ty wholeObjects;
+
+    void addWholeObject(const ArrayPtr &array) {
+        if (wholeObjects.count(array)) {
+            return;
+        }
+        if (elements.count(array)) {
+            elements = elements.remove(array);
+        }
+        wholeObjects = wholeObjects.insert(array);
+    }
+
+    template <typename Indices> void addIndices(const ArrayPtr &array, const Indices &added) {
+        if (wholeObjects.count(array)) {
+            return;
+        }
+
+        indices_ty indices;
+        auto existing = elements.lookup(array);
+        if (existing) {
+            indices = existing->second;
+        }
+
+        for (auto index : added) {
+            indices = indices.insert(index);
+        }
+
+        elements = elements.replace(std::make_pair(array, indices));
+    }
+
+public:
+    bool intersects(const IndependentElementSet &b) const {
+        for (const auto &array : b.wholeObjects) {
+            if (wholeObjects.count(array) || elements.count(array)) {
+                return true;
+            }
+        }
+
+        for (const auto &it : b.elements) {
+            if (wholeObjects.count(it.first)) {
+                return true;
+            }
+
+            auto indices = elements.lookup(it.first);
+            if (!indices) {
+                continue;
+            }
+
+            for (auto index : it.second.s) {
+                if (indices->second.count(index)) {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    void add(const IndependentElementSet &b) {
+        for (const auto &array : b.wholeObjects) {
+            addWholeObject(array);
+        }
+        for (const auto &it : b.elements) {
+            addIndices(it.first, it.second.s);
+        }
+    }
+
+    void add(const FactorElements &b) {
+        for (const auto &array : b.wholeObjects) {
+            addWholeObject(array);
+        }
+        for (const auto &it : b.elements) {
+            addIndices(it.first, it.second);
+        }
+    }
+
+    /// Returns true if the given byte of the array belongs to this set.
+    bool owns(const ArrayPtr &array, unsigned index) const {
+        if (wholeObjects.count(array)) {
+            return true;
+        }
+        auto indices = elements.lookup(array);
+        return indices && indices->second.count(index);
+    }
+
+    void getArrays(std::vector<ArrayPtr> &arrays) const {
+        for (const auto &array : wholeObjects) {
+            arrays.push_back(array);
+        }
+        for (const auto &it : elements) {
+            arrays.push_back(it.first);
+        }
+    }
+};
+
+///
+/// A set of constraints that share symbolic bytes with each other, but not with
+/// the constraints of any other factor of the same path.
+///
+struct IndependentFactor {
+    uint64_t id;
+    FactorElements elements;
+
+    /// The constraints of this factor, stored as a path in the slice tree
+    /// of the independent solver that created the factor.
+    ConditionNodeRef head;
+};
+
+using IndependentFactorPtr = std::shared_ptr<const IndependentFactor>;
+
+namespace klee {
+
+///
+/// Partition of the constraints of a path into independent factors.
+/// The partition is immutable and shares structure with the partition of
+/// the parent node, so that a child only pays for its newest constraint.
+///
+class ConstraintPartition {
+public:
+    typedef ImmutableMap<uint64_t, IndependentFactorPtr> factors_ty;
+    typedef ImmutableMap<ArrayPtr, ImmutableSet<uint64_t>, ArrayLt> index_ty;
+
+    /// Id of the solver that computed this partition. Its factors are slices
+    /// in the tree of that solver. Unlike the address of the tree, the id is
+    /// not reused by solvers created after that one is destroyed.
+    const uint64_t owner;
+
+    factors_ty factors;
+
+    /// Maps each array to the ids of the factors that read it
+    index_ty arrays;
+
+    ConstraintPartition(uint64_t owner) : owner(owner) {
+    }
+
+    /// Returns the ids of the factors that share bytes with the given set.
+    void getIntersecting(const IndependentElementSet &elts, std::set<uint64_t> &result) const {
+        std::vector<ArrayPtr> eltsArrays;
+        elts.getArrays(eltsArrays);
+
+        for (const auto &array : eltsArrays) {
+            auto ids = arrays.lookup(array);
+            if (!ids) {
+                continue;
+            }
+
+            for (auto id : ids->second) {
+                if (result.count(id)) {
+                    continue;
+                }
+
+                auto factor = factors.lookup(id);
+                assert(factor && "Stale factor index");
+                if (factor->second->elements.intersects(elts)) {
+                    result.insert(id);
+                }
+            }
+        }
+    }
+};
+
+} // namespace klee
+
 class IndependentSolver : public SolverImpl {
 private:
     SolverPtr solver;
 
-    IndependentSolver(SolverPtr _solver) : solver(_solver) {
+    /// All sliced constraint sets live in this tree. Identical slices
+    /// of different states map to the same nodes, which lets incremental
+    /// end solvers and the caching solvers reuse their work across states.
+    ConstraintManager m_sliceTree;
+
+    /// Owner of the partitions computed by this solver
+    uint64_t m_id;
+    static std::atomic<uint64_t> s_nextId;
+
+    std::shared_ptr<const ConstraintPartition> m_emptyPartition;
+
+    uint64_t m_nextFactorId;
+
+    IndependentSolver(SolverPtr _solver)
+        : solver(_solver), m_id(s_nextId++), m_emptyPartition(new ConstraintPartition(m_id)), m_nextFactorId(0) {
     }
 
+    std::shared_ptr<const ConstraintPartition> getPartition(const ConstraintManager &constraints);
+
+    std::shared_ptr<const ConstraintPartition>
+    addConstraint(const std::shared_ptr<const ConstraintPartition> &partition, const ref<Expr> &e);
+
+    void appendFactor(ConstraintManager &slice, const IndependentFactorPtr &factor) const;
+
+    ConstraintManager getSlice(const ConstraintPartition &partition, const std::set<uint64_t> &ids,
+                               FactorElements *elements = nullptr) const;
+
 public:
     ~IndependentSolver() {
     }
@@ -268,34 +485,280 @@ public:
     bool computeValidity(const Query &, Validity &result);
     bool computeValue(const Query &, ref<Expr> &result);
     bool computeInitialValues(const Query &query, const ArrayVec &objects,
-                              std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
-        return solver->impl->computeInitialValues(query, objects, values, hasSolution);
-    }
+                              std::vector<std::vector<unsigned char>> &values, bool &hasSolution);
 
     static SolverImplPtr create(SolverPtr &s) {
         return SolverImplPtr(new IndependentSolver(s));
     }
 };
 
+std::atomic<uint64_t> IndependentSolver::s_nextId(0);
+
+std::shared_ptr<const ConstraintPartition> IndependentSolver::getPartition(const ConstraintManager &constraints) {
+    std::vector<ConditionNodeRef> pending;
+    std::shared_ptr<const ConstraintPartition> partition;
+
+    // Find the closest ancestor whose partition is already known
+    ConditionNodeRef node = constraints.head();
+    for (ConditionNodeRef root = constraints.root(); node != root; node = node->parent()) {
+        auto &cached = node->partition();
+        if (cached && cached->owner == m_id) {
+            partition = cached;
+            break;
+        }
+        pending.push_back(node);
+    }
+
+    if (!partition) {
+        partition = m_emptyPartition;
+    }
+
+    for (auto it = pending.rbegin(); it != pending.rend(); ++it) {
+        partition = addConstraint(partition, (*it)->expr());
+        (*it)->setPartition(partition);
+    }
+
+    return partition;
+}
+
+std::shared_ptr<const ConstraintPartition>
+IndependentSolver::addConstraint(const std::shared_ptr<const ConstraintPartition> &partition, const ref<Expr> &e) {
+    IndependentElementSet elts(e);
+    std::vector<ArrayPtr> eltsArrays;
+    elts.getArrays(eltsArrays);
+
+    // Constraints that do not read symbolic data can never be relevant to a query
+    if (eltsArrays.empty()) {
+        return partition;
+    }
+
+    std::set<uint64_t> merged;
+    partition->getIntersecting(elts, merged);
+
+    // Reuse the longest merged factor as the prefix of the new one, so that
+    // its nodes (and whatever the end solver attached to them) stay valid.
+    IndependentFactorPtr base;
+    for (auto id : merged) {
+        auto &factor = partition->factors.lookup(id)->second;
+        if (!base || factor->head->depth() > base->head->depth()) {
+            base = factor;
+        }
+    }
+
+    auto result = std::make_shared<ConstraintPartition>(*partition);
+    auto factor = std::make_shared<IndependentFactor>();
+    factor->id = m_nextFactorId++;
+
+    ConstraintManager slice(m_sliceTree.root(), base ? base->head : m_sliceTree.root());
+    if (base) {
+        factor->elements = base->elements;
+    }
+
+    for (auto id : merged) {
+        auto &old = partition->factors.lookup(id)->second;
+        if (old != base) {
+            factor->elements.add(old->elements);
+            appendFactor(slice, old);
+        }
+
+        std::vector<ArrayPtr> oldArrays;
+        old->elements.getArrays(oldArrays);
+        for (const auto &array : oldArrays) {
+            auto ids = result->arrays.lookup(array)->second.remove(id);
+            if (ids.empty()) {
+                result->arrays = result->arrays.remove(array);
+            } else {
+                result->arrays = result->arrays.replace(std::make_pair(array, ids));
+            }
+        }
+
+        result->factors = result->factors.remove(id);
+    }
+
+    factor->elements.add(elts);
+    slice.addConstraint(e);
+    factor->head = slice.head();
+
+    std::vector<ArrayPtr> arrays;
+    factor->elements.getArrays(arrays);
+    for (const auto &array : arrays) {
+        ImmutableSet<uint64_t> ids;
+        auto existing = result->arrays.lookup(array);
+        if (existing) {
+            ids = existing->second;
+        }
+        result->arrays = result->arrays.replace(std::make_pair(array, ids.insert(factor->id)));
+    }
+
+    result->factors = result->factors.insert(std::make_pair(factor->id, factor));
+    return result;
+}
+
+void IndependentSolver::appendFactor(ConstraintManager &slice, const IndependentFactorPtr &factor) const {
+    std::vector<ref<Expr>> constraints;
+    for (ConditionNodeRef node = factor->head, root = m_sliceTree.root(); node != root; node = node->parent()) {
+        constraints.push_back(node->expr());
+    }
+
+    for (auto it = constraints.rbegin(); it != constraints.rend(); ++it) {
+        slice.addConstraint(*it);
+    }
+}
+
+ConstraintManager IndependentSolver::getSlice(const ConstraintPartition &partition, const std::set<uint64_t> &ids,
+                                              FactorElements *elements) const {
+    ConstraintManager slice(m_sliceTree.root(), m_sliceTree.root());
+
+    // Factors are appended oldest first, which keeps the resulting
+    // path stable for a given set of factors.
+    for (auto id : ids) {
+        auto &factor = partition.factors.lookup(id)->second;
+        if (slice.empty()) {
+            slice = ConstraintManager(m_sliceTree.root(), factor->head);
+        } else {
+            appendFactor(slice, factor);
+        }
+
+        if (elements) {
+            elements->add(factor->elements);
+        }
+    }
+
+    return slice;
+}
+
 bool IndependentSolver::computeValidity(const Query &query, Validity &result) {
-    std::vector<ref<Expr>> required;
-    IndependentElementSet eltsClosure = getIndependentConstraints(query, required);
-    ConstraintManager tmp(required);
-    return solver->impl->computeValidity(Query(tmp, query.expr), result);
+    auto partition = getPartition(query.constraints);
+    std::set<uint64_t> ids;
+    partition->getIntersecting(IndependentElementSet(query.expr), ids);
+    auto slice = getSlice(*partition, ids);
+    return solver->impl->computeValidity(Query(slice, query.expr, query.concolics), result);
 }
 
 bool IndependentSolver::computeTruth(const Query &query, bool &isValid) {
-    std::vector<ref<Expr>> required;
-    IndependentElementSet eltsClosure = getIndependentConstraints(query, required);
-    ConstraintManager tmp(required);
-    return solver->impl->computeTruth(Query(tmp, query.expr), isValid);
+    auto partition = getPartition(query.constraints);
+    std::set<uint64_t> ids;
+    partition->getIntersecting(IndependentElementSet(query.expr), ids);
+    auto slice = getSlice(*partition, ids);
+    return solver->impl->computeTruth(Query(slice, query.expr, query.concolics), isValid);
 }
 
 bool IndependentSolver::computeValue(const Query &query, ref<Expr> &result) {
-    std::vector<ref<Expr>> required;
-    IndependentElementSet eltsClosure = getIndependentConstraints(query, required);
-    ConstraintManager tmp(required);
-    return solver->impl->computeValue(Query(tmp, query.expr), result);
+    auto partition = getPartition(query.constraints);
+    std::set<uint64_t> ids;
+    partition->getIntersecting(IndependentElementSet(query.expr), ids);
+    auto slice = getSlice(*partition, ids);
+    return solver->impl->computeValue(Query(slice, query.expr, query.concolics), result);
+}
+
+///
+/// The returned assignment must satisfy the whole path, not only the slice
+/// relevant to the query expression. Each factor that reads one of the
+/// requested objects is solved separately and contributes the bytes it owns.
+/// Bytes that no constraint reads keep the concrete value of the state that
+/// asks the query, or are zero if there is none.
+///
+bool IndependentSolver::computeInitialValues(const Query &query, const ArrayVec &objects,
+                                             std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+    auto partition = getPartition(query.constraints);
+
+    IndependentElementSet queryElts(query.expr);
+    std::set<uint64_t> queryIds;
+    partition->getIntersecting(queryElts, queryIds);
+
+    // Group the remaining factors that read the requested objects
+    std::set<uint64_t> otherIds;
+    for (const auto &object : objects) {
+        auto ids = partition->arrays.lookup(object);
+        if (!ids) {
+            continue;
+        }
+        for (auto id : ids->second) {
+            if (!queryIds.count(id)) {
+                otherIds.insert(id);
+            }
+        }
+    }
+
+    if (otherIds.empty()) {
+        auto slice = getSlice(*partition, queryIds);
+        return solver->impl->computeInitialValues(Query(slice, query.expr, query.concolics), objects, values,
+                                                  hasSolution);
+    }
+
+    values.clear();
+    for (const auto &object : objects) {
+        if (query.concolics) {
+            values.push_back(query.concolics->getValue(object));
+        } else {
+            values.push_back(std::vector<unsigned char>(object->getSize(), 0));
+        }
+    }
+
+    auto solveGroup = [&](const std::set<uint64_t> &ids, const ref<Expr> &expr, const FactorElements *extra) {
+        FactorElements elements;
+        if (extra) {
+            elements.add(*extra);
+        }
+        auto slice = getSlice(*partition, ids, &elements);
+
+        std::vector<ArrayPtr> groupArrays;
+        elements.getArrays(groupArrays);
+        std::unordered_set<ArrayPtr, ArrayHash> groupSet(groupArrays.begin(), groupArrays.end());
+
+        ArrayVec groupObjects;
+        std::vector<unsigned> groupIndices;
+        for (unsigned i = 0; i < objects.size(); ++i) {
+            if (groupSet.count(objects[i])) {
+                groupObjects.push_back(objects[i]);
+                groupIndices.push_back(i);
+            }
+        }
+
+        std::vector<std::vector<unsigned char>> groupValues;
+        if (!solver->impl->computeInitialValues(Query(slice, expr, query.concolics), groupObjects, groupValues,
+                                                hasSolution)) {
+            return false;
+        }
+
+        if (!hasSolution) {
+            return true;
+        }
+
+        for (unsigned i = 0; i < groupObjects.size(); ++i) {
+            auto &object = groupObjects[i];
+            auto &dst = values[groupIndices[i]];
+            for (unsigned j = 0; j < object->getSize(); ++j) {
+                if (elements.owns(object, j)) {
+                    dst[j] = groupValues[i][j];
+                }
+            }
+        }
+
+        return true;
+    };
+
+    FactorElements queryElements;
+    queryElements.add(queryElts);
+    if (!solveGroup(queryIds, query.expr, &queryElements)) {
+        return false;
+    }
+
+    if (!hasSolution) {
+        return true;
+    }
+
+    for (auto id : otherIds) {
+        if (!solveGroup({id}, ConstantExpr::alloc(0, Expr::Bool), nullptr)) {
+            return false;
+        }
+
+        if (!hasSolution) {
+            return true;
+        }
+    }
+
+    return true;
 }
 
 SolverPtr klee::createIndependentSolver(SolverPtr &s) {
@@ -0,0 +1,552 @@
+//===-- PersistentQueryStore.cpp ------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PersistentQueryStore.h"
+
+#include "klee/Common.h"
+#include "klee/Internal/ADT/ImmutableMap.h"
+
+#include <llvm/Support/MD5.h>
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace klee {
+
+namespace {
+
+const char STORE_MAGIC[8] = {'K', 'L', 'E', 'E', 'Q', 'C', 'H', 'E'};
+const uint32_t STORE_VERSION = 4;
+const uint32_t RECORD_MAGIC = 0x51c4ed01;
+
+// Tags that keep the keys of the different kinds of records apart
+const uint32_t VALIDITY_TAG = 1;
+const uint32_t INITIAL_VALUES_TAG = 2;
+
+// Number of expression digests in a cache generation. Entries that are not
+// used again during a whole generation are dropped.
+const size_t MAX_EXPR_DIGESTS = 512 * 1024;
+
+// Smallest store that still has room for a useful number of records
+const uint64_t MIN_STORE_SIZE = 1024 * 1024;
+
+struct StoreHeader {
+    char magic[8];
+    uint32_t version;
+
+    // Number of entries of the table, a power of two
+    uint32_t slotCount;
+
+    // Size of the whole file
+    uint64_t size;
+
+    // Offset of the next free byte, advanced atomically by writers
+    uint64_t tail;
+
+    // Number of published records, updated atomically
+    uint64_t count;
+};
+
+// The table starts on its own cache line
+const uint64_t SLOTS_OFFSET = 64;
+static_assert(sizeof(StoreHeader) <= SLOTS_OFFSET, "Header overlaps the table");
+
+struct RecordHeader {
+    PersistentQueryStore::Digest key;
+    uint32_t size;
+    uint32_t check;
+};
+
+uint64_t getRecordSize(uint32_t dataSize) {
+    return (sizeof(RecordHeader) + dataSize + 7) & ~(uint64_t) 7;
+}
+
+uint32_t getRecordCheck(const PersistentQueryStore::Digest &key, llvm::ArrayRef<uint8_t> data) {
+    uint32_t ret = RECORD_MAGIC ^ (uint32_t) data.size();
+    for (unsigned i = 0; i < key.size(); i += sizeof(uint32_t)) {
+        uint32_t word;
+        memcpy(&word, &key[i], sizeof(word));
+        ret = (ret ^ word) * Expr::MAGIC_HASH_CONSTANT;
+    }
+    for (auto byte : data) {
+        ret = (ret ^ byte) * Expr::MAGIC_HASH_CONSTANT;
+    }
+    return ret;
+}
+
+uint64_t getSlotIndex(const PersistentQueryStore::Digest &key) {
+    uint64_t ret;
+    memcpy(&ret, key.data(), sizeof(ret));
+    return ret;
+}
+
+PersistentQueryStore::Digest finalize(llvm::MD5 &hash) {
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    return result.Bytes;
+}
+
+template <typename T> void update(llvm::MD5 &hash, const T &value) {
+    hash.update(llvm::ArrayRef<uint8_t>((const uint8_t *) &value, sizeof(value)));
+}
+
+void update(llvm::MD5 &hash, const PersistentQueryStore::Digest &digest) {
+    hash.update(llvm::ArrayRef<uint8_t>(digest.data(), digest.size()));
+}
+
+/// Adds two digests as 128-bit integers. The sum does not depend on the order
+/// of the operands, which lets path digests be computed one constraint at a time.
+PersistentQueryStore::Digest add(const PersistentQueryStore::Digest &a, const PersistentQueryStore::Digest &b) {
+    PersistentQueryStore::Digest ret;
+    unsigned carry = 0;
+    for (unsigned i = 0; i < ret.size(); ++i) {
+        unsigned sum = a[i] + b[i] + carry;
+        ret[i] = sum;
+        carry = sum >> 8;
+    }
+    return ret;
+}
+
+/// Looks up key in the current generation of a cache, then in the previous one.
+/// Entries found in the previous generation move to the current one.
+template <typename Map>
+typename Map::mapped_type *findCached(Map &current, Map &previous, const typename Map::key_type &key) {
+    auto it = current.find(key);
+    if (it != current.end()) {
+        return &it->second;
+    }
+
+    auto old = previous.find(key);
+    if (old == previous.end()) {
+        return nullptr;
+    }
+
+    auto &ret = current[key];
+    ret = std::move(old->second);
+    previous.erase(old);
+    return &ret;
+}
+
+/// Starts a new generation once the current one is full
+template <typename Map> void rotate(Map &current, Map &previous) {
+    std::swap(current, previous);
+    current.clear();
+}
+
+} // namespace
+
+///
+/// Name-independent digest of the constraints of a path. Arrays are numbered
+/// in the order of their first appearance along the path. Each constraint is
+/// digested together with the numbers of its arrays, and the path digest is
+/// the sum of these digests, so that a path only adds its last constraint to
+/// the digest of its parent.
+///
+class CanonicalPath {
+public:
+    /// Sum of the digests of the constraints
+    PersistentQueryStore::Digest sum = {};
+    uint32_t count = 0;
+
+    /// Digest of the sum and the number of constraints
+    PersistentQueryStore::Digest digest = {};
+
+    /// Numbers of the arrays of the path, shared with the parent path
+    ImmutableMap<ArrayPtr, uint32_t> arrays;
+    uint32_t arrayCount = 0;
+};
+
+///
+/// Serializes an expression into a digest. Arrays are replaced by
+/// their position in the list of arrays the expression references.
+/// The arrays of the given path keep their numbers, the others
+/// are numbered after them.
+///
+class PersistentQueryStore::Builder {
+private:
+    PersistentQueryStore &m_store;
+    llvm::MD5 m_hash;
+
+public:
+    /// Path whose array numbers the expression continues, if any
+    std::shared_ptr<const CanonicalPath> path;
+
+    /// Arrays that are not part of the path
+    ArrayVec arrays;
+
+    Builder(PersistentQueryStore &store) : m_store(store) {
+    }
+
+    template <typename T> void add(const T &value) {
+        update(m_hash, value);
+    }
+
+    void add(const ArrayPtr &array) {
+        if (path) {
+            if (auto known = path->arrays.lookup(array)) {
+                update(m_hash, known->second);
+                return;
+            }
+        }
+
+        auto it = std::find(arrays.begin(), arrays.end(), array);
+        uint32_t index = (path ? path->arrayCount : 0) + (it - arrays.begin());
+        if (it == arrays.end()) {
+            arrays.push_back(array);
+            update(m_hash, m_store.getDigest(array));
+        }
+        update(m_hash, index);
+    }
+
+    /// Adds a sub-expression and maps its arrays into this expression
+    void add(const ExprDigest &e) {
+        update(m_hash, e.digest);
+        update(m_hash, (uint32_t) e.arrays.size());
+        for (auto &array : e.arrays) {
+            add(array);
+        }
+    }
+
+    Digest finalize() {
+        return klee::finalize(m_hash);
+    }
+};
+
+PersistentQueryStore::PersistentQueryStore(int fd, const std::string &path, uint8_t *map, uint64_t size)
+    : m_fd(fd), m_path(path), m_map(map), m_size(size) {
+}
+
+PersistentQueryStore::~PersistentQueryStore() {
+    munmap(m_map, m_size);
+    close(m_fd);
+}
+
+PersistentQueryStorePtr PersistentQueryStore::open(const std::string &path, uint64_t size) {
+    size = std::max(size, MIN_STORE_SIZE);
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        klee_warning("Could not open query store %s: %s", path.c_str(), strerror(errno));
+        return nullptr;
+    }
+
+    // Several instances may try to create the store at the same time
+    flock(fd, LOCK_EX);
+
+    bool valid = false;
+    struct stat st;
+    StoreHeader header;
+
+    if (fstat(fd, &st) == 0) {
+        if (st.st_size == 0) {
+            // About one slot for every 64 bytes of records
+            uint32_t slotCount = 1;
+            while (slotCount < (1u << 31) && (uint64_t) slotCount * 2 * 64 <= size) {
+                slotCount *= 2;
+            }
+
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, STORE_MAGIC, sizeof(header.magic));
+            header.version = STORE_VERSION;
+            header.slotCount = slotCount;
+            header.size = size;
+            header.tail = SLOTS_OFFSET + (uint64_t) slotCount * sizeof(uint64_t);
+
+            // The file is sparse, only the parts that get written use disk space
+            valid = ftruncate(fd, size) == 0 && pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+        } else if (pread(fd, &header, sizeof(header), 0) == sizeof(header)) {
+            valid = !memcmp(header.magic, STORE_MAGIC, sizeof(header.magic)) && header.version == STORE_VERSION &&
+                    header.size == (uint64_t) st.st_size && header.slotCount &&
+                    !(header.slotCount & (header.slotCount - 1)) &&
+                    SLOTS_OFFSET + (uint64_t) header.slotCount * sizeof(uint64_t) <= header.size;
+            size = header.size;
+        }
+    }
+
+    flock(fd, LOCK_UN);
+
+    if (!valid) {
+        klee_warning("Query store %s is invalid or has an incompatible version", path.c_str());
+        close(fd);
+        return nullptr;
+    }
+
+    // The whole file is mapped once, lookups never need to remap it
+    void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        klee_warning("Could not map query store %s: %s", path.c_str(), strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+    return PersistentQueryStorePtr(new PersistentQueryStore(fd, path, (uint8_t *) map, size));
+}
+
+uint64_t *PersistentQueryStore::getSlots() const {
+    return (uint64_t *) (m_map + SLOTS_OFFSET);
+}
+
+/// Returns the record of the given key, or null if there is none.
+/// Records that fail their check, e.g. because the file was not completely
+/// written back before a system crash, are ignored.
+const uint8_t *PersistentQueryStore::getRecord(const Digest &key) const {
+    auto header = (const StoreHeader *) m_map;
+    auto slots = getSlots();
+    uint64_t mask = header->slotCount - 1;
+
+    for (uint64_t i = 0, slot = getSlotIndex(key) & mask; i <= mask; ++i, slot = (slot + 1) & mask) {
+        uint64_t offset = __atomic_load_n(&slots[slot], __ATOMIC_ACQUIRE);
+        if (!offset) {
+            return nullptr;
+        }
+
+        if (offset + sizeof(RecordHeader) > m_size) {
+            continue;
+        }
+
+        auto record = (const RecordHeader *) (m_map + offset);
+        if (record->key != key) {
+            continue;
+        }
+
+        auto data = llvm::ArrayRef<uint8_t>(m_map + offset + sizeof(RecordHeader),
+                                            std::min<uint64_t>(record->size, m_size - offset - sizeof(RecordHeader)));
+        if (data.size() != record->size || record->check != getRecordCheck(key, data)) {
+            return nullptr;
+        }
+
+        return m_map + offset;
+    }
+
+    return nullptr;
+}
+
+bool PersistentQueryStore::lookup(const Digest &key, llvm::ArrayRef<uint8_t> &data) const {
+    auto record = getRecord(key);
+    if (!record) {
+        return false;
+    }
+
+    data = llvm::ArrayRef<uint8_t>(record + sizeof(RecordHeader), ((const RecordHeader *) record)->size);
+    return true;
+}
+
+void PersistentQueryStore::insert(const Digest &key, llvm::ArrayRef<uint8_t> data) {
+    auto header = (StoreHeader *) m_map;
+    auto slots = getSlots();
+    uint64_t mask = header->slotCount - 1;
+
+    // Keep the table sparse enough for probe sequences to stay short
+    if (__atomic_load_n(&header->count, __ATOMIC_RELAXED) >= header->slotCount / 4 * 3) {
+        klee_warning_once(0, "Query store %s is full", m_path.c_str());
+        return;
+    }
+
+    uint64_t recordSize = getRecordSize(data.size());
+    uint64_t offset = __atomic_fetch_add(&header->tail, recordSize, __ATOMIC_RELAXED);
+    if (offset + recordSize > m_size) {
+        klee_warning_once(0, "Query store %s is full", m_path.c_str());
+        return;
+    }
+
+    auto record = (RecordHeader *) (m_map + offset);
+    record->key = key;
+    record->size = data.size();
+    record->check = getRecordCheck(key, data);
+    memcpy(m_map + offset + sizeof(RecordHeader), data.data(), data.size());
+
+    // Publish the record. If another instance already published the same
+    // key, the space reserved for this record stays unused.
+    for (uint64_t i = 0, slot = getSlotIndex(key) & mask; i <= mask; ++i, slot = (slot + 1) & mask) {
+        uint64_t expected = 0;
+        if (__atomic_compare_exchange_n(&slots[slot], &expected, offset, false, __ATOMIC_RELEASE,
+                                        __ATOMIC_ACQUIRE)) {
+            __atomic_fetch_add(&header->count, 1, __ATOMIC_RELAXED);
+            return;
+        }
+
+        if (expected + sizeof(RecordHeader) <= m_size && ((const RecordHeader *) (m_map + expected))->key == key) {
+            return;
+        }
+    }
+}
+
+bool PersistentQueryStore::lookup(const Digest &key, uint32_t &value) const {
+    llvm::ArrayRef<uint8_t> data;
+    if (!lookup(key, data) || data.size() != sizeof(value)) {
+        return false;
+    }
+
+    memcpy(&value, data.data(), sizeof(value));
+    return true;
+}
+
+void PersistentQueryStore::insert(const Digest &key, uint32_t value) {
+    insert(key, llvm::ArrayRef<uint8_t>((const uint8_t *) &value, sizeof(value)));
+}
+
+/// Arrays are identified by their shape and contents, the caller
+/// tells symbolic arrays of the same shape apart by their position.
+const PersistentQueryStore::Digest &PersistentQueryStore::getDigest(const ArrayPtr &array) {
+    if (auto cached = findCached(m_arrayDigests, m_oldArrayDigests, array.get())) {
+        return cached->second;
+    }
+
+    llvm::MD5 hash;
+    update(hash, array->getSize());
+    update(hash, array->getDomain());
+    update(hash, array->getRange());
+    update(hash, array->isSymbolicArray());
+    for (auto &value : array->getConstantValues()) {
+        update(hash, getDigest(value).digest);
+    }
+
+    auto &ret = m_arrayDigests[array.get()];
+    ret = std::make_pair(array, finalize(hash));
+    return ret.second;
+}
+
+void PersistentQueryStore::addDigest(Builder &builder, const UpdateListPtr &updates) {
+    builder.add(updates->getRoot());
+    for (auto un = updates->getHead(); un; un = un->getNext()) {
+        builder.add(getDigest(un->getIndex()));
+        builder.add(getDigest(un->getValue()));
+    }
+}
+
+const PersistentQueryStore::ExprDigest &PersistentQueryStore::getDigest(const ref<Expr> &e) {
+    if (auto cached = findCached(m_exprDigests, m_oldExprDigests, e)) {
+        return *cached;
+    }
+
+    Builder builder(*this);
+    builder.add((int) e->getKind());
+    builder.add(e->getWidth());
+
+    if (auto ce = dyn_cast<ConstantExpr>(e)) {
+        auto &value = ce->getAPValue();
+        for (unsigned i = 0; i < value.getNumWords(); ++i) {
+            builder.add(value.getRawData()[i]);
+        }
+    } else if (auto re = dyn_cast<ReadExpr>(e)) {
+        addDigest(builder, re->getUpdates());
+    } else if (auto ee = dyn_cast<ExtractExpr>(e)) {
+        builder.add(ee->getOffset());
+    }
+
+    for (unsigned i = 0; i < e->getNumKids(); ++i) {
+        builder.add(getDigest(e->getKid(i)));
+    }
+
+    auto &ret = m_exprDigests[e];
+    ret.digest = builder.finalize();
+    ret.arrays = std::move(builder.arrays);
+    return ret;
+}
+
+/// Constraints are a conjunction, adding their digests gives the same
+/// digest regardless of the order in which the path added them. The digest
+/// of a path is stored in its last node, a query only digests the constraints
+/// added since the last query on the same path.
+std::shared_ptr<const CanonicalPath> PersistentQueryStore::getDigest(const ConditionNodeRef &head) {
+    std::vector<ConditionNodeRef> missing;
+    ConditionNodeRef node = head;
+    while (node->parent() && !node->canonical()) {
+        missing.push_back(node);
+        node = node->parent();
+    }
+
+    auto path = node->canonical();
+    if (!path) {
+        path = std::make_shared<CanonicalPath>();
+        node->setCanonical(path);
+    }
+
+    for (auto it = missing.rbegin(); it != missing.rend(); ++it) {
+        auto next = std::make_shared<CanonicalPath>();
+        next->arrays = path->arrays;
+        next->arrayCount = path->arrayCount;
+
+        // The digest of a constraint must not depend on whether its
+        // arrays already appeared earlier in the path
+        auto &constraint = getDigest((*it)->expr());
+        llvm::MD5 hash;
+        update(hash, constraint.digest);
+        update(hash, (uint32_t) constraint.arrays.size());
+        for (auto &array : constraint.arrays) {
+            uint32_t index;
+            if (auto known = next->arrays.lookup(array)) {
+                index = known->second;
+            } else {
+                index = next->arrayCount++;
+                next->arrays = next->arrays.insert(std::make_pair(array, index));
+            }
+            update(hash, getDigest(array));
+            update(hash, index);
+        }
+
+        next->sum = add(path->sum, klee::finalize(hash));
+        next->count = path->count + 1;
+
+        llvm::MD5 pathHash;
+        update(pathHash, next->sum);
+        update(pathHash, next->count);
+        next->digest = klee::finalize(pathHash);
+
+        (*it)->setCanonical(next);
+        path = next;
+    }
+
+    return path;
+}
+
+/// Continues the numbering of the path's arrays in the query, so that
+/// the key says which arrays the query shares with its constraints.
+void PersistentQueryStore::initBuilder(Builder &builder, const ConstraintManager &constraints,
+                                       const ref<Expr> &query) {
+    // Rotate the caches between queries, the references they
+    // return must stay valid while a key is computed
+    if (m_exprDigests.size() > MAX_EXPR_DIGESTS) {
+        rotate(m_exprDigests, m_oldExprDigests);
+        rotate(m_arrayDigests, m_oldArrayDigests);
+    }
+
+    builder.path = getDigest(constraints.head());
+    builder.add(builder.path->digest);
+    builder.add(getDigest(query));
+}
+
+PersistentQueryStore::Digest PersistentQueryStore::getDigest(const ConstraintManager &constraints,
+                                                             const ref<Expr> &query) {
+    Builder builder(*this);
+    builder.add(VALIDITY_TAG);
+    initBuilder(builder, constraints, query);
+    return builder.finalize();
+}
+
+PersistentQueryStore::Digest PersistentQueryStore::getDigest(const ConstraintManager &constraints,
+                                                             const ref<Expr> &query, const ArrayVec &objects) {
+    Builder builder(*this);
+    builder.add(INITIAL_VALUES_TAG);
+    initBuilder(builder, constraints, query);
+
+    builder.add((uint32_t) objects.size());
+    for (auto &object : objects) {
+        builder.add(object);
+    }
+
+    return builder.finalize();
+}
+
+} // namespace klee
@@ -0,0 +1,122 @@
+//===-- PersistentQueryStore.h ----------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_PERSISTENTQUERYSTORE_H
+#define KLEE_PERSISTENTQUERYSTORE_H
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/util/ExprHashMap.h"
+
+#include <llvm/ADT/ArrayRef.h>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace klee {
+
+class PersistentQueryStore;
+using PersistentQueryStorePtr = std::shared_ptr<PersistentQueryStore>;
+
+///
+/// Content-addressed store of solver results backed by a memory-mapped file.
+///
+/// Keys are digests of a canonical serialization of the constraints and the
+/// query expression. Symbolic arrays are identified by their shape and by
+/// the order in which they first appear along the path and in the query, not
+/// by their names, so the same query matches across runs even if the arrays
+/// were created in a different order.
+///
+/// The file has a fixed size, chosen when it is created, and is allocated
+/// sparsely. It holds an open-addressing table of record offsets followed
+/// by the records themselves. Instances reserve space for a record with an
+/// atomic increment of the tail offset in the shared mapping, write the record
+/// and then publish it in the table. Lookups read the table and the records
+/// in the mapping directly and never make system calls, which lets every
+/// instance of a multi-process run share the same file. Records of instances
+/// that crash before publishing them are never seen. Inserts are dropped once
+/// the file is full.
+///
+class PersistentQueryStore {
+public:
+    typedef std::array<uint8_t, 16> Digest;
+
+    /// Size of the stores created when the caller does not give one
+    static const uint64_t DEFAULT_SIZE = 256 * 1024 * 1024;
+
+private:
+    struct ExprDigest {
+        Digest digest;
+
+        // Arrays referenced by the expression, in the order of
+        // their first appearance in the serialization
+        std::vector<ArrayPtr> arrays;
+    };
+
+    class Builder;
+
+    int m_fd;
+    std::string m_path;
+
+    uint8_t *m_map;
+    uint64_t m_size;
+
+    // Digests of expressions seen so far. Path constraints are shared by
+    // many queries, this avoids serializing them over and over. The caches
+    // keep two generations, entries of the previous generation that are
+    // used again move to the current one and the others are dropped when
+    // the current one fills up.
+    ExprHashMap<ExprDigest> m_exprDigests;
+    ExprHashMap<ExprDigest> m_oldExprDigests;
+
+    std::unordered_map<const Array *, std::pair<ArrayPtr, Digest>> m_arrayDigests;
+    std::unordered_map<const Array *, std::pair<ArrayPtr, Digest>> m_oldArrayDigests;
+
+    PersistentQueryStore(int fd, const std::string &path, uint8_t *map, uint64_t size);
+
+    uint64_t *getSlots() const;
+    const uint8_t *getRecord(const Digest &key) const;
+
+    const Digest &getDigest(const ArrayPtr &array);
+    const ExprDigest &getDigest(const ref<Expr> &e);
+    void addDigest(Builder &builder, const UpdateListPtr &updates);
+    std::shared_ptr<const CanonicalPath> getDigest(const ConditionNodeRef &head);
+
+    void initBuilder(Builder &builder, const ConstraintManager &constraints, const ref<Expr> &query);
+
+public:
+    ~PersistentQueryStore();
+
+    /// Opens the store at the given path, or creates one of the given size.
+    /// An existing store keeps the size it was created with.
+    /// Returns null if the file cannot be used.
+    static PersistentQueryStorePtr open(const std::string &path, uint64_t size = DEFAULT_SIZE);
+
+    /// Key of the validity of query under constraints
+    Digest getDigest(const ConstraintManager &constraints, const ref<Expr> &query);
+
+    /// Key of the initial values of objects for query under constraints
+    Digest getDigest(const ConstraintManager &constraints, const ref<Expr> &query, const ArrayVec &objects);
+
+    /// Finds the record of the given key. The returned data points into
+    /// the mapping and stays valid as long as the store is open.
+    bool lookup(const Digest &key, llvm::ArrayRef<uint8_t> &data) const;
+
+    void insert(const Digest &key, llvm::ArrayRef<uint8_t> data);
+
+    bool lookup(const Digest &key, uint32_t &value) const;
+
+    void insert(const Digest &key, uint32_t value);
+};
+} // namespace klee
+
+#endif
@@ -52,8 +52,10 @@ cl::opt<SolverIncrementalityType> SolverIncrementality(
                clEnumValN(INCREMENTAL_ASSUMPTIONS, "assumptions", "Assumption-based incrementality")),
     cl::init(INCREMENTAL_NONE));
 
-// The counter example cache may have bad interactions with
-// concolic mode. Disabled by default.
+cl::list<std::string> Z3Portfolio("z3-portfolio", cl::CommaSeparated,
+                                  cl::desc("Race these Z3 configurations on worker threads. Each configuration is "
+                                           "incrementality:array-mode, e.g., none:ite,stack:asserts,assumptions:stores"));
+
 cl::opt<bool> UseCexCache("use-cex-cache", cl::init(false), cl::desc("Use counterexample caching"));
 
 cl::opt<int> MinQueryTimeToLog("min-query-time-to-log", cl::init(0), cl::value_desc("milliseconds"),
@@ -92,6 +94,14 @@ cl::opt<bool> UseFastCexSolver("use-fast-cex-solver", cl::init(false));
 
 cl::opt<bool> UseCache("use-cache", cl::init(true), cl::desc("Use validity caching"));
 
+cl::opt<std::string> PersistentCache("persistent-query-cache", cl::init(""),
+                                     cl::desc("Path of an on-disk cache of solver results shared between runs and "
+                                              "instances. Requires -use-cache."));
+
+cl::opt<unsigned> PersistentCacheSize("persistent-query-cache-size", cl::init(256),
+                                      cl::desc("Size in MiB of the persistent query cache file, including its index. "
+                                               "New results are dropped once it is full (default=256)"));
+
 cl::opt<bool> UseIndependentSolver("use-independent-solver", cl::init(true), cl::desc("Use constraint independence"));
 
 cl::opt<bool> DebugValidateSolver("debug-validate-solver", cl::init(false));
@@ -109,9 +119,46 @@ std::filesystem::path DefaultSolverFactory::getOutputFileName(const std::string
     return ret;
 }
 
+#ifdef ENABLE_Z3
+static Z3SolverPtr createZ3Solver(const std::string &config) {
+    auto sep = config.find(':');
+    auto incrementality = config.substr(0, sep);
+    auto arrays = sep == std::string::npos ? "" : config.substr(sep + 1);
+
+    Z3Solver::ArrayMode mode = Z3Solver::ARRAY_DEFAULT;
+    if (arrays == "ite") {
+        mode = Z3Solver::ARRAY_ITE;
+    } else if (arrays == "stores") {
+        mode = Z3Solver::ARRAY_STORES;
+    } else if (arrays == "asserts") {
+        mode = Z3Solver::ARRAY_ASSERTS;
+    } else if (!arrays.empty()) {
+        klee_error("Invalid Z3 array mode in portfolio configuration %s", config.c_str());
+    }
+
+    if (incrementality == "none") {
+        return Z3Solver::createResetSolver(mode);
+    } else if (incrementality == "stack") {
+        return Z3Solver::createStackSolver(mode);
+    } else if (incrementality == "assumptions") {
+        return Z3Solver::createAssumptionSolver(mode);
+    }
+
+    klee_error("Invalid Z3 incrementality in portfolio configuration %s", config.c_str());
+}
+#endif
+
 SolverPtr DefaultSolverFactory::createEndSolver() {
     if (EndSolver == SOLVER_Z3) {
 #ifdef ENABLE_Z3
+        if (!Z3Portfolio.empty()) {
+            std::vector<Z3SolverPtr> solvers;
+            for (const auto &config : Z3Portfolio) {
+                solvers.push_back(createZ3Solver(config));
+            }
+            return createZ3PortfolioSolver(solvers);
+        }
+
         switch (SolverIncrementality) {
             case INCREMENTAL_NONE:
                 return Z3Solver::createResetSolver();
@@ -127,6 +174,27 @@ SolverPtr DefaultSolverFactory::createEndSolver() {
     return NULL;
 }
 
+Z3SolverPtr DefaultSolverFactory::createBackgroundSolver() {
+#ifdef ENABLE_Z3
+    // A portfolio races on its own threads, background checks use its first configuration
+    if (!Z3Portfolio.empty()) {
+        return createZ3Solver(Z3Portfolio[0]);
+    }
+
+    switch (SolverIncrementality) {
+        case INCREMENTAL_NONE:
+            return Z3Solver::createResetSolver();
+        case INCREMENTAL_STACK:
+            return Z3Solver::createStackSolver();
+        case INCREMENTAL_ASSUMPTIONS:
+            return Z3Solver::createAssumptionSolver();
+    }
+#else
+    pabort("Z3 support not compiled");
+#endif
+    return nullptr;
+}
+
 SolverPtr DefaultSolverFactory::decorateSolver(SolverPtr &end_solver) {
     SolverPtr solver = end_solver;
 
@@ -148,12 +216,13 @@ SolverPtr DefaultSolverFactory::decorateSolver(SolverPtr &end_solver) {
     }
 
     if (UseCache) {
-        solver = createCachingSolver(solver);
+        auto cachePath = PersistentCache.empty() ? m_defaultPersistentCache : std::string(PersistentCache);
+        solver = createCachingSolver(solver, cachePath, uint64_t(PersistentCacheSize) * 1024 * 1024);
     }
 
-    // FIXME: The check should be more generic (e.g., enable only for
-    // non-incremental solvers)
-    if (UseIndependentSolver && (EndSolver != SOLVER_Z3)) {
+    // The independent solver keeps its slices in a persistent constraint tree,
+    // so incremental end solvers still see stable prefixes.
+    if (UseIndependentSolver) {
         solver = createIndependentSolver(solver);
     }
 
@@ -13,11 +13,14 @@ namespace klee {
 namespace stats {
 
 auto cexCacheTime = Statistic::create("CexCacheTime", "CCtime");
+auto cexCacheHits = Statistic::create("CexCacheHits", "CChits");
+auto cexCacheMisses = Statistic::create("CexCacheMisses", "CCmisses");
 auto queries = Statistic::create("Queries", "Q");
 auto queriesInvalid = Statistic::create("QueriesInvalid", "Qiv");
 auto queriesValid = Statistic::create("QueriesValid", "Qv");
 auto queryCacheHits = Statistic::create("QueryCacheHits", "QChits");
 auto queryCacheMisses = Statistic::create("QueryCacheMisses", "QCmisses");
+auto queryPersistentCacheHits = Statistic::create("QueryPersistentCacheHits", "QPChits");
 auto queryConstructTime = Statistic::create("QueryConstructTime", "QBtime");
 auto queryConstructs = Statistic::create("QueriesConstructs", "QB");
 auto queryCounterexamples = Statistic::create("QueriesCEX", "Qcex");
@@ -15,12 +15,14 @@
 #include "klee/Solver.h"
 
 #include "klee/Stats/CoreStats.h"
+#include "klee/util/Activity.h"
 
 using namespace llvm;
 using namespace std::chrono;
 
 namespace klee {
 template <typename Func> static bool measureTime(double &queryCost, Func f) {
+    ActivityScope activity(Activity::Solver);
     auto t1 = steady_clock::now();
 
     auto ret = f();
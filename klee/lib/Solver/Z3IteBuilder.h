@@ -39,7 +39,7 @@ namespace klee {
 class Z3IteBuilderCache : public Z3BuilderCache {
 public:
     typedef std::vector<z3::expr> ExprVector;
-    typedef std::pair<const ArrayPtr &, const UpdateNode *> Update;
+    typedef std::pair<ArrayPtr, const UpdateNode *> Update;
     typedef std::pair<Z3_ast, Update> ReadUpdatePair;
 
     virtual bool findArray(const ArrayPtr &root, boost::shared_ptr<ExprVector> &ev) = 0;
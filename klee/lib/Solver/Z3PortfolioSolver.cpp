@@ -0,0 +1,317 @@
+//===-- Z3PortfolioSolver.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Constraints.h"
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprUtil.h"
+
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/MathExtras.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+cl::opt<unsigned> PortfolioMinConstraints("z3-portfolio-min-constraints",
+                                          cl::desc("Queries with fewer constraints are not raced (default=16)"),
+                                          cl::init(16));
+
+cl::opt<unsigned> PortfolioLearnRaces("z3-portfolio-learn-races",
+                                      cl::desc("Number of races per query shape before the most frequent "
+                                               "winner is used alone (default=8)"),
+                                      cl::init(8));
+
+cl::opt<unsigned> PortfolioReraceInterval("z3-portfolio-rerace-interval",
+                                          cl::desc("Race again every N queries of a learned shape, "
+                                                   "in case another configuration became faster (default=64)"),
+                                          cl::init(64));
+} // namespace
+
+class Z3PortfolioSolver : public SolverImpl {
+private:
+    struct Worker {
+        Z3SolverPtr solver;
+        std::thread thread;
+
+        bool pending;
+        bool busy;
+        bool success;
+        bool hasSolution;
+        std::vector<std::vector<unsigned char>> values;
+    };
+
+    /// What the portfolio learned about queries of a given shape
+    struct ShapeInfo {
+        unsigned races;
+        unsigned queries;
+        std::vector<unsigned> wins;
+    };
+
+    std::vector<Worker> m_workers;
+
+    // Serializes accesses to KLEE expressions between the workers
+    std::mutex m_exprLock;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::condition_variable m_done;
+    bool m_quit;
+
+    // The race in progress
+    const Query *m_query;
+    const ArrayVec *m_objects;
+    unsigned m_running;
+    int m_winner;
+
+    std::unordered_map<uint64_t, ShapeInfo> m_shapes;
+
+    Z3PortfolioSolver(const std::vector<Z3SolverPtr> &solvers);
+
+    void run(unsigned index);
+
+    static uint64_t getShape(const Query &query);
+
+    int selectConfig(ShapeInfo &info);
+
+    bool race(const Query &query, const ArrayVec &objects, const std::vector<unsigned> &configs,
+              std::vector<std::vector<unsigned char>> &values, bool &hasSolution, int &winner);
+
+public:
+    ~Z3PortfolioSolver();
+
+    bool computeTruth(const Query &, bool &isValid);
+    bool computeValue(const Query &, ref<Expr> &result);
+    bool computeInitialValues(const Query &query, const ArrayVec &objects,
+                              std::vector<std::vector<unsigned char>> &values, bool &hasSolution);
+
+    static SolverImplPtr create(const std::vector<Z3SolverPtr> &solvers) {
+        return SolverImplPtr(new Z3PortfolioSolver(solvers));
+    }
+};
+
+Z3PortfolioSolver::Z3PortfolioSolver(const std::vector<Z3SolverPtr> &solvers)
+    : m_workers(solvers.size()), m_quit(false), m_query(nullptr), m_objects(nullptr), m_running(0), m_winner(-1) {
+    assert(!solvers.empty());
+
+    for (unsigned i = 0; i < solvers.size(); ++i) {
+        auto &worker = m_workers[i];
+        worker.solver = solvers[i];
+        worker.solver->setExprLock(&m_exprLock);
+        worker.pending = false;
+        worker.busy = false;
+    }
+
+    for (unsigned i = 0; i < m_workers.size(); ++i) {
+        m_workers[i].thread = std::thread(&Z3PortfolioSolver::run, this, i);
+    }
+}
+
+Z3PortfolioSolver::~Z3PortfolioSolver() {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+
+    m_wakeup.notify_all();
+
+    for (auto &worker : m_workers) {
+        worker.thread.join();
+    }
+}
+
+void Z3PortfolioSolver::run(unsigned index) {
+    auto &worker = m_workers[index];
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true) {
+        m_wakeup.wait(lock, [&] { return worker.pending || m_quit; });
+        if (m_quit) {
+            return;
+        }
+
+        worker.pending = false;
+        lock.unlock();
+
+        worker.values.clear();
+        worker.success =
+            worker.solver->impl->computeInitialValues(*m_query, *m_objects, worker.values, worker.hasSolution);
+
+        lock.lock();
+        worker.busy = false;
+
+        if (worker.success && m_winner < 0) {
+            m_winner = index;
+            for (auto &other : m_workers) {
+                if (other.busy) {
+                    other.solver->interrupt();
+                }
+            }
+        }
+
+        --m_running;
+        m_done.notify_all();
+    }
+}
+
+/// The shape of a query is the magnitude of its constraint count
+/// together with the kind of the query expression.
+uint64_t Z3PortfolioSolver::getShape(const Query &query) {
+    uint64_t bucket = Log2_64(query.constraints.size() + 1);
+    return (bucket << 32) | (uint32_t) query.expr->getKind();
+}
+
+/// Returns the configuration to use alone for a shape,
+/// or -1 if all configurations should be raced.
+int Z3PortfolioSolver::selectConfig(ShapeInfo &info) {
+    ++info.queries;
+
+    if (info.races < PortfolioLearnRaces) {
+        return -1;
+    }
+
+    if (PortfolioReraceInterval && (info.queries % PortfolioReraceInterval) == 0) {
+        return -1;
+    }
+
+    unsigned best = 0;
+    for (unsigned i = 1; i < info.wins.size(); ++i) {
+        if (info.wins[i] > info.wins[best]) {
+            best = i;
+        }
+    }
+
+    // Keep racing when there is no clear winner
+    if (info.wins[best] * 4 < info.races * 3) {
+        return -1;
+    }
+
+    return best;
+}
+
+bool Z3PortfolioSolver::race(const Query &query, const ArrayVec &objects, const std::vector<unsigned> &configs,
+                             std::vector<std::vector<unsigned char>> &values, bool &hasSolution, int &winner) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_query = &query;
+    m_objects = &objects;
+    m_winner = -1;
+    m_running = configs.size();
+
+    for (auto i : configs) {
+        m_workers[i].pending = true;
+        m_workers[i].busy = true;
+    }
+
+    m_wakeup.notify_all();
+
+    // The workers reference the query, wait for all of them to stop.
+    // A loser may miss the interrupt if it was sent right before its
+    // check started, so keep interrupting until it gives up.
+    while (m_running > 0) {
+        m_done.wait_for(lock, std::chrono::milliseconds(10));
+        if (m_winner >= 0) {
+            for (auto &worker : m_workers) {
+                if (worker.busy) {
+                    worker.solver->interrupt();
+                }
+            }
+        }
+    }
+
+    winner = m_winner;
+    if (winner < 0) {
+        return false;
+    }
+
+    auto &worker = m_workers[winner];
+    values = std::move(worker.values);
+    hasSolution = worker.hasSolution;
+    return true;
+}
+
+bool Z3PortfolioSolver::computeInitialValues(const Query &query, const ArrayVec &objects,
+                                             std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+    // Small queries are not worth the synchronization
+    if (query.constraints.size() < PortfolioMinConstraints || m_workers.size() == 1) {
+        return m_workers[0].solver->impl->computeInitialValues(query, objects, values, hasSolution);
+    }
+
+    auto &info = m_shapes[getShape(query)];
+    if (info.wins.empty()) {
+        info.wins.resize(m_workers.size());
+    }
+
+    // No worker is running between races, so the selected
+    // configuration can be used from the calling thread.
+    std::vector<unsigned> configs;
+    int selected = selectConfig(info);
+    if (selected >= 0) {
+        if (m_workers[selected].solver->impl->computeInitialValues(query, objects, values, hasSolution)) {
+            return true;
+        }
+    }
+
+    for (unsigned i = 0; i < m_workers.size(); ++i) {
+        if ((int) i != selected) {
+            configs.push_back(i);
+        }
+    }
+
+    int winner;
+    if (!race(query, objects, configs, values, hasSolution, winner)) {
+        return false;
+    }
+
+    ++info.races;
+    ++info.wins[winner];
+    return true;
+}
+
+bool Z3PortfolioSolver::computeTruth(const Query &query, bool &isValid) {
+    ArrayVec objects;
+    std::vector<std::vector<unsigned char>> values;
+    bool hasSolution;
+
+    if (!computeInitialValues(query, objects, values, hasSolution)) {
+        return false;
+    }
+
+    isValid = !hasSolution;
+    return true;
+}
+
+bool Z3PortfolioSolver::computeValue(const Query &query, ref<Expr> &result) {
+    ArrayVec objects;
+    std::vector<std::vector<unsigned char>> values;
+    bool hasSolution;
+
+    findSymbolicObjects(query.expr, objects);
+    if (!computeInitialValues(query.withFalse(), objects, values, hasSolution)) {
+        return false;
+    }
+
+    assert(hasSolution && "state has invalid constraint set");
+
+    AssignmentPtr a = Assignment::create(objects, values);
+    result = a->evaluate(query.expr);
+
+    return true;
+}
+
+SolverPtr klee::createZ3PortfolioSolver(const std::vector<Z3SolverPtr> &solvers) {
+    return Solver::create(Z3PortfolioSolver::create(solvers));
+}
@@ -47,8 +47,11 @@
 
 #include <z3++.h>
 
+#include <condition_variable>
 #include <iostream>
 #include <list>
+#include <mutex>
+#include <thread>
 
 using namespace llvm;
 using boost::scoped_ptr;
@@ -83,12 +86,32 @@ public:
 
     void initializeSolver();
 
+    void interrupt() {
+        // Z3 raises an exception if it gets interrupted outside of a check
+        std::unique_lock<std::mutex> lock(interruptLock_);
+        if (checking_) {
+            context_.interrupt();
+            interrupted_ = true;
+        }
+    }
+
+    void setExprLock(std::mutex *lock) {
+        exprLock_ = lock;
+    }
+
+    void startCheck(const Query &query);
+    bool isCheckDone();
+    bool finishCheck(const ArrayVec &objects, std::vector<std::vector<unsigned char>> &values, bool &hasSolution);
+    void stopChecks();
+
 protected:
-    Z3BaseSolverImpl();
+    Z3BaseSolverImpl(Z3ArrayConsMode arrayMode);
 
     virtual void createBuilderCache() = 0;
 
-    virtual z3::check_result check(const Query &) = 0;
+    /// Asserts the constraints and the negated query expression in the solver.
+    /// Assumption-based solvers return the literals to check under.
+    virtual void prepare(const Query &, z3::expr_vector &assumptions) = 0;
     virtual void postCheck(const Query &) = 0;
 
     void extractModel(const ArrayVec &objects, std::vector<std::vector<unsigned char>> &values);
@@ -114,6 +137,37 @@ protected:
     scoped_ptr<Z3BuilderCache> builder_cache_;
     scoped_ptr<Z3Builder> builder_;
 
+    const Z3ArrayConsMode arrayMode_;
+
+    // Held whenever KLEE expressions are touched, if set
+    std::mutex *exprLock_;
+
+    std::mutex interruptLock_;
+    bool checking_;
+    bool interrupted_;
+
+    z3::check_result runCheck(z3::expr_vector &assumptions);
+
+    bool processResult(const Query &query, z3::check_result result, const ArrayVec &objects,
+                       std::vector<std::vector<unsigned char>> &values, bool &hasSolution);
+
+    // The check started by startCheck(). It runs on checkThread_, which
+    // waits for the next check until stopChecks() is called.
+    z3::expr_vector pendingAssumptions_;
+    ConstraintManager pendingConstraints_;
+    ref<Expr> pendingExpr_;
+    bool checkPending_;
+
+    std::thread checkThread_;
+    std::mutex checkLock_;
+    std::condition_variable checkCond_;
+    bool checkRequested_;
+    bool checkDone_;
+    bool checkQuit_;
+    z3::check_result checkResult_;
+
+    void runChecks();
+
 private:
     void configureSolver();
     void createBuilder();
@@ -126,20 +180,20 @@ public:
     virtual ~Z3StackSolverImpl();
 
 protected:
-    Z3StackSolverImpl();
+    Z3StackSolverImpl(Z3ArrayConsMode arrayMode);
 
     typedef std::list<ConditionNodeRef> ConditionNodeList;
 
     virtual void createBuilderCache();
 
-    virtual z3::check_result check(const Query &);
+    virtual void prepare(const Query &, z3::expr_vector &assumptions);
     virtual void postCheck(const Query &);
 
     scoped_ptr<ConditionNodeList> last_constraints_;
 
 public:
-    static Z3StackSolverImplPtr create() {
-        return Z3StackSolverImplPtr(new Z3StackSolverImpl());
+    static Z3StackSolverImplPtr create(Z3ArrayConsMode arrayMode) {
+        return Z3StackSolverImplPtr(new Z3StackSolverImpl(arrayMode));
     }
 };
 
@@ -150,14 +204,14 @@ public:
     virtual ~Z3ResetSolverImpl();
 
 protected:
-    Z3ResetSolverImpl();
+    Z3ResetSolverImpl(Z3ArrayConsMode arrayMode);
     virtual void createBuilderCache();
-    virtual z3::check_result check(const Query &);
+    virtual void prepare(const Query &, z3::expr_vector &assumptions);
     virtual void postCheck(const Query &);
 
 public:
-    static Z3ResetSolverImplPtr create() {
-        return Z3ResetSolverImplPtr(new Z3ResetSolverImpl());
+    static Z3ResetSolverImplPtr create(Z3ArrayConsMode arrayMode) {
+        return Z3ResetSolverImplPtr(new Z3ResetSolverImpl(arrayMode));
     }
 };
 
@@ -168,9 +222,9 @@ public:
     virtual ~Z3AssumptionSolverImpl();
 
 protected:
-    Z3AssumptionSolverImpl();
+    Z3AssumptionSolverImpl(Z3ArrayConsMode arrayMode);
     virtual void createBuilderCache();
-    virtual z3::check_result check(const Query &);
+    virtual void prepare(const Query &, z3::expr_vector &assumptions);
     virtual void postCheck(const Query &);
 
 private:
@@ -182,29 +236,42 @@ private:
     uint64_t guard_counter_;
 
 public:
-    static Z3AssumptionSolverImplPtr create() {
-        return Z3AssumptionSolverImplPtr(new Z3AssumptionSolverImpl());
+    static Z3AssumptionSolverImplPtr create(Z3ArrayConsMode arrayMode) {
+        return Z3AssumptionSolverImplPtr(new Z3AssumptionSolverImpl(arrayMode));
     }
 };
 
 // Z3Solver ////////////////////////////////////////////////////////////////////
 
-Z3SolverPtr Z3Solver::createResetSolver() {
-    auto impl = Z3ResetSolverImpl::create();
+static Z3ArrayConsMode getArrayConsMode(Z3Solver::ArrayMode mode) {
+    switch (mode) {
+        case Z3Solver::ARRAY_ITE:
+            return Z3_ARRAY_ITE;
+        case Z3Solver::ARRAY_STORES:
+            return Z3_ARRAY_STORES;
+        case Z3Solver::ARRAY_ASSERTS:
+            return Z3_ARRAY_ASSERTS;
+        default:
+            return ArrayConsMode;
+    }
+}
+
+Z3SolverPtr Z3Solver::createResetSolver(ArrayMode mode) {
+    auto impl = Z3ResetSolverImpl::create(getArrayConsMode(mode));
     impl->initializeSolver();
 
     return Z3Solver::create(std::dynamic_pointer_cast<SolverImpl>(impl));
 }
 
-Z3SolverPtr Z3Solver::createStackSolver() {
-    auto impl = Z3StackSolverImpl::create();
+Z3SolverPtr Z3Solver::createStackSolver(ArrayMode mode) {
+    auto impl = Z3StackSolverImpl::create(getArrayConsMode(mode));
     impl->initializeSolver();
 
     return Z3Solver::create(impl);
 }
 
-Z3SolverPtr Z3Solver::createAssumptionSolver() {
-    auto impl = Z3AssumptionSolverImpl::create();
+Z3SolverPtr Z3Solver::createAssumptionSolver(ArrayMode mode) {
+    auto impl = Z3AssumptionSolverImpl::create(getArrayConsMode(mode));
     impl->initializeSolver();
 
     return Z3Solver::create(impl);
@@ -213,12 +280,47 @@ Z3SolverPtr Z3Solver::createAssumptionSolver() {
 Z3Solver::Z3Solver(SolverImplPtr &impl) : Solver(impl) {
 }
 
+void Z3Solver::interrupt() {
+    std::static_pointer_cast<Z3BaseSolverImpl>(impl)->interrupt();
+}
+
+void Z3Solver::setExprLock(std::mutex *lock) {
+    std::static_pointer_cast<Z3BaseSolverImpl>(impl)->setExprLock(lock);
+}
+
+void Z3Solver::startCheck(const Query &query) {
+    std::static_pointer_cast<Z3BaseSolverImpl>(impl)->startCheck(query);
+}
+
+bool Z3Solver::isCheckDone() {
+    return std::static_pointer_cast<Z3BaseSolverImpl>(impl)->isCheckDone();
+}
+
+bool Z3Solver::finishCheck(const ArrayVec &objects, std::vector<std::vector<unsigned char>> &values,
+                           bool &hasSolution) {
+    return std::static_pointer_cast<Z3BaseSolverImpl>(impl)->finishCheck(objects, values, hasSolution);
+}
+
+void Z3Solver::stopChecks() {
+    std::static_pointer_cast<Z3BaseSolverImpl>(impl)->stopChecks();
+}
+
 // Z3BaseSolverImpl ////////////////////////////////////////////////////////////
 
-Z3BaseSolverImpl::Z3BaseSolverImpl() : solver_(context_, "QF_ABV") {
+Z3BaseSolverImpl::Z3BaseSolverImpl(Z3ArrayConsMode arrayMode)
+    : solver_(context_, "QF_ABV"), arrayMode_(arrayMode), exprLock_(nullptr), checking_(false),
+      interrupted_(false), pendingAssumptions_(context_), checkPending_(false), checkRequested_(false),
+      checkDone_(false), checkQuit_(false), checkResult_(z3::unknown) {
 }
 
 Z3BaseSolverImpl::~Z3BaseSolverImpl() {
+    // The result of a check in progress is not needed anymore
+    if (checkPending_) {
+        interrupt();
+        checkPending_ = false;
+    }
+
+    stopChecks();
 }
 
 void Z3BaseSolverImpl::extractModel(const ArrayVec &objects, std::vector<std::vector<unsigned char>> &values) {
@@ -274,13 +376,56 @@ bool Z3BaseSolverImpl::computeValue(const Query &query, ref<Expr> &result) {
     return true;
 }
 
+z3::check_result Z3BaseSolverImpl::runCheck(z3::expr_vector &assumptions) {
+    {
+        std::unique_lock<std::mutex> lock(interruptLock_);
+        checking_ = true;
+    }
+
+    z3::check_result result = assumptions.empty() ? solver_.check() : solver_.check(assumptions);
+
+    std::unique_lock<std::mutex> lock(interruptLock_);
+    checking_ = false;
+
+    // An interrupt that arrives as the check completes stays pending and makes
+    // the next Z3 call fail. Only a new check clears it, so run an empty one.
+    if (interrupted_) {
+        interrupted_ = false;
+        z3::solver(context_).check();
+    }
+
+    return result;
+}
+
 bool Z3BaseSolverImpl::computeInitialValues(const Query &query, const ArrayVec &objects,
                                             std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+    std::unique_lock<std::mutex> lock;
+    if (exprLock_) {
+        lock = std::unique_lock<std::mutex>(*exprLock_);
+    }
+
     ++*stats::queries;
     ++*stats::queryCounterexamples;
 
-    z3::check_result result = check(query);
+    z3::expr_vector assumptions(context_);
+    prepare(query, assumptions);
+
+    // The check itself does not touch KLEE expressions
+    if (lock) {
+        lock.unlock();
+    }
+
+    z3::check_result result = runCheck(assumptions);
+
+    if (exprLock_) {
+        lock.lock();
+    }
+
+    return processResult(query, result, objects, values, hasSolution);
+}
 
+bool Z3BaseSolverImpl::processResult(const Query &query, z3::check_result result, const ArrayVec &objects,
+                                     std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
     switch (result) {
         case z3::unknown:
             postCheck(query);
@@ -297,6 +442,95 @@ bool Z3BaseSolverImpl::computeInitialValues(const Query &query, const ArrayVec &
             ++*stats::queriesInvalid;
             return true;
     }
+
+    return false;
+}
+
+void Z3BaseSolverImpl::startCheck(const Query &query) {
+    assert(!checkPending_ && "A check is already in progress");
+
+    ++*stats::queries;
+    ++*stats::queryCounterexamples;
+
+    pendingConstraints_ = query.constraints;
+    pendingExpr_ = query.expr;
+
+    pendingAssumptions_ = z3::expr_vector(context_);
+    prepare(query, pendingAssumptions_);
+
+    if (!checkThread_.joinable()) {
+        checkThread_ = std::thread(&Z3BaseSolverImpl::runChecks, this);
+    }
+
+    std::unique_lock<std::mutex> lock(checkLock_);
+    checkPending_ = true;
+    checkRequested_ = true;
+    checkDone_ = false;
+    checkCond_.notify_all();
+}
+
+void Z3BaseSolverImpl::runChecks() {
+    std::unique_lock<std::mutex> lock(checkLock_);
+
+    while (true) {
+        checkCond_.wait(lock, [this] { return checkRequested_ || checkQuit_; });
+        if (checkQuit_) {
+            return;
+        }
+
+        checkRequested_ = false;
+        lock.unlock();
+
+        z3::check_result result = runCheck(pendingAssumptions_);
+
+        lock.lock();
+        checkResult_ = result;
+        checkDone_ = true;
+        checkCond_.notify_all();
+    }
+}
+
+bool Z3BaseSolverImpl::isCheckDone() {
+    assert(checkPending_ && "No check in progress");
+
+    std::unique_lock<std::mutex> lock(checkLock_);
+    return checkDone_;
+}
+
+bool Z3BaseSolverImpl::finishCheck(const ArrayVec &objects, std::vector<std::vector<unsigned char>> &values,
+                                   bool &hasSolution) {
+    assert(checkPending_ && "No check in progress");
+
+    z3::check_result result;
+    {
+        std::unique_lock<std::mutex> lock(checkLock_);
+        checkCond_.wait(lock, [this] { return checkDone_; });
+        result = checkResult_;
+    }
+
+    checkPending_ = false;
+    bool ret = processResult(Query(pendingConstraints_, pendingExpr_), result, objects, values, hasSolution);
+
+    pendingConstraints_ = ConstraintManager();
+    pendingExpr_ = ref<Expr>();
+    return ret;
+}
+
+void Z3BaseSolverImpl::stopChecks() {
+    assert(!checkPending_ && "A check is in progress");
+
+    if (!checkThread_.joinable()) {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(checkLock_);
+        checkQuit_ = true;
+        checkCond_.notify_all();
+    }
+
+    checkThread_.join();
+    checkQuit_ = false;
 }
 
 void Z3BaseSolverImpl::configureSolver() {
@@ -317,7 +551,7 @@ void Z3BaseSolverImpl::configureSolver() {
 void Z3BaseSolverImpl::createBuilder() {
     assert(builder_cache_ && "The cache needs to be created first");
 
-    switch (ArrayConsMode) {
+    switch (arrayMode_) {
         case Z3_ARRAY_ITE:
             builder_.reset(new Z3IteBuilder(context_, (Z3IteBuilderCache *) builder_cache_.get()));
             break;
@@ -338,13 +572,14 @@ void Z3BaseSolverImpl::initializeSolver() {
 
 // Z3StackSolverImpl ///////////////////////////////////////////////////////////
 
-Z3StackSolverImpl::Z3StackSolverImpl() : Z3BaseSolverImpl(), last_constraints_(new ConditionNodeList()) {
+Z3StackSolverImpl::Z3StackSolverImpl(Z3ArrayConsMode arrayMode)
+    : Z3BaseSolverImpl(arrayMode), last_constraints_(new ConditionNodeList()) {
 }
 
 Z3StackSolverImpl::~Z3StackSolverImpl() {
 }
 
-z3::check_result Z3StackSolverImpl::check(const Query &query) {
+void Z3StackSolverImpl::prepare(const Query &query, z3::expr_vector &assumptions) {
     if (DebugSolverStack) {
         *klee_message_stream << "[Z3] query size " << query.constraints.size() << '\n';
     }
@@ -395,8 +630,6 @@ z3::check_result Z3StackSolverImpl::check(const Query &query) {
     // Note the negation, since we're checking for validity
     // (i.e., a counterexample)
     solver_.add(!builder_->construct(query.expr));
-
-    return solver_.check();
 }
 
 void Z3StackSolverImpl::postCheck(const Query &) {
@@ -404,7 +637,7 @@ void Z3StackSolverImpl::postCheck(const Query &) {
 }
 
 void Z3StackSolverImpl::createBuilderCache() {
-    switch (ArrayConsMode) {
+    switch (arrayMode_) {
         case Z3_ARRAY_ITE:
             builder_cache_.reset(new Z3IteBuilderCacheNoninc());
             break;
@@ -419,13 +652,13 @@ void Z3StackSolverImpl::createBuilderCache() {
 
 // Z3ResetSolverImpl ///////////////////////////////////////////////////////////
 
-Z3ResetSolverImpl::Z3ResetSolverImpl() : Z3BaseSolverImpl() {
+Z3ResetSolverImpl::Z3ResetSolverImpl(Z3ArrayConsMode arrayMode) : Z3BaseSolverImpl(arrayMode) {
 }
 
 Z3ResetSolverImpl::~Z3ResetSolverImpl() {
 }
 
-z3::check_result Z3ResetSolverImpl::check(const Query &query) {
+void Z3ResetSolverImpl::prepare(const Query &query, z3::expr_vector &assumptions) {
     std::list<ConditionNodeRef> cur_constraints;
 
     for (ConditionNodeRef node = query.constraints.head(), root = query.constraints.root(); node != root;
@@ -439,7 +672,6 @@ z3::check_result Z3ResetSolverImpl::check(const Query &query) {
     }
 
     solver_.add(!builder_->construct(query.expr));
-    return solver_.check();
 }
 
 void Z3ResetSolverImpl::postCheck(const Query &) {
@@ -447,7 +679,7 @@ void Z3ResetSolverImpl::postCheck(const Query &) {
 }
 
 void Z3ResetSolverImpl::createBuilderCache() {
-    switch (ArrayConsMode) {
+    switch (arrayMode_) {
         case Z3_ARRAY_ITE:
             builder_cache_.reset(new Z3IteBuilderCacheNoninc());
             break;
@@ -462,27 +694,25 @@ void Z3ResetSolverImpl::createBuilderCache() {
 
 // Z3AssumptionSolverImpl //////////////////////////////////////////////////////
 
-Z3AssumptionSolverImpl::Z3AssumptionSolverImpl() : Z3BaseSolverImpl(), guard_counter_(0) {
+Z3AssumptionSolverImpl::Z3AssumptionSolverImpl(Z3ArrayConsMode arrayMode)
+    : Z3BaseSolverImpl(arrayMode), guard_counter_(0) {
 }
 
 Z3AssumptionSolverImpl::~Z3AssumptionSolverImpl() {
 }
 
-z3::check_result Z3AssumptionSolverImpl::check(const Query &query) {
+void Z3AssumptionSolverImpl::prepare(const Query &query, z3::expr_vector &assumptions) {
     std::list<ConditionNodeRef> cur_constraints;
     for (ConditionNodeRef node = query.constraints.head(), root = query.constraints.root(); node != root;
          node = node->parent()) {
         cur_constraints.push_front(node);
     }
 
-    z3::expr_vector assumptions(context_);
-
     for (std::list<ConditionNodeRef>::iterator it = cur_constraints.begin(), ie = cur_constraints.end(); it != ie;
          ++it) {
         assumptions.push_back(getAssumption((*it)->expr()));
     }
     assumptions.push_back(getAssumption(Expr::createIsZero(query.expr)));
-    return solver_.check(assumptions);
 }
 
 void Z3AssumptionSolverImpl::postCheck(const Query &) {
@@ -513,7 +743,7 @@ z3::expr Z3AssumptionSolverImpl::getAssumption(ref<Expr> assertion) {
 }
 
 void Z3AssumptionSolverImpl::createBuilderCache() {
-    switch (ArrayConsMode) {
+    switch (arrayMode_) {
         case Z3_ARRAY_ITE:
             builder_cache_.reset(new Z3IteBuilderCacheNoninc());
             break;
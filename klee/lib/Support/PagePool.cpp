@@ -20,40 +20,124 @@
 /// SOFTWARE.
 ///
 
+#include <sched.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <klee/util/PagePool.h>
 
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+
+namespace {
+cl::opt<klee::PagePoolBacking>
+    PagePoolHugePages("page-pool-huge-pages", cl::desc("Back the page pool with huge pages"),
+                      cl::values(clEnumValN(klee::PagePoolBacking::Default, "none", "Regular pages"),
+                                 clEnumValN(klee::PagePoolBacking::TransparentHuge, "transparent",
+                                            "Transparent huge pages"),
+                                 clEnumValN(klee::PagePoolBacking::ExplicitHuge, "explicit",
+                                            "Huge pages reserved in the hugetlbfs pool")),
+                      cl::init(klee::PagePoolBacking::Default));
+
+cl::opt<bool> PagePoolNuma("page-pool-numa", cl::desc("Allocate pages from the NUMA node of the current CPU"),
+                           cl::init(false));
+
+cl::opt<unsigned> PagePoolReserveChunks("page-pool-reserve-chunks",
+                                        cl::desc("Number of free 2MB chunks kept for reuse after their memory "
+                                                 "is returned to the OS (default=4)"),
+                                        cl::init(4));
+
+// From numaif.h, which is not always installed
+const int MPOL_PREFERRED = 1;
+} // namespace
+
 namespace klee {
 
-PagePoolPtr PagePool::s_pool = PagePool::create();
+PagePoolPtr PagePool::s_pool;
 
 const uint64_t PagePoolDesc::POOL_PAGE_COUNT = 2 * 1024 * 1024 / 4096;
 const uint64_t PagePoolDesc::POOL_PAGE_SIZE = PagePoolDesc::POOL_PAGE_COUNT * 4096;
 
-Pages::Pages(unsigned numPages) : m_refCount(0), m_buffer(nullptr), m_size(0) {
-    assert(numPages > 0);
+PagePoolOptions PagePoolOptions::get() {
+    PagePoolOptions ret;
+    ret.backing = PagePoolHugePages;
+    ret.numaAware = PagePoolNuma;
+    ret.reserveChunks = PagePoolReserveChunks;
+    return ret;
+}
+
+Pages::Pages(unsigned numPages, PagePoolBacking backing, unsigned node)
+    : m_refCount(0), m_firstUnused(0), m_buffer(nullptr), m_size(0), m_mappedSize(0), m_node(node),
+      m_poolIndex(-1) {
+    assert(numPages > 0 && numPages <= 0x10000);
     m_size = numPages * PAGE_SIZE;
-    m_buffer = (uint8_t *) mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (m_buffer == MAP_FAILED) {
+    map(backing);
+
+    m_pageStatus = BitArray::create(numPages, true);
+}
+
+/// Maps a buffer aligned on the size of a pool chunk
+void Pages::map(PagePoolBacking backing) {
+    if (backing == PagePoolBacking::ExplicitHuge) {
+        m_buffer = (uint8_t *) mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                                    -1, 0);
+        if (m_buffer != MAP_FAILED) {
+            m_mappedSize = m_size;
+            return;
+        }
+
+        static bool warned = false;
+        if (!warned) {
+            llvm::errs() << "PagePool: could not get huge pages, using regular pages\n";
+            warned = true;
+        }
+    }
+
+    auto alignment = PagePoolDesc::POOL_PAGE_SIZE;
+    auto size = m_size + alignment;
+    auto buffer = (uint8_t *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
         throw std::bad_alloc();
     }
-    m_pageStatus = BitArray::create(numPages, true);
+
+    // Trim the mapping so that it starts on an aligned address
+    auto start = (uint8_t *) (((uintptr_t) buffer + alignment - 1) & ~(alignment - 1));
+    if (start > buffer) {
+        munmap(buffer, start - buffer);
+    }
+    if (buffer + size > start + m_size) {
+        munmap(start + m_size, buffer + size - (start + m_size));
+    }
+
+    m_buffer = start;
+    m_mappedSize = m_size;
+
+    if (backing == PagePoolBacking::TransparentHuge) {
+        madvise(m_buffer, m_size, MADV_HUGEPAGE);
+    }
 }
 
 Pages::~Pages() {
-    munmap(m_buffer, m_size);
+    munmap(m_buffer, m_mappedSize);
 }
 
 uint8_t *Pages::alloc() {
     unsigned index;
-    if (!m_pageStatus->findFirstSet(index)) {
+    if (!m_freeList.empty()) {
+        index = m_freeList.back();
+        m_freeList.pop_back();
+    } else if (m_firstUnused < m_pageStatus->getBitCount()) {
+        index = m_firstUnused++;
+    } else {
         return nullptr;
     }
 
+    assert(m_pageStatus->get(index));
     m_pageStatus->unset(index);
     auto ret = getBuffer() + index * PAGE_SIZE;
     assert(ret >= getBuffer());
@@ -66,48 +150,116 @@ void Pages::free(uint8_t *addr) {
     auto page = offset / PAGE_SIZE;
     assert(!m_pageStatus->get(page));
     m_pageStatus->set(page);
+    m_freeList.push_back(page);
+}
+
+void Pages::release() {
+    assert(empty());
+    madvise(m_buffer, m_size, MADV_DONTNEED);
+}
+
+unsigned PagePool::getCurrentNode() const {
+    if (!m_options.numaAware) {
+        return 0;
+    }
+
+    // sched_getcpu() goes through the vDSO, only the node of a new CPU needs a system call
+    int cpu = sched_getcpu();
+    if (cpu >= 0 && (unsigned) cpu < m_cpuNodes.size() && m_cpuNodes[cpu] >= 0) {
+        return m_cpuNodes[cpu];
+    }
+
+    unsigned callCpu, node;
+    if (syscall(SYS_getcpu, &callCpu, &node, nullptr) < 0 || node >= sizeof(unsigned long) * 8) {
+        return 0;
+    }
+
+    // The thread may have moved in between, so record the CPU the system call ran on
+    if (callCpu >= m_cpuNodes.size()) {
+        m_cpuNodes.resize(callCpu + 1, -1);
+    }
+    m_cpuNodes[callCpu] = node;
+
+    return node;
 }
 
-PagesPtr PagePool::allocatePages() {
-    auto pages = Pages::create(PagePoolDesc::POOL_PAGE_COUNT);
+PagesPtr PagePool::allocatePages(unsigned node) {
+    PagesPtr pages;
+
+    for (unsigned i = 0; i < m_reserve.size(); ++i) {
+        if (m_reserve[i]->getNode() == node) {
+            pages = m_reserve[i];
+            m_reserve[i] = m_reserve.back();
+            m_reserve.pop_back();
+            break;
+        }
+    }
+
+    if (!pages) {
+        pages = Pages::create(PagePoolDesc::POOL_PAGE_COUNT, m_options.backing, node);
+
+        // Pages are placed when they are first touched, this only sets the preferred node
+        if (m_options.numaAware) {
+            unsigned long mask = 1ul << node;
+            syscall(SYS_mbind, pages->getBuffer(), PagePoolDesc::POOL_PAGE_SIZE, MPOL_PREFERRED, &mask,
+                    sizeof(mask) * 8, 0);
+        }
+    }
+
     auto start = (uintptr_t) pages->getBuffer();
     m_map[start] = pages;
-    m_freePages[start] = pages;
+    addFreePages(pages);
     return pages;
 }
 
+void PagePool::addFreePages(const PagesPtr &pages) {
+    assert(pages->m_poolIndex < 0);
+    auto node = pages->getNode();
+    if (node >= m_freePages.size()) {
+        m_freePages.resize(node + 1);
+    }
+
+    auto &list = m_freePages[node];
+    pages->m_poolIndex = list.size();
+    list.push_back(pages);
+}
+
+void PagePool::removeFreePages(const PagesPtr &pages) {
+    assert(pages->m_poolIndex >= 0);
+    auto &list = m_freePages[pages->getNode()];
+    auto index = pages->m_poolIndex;
+
+    list[index] = list.back();
+    list[index]->m_poolIndex = index;
+    list.pop_back();
+    pages->m_poolIndex = -1;
+}
+
 uint8_t *PagePool::alloc() {
     PagesPtr pages;
-    auto fp = m_freePages.begin();
-    if (fp == m_freePages.end()) {
-        pages = allocatePages();
+    auto node = getCurrentNode();
+    if (node >= m_freePages.size() || m_freePages[node].empty()) {
+        pages = allocatePages(node);
     } else {
-        pages = fp->second;
+        pages = m_freePages[node].back();
     }
 
     auto ret = pages->alloc();
     if (pages->full()) {
-        m_freePages.erase((uintptr_t) pages->getBuffer());
+        removeFreePages(pages);
     }
     return ret;
 }
 
 void PagePool::free(uint8_t *_ptr) {
     PagesPtr page;
-    uintptr_t start;
-
-    if (m_cachedPages) {
-        auto buffer = m_cachedPages->getBuffer();
-        if (_ptr >= buffer && _ptr < buffer + PagePoolDesc::POOL_PAGE_SIZE) {
-            page = m_cachedPages;
-            start = (uintptr_t) m_cachedPages->getBuffer();
-        }
-    }
+    uintptr_t start = (uintptr_t) _ptr & ~(PagePoolDesc::POOL_PAGE_SIZE - 1);
 
-    if (!page) {
-        auto it = m_map.find((uintptr_t) _ptr);
+    if (m_cachedPages && (uintptr_t) m_cachedPages->getBuffer() == start) {
+        page = m_cachedPages;
+    } else {
+        auto it = m_map.find(start);
         assert(it != m_map.end());
-        start = it->first;
         page = it->second;
         m_cachedPages = page;
     }
@@ -116,12 +268,17 @@ void PagePool::free(uint8_t *_ptr) {
     page->free(_ptr);
 
     if (page->empty()) {
-        m_freePages.erase(start);
+        removeFreePages(page);
         m_map.erase(start);
-    } else {
-        if (full) {
-            m_freePages[start] = page;
+        m_cachedPages = nullptr;
+
+        // Keep some chunks to avoid mapping them again
+        if (m_reserve.size() < m_options.reserveChunks) {
+            page->release();
+            m_reserve.push_back(page);
         }
+    } else if (full) {
+        addFreePages(page);
     }
 }
 
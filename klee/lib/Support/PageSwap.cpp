@@ -0,0 +1,135 @@
+///
+/// Copyright (C) 2020, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <klee/util/PageSwap.h>
+
+#include <llvm/Support/raw_ostream.h>
+
+namespace klee {
+
+std::unique_ptr<PageSwap> PageSwap::s_swap;
+
+PageSwap::File::~File() {
+    munmap(map, slotCount * PAGE_SIZE);
+}
+
+void PageSwap::initialize(const std::string &directory, uint64_t maxSize) {
+    s_swap.reset(new PageSwap(directory, maxSize));
+}
+
+PageSwap::FilePtr PageSwap::createFile() {
+    std::string path = m_directory + "/swap-XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back(0);
+
+    int fd = mkstemp(name.data());
+    if (fd < 0) {
+        llvm::errs() << "PageSwap: could not create " << path << ": " << strerror(errno) << "\n";
+        return nullptr;
+    }
+
+    // The mapping keeps the file alive
+    unlink(name.data());
+
+    auto slotCount = m_maxSize / PAGE_SIZE;
+    auto size = slotCount * PAGE_SIZE;
+
+    // The file is sparse, its blocks are allocated when pages are written
+    if (ftruncate(fd, size) < 0) {
+        llvm::errs() << "PageSwap: could not resize swap file: " << strerror(errno) << "\n";
+        close(fd);
+        return nullptr;
+    }
+
+    auto map = (uint8_t *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        llvm::errs() << "PageSwap: could not map swap file: " << strerror(errno) << "\n";
+        return nullptr;
+    }
+
+    return std::make_shared<File>(map, slotCount);
+}
+
+bool PageSwap::write(const uint8_t *page, Slot &slot) {
+    assert(!slot);
+
+    if (!m_file) {
+        m_file = createFile();
+        if (!m_file) {
+            return false;
+        }
+    }
+
+    uint64_t index;
+    if (!m_file->freeSlots.empty()) {
+        index = m_file->freeSlots.back();
+        m_file->freeSlots.pop_back();
+    } else if (m_file->firstUnused < m_file->slotCount) {
+        index = m_file->firstUnused++;
+    } else {
+        return false;
+    }
+
+    memcpy(m_file->map + index * PAGE_SIZE, page, PAGE_SIZE);
+    slot.file = m_file;
+    slot.index = index;
+    ++m_swappedPages;
+    return true;
+}
+
+void PageSwap::read(Slot &slot, uint8_t *page) {
+    assert(slot);
+    memcpy(page, slot.file->map + slot.index * PAGE_SIZE, PAGE_SIZE);
+    release(slot);
+}
+
+void PageSwap::release(Slot &slot) {
+    assert(slot);
+
+    // The other process may still read slots of a frozen file
+    auto &file = slot.file;
+    if (!file->frozen) {
+        madvise(file->map + slot.index * PAGE_SIZE, PAGE_SIZE, MADV_REMOVE);
+        file->freeSlots.push_back(slot.index);
+    }
+
+    slot = Slot();
+    --m_swappedPages;
+}
+
+void PageSwap::onProcessFork() {
+    if (m_file) {
+        m_file->frozen = true;
+        m_file = nullptr;
+    }
+}
+
+} // namespace klee
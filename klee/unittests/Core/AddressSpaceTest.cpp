@@ -356,4 +356,74 @@ TEST(AddressSpaceTest, ObjectSplit) {
     }
 }
 
+TEST(AddressSpaceTest, WriteAfterCopy) {
+    Context::initialize(true, klee::Expr::Int64);
+
+    TestAsNotify notify;
+    auto as = std::make_unique<AddressSpace>(&notify);
+    InitAs(notify, *as);
+
+    auto array = Array::create("symb", 8, nullptr, nullptr, "symb");
+    auto expr = ReadExpr::createTempRead(array, klee::Expr::Int64);
+    EXPECT_CALL(notify, addressSpaceSymbolicStatusChange).Times(1);
+    EXPECT_EQ(as->write(0x2000, expr, nullptr), true);
+
+    TestAsNotify copyNotify;
+    auto copy = std::make_unique<AddressSpace>(*as);
+    copy->state = &copyNotify;
+
+    // Overwrite one symbolic and one concrete byte in the copy
+    auto value = klee::ConstantExpr::create(0xab, klee::Expr::Int8);
+    EXPECT_CALL(copyNotify, addressSpaceChange).Times(1);
+    EXPECT_EQ(copy->write(0x2000, value, nullptr), true);
+    EXPECT_EQ(copy->write(0x2010, value, nullptr), true);
+
+    EXPECT_EQ(copy->symbolic(0x2000, 1), false);
+    EXPECT_EQ(copy->symbolic(0x2001, 7), true);
+    EXPECT_EQ(dyn_cast<ConstantExpr>(copy->read(0x2000, Expr::Int8))->getZExtValue(), 0xabu);
+    EXPECT_EQ(dyn_cast<ConstantExpr>(copy->read(0x2010, Expr::Int8))->getZExtValue(), 0xabu);
+
+    // The original object must not change
+    EXPECT_EQ(as->symbolic(0x2000, 8), true);
+    EXPECT_EQ(as->read(0x2000, Expr::Int8), ExtractExpr::create(expr, 0, Expr::Int8));
+    EXPECT_EQ(dyn_cast<ConstantExpr>(as->read(0x2010, Expr::Int8))->getZExtValue(), 0u);
+}
+
+TEST(AddressSpaceTest, ShareObject) {
+    TestAsNotify notify;
+    auto as = std::make_unique<AddressSpace>(&notify);
+    InitAs(notify, *as);
+
+    TestAsNotify copyNotify;
+    auto copy = std::make_unique<AddressSpace>(*as);
+    copy->state = &copyNotify;
+
+    // Both address spaces get a private copy with the same contents
+    auto in = GetBuffer(0x1000);
+    EXPECT_CALL(notify, addressSpaceChange).Times(1);
+    EXPECT_EQ(as->write(0x2000, in.data(), in.size()), true);
+    EXPECT_CALL(copyNotify, addressSpaceChange).Times(1);
+    EXPECT_EQ(copy->write(0x2000, in.data(), in.size()), true);
+
+    auto os = as->findObject(0x2000);
+    auto copyOs = copy->findObject(0x2000);
+    EXPECT_NE(os, copyOs);
+
+    auto shared = ObjectStatePtr(const_cast<ObjectState *>(os.get()));
+    shared->setOwnerId(0);
+    EXPECT_CALL(copyNotify, addressSpaceChange).Times(1);
+    copy->shareObject(copyOs, shared);
+    EXPECT_EQ(copy->findObject(0x2000), os);
+
+    // Writing breaks the sharing again
+    uint8_t value = 0xab;
+    EXPECT_CALL(copyNotify, addressSpaceChange).Times(1);
+    EXPECT_EQ(copy->write(0x2000, &value, sizeof(value)), true);
+    EXPECT_NE(copy->findObject(0x2000), os);
+
+    auto out = std::vector<uint8_t>(in.size());
+    EXPECT_EQ(as->read(0x2000, out.data(), out.size(), nullptr), true);
+    EXPECT_EQ(out, in);
+}
+
 } // namespace
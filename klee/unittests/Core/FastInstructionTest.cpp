@@ -0,0 +1,286 @@
+///
+/// Copyright (C) 2022, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <iostream>
+
+#include <klee/Executor.h>
+#include <klee/ExecutionState.h>
+#include <klee/Expr.h>
+#include <klee/Internal/Module/KInstruction.h>
+#include <klee/Internal/Module/KModule.h>
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+
+// Exposes the instruction execution entry points of the executor
+class TestExecutor : public Executor {
+public:
+    TestExecutor(LLVMContext &context, const KModulePtr &module) : Executor(context) {
+        kmodule = module;
+    }
+
+    using Executor::countFunctionCall;
+    using Executor::eval;
+    using Executor::executeFastInstruction;
+    using Executor::executeInstruction;
+};
+
+class FastInstructionTest : public ::testing::Test {
+protected:
+    LLVMContext m_context;
+    std::unique_ptr<Module> m_module;
+    KModulePtr m_kmodule;
+    KFunction *m_kf;
+    std::unique_ptr<TestExecutor> m_executor;
+
+    // Straight-line code similar to what the translator generates for flag computations
+    Function *createFunction() {
+        auto i64 = Type::getInt64Ty(m_context);
+        auto i32 = Type::getInt32Ty(m_context);
+        auto i8 = Type::getInt8Ty(m_context);
+        auto type = FunctionType::get(i64, {i64, i64}, false);
+        auto f = Function::Create(type, Function::ExternalLinkage, "tb", m_module.get());
+        auto bb = BasicBlock::Create(m_context, "entry", f);
+        IRBuilder<> b(bb);
+
+        auto a = &*f->arg_begin();
+        auto c = &*(f->arg_begin() + 1);
+
+        auto v = b.CreateAdd(a, c);
+        v = b.CreateMul(v, b.getInt64(0x9e3779b97f4a7c15ull));
+        v = b.CreateXor(v, b.CreateLShr(v, b.getInt64(29)));
+        auto lo = b.CreateTrunc(v, i32);
+        auto hi = b.CreateTrunc(b.CreateLShr(v, b.getInt64(32)), i32);
+        auto sum = b.CreateSub(lo, hi);
+        auto div = b.CreateUDiv(sum, b.CreateOr(hi, b.getInt32(1)));
+        auto rem = b.CreateSRem(b.CreateSExt(b.CreateTrunc(sum, i8), i32), b.getInt32(-7));
+        auto cmp = b.CreateICmpSLT(sum, b.getInt32(0));
+        auto sel = b.CreateSelect(cmp, div, rem);
+        auto shifted = b.CreateAShr(b.CreateShl(sel, b.getInt32(3)), b.getInt32(2));
+        auto eq = b.CreateZExt(b.CreateICmpEQ(shifted, lo), i64);
+        auto res = b.CreateAnd(b.CreateSExt(shifted, i64), b.getInt64(0xffffffff0000ffffull));
+        b.CreateRet(b.CreateOr(res, b.CreateShl(eq, b.getInt64(63))));
+        return f;
+    }
+
+    void SetUp() override {
+        m_module = std::make_unique<Module>("test", m_context);
+        m_module->setDataLayout("e-m:e-i64:64-f80:128-n8:16:32:64-S128");
+        auto f = createFunction();
+
+        m_kmodule = KModule::create(m_module.get());
+        m_kf = m_kmodule->updateModuleWithFunction(f);
+
+        GlobalAddresses addresses;
+        m_kmodule->bindModuleConstants(addresses);
+
+        m_executor = std::make_unique<TestExecutor>(m_context, m_kmodule);
+    }
+
+    void setArguments(ExecutionState &state, const ref<Expr> &a, const ref<Expr> &b) {
+        state.stack.back().locals[0].value = a;
+        state.stack.back().locals[1].value = b;
+    }
+
+    KInstruction *findInstruction(unsigned opcode) {
+        for (auto ki : m_kf->getInstructions()) {
+            if (ki->inst->getOpcode() == opcode) {
+                return ki;
+            }
+        }
+
+        ADD_FAILURE() << "No instruction with opcode " << opcode;
+        return nullptr;
+    }
+
+    // Runs the function through the executor, with or without the pre-decoded form
+    uint64_t execute(uint64_t a, uint64_t b) {
+        ExecutionState state(m_kf);
+        setArguments(state, klee::ConstantExpr::create(a, Expr::Int64), klee::ConstantExpr::create(b, Expr::Int64));
+
+        for (auto ki : m_kf->getInstructions()) {
+            if (isa<ReturnInst>(ki->inst)) {
+                return cast<klee::ConstantExpr>(m_executor->eval(ki, 0, state).value)->getZExtValue();
+            }
+
+            m_executor->executeInstruction(state, ki);
+        }
+
+        ADD_FAILURE() << "Function has no return instruction";
+        return 0;
+    }
+
+    // Runs every instruction through the fast path and checks that it produces
+    // the same value as the interpreter does without the pre-decoded form.
+    uint64_t run(uint64_t a, uint64_t b) {
+        ExecutionState state(m_kf);
+        setArguments(state, klee::ConstantExpr::create(a, Expr::Int64), klee::ConstantExpr::create(b, Expr::Int64));
+
+        auto &instructions = m_kf->getInstructions();
+        for (unsigned i = 0; i < instructions.size(); ++i) {
+            auto ki = instructions[i];
+            if (isa<ReturnInst>(ki->inst)) {
+                return cast<klee::ConstantExpr>(m_executor->eval(ki, 0, state).value)->getZExtValue();
+            }
+
+            auto fast = ki->fast;
+            ki->fast = nullptr;
+            m_executor->executeInstruction(state, ki);
+            ki->fast = fast;
+            auto expected = state.getDestCell(ki).value;
+
+            state.getDestCell(ki).value = ref<Expr>();
+            EXPECT_TRUE(m_executor->executeFastInstruction(state, ki)) << i;
+            EXPECT_EQ(expected, state.getDestCell(ki).value) << i << ": " << std::hex << a << " " << b;
+        }
+
+        ADD_FAILURE() << "Function has no return instruction";
+        return 0;
+    }
+};
+
+TEST_F(FastInstructionTest, AllInstructionsDecoded) {
+    m_kf->createFastInstructions(*m_kmodule);
+
+    auto &instructions = m_kf->getInstructions();
+    for (unsigned i = 0; i < instructions.size() && !isa<ReturnInst>(instructions[i]->inst); ++i) {
+        EXPECT_NE(instructions[i]->fast, nullptr) << i;
+    }
+}
+
+TEST_F(FastInstructionTest, DecodedAfterThreshold) {
+    auto add = findInstruction(Instruction::Add);
+    ASSERT_NE(add, nullptr);
+
+    unsigned calls = 0;
+    while (!add->fast) {
+        m_executor->countFunctionCall(m_kf);
+        ASSERT_LT(++calls, 1000u);
+    }
+
+    EXPECT_GT(calls, 1u);
+}
+
+TEST_F(FastInstructionTest, UndefinedResults) {
+    KFastInstruction fi = {};
+    fi.numOperands = 2;
+    fi.width = fi.operandWidth = 32;
+    uint64_t result;
+
+    uint64_t zero[] = {5, 0};
+    fi.opcode = KFastInstruction::UDiv;
+    EXPECT_FALSE(fi.evaluate(zero, result));
+    fi.opcode = KFastInstruction::SRem;
+    EXPECT_FALSE(fi.evaluate(zero, result));
+
+    uint64_t shift[] = {1, 32};
+    fi.opcode = KFastInstruction::Shl;
+    EXPECT_FALSE(fi.evaluate(shift, result));
+
+    uint64_t neg[] = {0xfffffff0, 3};
+    fi.opcode = KFastInstruction::AShr;
+    EXPECT_TRUE(fi.evaluate(neg, result));
+    EXPECT_EQ(result, 0xfffffffeu);
+}
+
+TEST_F(FastInstructionTest, MatchesInterpreter) {
+    m_kf->createFastInstructions(*m_kmodule);
+
+    uint64_t a = 1, b = 0x123456789;
+    for (unsigned i = 0; i < 1000; ++i) {
+        run(a, b);
+        a = a * 6364136223846793005ull + 1442695040888963407ull;
+        b ^= a >> 17;
+    }
+}
+
+TEST_F(FastInstructionTest, SymbolicOperands) {
+    m_kf->createFastInstructions(*m_kmodule);
+
+    auto array = Array::create("symb", 8, nullptr, nullptr, "symb");
+    ExecutionState state(m_kf);
+    setArguments(state, ReadExpr::createTempRead(array, Expr::Int64), klee::ConstantExpr::create(1, Expr::Int64));
+
+    auto add = findInstruction(Instruction::Add);
+    ASSERT_NE(add, nullptr);
+    EXPECT_FALSE(m_executor->executeFastInstruction(state, add));
+    m_executor->executeInstruction(state, add);
+    EXPECT_FALSE(isa<klee::ConstantExpr>(state.getDestCell(add).value));
+}
+
+TEST_F(FastInstructionTest, SelectForwardsSymbolicValue) {
+    m_kf->createFastInstructions(*m_kmodule);
+
+    auto array = Array::create("symb", 4, nullptr, nullptr, "symb");
+    auto symbolic = ReadExpr::createTempRead(array, Expr::Int32);
+    auto select = findInstruction(Instruction::Select);
+    ASSERT_NE(select, nullptr);
+    ASSERT_NE(select->fast, nullptr);
+
+    ExecutionState state(m_kf);
+    auto &locals = state.stack.back().locals;
+    locals[select->operands[0]].value = klee::ConstantExpr::create(1, Expr::Bool);
+    locals[select->operands[1]].value = symbolic;
+    locals[select->operands[2]].value = klee::ConstantExpr::create(7, Expr::Int32);
+
+    EXPECT_TRUE(m_executor->executeFastInstruction(state, select));
+    EXPECT_EQ(state.getDestCell(select).value, symbolic);
+
+    locals[select->operands[0]].value = EqExpr::create(symbolic, klee::ConstantExpr::create(0, Expr::Int32));
+    EXPECT_FALSE(m_executor->executeFastInstruction(state, select));
+}
+
+// Compares the executor with and without the pre-decoded form.
+// Run with --gtest_also_run_disabled_tests.
+TEST_F(FastInstructionTest, DISABLED_Benchmark) {
+    const unsigned iterations = 20000;
+
+    uint64_t results[2] = {0, 0};
+    double times[2];
+
+    for (unsigned fast = 0; fast < 2; ++fast) {
+        if (fast) {
+            m_kf->createFastInstructions(*m_kmodule);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < iterations; ++i) {
+            results[fast] += execute(i, ~(uint64_t) i);
+        }
+        auto end = std::chrono::steady_clock::now();
+        times[fast] = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    std::cout << "interpreter: " << times[0] << " ms, pre-decoded: " << times[1] << " ms\n";
+    EXPECT_EQ(results[0], results[1]);
+}
+
+} // namespace
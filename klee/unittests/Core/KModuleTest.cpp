@@ -0,0 +1,144 @@
+///
+/// Copyright (C) 2022, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#include "gtest/gtest.h"
+
+#include <klee/Context.h>
+#include <klee/Expr.h>
+#include <klee/Internal/Module/KInstruction.h>
+#include <klee/Internal/Module/KModule.h>
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+
+class KModuleTest : public ::testing::Test {
+protected:
+    LLVMContext m_context;
+    std::unique_ptr<Module> m_module;
+    KModulePtr m_kmodule;
+    GlobalAddresses m_addresses;
+
+    Function *declare(const std::string &name) {
+        auto i64 = Type::getInt64Ty(m_context);
+        auto type = FunctionType::get(i64, {i64}, false);
+        return Function::Create(type, Function::ExternalLinkage, name, m_module.get());
+    }
+
+    // Similar to a translation block that calls a helper
+    Function *createTb(const std::string &name, Function *helper, uint64_t constant = 0x1234) {
+        auto f = declare(name);
+        auto bb = BasicBlock::Create(m_context, "entry", f);
+        IRBuilder<> b(bb);
+        auto v = b.CreateCall(helper, {b.CreateAdd(&*f->arg_begin(), b.getInt64(constant))});
+        b.CreateRet(b.CreateXor(v, b.getInt64(constant)));
+        return f;
+    }
+
+    uint64_t getOperand(const KInstruction *ki, unsigned i) {
+        return cast<klee::ConstantExpr>(m_kmodule->getConstant(-ki->operands[i] - 2).value)->getZExtValue();
+    }
+
+    void SetUp() override {
+        Context::initialize(true, Expr::Int64);
+        m_module = std::make_unique<Module>("test", m_context);
+        m_module->setDataLayout("e-m:e-i64:64-f80:128-n8:16:32:64-S128");
+        m_kmodule = KModule::create(m_module.get());
+        m_kmodule->bindModuleConstants(m_addresses);
+    }
+};
+
+TEST_F(KModuleTest, BindOnlyReferencedFunctions) {
+    auto helper = declare("helper");
+    auto unused = declare("unused");
+    auto tb = createTb("tb", helper);
+
+    auto kf = m_kmodule->bindFunctionConstants(m_addresses, tb);
+    ASSERT_NE(kf, nullptr);
+    EXPECT_EQ(m_kmodule->bindFunctionConstants(m_addresses, tb), kf);
+
+    ASSERT_EQ(m_addresses.count(helper), 1u);
+    EXPECT_EQ(m_addresses[helper]->getZExtValue(), (uintptr_t) helper);
+    EXPECT_EQ(m_addresses.count(unused), 0u);
+
+    // The call operand evaluates to the helper's address
+    auto call = kf->getInstructions()[1];
+    ASSERT_TRUE(isa<CallInst>(call->inst));
+    ASSERT_LT(call->operands[0], -1);
+    EXPECT_EQ(m_kmodule->getConstant(-call->operands[0] - 2).value, m_addresses[helper]);
+}
+
+TEST_F(KModuleTest, RemoveFunctions) {
+    auto helper = declare("helper");
+    auto tb1 = createTb("tb1", helper);
+    auto tb2 = createTb("tb2", helper);
+
+    m_kmodule->bindFunctionConstants(m_addresses, tb1);
+    auto kf2 = m_kmodule->bindFunctionConstants(m_addresses, tb2);
+
+    m_kmodule->removeFunctions({tb1});
+    EXPECT_EQ(m_module->getFunction("tb1"), nullptr);
+    EXPECT_EQ(m_kmodule->getKFunction(tb1), nullptr);
+    EXPECT_EQ(m_kmodule->getKFunction(tb2), kf2);
+
+    // Constants shared with the removed function are still valid
+    auto tb3 = createTb("tb3", helper);
+    auto kf3 = m_kmodule->bindFunctionConstants(m_addresses, tb3);
+    auto add = kf3->getInstructions()[0];
+    ASSERT_LT(add->operands[1], -1);
+    EXPECT_EQ(cast<klee::ConstantExpr>(m_kmodule->getConstant(-add->operands[1] - 2).value)->getZExtValue(), 0x1234u);
+}
+
+TEST_F(KModuleTest, FreeUnusedConstants) {
+    auto helper = declare("helper");
+    auto tb1 = createTb("tb1", helper, 0x1111);
+    auto tb2 = createTb("tb2", helper, 0x2222);
+
+    auto kf1 = m_kmodule->bindFunctionConstants(m_addresses, tb1);
+    auto kf2 = m_kmodule->bindFunctionConstants(m_addresses, tb2);
+    int unique = kf1->getInstructions()[0]->operands[1];
+    int shared = kf1->getInstructions()[1]->operands[0];
+    ASSERT_LT(unique, -1);
+    ASSERT_EQ(kf2->getInstructions()[1]->operands[0], shared);
+
+    // The constant only used by tb1 is freed and its id goes to the next new constant
+    m_kmodule->removeFunctions({tb1});
+    auto tb3 = createTb("tb3", helper, 0x3333);
+    auto kf3 = m_kmodule->bindFunctionConstants(m_addresses, tb3);
+
+    auto add = kf3->getInstructions()[0];
+    EXPECT_EQ(add->operands[1], unique);
+    EXPECT_EQ(getOperand(add, 1), 0x3333u);
+
+    auto call = kf3->getInstructions()[1];
+    EXPECT_EQ(call->operands[0], shared);
+    EXPECT_EQ(getOperand(call, 0), (uintptr_t) helper);
+    EXPECT_EQ(getOperand(kf2->getInstructions()[0], 1), 0x2222u);
+}
+
+} // namespace
@@ -0,0 +1,174 @@
+///
+/// Copyright (C) 2020, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+
+#include "gtest/gtest.h"
+
+#include <klee/Constraints.h>
+#include <klee/Expr.h>
+#include <klee/Solver.h>
+#include <klee/SolverImpl.h>
+#include <klee/util/Assignment.h>
+
+using namespace klee;
+
+namespace {
+
+/// End solver that always returns the same model and counts its queries
+class FixedModelSolver : public SolverImpl {
+public:
+    Assignment::bindings_ty model;
+    unsigned queries = 0;
+
+    bool computeTruth(const Query &, bool &) {
+        return false;
+    }
+
+    bool computeValue(const Query &, ref<Expr> &) {
+        return false;
+    }
+
+    bool computeInitialValues(const Query &query, const ArrayVec &objects,
+                              std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+        ++queries;
+        values.clear();
+        for (auto &object : objects) {
+            auto it = model.find(object);
+            values.push_back(it != model.end() ? it->second : std::vector<unsigned char>(object->getSize(), 0));
+        }
+        hasSolution = true;
+        return true;
+    }
+};
+
+class CexCachingSolverTest : public ::testing::Test {
+protected:
+    std::shared_ptr<FixedModelSolver> m_end;
+    SolverPtr m_solver;
+
+    // a and c have concolic values, b is a free array
+    ArrayPtr m_a = Array::create("a", 1);
+    ArrayPtr m_b = Array::create("b", 1);
+    ArrayPtr m_c = Array::create("c", 1);
+
+    void SetUp() override {
+        m_end = std::make_shared<FixedModelSolver>();
+        auto end = Solver::create(m_end);
+        m_solver = createCexCachingSolver(end);
+    }
+
+    static ref<Expr> read(const ArrayPtr &array) {
+        return ReadExpr::create(UpdateList::create(array, 0), ConstantExpr::alloc(0, Expr::Int32));
+    }
+
+    static ref<Expr> byte(unsigned value) {
+        return ConstantExpr::alloc(value, Expr::Int8);
+    }
+
+    std::vector<std::vector<unsigned char>> solve(const ConstraintManager &constraints, const Assignment &concolics) {
+        std::vector<std::vector<unsigned char>> values;
+        Query query(constraints, ConstantExpr::alloc(0, Expr::Bool), &concolics);
+        EXPECT_TRUE(m_solver->getInitialValues(query, {m_a, m_b, m_c}, values));
+        return values;
+    }
+};
+
+TEST_F(CexCachingSolverTest, ConcolicsFirst) {
+    auto concolics = Assignment::create(true);
+    concolics->add(m_a, {7});
+    concolics->add(m_c, {9});
+
+    // The concrete inputs already satisfy the path, the end solver is not needed
+    ConstraintManager constraints;
+    constraints.addConstraint(UltExpr::create(read(m_a), byte(10)));
+    auto values = solve(constraints, *concolics);
+    EXPECT_EQ(m_end->queries, 0u);
+    EXPECT_EQ(values, (std::vector<std::vector<unsigned char>>{{7}, {0}, {9}}));
+
+    // Another state on the same path keeps its own inputs
+    auto other = Assignment::create(true);
+    other->add(m_a, {5});
+    values = solve(constraints, *other);
+    EXPECT_EQ(m_end->queries, 0u);
+    EXPECT_EQ(values[0], std::vector<unsigned char>{5});
+}
+
+TEST_F(CexCachingSolverTest, UnboundArraysKeepConcolics) {
+    auto concolics = Assignment::create(true);
+    concolics->add(m_a, {7});
+    concolics->add(m_c, {9});
+
+    m_end->model[m_a] = {1};
+    m_end->model[m_b] = {3};
+
+    // The free array must change, c is not constrained and keeps its value
+    ConstraintManager constraints;
+    constraints.addConstraint(UltExpr::create(read(m_a), byte(10)));
+    constraints.addConstraint(EqExpr::create(read(m_b), byte(3)));
+    auto values = solve(constraints, *concolics);
+    EXPECT_EQ(m_end->queries, 1u);
+    EXPECT_EQ(values, (std::vector<std::vector<unsigned char>>{{1}, {3}, {9}}));
+
+    // The cached model is reused for a state with different inputs,
+    // only the arrays it does not bind take that state's values
+    auto other = Assignment::create(true);
+    other->add(m_a, {20});
+    other->add(m_c, {4});
+    values = solve(constraints, *other);
+    EXPECT_EQ(m_end->queries, 1u);
+    EXPECT_EQ(values, (std::vector<std::vector<unsigned char>>{{1}, {3}, {4}}));
+}
+
+TEST_F(CexCachingSolverTest, ReusedModelsBindCheckedArrays) {
+    auto concolics = Assignment::create(true);
+    concolics->add(m_a, {7});
+    concolics->add(m_c, {2});
+
+    m_end->model[m_b] = {3};
+
+    // Solved by the end solver, the model only binds b
+    ConstraintManager prefix;
+    prefix.addConstraint(EqExpr::create(read(m_b), byte(3)));
+    auto values = solve(prefix, *concolics);
+    EXPECT_EQ(m_end->queries, 1u);
+
+    // The path model of the prefix is checked with the concrete value of c
+    ConstraintManager constraints = prefix;
+    constraints.addConstraint(UltExpr::create(read(m_c), byte(5)));
+    auto other = Assignment::create(true);
+    other->add(m_c, {2});
+    values = solve(constraints, *other);
+    EXPECT_EQ(m_end->queries, 1u);
+    EXPECT_EQ(values[1], std::vector<unsigned char>{3});
+    EXPECT_EQ(values[2], std::vector<unsigned char>{2});
+
+    // A state whose value of c violates the path must not get the cached
+    // model with its own value of c filled in
+    auto violating = Assignment::create(true);
+    violating->add(m_c, {8});
+    values = solve(constraints, *violating);
+    EXPECT_EQ(values[1], std::vector<unsigned char>{3});
+    EXPECT_LT(values[2][0], 5);
+}
+
+} // namespace
@@ -0,0 +1,283 @@
+///
+/// Copyright (C) 2020, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#include "gtest/gtest.h"
+
+#include "PersistentQueryStore.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+class PersistentQueryStoreTest : public ::testing::Test {
+protected:
+    std::string m_path;
+
+    void SetUp() override {
+        char path[] = "/tmp/kleequerystoreXXXXXX";
+        int fd = mkstemp(path);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        unlink(path);
+        m_path = path;
+    }
+
+    void TearDown() override {
+        unlink(m_path.c_str());
+    }
+
+    static PersistentQueryStore::Digest getKey(unsigned i, unsigned tag = 0) {
+        PersistentQueryStore::Digest key = {};
+        memcpy(&key[0], &i, sizeof(i));
+        memcpy(&key[8], &tag, sizeof(tag));
+        return key;
+    }
+
+    off_t getFileSize() {
+        struct stat st;
+        EXPECT_EQ(stat(m_path.c_str(), &st), 0);
+        return st.st_size;
+    }
+};
+
+TEST_F(PersistentQueryStoreTest, RoundTrip) {
+    {
+        auto store = PersistentQueryStore::open(m_path);
+        ASSERT_TRUE(store);
+        for (unsigned i = 0; i < 100; ++i) {
+            store->insert(getKey(i), i * 3);
+        }
+    }
+
+    auto store = PersistentQueryStore::open(m_path);
+    ASSERT_TRUE(store);
+
+    uint32_t value;
+    for (unsigned i = 0; i < 100; ++i) {
+        ASSERT_TRUE(store->lookup(getKey(i), value)) << i;
+        EXPECT_EQ(value, i * 3);
+    }
+
+    EXPECT_FALSE(store->lookup(getKey(100), value));
+}
+
+TEST_F(PersistentQueryStoreTest, InvalidHeader) {
+    int fd = ::open(m_path.c_str(), O_WRONLY | O_CREAT, 0644);
+    ASSERT_GE(fd, 0);
+    char junk[64] = "not a query store";
+    ASSERT_EQ(write(fd, junk, sizeof(junk)), (ssize_t) sizeof(junk));
+    close(fd);
+
+    EXPECT_FALSE(PersistentQueryStore::open(m_path));
+}
+
+TEST_F(PersistentQueryStoreTest, Data) {
+    const uint8_t bytes[] = {1, 2, 3, 4, 5};
+    {
+        auto store = PersistentQueryStore::open(m_path);
+        ASSERT_TRUE(store);
+        store->insert(getKey(1), llvm::ArrayRef<uint8_t>(bytes));
+        store->insert(getKey(2), llvm::ArrayRef<uint8_t>());
+    }
+
+    auto store = PersistentQueryStore::open(m_path);
+    ASSERT_TRUE(store);
+
+    llvm::ArrayRef<uint8_t> data;
+    ASSERT_TRUE(store->lookup(getKey(1), data));
+    EXPECT_EQ(data, llvm::ArrayRef<uint8_t>(bytes));
+    ASSERT_TRUE(store->lookup(getKey(2), data));
+    EXPECT_TRUE(data.empty());
+
+    // A value of the wrong size is not a validity result
+    uint32_t value;
+    EXPECT_FALSE(store->lookup(getKey(1), value));
+}
+
+TEST_F(PersistentQueryStoreTest, CorruptRecord) {
+    auto key = getKey(2);
+    {
+        auto store = PersistentQueryStore::open(m_path, 0);
+        ASSERT_TRUE(store);
+        store->insert(getKey(1), 1);
+        store->insert(key, 2);
+        store->insert(getKey(3), 3);
+    }
+
+    // Change the value of the second record without updating its check
+    std::vector<uint8_t> contents(getFileSize());
+    int fd = ::open(m_path.c_str(), O_RDWR);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(pread(fd, contents.data(), contents.size(), 0), (ssize_t) contents.size());
+    // Records follow the table, the last match is the key of the record
+    auto it = std::find_end(contents.begin(), contents.end(), key.begin(), key.end());
+    ASSERT_NE(it, contents.end());
+    uint32_t value = 5;
+    off_t offset = (it - contents.begin()) + sizeof(key) + 2 * sizeof(uint32_t);
+    ASSERT_EQ(pwrite(fd, &value, sizeof(value), offset), (ssize_t) sizeof(value));
+    close(fd);
+
+    auto store = PersistentQueryStore::open(m_path);
+    ASSERT_TRUE(store);
+    EXPECT_TRUE(store->lookup(getKey(1), value));
+    EXPECT_FALSE(store->lookup(key, value));
+    EXPECT_TRUE(store->lookup(getKey(3), value));
+    EXPECT_EQ(value, 3u);
+}
+
+TEST_F(PersistentQueryStoreTest, Full) {
+    auto store = PersistentQueryStore::open(m_path, 0);
+    ASSERT_TRUE(store);
+    off_t size = getFileSize();
+
+    // Much more than the smallest store can hold
+    const unsigned recordCount = 100000;
+    for (unsigned i = 0; i < recordCount; ++i) {
+        store->insert(getKey(i), i);
+    }
+
+    EXPECT_EQ(getFileSize(), size);
+
+    uint32_t value;
+    ASSERT_TRUE(store->lookup(getKey(0), value));
+    EXPECT_EQ(value, 0u);
+    EXPECT_FALSE(store->lookup(getKey(recordCount - 1), value));
+
+    // An existing store keeps its size
+    EXPECT_TRUE(PersistentQueryStore::open(m_path, size * 2));
+    EXPECT_EQ(getFileSize(), size);
+}
+
+TEST_F(PersistentQueryStoreTest, SharedBetweenInstances) {
+    auto reader = PersistentQueryStore::open(m_path);
+    auto writer = PersistentQueryStore::open(m_path);
+    ASSERT_TRUE(reader && writer);
+
+    uint32_t value;
+    for (unsigned i = 0; i < 1000; ++i) {
+        EXPECT_FALSE(reader->lookup(getKey(i), value));
+        writer->insert(getKey(i), i);
+        ASSERT_TRUE(reader->lookup(getKey(i), value)) << i;
+        EXPECT_EQ(value, i);
+    }
+}
+
+TEST_F(PersistentQueryStoreTest, ConcurrentAppends) {
+    const unsigned threadCount = 4;
+    const unsigned recordCount = 500;
+
+    auto reader = PersistentQueryStore::open(m_path);
+    ASSERT_TRUE(reader);
+
+    // Each thread has its own instance, like the processes of a multi-process run
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t] {
+            auto store = PersistentQueryStore::open(m_path);
+            ASSERT_TRUE(store);
+            for (unsigned i = 0; i < recordCount; ++i) {
+                store->insert(getKey(i, t), i + t);
+            }
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    // Torn or interleaved records would fail their check and be missing
+    for (unsigned t = 0; t < threadCount; ++t) {
+        for (unsigned i = 0; i < recordCount; ++i) {
+            uint32_t value;
+            ASSERT_TRUE(reader->lookup(getKey(i, t), value)) << t << " " << i;
+            EXPECT_EQ(value, i + t);
+        }
+    }
+}
+
+TEST_F(PersistentQueryStoreTest, DigestIgnoresConstraintOrder) {
+    auto store = PersistentQueryStore::open(m_path);
+    ASSERT_TRUE(store);
+
+    auto array = Array::create("a", 4);
+    auto x = ReadExpr::createTempRead(array, Expr::Int32);
+    auto c1 = UltExpr::create(x, ConstantExpr::create(10, Expr::Int32));
+    auto c2 = NeExpr::create(x, ConstantExpr::create(3, Expr::Int32));
+    auto query = EqExpr::create(x, ConstantExpr::create(5, Expr::Int32));
+
+    ConstraintManager cm1;
+    cm1.addConstraint(c1);
+    auto prefix = store->getDigest(cm1, query);
+    cm1.addConstraint(c2);
+
+    ConstraintManager cm2;
+    cm2.addConstraint(c2);
+    cm2.addConstraint(c1);
+
+    EXPECT_EQ(store->getDigest(cm1, query), store->getDigest(cm2, query));
+    EXPECT_NE(store->getDigest(cm1, query), prefix);
+    EXPECT_NE(store->getDigest(cm1, query), store->getDigest(cm1, Expr::createIsZero(query)));
+    EXPECT_NE(store->getDigest(cm1, query), store->getDigest(cm1, query, ArrayVec{array}));
+}
+
+TEST_F(PersistentQueryStoreTest, DigestIgnoresArrayNames) {
+    auto store = PersistentQueryStore::open(m_path);
+    ASSERT_TRUE(store);
+
+    auto getQuery = [](const ArrayPtr &a, const ArrayPtr &b, ConstraintManager &cm) {
+        auto x = ReadExpr::createTempRead(a, Expr::Int32);
+        auto y = ReadExpr::createTempRead(b, Expr::Int32);
+        cm.addConstraint(UltExpr::create(x, ConstantExpr::create(10, Expr::Int32)));
+        cm.addConstraint(UltExpr::create(y, ConstantExpr::create(10, Expr::Int32)));
+        return EqExpr::create(x, y);
+    };
+
+    auto a1 = Array::create("v0_a_0", 4), b1 = Array::create("v1_b_1", 4);
+    auto a2 = Array::create("v5_a_5", 4), b2 = Array::create("v7_b_7", 4);
+    auto c = Array::create("v0_c_0", 8);
+
+    ConstraintManager cm1, cm2, cm3, cm4;
+    auto q1 = getQuery(a1, b1, cm1);
+    auto q2 = getQuery(a2, b2, cm2);
+    auto q3 = getQuery(a1, a1, cm3);
+    auto q4 = getQuery(c, b1, cm4);
+
+    // Renamed arrays match, arrays of a different shape or a shared array do not
+    EXPECT_EQ(store->getDigest(cm1, q1), store->getDigest(cm2, q2));
+    EXPECT_NE(store->getDigest(cm1, q1), store->getDigest(cm3, q3));
+    EXPECT_NE(store->getDigest(cm1, q1), store->getDigest(cm4, q4));
+
+    // The objects of a counterexample are numbered like the arrays of the query
+    EXPECT_EQ(store->getDigest(cm1, q1, ArrayVec{a1, b1}), store->getDigest(cm2, q2, ArrayVec{a2, b2}));
+    EXPECT_NE(store->getDigest(cm1, q1, ArrayVec{a1, b1}), store->getDigest(cm2, q2, ArrayVec{b2, a2}));
+}
+
+} // namespace
@@ -76,4 +76,57 @@ TEST(PagePoolTest, AllocationBenchmark) {
     EXPECT_EQ(0u, pp->getFreePages());
 }
 
+TEST(PagePoolTest, ReserveChunks) {
+    PagePoolOptions options;
+    options.reserveChunks = 1;
+    auto pp = PagePool::create(options);
+    std::vector<uint8_t *> vptrs;
+
+    for (auto i = 0u; i < 2 * PagePoolDesc::POOL_PAGE_COUNT; ++i) {
+        vptrs.push_back(pp->alloc());
+    }
+
+    EXPECT_EQ(2, pp->getPoolCount());
+
+    for (auto ptr : vptrs) {
+        pp->free(ptr);
+    }
+
+    // One chunk is kept for reuse, the other one is unmapped
+    EXPECT_EQ(0, pp->getPoolCount());
+    EXPECT_EQ(1u, pp->getReserveCount());
+
+    auto ptr = pp->alloc();
+    EXPECT_NE(nullptr, ptr);
+    EXPECT_EQ(1, pp->getPoolCount());
+    EXPECT_EQ(0u, pp->getReserveCount());
+    pp->free(ptr);
+}
+
+TEST(PagePoolTest, HugePageBacking) {
+    for (auto backing : {PagePoolBacking::TransparentHuge, PagePoolBacking::ExplicitHuge}) {
+        PagePoolOptions options;
+        options.backing = backing;
+        options.numaAware = true;
+        auto pp = PagePool::create(options);
+        std::vector<uint8_t *> vptrs;
+
+        for (auto i = 0u; i < PagePoolDesc::POOL_PAGE_COUNT + 1; ++i) {
+            auto ptr = pp->alloc();
+            EXPECT_NE(nullptr, ptr);
+            EXPECT_EQ(0u, (uintptr_t) ptr % 4096);
+            memset(ptr, 0xab, 4096);
+            vptrs.push_back(ptr);
+        }
+
+        EXPECT_EQ(2, pp->getPoolCount());
+
+        for (auto ptr : vptrs) {
+            pp->free(ptr);
+        }
+
+        EXPECT_EQ(0u, pp->getFreePages());
+    }
+}
+
 } // namespace
@@ -0,0 +1,124 @@
+///
+/// Copyright (C) 2020, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#include "gtest/gtest.h"
+
+#include <klee/util/ConcreteBuffer.h>
+#include <klee/util/PageSwap.h>
+
+using namespace klee;
+
+namespace {
+
+static void fill(uint8_t *page, uint8_t seed) {
+    for (unsigned i = 0; i < PageSwap::PAGE_SIZE; ++i) {
+        page[i] = seed + i;
+    }
+}
+
+TEST(PageSwapTest, ConcreteBufferRoundTrip) {
+    PageSwap::initialize("/tmp", 16 * PageSwap::PAGE_SIZE);
+
+    auto buffer = ConcreteBuffer::create(ConcreteBuffer::PAGE_SIZE);
+    fill(buffer->get(), 3);
+
+    EXPECT_TRUE(buffer->swapOut());
+    EXPECT_TRUE(buffer->isSwappedOut());
+    EXPECT_EQ(1u, PageSwap::get()->getSwappedPages());
+
+    uint8_t expected[PageSwap::PAGE_SIZE];
+    fill(expected, 3);
+    EXPECT_EQ(0, memcmp(expected, buffer->get(), sizeof(expected)));
+    EXPECT_FALSE(buffer->isSwappedOut());
+    EXPECT_EQ(0u, PageSwap::get()->getSwappedPages());
+
+    // Only whole pages go to the swap file
+    auto small = ConcreteBuffer::create(16);
+    EXPECT_FALSE(small->swapOut());
+
+    // Copies of a swapped out buffer read it back first
+    EXPECT_TRUE(buffer->swapOut());
+    auto copy = ConcreteBuffer::create(buffer);
+    EXPECT_EQ(0, memcmp(expected, copy->get(), sizeof(expected)));
+
+    EXPECT_TRUE(buffer->swapOut());
+    buffer = nullptr;
+    EXPECT_EQ(0u, PageSwap::get()->getSwappedPages());
+}
+
+TEST(PageSwapTest, FullFile) {
+    PageSwap::initialize("/tmp", 4 * PageSwap::PAGE_SIZE);
+    auto swap = PageSwap::get();
+
+    uint8_t page[PageSwap::PAGE_SIZE];
+    std::vector<PageSwap::Slot> slots(5);
+    for (unsigned i = 0; i < 4; ++i) {
+        fill(page, i);
+        EXPECT_TRUE(swap->write(page, slots[i]));
+    }
+
+    EXPECT_FALSE(swap->write(page, slots[4]));
+
+    // Released slots are reused
+    swap->read(slots[1], page);
+    uint8_t expected[PageSwap::PAGE_SIZE];
+    fill(expected, 1);
+    EXPECT_EQ(0, memcmp(expected, page, sizeof(page)));
+    EXPECT_TRUE(swap->write(page, slots[4]));
+    EXPECT_EQ(1u, slots[4].index);
+
+    for (auto &slot : slots) {
+        if (slot) {
+            swap->release(slot);
+        }
+    }
+}
+
+TEST(PageSwapTest, ProcessFork) {
+    PageSwap::initialize("/tmp", 4 * PageSwap::PAGE_SIZE);
+    auto swap = PageSwap::get();
+
+    uint8_t page[PageSwap::PAGE_SIZE];
+    PageSwap::Slot before, after;
+    fill(page, 7);
+    EXPECT_TRUE(swap->write(page, before));
+
+    swap->onProcessFork();
+
+    // Pages written before the fork stay readable, new ones go to another file
+    fill(page, 9);
+    EXPECT_TRUE(swap->write(page, after));
+    EXPECT_NE(before.file, after.file);
+    EXPECT_TRUE(before.file->frozen);
+
+    uint8_t expected[PageSwap::PAGE_SIZE];
+    swap->read(before, page);
+    fill(expected, 7);
+    EXPECT_EQ(0, memcmp(expected, page, sizeof(page)));
+
+    swap->read(after, page);
+    fill(expected, 9);
+    EXPECT_EQ(0, memcmp(expected, page, sizeof(page)));
+}
+
+} // namespace
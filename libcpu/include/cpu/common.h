@@ -63,6 +63,9 @@ typedef struct CPUWatchpoint {
     uint32_t halted; /* Nonzero if the CPU is in suspend state */                                     \
     uint32_t interrupt_request;                                                                       \
     volatile sig_atomic_t exit_request;                                                               \
+    /* Parts of the symbolic register area that native code must not access.                          \
+       A translation block that accesses them exits at its start, see se_reg_rmask/wmask. */          \
+    uint64_t se_symbolic_regs;                                                                        \
     CPU_COMMON_TLB                                                                                    \
     CPU_COMMON_PHYSRAM_TLB                                                                            \
     CPUTLBEntry *se_tlb_current;                                                                      \
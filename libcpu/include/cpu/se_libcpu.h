@@ -160,6 +160,7 @@ struct se_libcpu_interface_t {
     struct events {
         unsigned *before_memory_access_signals_count;
         unsigned *after_memory_access_signals_count;
+        unsigned *watched_memory_access_signals_count;
         unsigned *on_translate_soft_interrupt_signals_count;
         unsigned *on_translate_block_start_signals_count;
         unsigned *on_translate_block_end_signals_count;
@@ -185,6 +186,9 @@ struct se_libcpu_interface_t {
 
         void (*after_memory_access)(uint64_t vaddr, uint64_t value, unsigned size, unsigned flags, uintptr_t retaddr);
 
+        /** Returns non-zero if a plugin watches the given virtual addresses in any address space */
+        int (*is_memory_watched)(uint64_t vaddr, uint64_t size);
+
         void (*trace_port_access)(uint64_t port, uint64_t value, unsigned bits, int isWrite, void *retaddr);
 
         /* Translation events */
@@ -28,6 +28,7 @@
 #include "qemu-common.h"
 
 #include "exec-phystb.h"
+#include "exec-ram.h"
 #include "exec.h"
 
 #ifdef CONFIG_SYMBEX
@@ -290,6 +291,64 @@ static void page_flush_tb(void) {
     }
 }
 
+#ifdef CONFIG_SYMBEX
+typedef int (*code_page_changed_t)(void *opaque, uintptr_t host_page);
+
+static unsigned page_invalidate_tb_1(int level, void **lp, tb_page_addr_t index, code_page_changed_t page_changed,
+                                     void *opaque) {
+    unsigned count = 0;
+    int i;
+
+    if (*lp == NULL) {
+        return 0;
+    }
+    if (level == 0) {
+        PageDesc *pd = *lp;
+        for (i = 0; i < L2_SIZE; ++i) {
+            tb_page_addr_t addr;
+
+            if (!pd[i].first_tb) {
+                continue;
+            }
+
+            addr = ((index << L2_BITS) | i) << TARGET_PAGE_BITS;
+            if (page_changed(opaque, (uintptr_t) qemu_get_ram_ptr(addr))) {
+                tb_invalidate_phys_page_range(addr, addr + TARGET_PAGE_SIZE, 0);
+                ++count;
+            } else {
+                /* The page may have been translated while the dirty mask of
+                   the current state was inactive, mark it as code there too */
+                cpu_physical_memory_mask_dirty_range(addr, TARGET_PAGE_SIZE, CODE_DIRTY_FLAG);
+            }
+        }
+    } else {
+        void **pp = *lp;
+        for (i = 0; i < L2_SIZE; ++i) {
+            count += page_invalidate_tb_1(level - 1, pp + i, (index << L2_BITS) | i, page_changed, opaque);
+        }
+    }
+
+    return count;
+}
+
+/* Unlike tb_flush, keeps the TBs of the code pages whose content is unchanged.
+   The virtual pc cache is cleared because the new mappings may differ.
+   The restored TLB keeps its entries, those that write directly to a kept
+   code page are write-protected so that writes still invalidate its TBs. */
+unsigned se_tb_invalidate_code_pages(CPUArchState *env, code_page_changed_t page_changed, void *opaque) {
+    unsigned count = 0;
+    int i;
+
+    for (i = 0; i < V_L1_SIZE; i++) {
+        count += page_invalidate_tb_1(V_L1_SHIFT / L2_BITS - 1, l1_map + i, i, page_changed, opaque);
+    }
+
+    tlb_protect_code_entries(env);
+    memset(env->tb_jmp_cache, 0, TB_JMP_CACHE_SIZE * sizeof(void *));
+    return count;
+}
+#endif
+
 static inline void set_bits(uint8_t *tab, int start, int len) {
     int end, mask, end1;
 
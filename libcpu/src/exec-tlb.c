@@ -67,6 +67,7 @@ static const CPUTLBEntry s_cputlb_empty_entry = {
 
 #ifdef CONFIG_SYMBEX
 int g_se_disable_tlb_flush = 0;
+int g_se_tlb_flush_skipped = 0;
 #endif
 
 void tlb_flush(CPUArchState *env, int flush_global) {
@@ -74,6 +75,7 @@ void tlb_flush(CPUArchState *env, int flush_global) {
 
 #ifdef CONFIG_SYMBEX
     if (g_se_disable_tlb_flush) {
+        g_se_tlb_flush_skipped = 1;
         return;
     }
 #endif
@@ -175,6 +177,33 @@ int tlb_is_dirty(CPUArchState *env, target_ulong vaddr) {
 
     return ret;
 }
+
+/* Set the not-dirty flag of the writable RAM entries whose page is not
+   completely dirty, e.g., because it has code, like tlb_set_page does
+   when it fills an entry. This is needed when the TLB was saved with
+   another dirty mask than the current one. */
+void tlb_protect_code_entries(CPUArchState *env) {
+    int i;
+    int mmu_idx;
+
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        for (i = 0; i < CPU_TLB_SIZE; i++) {
+            CPUTLBEntry *te = &env->tlb_table[mmu_idx][i];
+            target_ulong vaddr;
+            ram_addr_t ram_addr;
+
+            if (!tlb_is_dirty_ram(te)) {
+                continue;
+            }
+
+            vaddr = te->addr_write & TARGET_PAGE_MASK;
+            ram_addr = (env->iotlb[mmu_idx][i] + vaddr) & TARGET_PAGE_MASK;
+            if (!cpu_physical_memory_is_dirty(ram_addr)) {
+                te->addr_write |= TLB_NOTDIRTY;
+            }
+        }
+    }
+}
 #endif
 
 /* Our TLB does not support large pages, so remember the area covered by
@@ -300,7 +329,10 @@ void tlb_set_page(CPUArchState *env, target_ulong vaddr, target_phys_addr_t padd
 #endif
 #if defined(CONFIG_SYMBEX)
 
-    if (*g_sqi.events.before_memory_access_signals_count || *g_sqi.events.after_memory_access_signals_count) {
+    // Pages that no plugin watches stay on the fast path
+    if (*g_sqi.events.before_memory_access_signals_count || *g_sqi.events.after_memory_access_signals_count ||
+        (*g_sqi.events.watched_memory_access_signals_count &&
+         g_sqi.events.is_memory_watched(vaddr & TARGET_PAGE_MASK, TARGET_PAGE_SIZE))) {
         te->addr_read |= TLB_MEM_TRACE;
         te->addr_write |= TLB_MEM_TRACE;
     }
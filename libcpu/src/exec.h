@@ -55,6 +55,9 @@
 
 void tlb_protect_code(ram_addr_t ram_addr);
 void tlb_unprotect_code_phys(CPUArchState *env, ram_addr_t ram_addr, target_ulong vaddr);
+#ifdef CONFIG_SYMBEX
+void tlb_protect_code_entries(CPUArchState *env);
+#endif
 
 const MemoryDesc *phys_page_find(target_phys_addr_t index);
 
@@ -76,12 +76,18 @@
 #include <cpu/se_libcpu_config.h>
 
 // clang-format off
+/* When plugins only watch some ranges, accesses to pages that are not watched skip the handler.
+   Expects the TLB entry of the access in tlb_entry. */
+#define SE_TRACE_ACCESS() \
+    (*g_sqi.events.after_memory_access_signals_count || \
+     (*g_sqi.events.watched_memory_access_signals_count && (tlb_entry->addr_read & TLB_MEM_TRACE)))
+
 #if defined(SYMBEX_LLVM_LIB) && !defined(STATIC_TRANSLATOR)
     #define SMHINLINE
     #define INSTR_BEFORE_MEMORY_ACCESS(vaddr, value, size, flags) \
         if (*g_sqi.events.before_memory_access_signals_count) tcg_llvm_before_memory_access(vaddr, value, size, flags);
     #define INSTR_AFTER_MEMORY_ACCESS(vaddr, value, size, flags) \
-        if (*g_sqi.events.after_memory_access_signals_count) tcg_llvm_after_memory_access(vaddr, value, size, flags, 0);
+        if (SE_TRACE_ACCESS()) tcg_llvm_after_memory_access(vaddr, value, size, flags, 0);
     #define INSTR_FORK_AND_CONCRETIZE(val, max) \
         tcg_llvm_fork_and_concretize(val, 0, max, 0)
 #else // SYMBEX_LLVM_LIB
@@ -93,7 +99,7 @@
         #else
             #define INSTR_BEFORE_MEMORY_ACCESS(vaddr, value, size, flags)
             #define INSTR_AFTER_MEMORY_ACCESS(vaddr, value, size, flags) \
-                if (unlikely(*g_sqi.events.after_memory_access_signals_count)) INSTR_AFTER_MEMORY_ACCESS(vaddr, value, size, flags, 0);
+                if (unlikely(SE_TRACE_ACCESS())) INSTR_AFTER_MEMORY_ACCESS(vaddr, value, size, flags, 0);
         #endif
     #else
         #define INSTR_BEFORE_MEMORY_ACCESS(vaddr, value, size, flags)
@@ -331,6 +337,7 @@ static SMHINLINE void glue(glue(CPU_PREFIX, stfl), MEMSUFFIX)(CPUArchState *env,
 #undef SE_RAM_OBJECT_DIFF
 #undef INSTR_FORK_AND_CONCRETIZE
 #undef INSTR_AFTER_MEMORY_ACCESS
+#undef SE_TRACE_ACCESS
 #undef INSTR_BEFORE_MEMORY_ACCESS
 #undef ADDR_MAX
 #undef RES_TYPE
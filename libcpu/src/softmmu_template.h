@@ -60,11 +60,17 @@
 #include <cpu/se_libcpu_config.h>
 
 // clang-format off
+/* When plugins only watch some ranges, accesses to pages that are not watched skip the handler.
+   Expects the TLB entry of the access in tlb_entry. */
+#define SE_TRACE_ACCESS() \
+    (*g_sqi.events.after_memory_access_signals_count || \
+     (*g_sqi.events.watched_memory_access_signals_count && (tlb_entry->addr_read & TLB_MEM_TRACE)))
+
 #if defined(SYMBEX_LLVM_LIB) && !defined(STATIC_TRANSLATOR)
     #define INSTR_BEFORE_MEMORY_ACCESS(vaddr, value, size, flags) \
         if (*g_sqi.events.before_memory_access_signals_count) tcg_llvm_before_memory_access(vaddr, value, size, flags);
     #define INSTR_AFTER_MEMORY_ACCESS(vaddr, value, size, flags, retaddr) \
-        if (*g_sqi.events.after_memory_access_signals_count) tcg_llvm_after_memory_access(vaddr, value, size, flags, 0);
+        if (SE_TRACE_ACCESS()) tcg_llvm_after_memory_access(vaddr, value, size, flags, 0);
     #define INSTR_FORK_AND_CONCRETIZE(val, max) \
         tcg_llvm_fork_and_concretize(val, 0, max, 0)
     #define SE_SET_MEM_IO_VADDR(env, addr, reset) \
@@ -77,7 +83,7 @@
         #else
             #define INSTR_BEFORE_MEMORY_ACCESS(vaddr, value, size, flags)
             #define INSTR_AFTER_MEMORY_ACCESS(vaddr, value, size, flags, retaddr) \
-                if (unlikely(*g_sqi.events.after_memory_access_signals_count)) g_sqi.events.after_memory_access(vaddr, value, size, flags, (uintptr_t) 0);
+                if (unlikely(SE_TRACE_ACCESS())) g_sqi.events.after_memory_access(vaddr, value, size, flags, (uintptr_t) 0);
         #endif
     #else
         #define INSTR_BEFORE_MEMORY_ACCESS(vaddr, value, size, flags)
@@ -635,6 +641,7 @@ redo:
 #undef INSTR_FORK_AND_CONCRETIZE_ADDR
 #undef INSTR_FORK_AND_CONCRETIZE
 #undef INSTR_AFTER_MEMORY_ACCESS
+#undef SE_TRACE_ACCESS
 #undef INSTR_BEFORE_MEMORY_ACCESS
 #undef ADDR_MAX
 #undef READ_ACCESS_TYPE
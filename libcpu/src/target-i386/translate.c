@@ -7734,7 +7734,16 @@ void optimize_flags_init(void) {
 #endif
 }
 
+#ifdef CONFIG_SYMBEX
+/* Loads the mask of symbolic registers accessed by the TB, patched in gen_tb_end */
+static TCGOp *se_reg_mask_op;
+#endif
+
 static inline void gen_tb_start(TranslationBlock *tb) {
+#ifdef CONFIG_SYMBEX
+    se_reg_mask_op = NULL;
+#endif
+
     if (tb->cflags & CF_HAS_INTERRUPT_EXIT) {
         TCGv_i32 exit_request;
 
@@ -7745,10 +7754,31 @@ static inline void gen_tb_start(TranslationBlock *tb) {
         tcg_gen_brcondi_i32(TCG_COND_NE, exit_request, 0, tcg_ctx->exitreq_label);
 
         tcg_temp_free_i32(exit_request);
+
+#ifdef CONFIG_SYMBEX
+        /* Exit to the dispatcher if the TB accesses symbolic registers.
+           This is needed for chained TBs, which do not go through the dispatcher. */
+        TCGv_i64 symbolic_regs = tcg_temp_new_i64();
+        TCGv_i64 accessed_regs = tcg_temp_new_i64();
+        tcg_gen_ld_i64(symbolic_regs, cpu_env, offsetof(CPUState, se_symbolic_regs));
+        tcg_gen_movi_i64(accessed_regs, 0);
+        se_reg_mask_op = tcg_last_op();
+        tcg_gen_and_i64(symbolic_regs, symbolic_regs, accessed_regs);
+        tcg_gen_brcondi_i64(TCG_COND_NE, symbolic_regs, 0, tcg_ctx->exitreq_label);
+        tcg_temp_free_i64(accessed_regs);
+        tcg_temp_free_i64(symbolic_regs);
+#endif
     }
 }
 
 static inline void gen_tb_end(TranslationBlock *tb) {
+#ifdef CONFIG_SYMBEX
+    tcg_calc_tb_regmask(tcg_ctx, offsetof(CPUX86State, eip), &tb->se_reg_rmask, &tb->se_reg_wmask);
+    if (se_reg_mask_op) {
+        tcg_set_insn_param(se_reg_mask_op, 1, tb->se_reg_rmask | tb->se_reg_wmask);
+    }
+#endif
+
     if (tb->cflags & CF_HAS_INTERRUPT_EXIT) {
         assert(tcg_ctx->exitreq_label);
         gen_set_label(tcg_ctx->exitreq_label);
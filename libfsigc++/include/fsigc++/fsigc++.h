@@ -107,13 +107,31 @@ template <typename T> inline void intrusive_ptr_release(T *ptr) {
 }
 
 template <typename RET, typename... PARAM_TYPES> class functor_base : public functor_refcnt {
+public:
+    // Non-virtual entry point, lets signals call functors without going through the vtable
+    typedef RET (*invoke_t)(functor_base *, PARAM_TYPES...);
+
 protected:
-    functor_base() {
+    invoke_t m_invoke;
+
+    static RET invoke_virtual(functor_base *self, PARAM_TYPES... params) {
+        return self->operator()(params...);
+    }
+
+    functor_base() : m_invoke(&functor_base::invoke_virtual) {
     }
 
 public:
     typedef boost::intrusive_ptr<functor_base<RET, PARAM_TYPES...>> functor_base_ptr;
 
+    inline invoke_t get_invoke() const {
+        return m_invoke;
+    }
+
+    inline RET invoke(PARAM_TYPES... params) {
+        return m_invoke(this, params...);
+    }
+
     static functor_base_ptr create() {
         return new functor_base();
     }
@@ -137,8 +155,13 @@ public:
 protected:
     func_t m_func;
 
+    static RET invoke_direct(functor_base<RET, PARAM_TYPES...> *self, PARAM_TYPES... params) {
+        return (*static_cast<ptrfunn *>(self)->m_func)(params...);
+    }
+
     ptrfunn(func_t f) {
         m_func = f;
+        this->m_invoke = &ptrfunn::invoke_direct;
     }
 
 public:
@@ -174,9 +197,15 @@ protected:
     func_t m_func;
     T *m_obj;
 
+    static RET invoke_direct(functor_base<RET, PARAM_TYPES...> *self, PARAM_TYPES... params) {
+        auto f = static_cast<functorn *>(self);
+        return (*f->m_obj.*f->m_func)(params...);
+    }
+
     functorn(T *obj, func_t f) {
         m_obj = obj;
         m_func = f;
+        this->m_invoke = &functorn::invoke_direct;
     }
 
 public:
@@ -203,6 +232,8 @@ public:
     typedef boost::intrusive_ptr<functor_base<RET, PARAM_TYPES...>> func_t;
 
 private:
+    typedef functor_base<RET, PARAM_TYPES...> functor_t;
+
     unsigned m_activeSignals;
     unsigned m_deletedSignals;
 
@@ -212,6 +243,37 @@ private:
     typedef std::pair<func_t, int> func_priority_t;
     boost::container::small_vector<func_priority_t, 16> m_funcs;
 
+    // Flat copy of m_funcs that emit() walks without touching reference
+    // counts or vtables. It is rebuilt before the first emission that
+    // follows a change of the connections, unless another emission is
+    // in progress. Handlers connected during an emission are called
+    // from the next outermost emission on.
+    struct call_t {
+        typename functor_t::invoke_t invoke;
+        functor_t *functor;
+    };
+    boost::container::small_vector<call_t, 4> m_calls;
+    bool m_callsDirty;
+
+    // Number of emit() calls in progress, including nested ones
+    unsigned m_emitDepth;
+
+    struct emit_scope {
+        signal &m_signal;
+
+        emit_scope(signal &s) : m_signal(s) {
+            ++m_signal.m_emitDepth;
+        }
+
+        ~emit_scope() {
+            --m_signal.m_emitDepth;
+        }
+    };
+
+    static RET invoke_disconnected(functor_t *, PARAM_TYPES...) {
+        return RET();
+    }
+
     void cleanup() {
         while (m_deletedSignals > 0) {
             for (auto it = m_funcs.begin(); it != m_funcs.end(); ++it) {
@@ -224,15 +286,34 @@ private:
         }
     }
 
+    void rebuild_calls() {
+        m_calls.clear();
+        for (auto &it : m_funcs) {
+            if (it.first) {
+                m_calls.push_back({it.first->get_invoke(), it.first.get()});
+            }
+        }
+        m_callsDirty = false;
+    }
+
 public:
     signal() {
         m_activeSignals = 0;
         m_deletedSignals = 0;
+        m_callsDirty = false;
+        m_emitDepth = 0;
     }
 
     signal(const signal &one) {
         m_activeSignals = one.m_activeSignals;
-        m_funcs = one.m_funcs;
+        m_deletedSignals = 0;
+        for (auto &it : one.m_funcs) {
+            if (it.first) {
+                m_funcs.push_back(it);
+            }
+        }
+        m_callsDirty = true;
+        m_emitDepth = 0;
     }
 
     virtual ~signal() {
@@ -246,6 +327,17 @@ public:
             if (fcn == functor) {
                 --m_activeSignals;
                 ++m_deletedSignals;
+
+                // The functor may be freed as soon as this function returns,
+                // make sure that an ongoing emit() does not call it anymore.
+                for (auto &call : m_calls) {
+                    if (call.functor == functor) {
+                        call.invoke = &signal::invoke_disconnected;
+                        call.functor = nullptr;
+                    }
+                }
+                m_callsDirty = true;
+
                 // Don't erase the entry to avoid invalidating
                 // the iterator in emit(). This may happen if the called
                 // signal handler tries to disconnect itself.
@@ -257,6 +349,7 @@ public:
 
     connection connect(const func_t &fcn, int priority = MEDIUM_PRIORITY) {
         ++m_activeSignals;
+        m_callsDirty = true;
         auto p = func_priority_t(fcn, priority);
 
         for (auto it = m_funcs.begin(); it != m_funcs.end(); ++it) {
@@ -275,13 +368,17 @@ public:
     }
 
     void emit(PARAM_TYPES... params) {
-        for (auto &it : m_funcs) {
-            if (it.first) {
-                it.first->operator()(params...);
-            }
+        // Outer emissions are still walking m_calls, nested ones keep using it.
+        // Disconnected handlers are replaced in place by invoke_disconnected.
+        if (m_callsDirty && !m_emitDepth) {
+            cleanup();
+            rebuild_calls();
         }
 
-        cleanup();
+        emit_scope scope(*this);
+        for (const auto &call : m_calls) {
+            call.invoke(call.functor, params...);
+        }
     }
 
     // This is intended for optimization purposes only.
@@ -306,7 +403,13 @@ private:
     functor_t m_fb;
     A1 a1;
 
+    static RET invoke_direct(functor_base<RET, PARAM_TYPES...> *self, PARAM_TYPES... params) {
+        auto f = static_cast<functorn_1 *>(self);
+        return f->m_fb->invoke(params..., f->a1);
+    }
+
     functorn_1(const functor_t &fb, A1 _a1) : m_fb(fb), a1(_a1) {
+        this->m_invoke = &functorn_1::invoke_direct;
     }
 
 public:
@@ -332,7 +435,13 @@ private:
     A1 a1;
     A2 a2;
 
+    static RET invoke_direct(functor_base<RET, PARAM_TYPES...> *self, PARAM_TYPES... params) {
+        auto f = static_cast<functorn_2 *>(self);
+        return f->m_fb->invoke(params..., f->a1, f->a2);
+    }
+
     functorn_2(const functor_t &fb, A1 _a1, A2 _a2) : m_fb(fb), a1(_a1), a2(_a2) {
+        this->m_invoke = &functorn_2::invoke_direct;
     }
 
 public:
@@ -359,7 +468,13 @@ private:
     A2 a2;
     A3 a3;
 
+    static RET invoke_direct(functor_base<RET, PARAM_TYPES...> *self, PARAM_TYPES... params) {
+        auto f = static_cast<functorn_3 *>(self);
+        return f->m_fb->invoke(params..., f->a1, f->a2, f->a3);
+    }
+
     functorn_3(const functor_t &fb, A1 _a1, A2 _a2, A3 _a3) : m_fb(fb), a1(_a1), a2(_a2), a3(_a3) {
+        this->m_invoke = &functorn_3::invoke_direct;
     }
 
 public:
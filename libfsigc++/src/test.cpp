@@ -19,6 +19,7 @@
 /// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 /// SOFTWARE.
 
+#include <cassert>
 #include <fsigc++/fsigc++.h>
 #include <iostream>
 
@@ -105,7 +106,102 @@ private:
 
 uint64_t MyPlugin1::s_counter = 0;
 
+// Handlers that change the connections of the signal they are called from
+class ReentrantPlugin {
+public:
+    fsigc::signal<void, int> sig;
+
+    unsigned m_first = 0;
+    unsigned m_second = 0;
+    unsigned m_late = 0;
+    unsigned m_self = 0;
+
+    sigc::connection m_secondConn, m_selfConn;
+
+    void first(int depth) {
+        ++m_first;
+    }
+
+    void second(int depth) {
+        ++m_second;
+    }
+
+    void late(int depth) {
+        ++m_late;
+    }
+
+    void disconnectSelf(int depth) {
+        ++m_self;
+        m_selfConn.disconnect();
+    }
+
+    void connectLate(int depth) {
+        sig.connect(fsigc::mem_fun(*this, &ReentrantPlugin::late));
+    }
+
+    void disconnectSecond(int depth) {
+        m_secondConn.disconnect();
+    }
+
+    // Connects a handler from a nested emission, which must not disturb the outer one
+    void emitNested(int depth) {
+        if (depth == 0) {
+            connectLate(depth);
+            sig.emit(depth + 1);
+        }
+    }
+};
+
+static void testConnectDuringEmission() {
+    ReentrantPlugin p;
+    p.sig.connect(fsigc::mem_fun(p, &ReentrantPlugin::first));
+    p.sig.connect(fsigc::mem_fun(p, &ReentrantPlugin::connectLate));
+
+    // The new handler is called from the next emission on
+    p.sig.emit(0);
+    assert(p.m_first == 1 && p.m_late == 0);
+
+    p.sig.emit(0);
+    assert(p.m_first == 2 && p.m_late == 1);
+}
+
+static void testDisconnectDuringEmission() {
+    ReentrantPlugin p;
+    p.sig.connect(fsigc::mem_fun(p, &ReentrantPlugin::disconnectSecond));
+    p.m_secondConn = p.sig.connect(fsigc::mem_fun(p, &ReentrantPlugin::second));
+    p.m_selfConn = p.sig.connect(fsigc::mem_fun(p, &ReentrantPlugin::disconnectSelf));
+    p.sig.connect(fsigc::mem_fun(p, &ReentrantPlugin::first));
+
+    // Disconnected handlers are not called anymore, even later in the same emission
+    p.sig.emit(0);
+    assert(p.m_second == 0 && p.m_self == 1 && p.m_first == 1);
+
+    p.sig.emit(0);
+    assert(p.m_second == 0 && p.m_self == 1 && p.m_first == 2);
+}
+
+static void testNestedEmission() {
+    ReentrantPlugin p;
+    p.sig.connect(fsigc::mem_fun(p, &ReentrantPlugin::emitNested));
+    p.m_secondConn = p.sig.connect(fsigc::mem_fun(p, &ReentrantPlugin::second));
+    p.sig.connect(fsigc::mem_fun(p, &ReentrantPlugin::first));
+
+    // Each handler runs once per emission, the handler connected by the
+    // nested emission runs in neither of them
+    p.sig.emit(0);
+    assert(p.m_second == 2 && p.m_first == 2 && p.m_late == 0);
+
+    // A nested emission that follows a disconnection skips the handler too
+    p.sig.connect(fsigc::mem_fun(p, &ReentrantPlugin::disconnectSecond), fsigc::signal_base::HIGHEST_PRIORITY);
+    p.sig.emit(0);
+    assert(p.m_second == 2 && p.m_first == 4 && p.m_late == 2);
+}
+
 int main(int argc, char **argv) {
+    testConnectDuringEmission();
+    testDisconnectDuringEmission();
+    testNestedEmission();
+
     MyPlugin p0;
     MyPlugin1 p1;
     p1.init(&p0);
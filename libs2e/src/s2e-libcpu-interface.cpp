@@ -115,6 +115,7 @@ void init_s2e_libcpu_interface(struct se_libcpu_interface_t *sqi) {
 
     sqi->events.before_memory_access_signals_count = g_s2e_before_memory_access_signals_count;
     sqi->events.after_memory_access_signals_count = g_s2e_after_memory_access_signals_count;
+    sqi->events.watched_memory_access_signals_count = g_s2e_watched_memory_access_signals_count;
     sqi->events.on_translate_soft_interrupt_signals_count = g_s2e_on_translate_soft_interrupt_signals_count;
     sqi->events.on_translate_block_start_signals_count = g_s2e_on_translate_block_start_signals_count;
     sqi->events.on_translate_block_end_signals_count = g_s2e_on_translate_block_end_signals_count;
@@ -139,6 +140,7 @@ void init_s2e_libcpu_interface(struct se_libcpu_interface_t *sqi) {
     sqi->events.on_page_fault = s2e_on_page_fault;
     sqi->events.on_tlb_miss = s2e_on_tlb_miss;
     sqi->events.after_memory_access = s2e_after_memory_access;
+    sqi->events.is_memory_watched = s2e_is_memory_watched;
     sqi->events.trace_port_access = s2e_trace_port_access;
     sqi->events.tcg_execution_handler = s2e_tcg_execution_handler;
     sqi->events.tcg_custom_instruction_handler = s2e_tcg_custom_instruction_handler;
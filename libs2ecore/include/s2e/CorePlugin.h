@@ -29,6 +29,11 @@
 
 #include <inttypes.h>
 #include <klee/Memory.h>
+#include <llvm/ADT/IntervalMap.h>
+#include <memory>
+#include <set>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include <klee/Common.h>
@@ -56,16 +61,63 @@ class CorePlugin : public Plugin {
     S2E_PLUGIN
 
 private:
+    /// Closed intervals of watched addresses
+    typedef llvm::IntervalMap<uint64_t, bool> WatchIndex;
+
+    /// Page directory, first and last address of each watch. A range may be watched more than once.
+    std::multiset<std::tuple<uint64_t, uint64_t, uint64_t>> m_memoryWatches;
+
+    WatchIndex::Allocator m_watchAllocator;
+
+    /// Ranges watched in any address space
+    WatchIndex m_anyWatches;
+
+    /// Ranges watched in each address space, page directory 0 is for the ranges of all address spaces
+    std::unordered_map<uint64_t, std::unique_ptr<WatchIndex>> m_watchesByPageDir;
+
+    void rebuildWatchIndex();
+    static bool overlaps(const WatchIndex &index, uint64_t address, uint64_t size);
+
     void onInitializationCompleteCb(S2EExecutionState *state);
 
 public:
-    CorePlugin(S2E *s2e) : Plugin(s2e) {
+    CorePlugin(S2E *s2e) : Plugin(s2e), m_anyWatches(m_watchAllocator) {
     }
 
     enum class symbolicAddressReason { MEMORY, PC };
 
     void initialize();
 
+    ///
+    /// \brief Emits onWatchedConcreteDataMemoryAccess for accesses to [start, start + size)
+    ///
+    /// A page directory of 0 matches all address spaces. Unlike onConcreteDataMemoryAccess, connecting
+    /// to the watched signal only takes accesses to pages that contain a watched range, in any
+    /// address space, off the softmmu fast path. The state is the one whose TLB must be flushed, it may be null during
+    /// plugin initialization.
+    ///
+    void addMemoryWatch(S2EExecutionState *state, uint64_t start, uint64_t size, uint64_t pageDir = 0);
+    void removeMemoryWatch(S2EExecutionState *state, uint64_t start, uint64_t size, uint64_t pageDir = 0);
+
+    /// Returns true if a watched range overlaps [address, address + size) in the given address space
+    bool isMemoryWatched(S2EExecutionState *state, uint64_t address, uint64_t size) const;
+
+    /// Returns true if a watched range of any address space overlaps [address, address + size).
+    /// Decides which TLB entries trap, because entries of global pages stay valid after the
+    /// page directory changes.
+    bool isMemoryWatchedInAnyAddressSpace(uint64_t address, uint64_t size) const {
+        return overlaps(m_anyWatches, address, size);
+    }
+
+    /// Returns true if some plugin is interested in concrete data memory accesses
+    bool hasConcreteDataMemoryAccessListeners() const {
+        return !onConcreteDataMemoryAccess.empty() || !onWatchedConcreteDataMemoryAccess.empty();
+    }
+
+    /// Emits onConcreteDataMemoryAccess and, if the access hits a watched range, onWatchedConcreteDataMemoryAccess
+    void notifyConcreteDataMemoryAccess(S2EExecutionState *state, uint64_t address, uint64_t value, uint8_t size,
+                                        unsigned flags);
+
     // clang-format off
 
     ///
@@ -266,6 +318,18 @@ public:
                  unsigned /* flags */>
         onConcreteDataMemoryAccess;
 
+    ///
+    /// Same as onConcreteDataMemoryAccess, but only emitted for accesses that
+    /// overlap a range registered with addMemoryWatch().
+    ///
+    sigc::signal<void,
+                 S2EExecutionState*,
+                 uint64_t /* virtual address */,
+                 uint64_t /* value */,
+                 uint8_t /* size */,
+                 unsigned /* flags */>
+        onWatchedConcreteDataMemoryAccess;
+
     ///
     /// Signals that are emitted on each port access.
     ///
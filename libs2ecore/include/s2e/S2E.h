@@ -70,13 +70,28 @@ struct S2EShared {
     // the instance index.
     unsigned instanceIds[S2E_MAX_PROCESSES];
     unsigned instancePids[S2E_MAX_PROCESSES];
+
+    // Number of states each instance could give away to a new instance, and the
+    // time (see getLoadTime) at which the instance last published it. Instances
+    // refresh their entry periodically, entries that are too old are ignored.
+    unsigned instanceLoads[S2E_MAX_PROCESSES];
+    uint64_t instanceLoadTimes[S2E_MAX_PROCESSES];
+
     S2EShared() {
         for (unsigned i = 0; i < S2E_MAX_PROCESSES; ++i) {
             instanceIds[i] = (unsigned) -1;
             instancePids[i] = (unsigned) -1;
+            instanceLoads[i] = 0;
+            instanceLoadTimes[i] = 0;
         }
     }
 
+    // Milliseconds of the monotonic clock, which is the same in all processes
+    static uint64_t getLoadTime() {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+    }
+
     // This API can be used for synchronization
     // (e.g., when a task must be performed by only one instance,
     // and there is a need to get a consensus on what that instance is).
@@ -92,6 +107,22 @@ struct S2EShared {
         assert(ret >= 0);
         return ret;
     }
+
+    // Returns true if no other running instance has more states to give away.
+    // Ties go to the instance with the lowest index. Loads published before
+    // minTime are stale, e.g., the instance is stopped or died without cleaning up.
+    bool isBusiestInstance(unsigned index, uint64_t minTime) const {
+        for (unsigned i = 0; i < S2E_MAX_PROCESSES; ++i) {
+            if (i == index || instanceIds[i] == (unsigned) -1 || instanceLoadTimes[i] < minTime) {
+                continue;
+            }
+
+            if (instanceLoads[i] > instanceLoads[index] || (instanceLoads[i] == instanceLoads[index] && i < index)) {
+                return false;
+            }
+        }
+        return true;
+    }
 };
 
 class S2E {
@@ -265,6 +296,14 @@ public:
 
     unsigned getInstanceIndexWithLowestId();
 
+    /// Publishes the number of states this instance could give away.
+    void publishInstanceLoad(unsigned load);
+
+    /// Returns true if an instance slot is free and this instance has the most
+    /// states, i.e., it is the one that should fork. Loads that are older than
+    /// maxAge milliseconds are ignored.
+    bool isBusiestInstance(uint64_t maxAge);
+
     inline uint64_t getStartTime() const {
         return m_startTime.count();
     }
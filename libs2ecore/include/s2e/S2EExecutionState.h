@@ -93,6 +93,10 @@ protected:
               in shared locations, for inactive - in ObjectStates. */
     bool m_active;
 
+    /** TLB epoch of the executor when the state was last active.
+        If it is older, the saved TLB is stale and must be flushed. */
+    uint64_t m_tlbEpoch;
+
     /** Set to true when the state is killed. The cpu loop actively checks
         for such a condition, and, when met, asks the scheduler to get a new
         state */
@@ -140,6 +144,9 @@ protected:
 
     bool m_forkAborted;
 
+    /** Set when flushing the TLB was skipped while switching to this state */
+    bool m_flushTlbOnFinalize;
+
     unsigned m_nextSymbVarId;
 
     S2EExecutionStateTlb m_tlb;
@@ -182,6 +189,11 @@ public:
         m_memIoVaddr = e;
     }
 
+    /// The translation block whose function the state executes in KLEE
+    S2ETranslationBlock *getCurrentS2ETb() const {
+        return m_lastS2ETb.get();
+    }
+
     ///
     /// \brief Assign a new state id.
     ///
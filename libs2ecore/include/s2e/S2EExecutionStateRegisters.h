@@ -68,7 +68,13 @@ protected:
     klee::IAddressSpaceNotification *m_notification;
     klee::IConcretizer *m_concretizer;
 
+    /// Cache for getSymbolicRegistersMask(), only used while running concretely
+    mutable uint64_t m_symbolicRegsMask;
+    mutable bool m_symbolicRegsMaskValid;
+
 private:
+    void updateNativeRegisters(unsigned offset, unsigned size) const;
+
     /// Read CPU general purpose register
     klee::ref<klee::Expr> readSymbolicRegion(unsigned offset, klee::Expr::Width width) const;
 
@@ -98,7 +104,7 @@ public:
     S2EExecutionStateRegisters(const bool *active, const bool *running_concrete,
                                klee::IAddressSpaceNotification *notification, klee::IConcretizer *concretizer)
         : m_active(active), m_runningConcrete(running_concrete), m_notification(notification),
-          m_concretizer(concretizer){};
+          m_concretizer(concretizer), m_symbolicRegsMask(0), m_symbolicRegsMaskValid(false){};
 
     void initialize(klee::AddressSpace &addressSpace, const klee::ObjectStatePtr &symbolicRegs,
                     const klee::ObjectStatePtr &concreteRegs);
@@ -139,6 +145,10 @@ public:
 
     bool flagsRegistersAreSymbolic() const;
 
+    /// Returns the parts of the symbolic register area that contain symbolic data,
+    /// in the format of the masks computed by tcg_calc_tb_regmask().
+    uint64_t getSymbolicRegistersMask() const;
+
     static bool initialized() {
         return s_concreteRegs.address != 0 && s_symbolicRegs.address != 0;
     }
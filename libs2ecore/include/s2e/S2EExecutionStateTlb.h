@@ -82,6 +82,9 @@ public:
 
     void clearTlbOwnership();
 
+    /// Returns true if a TLB entry points to the given object
+    bool isReferenced(const klee::ObjectStateConstPtr &os) const;
+
     void updateTlbEntry(struct CPUX86State *env, int mmu_idx, uint64_t virtAddr, uint64_t hostAddr);
 
     bool audit();
@@ -24,14 +24,20 @@
 #ifndef S2E_EXECUTOR_H
 #define S2E_EXECUTOR_H
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 
 #include <klee/Executor.h>
+#include <klee/Solver.h>
 #include <llvm/Support/raw_ostream.h>
 #include <s2e/s2e_libcpu.h>
 #include <timer.h>
 
 #include "S2ETranslationBlock.h"
+#include "StateSwapPolicy.h"
 
 struct TranslationBlock;
 struct CPUX86State;
@@ -68,18 +74,99 @@ protected:
 
     bool m_inLoadBalancing;
 
+    /// Number of states this instance could give away, computed on each load balancing tick
+    std::atomic<unsigned> m_instanceLoad;
+
+    /// Time of the last load balancing tick of the execution loop (see S2EShared::getLoadTime)
+    std::atomic<uint64_t> m_lastLoadBalancingTick;
+
+    /// The instance does not compete for free slots until this time, e.g., after a plugin vetoed its fork
+    std::atomic<uint64_t> m_loadBalanceBackoff;
+
+    /// Publishes the load of the instance from a separate thread, so that other instances
+    /// can tell a busy execution loop (which cannot fork) from a dead instance.
+    /// The thread does not survive a process fork.
+    std::thread m_loadPublisher;
+    std::mutex m_loadPublisherLock;
+    std::condition_variable m_loadPublisherCond;
+    bool m_stopLoadPublisher;
+
+    void startLoadPublisher();
+    void stopLoadPublisher();
+    void runLoadPublisher();
+
     struct CPUTimer *m_stateSwitchTimer;
 
+    /// A fork whose branched state waits for a background feasibility check
+    struct DeferredFork {
+        S2EExecutionState *parent;
+        S2EExecutionState *child;
+
+        /// The constraint that the child gets if it is feasible
+        klee::ref<klee::Expr> childCondition;
+
+        /// The condition passed to notifyFork(), if it was called
+        klee::ref<klee::Expr> forkCondition;
+        bool childIsTrue;
+
+        /// Where the parent forked, for the log once the child is known to be feasible
+        uint64_t pc;
+        uint64_t pageDir;
+
+        klee::Z3SolverPtr solver;
+    };
+
+    /// Forks of the active state, which cannot be switched out until they are completed
+    std::vector<DeferredFork> m_deferredForks;
+    std::vector<klee::Z3SolverPtr> m_idleForkSolvers;
+
+    /// Set when a state switch or load balancing waits for the deferred forks
+    bool m_waitForDeferredForks;
+
+    int64_t m_lastPageDedup;
+
+    StateSwapPolicy *m_swapPolicy;
+    int64_t m_lastStateSwap;
+
+    /// Incremented every time the TLBs saved in inactive states become stale,
+    /// e.g., when their pages are swapped out or the memory watches change
+    uint64_t m_tlbEpoch;
+
     // This is a set of TBs that are currently stored in libcpu's TB cache
     std::unordered_set<S2ETranslationBlockPtr, S2ETranslationBlockHash, S2ETranslationBlockEqual> m_s2eTbs;
 
+    struct TbFunction {
+        /// The time the function last ran in KLEE
+        uint64_t lastUse;
+
+        /// Number of translation blocks that point to the function. Blocks with
+        /// identical code share their function.
+        unsigned users;
+    };
+
+    /// LLVM functions of translation blocks. The executor is the only owner of these
+    /// functions. They outlive their blocks, so that retranslated blocks get them back
+    /// from the translator, and are only erased when they are evicted.
+    std::unordered_map<llvm::Function *, TbFunction> m_tbFunctions;
+    uint64_t m_tbFunctionClock;
+    bool m_tbFunctionEvictionPending;
+
+    void evictTbFunctions();
+    void eraseTbFunctions(const std::unordered_set<llvm::Function *> &functions);
+
+    /// Bytes of shared concrete memory copied by the last state switch
+    uint64_t m_lastSwitchSavedBytes;
+    uint64_t m_lastSwitchRestoredBytes;
+
+    uint64_t saveSharedConcreteObjects(S2EExecutionState *state);
+
 public:
     S2EExecutor(S2E *s2e, TCGLLVMTranslator *translator);
     virtual ~S2EExecutor();
 
     /** Called on fork, used to trace forks */
     StatePair fork(klee::ExecutionState &current, const klee::ref<klee::Expr> &condition,
-                   bool keepConditionTrueInCurrentState = false);
+                   bool keepConditionTrueInCurrentState = false, bool deferrable = false);
 
     // A special version of fork() which does not take any symbolic condition,
     // so internally it will just work like the regular fork method
@@ -99,6 +186,9 @@ public:
 
     void flushTb();
 
+    /// Flushes the TLB of the active state and invalidates the TLBs saved in inactive states
+    void flushTlbs(S2EExecutionState *activeState);
+
     /** Create initial execution state */
     S2EExecutionState *createInitialState();
 
@@ -158,6 +248,14 @@ public:
         searcher = s;
     }
 
+    StateSwapPolicy *getSwapPolicy() const {
+        return m_swapPolicy;
+    }
+
+    void setSwapPolicy(StateSwapPolicy *policy) {
+        m_swapPolicy = policy;
+    }
+
     StatePair forkCondition(S2EExecutionState *state, klee::ref<klee::Expr> condition,
                             bool keepConditionTrueInCurrentState = false);
 
@@ -170,10 +268,21 @@ public:
     S2ETranslationBlock *allocateS2ETb();
     void flushS2ETBs();
 
+    void registerTbFunction(llvm::Function *function);
+    void releaseTbFunction(llvm::Function *function);
+
     bool isLoadBalancing() const {
         return m_inLoadBalancing;
     }
 
+    uint64_t getLastSwitchSavedBytes() const {
+        return m_lastSwitchSavedBytes;
+    }
+
+    uint64_t getLastSwitchRestoredBytes() const {
+        return m_lastSwitchRestoredBytes;
+    }
+
     /** Kills the specified state and raises an exception to exit the cpu loop */
     virtual void terminateState(klee::ExecutionState &state);
 
@@ -214,6 +323,23 @@ protected:
 
     void notifyBranch(klee::ExecutionState &state);
 
+    bool canDeferFork(klee::ExecutionState &current);
+    void deferFork(klee::ExecutionState &current, klee::ExecutionState *branchedState,
+                   const klee::ConstraintManager &constraints, const klee::ref<klee::Expr> &condition);
+
+    void resolveDeferredForks(bool wait);
+    void completeDeferredFork(DeferredFork &fork);
+    void dropDeferredForks();
+    bool isDeferredChild(klee::ExecutionState *state) const;
+
+    void printFork(S2EExecutionState *state, uint64_t pc, uint64_t pageDir, const StatePair &targets,
+                   const klee::ref<klee::Expr> &condition);
+
+    void deduplicatePages(S2EExecutionState *activeState);
+
+    unsigned swapOutState(S2EExecutionState *state, S2EExecutionState *activeState);
+    void swapOutIdleStates(S2EExecutionState *activeState);
+
     void initializeStateSwitchTimer();
     static void stateSwitchTimerCallback(void *opaque);
 
@@ -225,7 +351,7 @@ protected:
 private:
     // If `condition` is a nullptr, then no path constraints will be added.
     StatePair doFork(klee::ExecutionState &current, const klee::ref<klee::Expr> &condition,
-                     bool keepConditionTrueInCurrentState);
+                     bool keepConditionTrueInCurrentState, bool deferrable);
 };
 
 } // namespace s2e
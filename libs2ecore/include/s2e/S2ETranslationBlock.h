@@ -41,8 +41,8 @@ struct S2ETranslationBlock {
     llvm::Function *translationBlock;
 
     // A list of all instruction execution signals associated with
-    // this translation block. The LLVM function has hard-coded pointers
-    // to this vector.
+    // this translation block. The native code has hard-coded pointers
+    // to this vector, the LLVM function gets them by index.
     llvm::SmallVector<ExecutionSignal *, 16> executionSignals;
 
     S2ETranslationBlock() {
@@ -0,0 +1,81 @@
+///
+/// Copyright (C) 2020, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#ifndef S2E_STATESWAPPOLICY_H
+#define S2E_STATESWAPPOLICY_H
+
+#include <inttypes.h>
+#include <unordered_map>
+#include <vector>
+
+#include <klee/Common.h>
+
+namespace s2e {
+
+class S2EExecutionState;
+
+///
+/// \brief Decides which inactive states have their memory pages
+/// moved to the swap file.
+///
+/// The executor periodically asks the policy for states to swap out.
+/// Swapped pages are read back when the state accesses them again.
+///
+class StateSwapPolicy {
+public:
+    virtual ~StateSwapPolicy() {
+    }
+
+    /// Called when the executor switches to the state
+    virtual void activate(S2EExecutionState *state) = 0;
+
+    /// Called before the state is deleted
+    virtual void remove(S2EExecutionState *state) = 0;
+
+    /// Appends to \p toSwap the inactive states whose pages must be swapped out
+    virtual void selectStates(const klee::StateSet &states, std::vector<S2EExecutionState *> &toSwap) = 0;
+};
+
+/// Swaps out states that have not run for a given time
+class IdleStateSwapPolicy : public StateSwapPolicy {
+    struct StateInfo {
+        int64_t lastActive;
+        bool swapped;
+    };
+
+    int64_t m_idleTime;
+    std::unordered_map<S2EExecutionState *, StateInfo> m_states;
+
+public:
+    /// \param idleTime time in milliseconds
+    IdleStateSwapPolicy(int64_t idleTime) : m_idleTime(idleTime) {
+    }
+
+    virtual void activate(S2EExecutionState *state);
+    virtual void remove(S2EExecutionState *state);
+    virtual void selectStates(const klee::StateSet &states, std::vector<S2EExecutionState *> &toSwap);
+};
+
+} // namespace s2e
+
+#endif
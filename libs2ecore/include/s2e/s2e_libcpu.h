@@ -84,6 +84,9 @@ extern int g_s2e_concretize_io_writes;
 /** Prevent anything from flushing the TLB cache */
 extern int g_se_disable_tlb_flush;
 
+/** Set when a TLB flush was requested while flushing was disabled */
+extern int g_se_tlb_flush_skipped;
+
 /** Fast check for cpu-exec.c */
 extern int g_s2e_fast_concrete_invocation;
 
@@ -198,6 +201,11 @@ void s2e_fix_code_gen_ptr(struct TranslationBlock *tb, int code_gen_size);
 
 void se_tb_safe_flush(void);
 
+/** Invalidates the TBs of the code pages for which page_changed returns non-zero.
+    Returns the number of invalidated pages. */
+unsigned se_tb_invalidate_code_pages(struct CPUX86State *env, int (*page_changed)(void *opaque, uintptr_t host_page),
+                                     void *opaque);
+
 /******************************************************/
 /* Prototypes for special functions used in LLVM code */
 /* NOTE: this functions should never be defined. They */
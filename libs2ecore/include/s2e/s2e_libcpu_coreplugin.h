@@ -88,9 +88,11 @@ int s2e_on_call_return_translate(uint64_t pc, int isCall);
 #define MEM_TRACE_FLAG_PLUGIN  8
 
 void s2e_after_memory_access(uint64_t vaddr, uint64_t value, unsigned size, unsigned flags, uintptr_t retaddr);
+int s2e_is_memory_watched(uint64_t vaddr, uint64_t size);
 
 extern unsigned *g_s2e_before_memory_access_signals_count;
 extern unsigned *g_s2e_after_memory_access_signals_count;
+extern unsigned *g_s2e_watched_memory_access_signals_count;
 extern unsigned *g_s2e_on_translate_soft_interrupt_signals_count;
 extern unsigned *g_s2e_on_translate_block_start_signals_count;
 extern unsigned *g_s2e_on_translate_block_end_signals_count;
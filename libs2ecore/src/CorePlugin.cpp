@@ -21,7 +21,10 @@
 /// SOFTWARE.
 ///
 
+#include <algorithm>
+
 #include <s2e/S2E.h>
+#include <s2e/S2EExecutionState.h>
 #include <s2e/S2EExecutor.h>
 #include <s2e/s2e_libcpu.h>
 
@@ -36,6 +39,7 @@ S2E_DEFINE_PLUGIN(CorePlugin, "S2E core functionality", "Core", );
 extern "C" {
 unsigned *g_s2e_before_memory_access_signals_count = nullptr;
 unsigned *g_s2e_after_memory_access_signals_count = nullptr;
+unsigned *g_s2e_watched_memory_access_signals_count = nullptr;
 unsigned *g_s2e_on_translate_soft_interrupt_signals_count = nullptr;
 unsigned *g_s2e_on_translate_block_start_signals_count = nullptr;
 unsigned *g_s2e_on_translate_block_end_signals_count = nullptr;
@@ -60,6 +64,7 @@ using namespace s2e;
 void CorePlugin::initialize() {
     g_s2e_before_memory_access_signals_count = onBeforeSymbolicDataMemoryAccess.getActiveSignalsPtr();
     g_s2e_after_memory_access_signals_count = onConcreteDataMemoryAccess.getActiveSignalsPtr();
+    g_s2e_watched_memory_access_signals_count = onWatchedConcreteDataMemoryAccess.getActiveSignalsPtr();
 
     g_s2e_on_translate_soft_interrupt_signals_count = onTranslateSoftInterruptStart.getActiveSignalsPtr();
     g_s2e_on_translate_block_start_signals_count = onTranslateBlockStart.getActiveSignalsPtr();
@@ -87,6 +92,7 @@ void CorePlugin::onInitializationCompleteCb(S2EExecutionState *state) {
 
     unsigned *vars[] = {g_s2e_before_memory_access_signals_count,
                         g_s2e_after_memory_access_signals_count,
+                        g_s2e_watched_memory_access_signals_count,
                         g_s2e_on_translate_block_start_signals_count,
                         g_s2e_on_translate_block_end_signals_count,
                         g_s2e_on_translate_instruction_start_signals_count,
@@ -113,3 +119,99 @@ void CorePlugin::onInitializationCompleteCb(S2EExecutionState *state) {
     exec->registerSharedExternalObject(state, &g_s2e_fork_on_symbolic_address, sizeof(g_s2e_fork_on_symbolic_address));
     exec->registerSharedExternalObject(state, &g_s2e_enable_mmio_checks, sizeof(g_s2e_enable_mmio_checks));
 }
+
+/// Last address of [address, address + size), the end of the range may wrap around
+static uint64_t getLastAddress(uint64_t address, uint64_t size) {
+    uint64_t last = address + size - 1;
+    return last < address ? UINT64_MAX : last;
+}
+
+/// Adds [start, last] to the index, merging the intervals it overlaps
+static void insertWatch(llvm::IntervalMap<uint64_t, bool> &index, uint64_t start, uint64_t last) {
+    // First interval that ends at or after the start
+    auto it = index.find(start);
+    while (it.valid() && it.start() <= last) {
+        start = std::min(start, it.start());
+        last = std::max(last, it.stop());
+        it.erase();
+    }
+
+    index.insert(start, last, true);
+}
+
+void CorePlugin::rebuildWatchIndex() {
+    m_anyWatches.clear();
+    m_watchesByPageDir.clear();
+
+    for (const auto &watch : m_memoryWatches) {
+        uint64_t pageDir, start, last;
+        std::tie(pageDir, start, last) = watch;
+
+        auto &index = m_watchesByPageDir[pageDir];
+        if (!index) {
+            index.reset(new WatchIndex(m_watchAllocator));
+        }
+
+        insertWatch(*index, start, last);
+        insertWatch(m_anyWatches, start, last);
+    }
+}
+
+bool CorePlugin::overlaps(const WatchIndex &index, uint64_t address, uint64_t size) {
+    if (index.empty() || !size) {
+        return false;
+    }
+
+    // First interval that ends at or after the address
+    auto it = index.find(address);
+    return it.valid() && it.start() <= getLastAddress(address, size);
+}
+
+void CorePlugin::addMemoryWatch(S2EExecutionState *state, uint64_t start, uint64_t size, uint64_t pageDir) {
+    assert(size > 0);
+    m_memoryWatches.insert(std::make_tuple(pageDir, start, getLastAddress(start, size)));
+    rebuildWatchIndex();
+
+    // Cached TLB entries of the watched pages don't have the trace flag yet
+    if (state) {
+        s2e()->getExecutor()->flushTlbs(state);
+    }
+}
+
+void CorePlugin::removeMemoryWatch(S2EExecutionState *state, uint64_t start, uint64_t size, uint64_t pageDir) {
+    auto it = m_memoryWatches.find(std::make_tuple(pageDir, start, getLastAddress(start, size)));
+    if (it == m_memoryWatches.end()) {
+        return;
+    }
+
+    m_memoryWatches.erase(it);
+    rebuildWatchIndex();
+
+    // Let the unwatched pages go back to the fast path
+    if (state) {
+        s2e()->getExecutor()->flushTlbs(state);
+    }
+}
+
+bool CorePlugin::isMemoryWatched(S2EExecutionState *state, uint64_t address, uint64_t size) const {
+    if (!overlaps(m_anyWatches, address, size)) {
+        return false;
+    }
+
+    auto it = m_watchesByPageDir.find(0);
+    if (it != m_watchesByPageDir.end() && overlaps(*it->second, address, size)) {
+        return true;
+    }
+
+    it = m_watchesByPageDir.find(state->regs()->getPageDir());
+    return it != m_watchesByPageDir.end() && overlaps(*it->second, address, size);
+}
+
+void CorePlugin::notifyConcreteDataMemoryAccess(S2EExecutionState *state, uint64_t address, uint64_t value,
+                                                uint8_t size, unsigned flags) {
+    onConcreteDataMemoryAccess.emit(state, address, value, size, flags);
+
+    if (!onWatchedConcreteDataMemoryAccess.empty() && isMemoryWatched(state, address, size)) {
+        onWatchedConcreteDataMemoryAccess.emit(state, address, value, size, flags);
+    }
+}
@@ -50,6 +50,7 @@ void s2e_gen_flags_update(void *context);
 #include <s2e/s2e_libcpu.h>
 
 #include <klee/Common.h>
+#include <klee/util/Activity.h>
 #include <s2e/CorePlugin.h>
 
 using namespace s2e;
@@ -65,6 +66,7 @@ void s2e_tcg_execution_handler(void *signal, uint64_t pc) {
     try {
         ExecutionSignal *s = (ExecutionSignal *) signal;
         if (g_s2e_enable_signals) {
+            klee::ActivityScope activity(klee::Activity::PluginCallback);
             s->emit(g_s2e_state, pc);
         }
     } catch (s2e::CpuExitException &) {
@@ -77,6 +79,7 @@ void s2e_tcg_custom_instruction_handler(uint64_t arg) {
            "You must activate a plugin that uses custom instructions.");
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onCustomInstruction.emit(g_s2e_state, arg);
     } catch (s2e::CpuExitException &) {
         longjmp(env->jmp_env, 1);
@@ -127,6 +130,7 @@ void s2e_on_translate_soft_interrupt_start(void *context, TranslationBlock *tb,
     assert(signal->empty());
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onTranslateSoftInterruptStart.emit(signal, g_s2e_state, tb, pc, vector);
         if (!signal->empty()) {
             s2e_gen_pc_update(context, pc, tb->cs_base);
@@ -146,6 +150,7 @@ void s2e_on_translate_block_start(void *context, TranslationBlock *tb, uint64_t
     assert(signal->empty());
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onTranslateBlockStart.emit(signal, g_s2e_state, tb, pc);
         if (!signal->empty()) {
             s2e_gen_pc_update(context, pc, tb->cs_base);
@@ -165,6 +170,7 @@ void s2e_on_translate_block_end(TranslationBlock *tb, uint64_t insPc, int static
     assert(signal->empty());
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onTranslateBlockEnd.emit(signal, g_s2e_state, tb, insPc, staticTarget, targetPc);
     } catch (s2e::CpuExitException &) {
         longjmp(env->jmp_env, 1);
@@ -180,6 +186,7 @@ void s2e_on_translate_block_complete(TranslationBlock *tb, uint64_t pc) {
     assert(g_s2e_state->isActive());
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onTranslateBlockComplete.emit(g_s2e_state, tb, pc);
     } catch (s2e::CpuExitException &) {
         longjmp(env->jmp_env, 1);
@@ -194,6 +201,7 @@ void s2e_on_translate_instruction_start(void *context, TranslationBlock *tb, uin
     assert(signal->empty());
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onTranslateInstructionStart.emit(signal, g_s2e_state, tb, pc);
         if (!signal->empty()) {
             s2e_gen_pc_update(context, pc, tb->cs_base);
@@ -215,6 +223,7 @@ void s2e_on_translate_special_instruction_end(void *context, TranslationBlock *t
     assert(signal->empty());
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onTranslateSpecialInstructionEnd.emit(signal, g_s2e_state, tb, pc, type, data);
         if (!signal->empty()) {
 
@@ -238,6 +247,7 @@ void s2e_on_translate_jump_start(void *context, TranslationBlock *tb, uint64_t p
     assert(signal->empty());
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onTranslateJumpStart.emit(signal, g_s2e_state, tb, pc, jump_type);
         if (!signal->empty()) {
             s2e_gen_pc_update(context, pc, tb->cs_base);
@@ -257,6 +267,7 @@ void s2e_on_translate_indirect_cti_start(void *context, TranslationBlock *tb, ui
     assert(signal->empty());
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onTranslateICTIStart.emit(signal, g_s2e_state, tb, pc, rm, op, offset);
         if (!signal->empty()) {
             s2e_gen_pc_update(context, pc, tb->cs_base);
@@ -276,6 +287,7 @@ void s2e_on_translate_lea_rip_relative(void *context, TranslationBlock *tb, uint
 
     assert(signal->empty());
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onTranslateLeaRipRelative.emit(signal, g_s2e_state, tb, pc, addr);
 
         if (!signal->empty()) {
@@ -298,6 +310,7 @@ void s2e_on_translate_instruction_end(void *context, TranslationBlock *tb, uint6
     assert(signal->empty());
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onTranslateInstructionEnd.emit(signal, g_s2e_state, tb, pc);
         if (!signal->empty()) {
             s2e_gen_flags_update(context);
@@ -318,6 +331,7 @@ void s2e_on_translate_register_access(TranslationBlock *tb, uint64_t pc, uint64_
     assert(signal->empty());
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onTranslateRegisterAccessEnd.emit(signal, g_s2e_state, tb, pc, readMask, writeMask,
                                                                   (bool) isMemoryAccess);
 
@@ -334,6 +348,7 @@ void s2e_on_exception(unsigned intNb) {
     assert(g_s2e_state->isActive());
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onException.emit(g_s2e_state, intNb, g_s2e_state->regs()->getPc());
     } catch (s2e::CpuExitException &) {
         longjmp(env->jmp_env, 1);
@@ -344,7 +359,10 @@ static CPUTimer *s_timer = nullptr;
 
 static void s2e_timer_cb(void *opaque) {
     CorePlugin *c = (CorePlugin *) opaque;
-    c->onTimer.emit();
+    {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
+        c->onTimer.emit();
+    }
     libcpu_mod_timer(s_timer, libcpu_get_clock_ms(rt_clock) + 1000);
 }
 
@@ -367,12 +385,17 @@ void s2e_after_memory_access(uint64_t vaddr, uint64_t value, unsigned size, unsi
     }
 
     try {
-        g_s2e->getCorePlugin()->onConcreteDataMemoryAccess.emit(g_s2e_state, vaddr, value, size, flags);
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
+        g_s2e->getCorePlugin()->notifyConcreteDataMemoryAccess(g_s2e_state, vaddr, value, size, flags);
     } catch (s2e::CpuExitException &) {
         longjmp(env->jmp_env, 1);
     }
 }
 
+int s2e_is_memory_watched(uint64_t vaddr, uint64_t size) {
+    return g_s2e->getCorePlugin()->isMemoryWatchedInAnyAddressSpace(vaddr, size);
+}
+
 uint8_t __ldb_mmu_trace(uint8_t *host_addr, target_ulong vaddr) {
     s2e_after_memory_access(vaddr, *host_addr, 1, 0, (uintptr_t) GETPC());
     return *host_addr;
@@ -415,6 +438,7 @@ void s2e_on_page_fault(uint64_t addr, int is_write, void *retaddr) {
     }
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onPageFault.emit(g_s2e_state, addr, (bool) is_write);
     } catch (s2e::CpuExitException &) {
         longjmp(env->jmp_env, 1);
@@ -427,6 +451,7 @@ void s2e_on_tlb_miss(uint64_t addr, int is_write, void *retaddr) {
     }
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onTlbMiss.emit(g_s2e_state, addr, (bool) is_write);
     } catch (s2e::CpuExitException &) {
         longjmp(env->jmp_env, 1);
@@ -443,6 +468,7 @@ void s2e_trace_port_access(uint64_t port, uint64_t value, unsigned size, int isW
     }
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onPortAccess.emit(g_s2e_state, klee::ConstantExpr::create(port, 64),
                                                   klee::ConstantExpr::create(value, size), isWrite);
     } catch (s2e::CpuExitException &) {
@@ -454,6 +480,7 @@ void s2e_on_privilege_change(unsigned previous, unsigned current) {
     assert(g_s2e_state->isActive());
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onPrivilegeChange.emit(g_s2e_state, previous, current);
     } catch (s2e::CpuExitException &) {
         pabort("Cannot throw exceptions here. VM state may be inconsistent at this point.");
@@ -464,6 +491,7 @@ void s2e_on_page_directory_change(uint64_t previous, uint64_t current) {
     assert(g_s2e_state->isActive());
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onPageDirectoryChange.emit(g_s2e_state, previous, current);
     } catch (s2e::CpuExitException &) {
         pabort("Cannot throw exceptions here. VM state may be inconsistent at this point.");
@@ -481,6 +509,7 @@ void s2e_on_initialization_complete(void) {
 int s2e_on_call_return_translate(uint64_t pc, int isCall) {
     bool instrument = false;
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onCallReturnTranslate.emit(g_s2e_state, pc, isCall, &instrument);
     } catch (s2e::CpuExitException &) {
         pabort("Cannot throw exceptions here.");
@@ -22,6 +22,7 @@
 ///
 
 #include <klee/Expr.h>
+#include <klee/util/Activity.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Support/CommandLine.h>
 
@@ -84,8 +85,11 @@ void handleForkAndConcretize(Executor *executor, ExecutionState *state, klee::KI
         castedAddress = klee::ExtractExpr::create(address, 0, klee::Expr::Int32);
     }
 
-    g_s2e->getCorePlugin()->onSymbolicAddress.emit(s2eState, castedAddress, concreteAddress->getZExtValue(),
-                                                   doConcretize, reason);
+    {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
+        g_s2e->getCorePlugin()->onSymbolicAddress.emit(s2eState, castedAddress, concreteAddress->getZExtValue(),
+                                                       doConcretize, reason);
+    }
 
     klee::ref<klee::Expr> condition = EqExpr::create(concreteAddress, address);
 
@@ -138,6 +142,22 @@ static void handleGetValue(klee::Executor *executor, klee::ExecutionState *state
     state->bindLocal(target, result);
 }
 
+/// Returns a host pointer that belongs to the translation block that the state
+/// executes, e.g., one of its execution signals. Translation blocks with the same
+/// code share their LLVM function, so it cannot embed these pointers.
+static void handleGetRelocation(klee::Executor *executor, klee::ExecutionState *state, klee::KInstruction *target,
+                                std::vector<klee::ref<klee::Expr>> &args) {
+    S2EExecutionState *s2eState = static_cast<S2EExecutionState *>(state);
+    assert(args.size() == 1);
+
+    auto index = cast<klee::ConstantExpr>(args[0])->getZExtValue();
+    auto se_tb = s2eState->getCurrentS2ETb();
+    assert(se_tb && index < se_tb->executionSignals.size());
+
+    auto pointer = (uintptr_t) se_tb->executionSignals[index];
+    state->bindLocal(target, klee::ConstantExpr::create(pointer, klee::Expr::Int64));
+}
+
 static void handlerWriteMemIoVaddr(klee::Executor *executor, klee::ExecutionState *state, klee::KInstruction *target,
                                    std::vector<klee::ref<klee::Expr>> &args) {
     S2EExecutionState *s2eState = static_cast<S2EExecutionState *>(state);
@@ -185,6 +205,7 @@ static void handlerBeforeMemoryAccess(klee::Executor *executor, klee::ExecutionS
     assert(dynamic_cast<S2EExecutionState *>(state));
     S2EExecutionState *s2eState = static_cast<S2EExecutionState *>(state);
 
+    klee::ActivityScope activity(klee::Activity::PluginCallback);
     g_s2e->getCorePlugin()->onBeforeSymbolicDataMemoryAccess.emit(s2eState, vaddr, value, flags);
 }
 
@@ -192,7 +213,7 @@ void handlerAfterMemoryAccess(Executor *executor, ExecutionState *state, klee::K
                               std::vector<klee::ref<klee::Expr>> &args) {
     auto corePlugin = g_s2e->getCorePlugin();
 
-    if (corePlugin->onAfterSymbolicDataMemoryAccess.empty() && corePlugin->onConcreteDataMemoryAccess.empty()) {
+    if (corePlugin->onAfterSymbolicDataMemoryAccess.empty() && !corePlugin->hasConcreteDataMemoryAccessListeners()) {
         return;
     }
 
@@ -222,8 +243,9 @@ void handlerAfterMemoryAccess(Executor *executor, ExecutionState *state, klee::K
 
     klee::ref<Expr> haddr = klee::ConstantExpr::create(0, klee::Expr::Int64);
 
+    klee::ActivityScope activity(klee::Activity::PluginCallback);
     if (isa<klee::ConstantExpr>(value) && isa<klee::ConstantExpr>(vaddr)) {
-        g_s2e->getCorePlugin()->onConcreteDataMemoryAccess.emit(
+        corePlugin->notifyConcreteDataMemoryAccess(
             s2eState, cast<klee::ConstantExpr>(vaddr)->getZExtValue(), cast<klee::ConstantExpr>(value)->getZExtValue(),
             klee::Expr::getMinBytesForWidth(width), flags);
     } else {
@@ -324,6 +346,7 @@ static void handlerTracePortAccess(Executor *executor, ExecutionState *state, kl
     }
 
     if (!g_s2e->getCorePlugin()->onPortAccess.empty()) {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onPortAccess.emit(s2eState, port, resizedValue, isWrite);
     }
 }
@@ -335,6 +358,11 @@ static Handler s_handlers[] = {{"tcg_llvm_write_mem_io_vaddr", handlerWriteMemIo
                                {"tcg_llvm_trace_mmio_access", handlerTraceMmioAccess, nullptr},
                                {"tcg_llvm_fork_and_concretize", handleForkAndConcretize, nullptr},
                                {"tcg_llvm_get_value", handleGetValue, nullptr},
+                               {"tcg_llvm_get_relocation", handleGetRelocation,
+                                [](llvm::Module &module) {
+                                    auto i64 = llvm::Type::getInt64Ty(module.getContext());
+                                    return llvm::FunctionType::get(i64, {i64}, false);
+                                }},
                                {"", nullptr, nullptr}};
 
 void S2EExecutor::registerFunctionHandlers(llvm::Module &module) {
@@ -51,6 +51,16 @@ namespace s2e {
 // XXX: Fix this
 #define CPU_MMU_INDEX 0
 
+/// Returns true if the access must be passed to handlerAfterMemoryAccess.
+/// When plugins only watch some ranges, the pages that are not watched don't have the trace flag.
+static bool isAccessTraced(CorePlugin *corePlugin, const CPUTLBEntry &tlbEntry) {
+    if (!corePlugin->onAfterSymbolicDataMemoryAccess.empty() || !corePlugin->onConcreteDataMemoryAccess.empty()) {
+        return true;
+    }
+
+    return !corePlugin->onWatchedConcreteDataMemoryAccess.empty() && (tlbEntry.addr_read & TLB_MEM_TRACE);
+}
+
 // This is an io_write_chkX_mmu function
 // XXX: width is redundant
 static void io_write_chk(S2EExecutionState *state, CPUArchState *env, target_phys_addr_t physaddr, const ref<Expr> &val,
@@ -254,9 +264,7 @@ redo:
                 value = io_read_chk(s2estate, tlbEntry, ioaddr, addr, retaddr, width);
             }
 
-            auto corePlugin = g_s2e->getCorePlugin();
-            if (!corePlugin->onAfterSymbolicDataMemoryAccess.empty() ||
-                !corePlugin->onConcreteDataMemoryAccess.empty()) {
+            if (isAccessTraced(g_s2e->getCorePlugin(), tlbEntry)) {
                 // Trace the access
                 std::vector<ref<Expr>> traceArgs;
                 traceArgs.push_back(symbAddress);
@@ -321,7 +329,7 @@ redo:
 
                 auto corePlugin = g_s2e->getCorePlugin();
                 if (!corePlugin->onAfterSymbolicDataMemoryAccess.empty() ||
-                    !corePlugin->onConcreteDataMemoryAccess.empty()) {
+                    corePlugin->hasConcreteDataMemoryAccessListeners()) {
                     // Trace the access
                     std::vector<ref<Expr>> traceArgs;
                     traceArgs.push_back(symbAddress);
@@ -348,9 +356,7 @@ redo:
                 value = s2estate->mem()->read(addr + addend, width, HostAddress);
             }
 
-            auto corePlugin = g_s2e->getCorePlugin();
-            if (!corePlugin->onAfterSymbolicDataMemoryAccess.empty() ||
-                !corePlugin->onConcreteDataMemoryAccess.empty()) {
+            if (isAccessTraced(g_s2e->getCorePlugin(), tlbEntry)) {
                 // Trace the access
                 std::vector<ref<Expr>> traceArgs;
                 traceArgs.push_back(symbAddress);
@@ -505,8 +511,7 @@ static void handle_ldst_kernel(Executor *executor, ExecutionState *state, klee::
 
         // Trace the access
         // TODO: don't do this if there is no instrumentation
-        auto corePlugin = g_s2e->getCorePlugin();
-        if (!corePlugin->onAfterSymbolicDataMemoryAccess.empty() || !corePlugin->onConcreteDataMemoryAccess.empty()) {
+        if (isAccessTraced(g_s2e->getCorePlugin(), tlbEntry)) {
             std::vector<ref<Expr>> traceArgs;
             traceArgs.push_back(constantAddress);
             traceArgs.push_back(value);
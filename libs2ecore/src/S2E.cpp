@@ -47,6 +47,7 @@
 #include <llvm/IR/Module.h>
 
 #include <klee/Common.h>
+#include <klee/util/PageSwap.h>
 
 #include <assert.h>
 #include <deque>
@@ -120,6 +121,8 @@ bool S2E::initialize(int argc, char **argv, TCGLLVMTranslator *translator, const
     shared->lastFileId = 1;
     shared->instanceIds[m_currentInstanceIndex] = m_currentInstanceId;
     shared->instancePids[m_currentInstanceIndex] = getpid();
+    shared->instanceLoads[m_currentInstanceIndex] = 0;
+    shared->instanceLoadTimes[m_currentInstanceIndex] = 0;
     m_sync.release();
 
     /* Open output directory. Do it at the very beginning so that
@@ -228,8 +231,10 @@ S2E::~S2E() {
     assert(shared->instanceIds[m_currentInstanceIndex] == m_currentInstanceId);
     shared->instanceIds[m_currentInstanceIndex] = (unsigned) -1;
     shared->instancePids[m_currentInstanceIndex] = (unsigned) -1;
+    shared->instanceLoads[m_currentInstanceIndex] = 0;
+    shared->instanceLoadTimes[m_currentInstanceIndex] = 0;
     assert(shared->currentInstanceCount > 0);
-    --shared->currentInstanceCount;
+    __atomic_sub_fetch(&shared->currentInstanceCount, 1, __ATOMIC_RELAXED);
 
     m_sync.release();
 
@@ -524,7 +529,7 @@ int S2E::fork() {
 
     unsigned newProcessId = shared->lastFileId;
     ++shared->lastFileId;
-    ++shared->currentInstanceCount;
+    __atomic_add_fetch(&shared->currentInstanceCount, 1, __ATOMIC_RELAXED);
 
     m_sync.release();
 
@@ -540,7 +545,7 @@ int S2E::fork() {
         // succeeded while we were handling the failure.
 
         assert(shared->currentInstanceCount > 1);
-        --shared->currentInstanceCount;
+        __atomic_sub_fetch(&shared->currentInstanceCount, 1, __ATOMIC_RELAXED);
 
         m_sync.release();
         return -1;
@@ -554,6 +559,8 @@ int S2E::fork() {
             if (shared->instanceIds[i] == (unsigned) -1) {
                 shared->instanceIds[i] = newProcessId;
                 shared->instancePids[i] = getpid();
+                shared->instanceLoads[i] = 0;
+                shared->instanceLoadTimes[i] = 0;
                 m_currentInstanceIndex = i;
                 break;
             }
@@ -572,29 +579,28 @@ int S2E::fork() {
         s2e_kvm_clone_process();
     }
 
+    // Both processes inherit the mapping of the swap file, they must write to separate ones
+    if (auto swap = klee::PageSwap::get()) {
+        swap->onProcessFork();
+    }
+
     return pid == 0 ? 1 : 0;
 #endif
 }
 
+// State ids are allocated on every fork, they don't need the lock
 unsigned S2E::fetchAndIncrementStateId() {
-    S2EShared *shared = m_sync.acquire();
-    unsigned ret = shared->lastStateId;
-    ++shared->lastStateId;
-    m_sync.release();
-    return ret;
+    S2EShared *shared = m_sync.get();
+    return __atomic_fetch_add(&shared->lastStateId, 1, __ATOMIC_RELAXED);
 }
 unsigned S2E::fetchNextStateId() {
-    S2EShared *shared = m_sync.acquire();
-    unsigned ret = shared->lastStateId;
-    m_sync.release();
-    return ret;
+    S2EShared *shared = m_sync.get();
+    return __atomic_load_n(&shared->lastStateId, __ATOMIC_RELAXED);
 }
 
 unsigned S2E::getCurrentInstanceCount() {
-    S2EShared *shared = m_sync.acquire();
-    unsigned ret = shared->currentInstanceCount;
-    m_sync.release();
-    return ret;
+    S2EShared *shared = m_sync.get();
+    return __atomic_load_n(&shared->currentInstanceCount, __ATOMIC_RELAXED);
 }
 
 unsigned S2E::getInstanceId(unsigned index) {
@@ -612,6 +618,28 @@ unsigned S2E::getInstanceIndexWithLowestId() {
     return ret;
 }
 
+// Called from the load publisher thread of the executor
+void S2E::publishInstanceLoad(unsigned load) {
+    S2EShared *shared = m_sync.acquire();
+    // The slot may already be released if the instance is terminating
+    if (shared->instanceIds[m_currentInstanceIndex] == m_currentInstanceId) {
+        shared->instanceLoads[m_currentInstanceIndex] = load;
+        shared->instanceLoadTimes[m_currentInstanceIndex] = S2EShared::getLoadTime();
+    }
+    m_sync.release();
+}
+
+bool S2E::isBusiestInstance(uint64_t maxAge) {
+    uint64_t now = S2EShared::getLoadTime();
+    uint64_t minTime = now > maxAge ? now - maxAge : 0;
+
+    S2EShared *shared = m_sync.acquire();
+    bool ret =
+        shared->currentInstanceCount < m_maxInstances && shared->isBusiestInstance(m_currentInstanceIndex, minTime);
+    m_sync.release();
+    return ret;
+}
+
 } // namespace s2e
 
 /******************************/
@@ -68,11 +68,11 @@ unsigned S2EExecutionState::s_lastSymbolicId = 0;
 
 S2EExecutionState::S2EExecutionState(klee::KFunction *kf)
     : klee::ExecutionState(kf), m_stateID(g_s2e->fetchAndIncrementStateId()), m_startSymbexAtPC((uint64_t) -1),
-      m_active(true), m_zombie(false), m_yielded(false), m_runningConcrete(true), m_pinned(false),
+      m_active(true), m_tlbEpoch(0), m_zombie(false), m_yielded(false), m_runningConcrete(true), m_pinned(false),
       m_isStateSwitchForbidden(false), m_deviceState(this), m_asCache(&addressSpace),
       m_registers(&m_active, &m_runningConcrete, this, this), m_memory(), m_lastS2ETb(nullptr),
-      m_needFinalizeTBExec(false), m_forkAborted(false), m_nextSymbVarId(0), m_tlb(&m_asCache, &m_registers),
-      m_runningExceptionEmulationCode(false) {
+      m_needFinalizeTBExec(false), m_forkAborted(false), m_flushTlbOnFinalize(false), m_nextSymbVarId(0),
+      m_tlb(&m_asCache, &m_registers), m_runningExceptionEmulationCode(false) {
     // XXX: make this a struct, not a pointer...
     m_timersState = new TimersState;
     m_guid = m_stateID;
@@ -506,8 +506,8 @@ bool S2EExecutionState::testConstraints(const std::vector<ref<Expr>> &c, Constra
     ArrayVec symbObjects = symbolics;
 
     std::vector<std::vector<unsigned char>> concreteObjects;
-    if (!solver()->getInitialValues(Query(tmpConstraints, ConstantExpr::create(0, Expr::Bool)), symbObjects,
-                                    concreteObjects)) {
+    if (!solver()->getInitialValues(Query(tmpConstraints, ConstantExpr::create(0, Expr::Bool), concolics.get()),
+                                    symbObjects, concreteObjects)) {
         return false;
     }
 
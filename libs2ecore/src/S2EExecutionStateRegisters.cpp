@@ -88,6 +88,8 @@ void S2EExecutionStateRegisters::copySymbRegs(bool toNative) {
         assert(*m_runningConcrete);
         memcpy(m_symbolicRegs->getConcreteBuffer(true), (void *) s_symbolicRegs.address, m_symbolicRegs->getSize());
     }
+
+    m_symbolicRegsMaskValid = false;
 }
 
 // XXX: The returned pointer cannot be used to modify symbolic state
@@ -120,6 +122,61 @@ bool S2EExecutionStateRegisters::addressSpaceChange(const klee::ObjectKey &key,
     }
 }
 
+uint64_t S2EExecutionStateRegisters::getSymbolicRegistersMask() const {
+    if (m_symbolicRegs->isAllConcrete()) {
+        return 0;
+    }
+
+    // Registers may only become symbolic in KLEE or through writeSymbolicRegionUnsafe
+    if (*m_runningConcrete && m_symbolicRegsMaskValid) {
+        return m_symbolicRegsMask;
+    }
+
+    uint64_t mask = 0;
+    unsigned size = m_symbolicRegs->getSize();
+    for (unsigned slot = 0; slot < 64; ++slot) {
+        unsigned offset = slot * TCG_REGMASK_SLOT_SIZE;
+        if (offset >= size) {
+            break;
+        }
+
+        // The last bit covers the rest of the area
+        unsigned slotSize = slot == 63 ? size - offset : std::min<unsigned>(TCG_REGMASK_SLOT_SIZE, size - offset);
+        if (!m_symbolicRegs->isConcrete(offset, slotSize * 8)) {
+            mask |= 1ull << slot;
+        }
+    }
+
+    m_symbolicRegsMask = mask;
+    m_symbolicRegsMaskValid = true;
+    return mask;
+}
+
+///
+/// \brief Updates the native register area after a write to the symbolic registers object
+///
+/// Registers may stay symbolic while the state runs concretely. Translation blocks that
+/// run natively read the native area, and switching to symbolic mode copies it back into
+/// the object, so the concrete bytes of the written range must be copied there too.
+///
+void S2EExecutionStateRegisters::updateNativeRegisters(unsigned offset, unsigned size) const {
+    m_symbolicRegsMaskValid = false;
+
+    if (!*m_runningConcrete) {
+        return;
+    }
+
+    auto native = (uint8_t *) s_symbolicRegs.address;
+    for (unsigned i = offset; i < offset + size; ++i) {
+        auto value = dyn_cast<ConstantExpr>(m_symbolicRegs->read8(i));
+        if (value) {
+            native[i] = value->getZExtValue(8);
+        }
+    }
+
+    env->se_symbolic_regs = getSymbolicRegistersMask();
+}
+
 bool S2EExecutionStateRegisters::flagsRegistersAreSymbolic() const {
     if (m_symbolicRegs->isAllConcrete())
         return false;
@@ -184,7 +241,8 @@ bool S2EExecutionStateRegisters::readSymbolicRegion(unsigned offset, void *_buf,
             std::string reason = "access to " + regName + " register from libcpu helper";
 
             concreteValue = m_concretizer->concretize(value, reason.c_str());
-            wos->write(offset, ConstantExpr::create(concreteValue, csize * 8));
+            wos->write(offset + i, ConstantExpr::create(concreteValue, csize * 8));
+            updateNativeRegisters(offset + i, csize);
         } else {
             ConstantExpr *ce = dyn_cast<ConstantExpr>(value);
             concreteValue = ce->getZExtValue(csize * 8);
@@ -231,6 +289,8 @@ void S2EExecutionStateRegisters::writeSymbolicRegion(unsigned offset, const void
         if ((oldAllConcrete != newAllConcrete) && (wos->notifyOnConcretenessChange())) {
             m_notification->addressSpaceSymbolicStatusChange(wos, newAllConcrete);
         }
+
+        updateNativeRegisters(offset, size);
     }
 
 #ifdef S2E_TRACE_EFLAGS
@@ -272,6 +332,7 @@ void S2EExecutionStateRegisters::writeSymbolicRegion(unsigned offset, klee::ref<
             m_notification->addressSpaceSymbolicStatusChange(m_symbolicRegs, newAllConcrete);
         }
 
+        updateNativeRegisters(offset, Expr::getMinBytesForWidth(width));
     } else {
         /* XXX: should we check getSymbolicRegisterMask ? */
         /* XXX: why don't we allow writing symbolic values here ??? */
@@ -299,6 +360,13 @@ void S2EExecutionStateRegisters::writeSymbolicRegionUnsafe(unsigned offset, klee
     if ((oldAllConcrete != newAllConcrete) && (m_symbolicRegs->notifyOnConcretenessChange())) {
         m_notification->addressSpaceSymbolicStatusChange(m_symbolicRegs, newAllConcrete);
     }
+
+    // Translation blocks that access the new symbolic data must not run natively anymore
+    if (*m_active) {
+        updateNativeRegisters(offset, Expr::getMinBytesForWidth(width));
+    } else {
+        m_symbolicRegsMaskValid = false;
+    }
 }
 
 /***/
@@ -265,6 +265,22 @@ void S2EExecutionStateTlb::clearTlbOwnership() {
     }
 }
 
+bool S2EExecutionStateTlb::isReferenced(const klee::ObjectStateConstPtr &os) const {
+    if (m_tlbMap.count(os)) {
+        return true;
+    }
+
+#if defined(SE_ENABLE_PHYSRAM_TLB)
+    CPUX86State *cpu = m_registers->getCpuState();
+    uintptr_t tlb_index = (os->getAddress() >> 12) & (CPU_TLB_SIZE - 1);
+    if (cpu->se_ram_tlb[tlb_index].object_state == os.get()) {
+        return true;
+    }
+#endif
+
+    return false;
+}
+
 void S2EExecutionStateTlb::updateTlbEntry(CPUX86State *env, int mmu_idx, uint64_t virtAddr, uint64_t hostAddr) {
     assert((hostAddr & ~TARGET_PAGE_MASK) == 0);
     assert((virtAddr & ~TARGET_PAGE_MASK) == 0);
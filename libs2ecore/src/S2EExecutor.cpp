@@ -59,12 +59,16 @@
 #include <klee/SolverFactory.h>
 #include <klee/Stats/CoreStats.h>
 #include <klee/Stats/TimerStatIncrementer.h>
+#include <klee/util/Activity.h>
 #include <klee/util/ExprTemplates.h>
+#include <klee/util/PageSwap.h>
 
 #include <tcg/tcg-llvm.h>
 
 #include <glib.h>
 #include <sstream>
+#include <string_view>
+#include <unordered_set>
 #include <vector>
 
 #ifdef WIN32
@@ -93,6 +97,23 @@ namespace {
             cl::desc("Allow unimportant memory regions (like video RAM) to be shared between states"),
             cl::init(true));
 
+    cl::opt<bool>
+    ShareQueryCache("share-query-cache",
+            cl::desc("Share validity results between the instances of a multi-process run"
+                     " through a cache file in the output directory"),
+            cl::init(false));
+
+    cl::opt<bool>
+    LoadBalanceBusiestFirst("load-balance-busiest-first",
+            cl::desc("When an instance slot is free, let only the instance with the most states fork"),
+            cl::init(true));
+
+    cl::opt<unsigned>
+    LoadBalanceLoadExpiry("load-balance-load-expiry",
+            cl::desc("Ignore the load of instances that did not run a load balancing tick"
+                     " within this number of milliseconds"),
+            cl::init(1000));
+
 
     cl::opt<bool>
     FlushTBsOnStateSwitch("flush-tbs-on-state-switch",
@@ -100,6 +121,18 @@ namespace {
                      " disabling leads to faster but possibly incorrect execution"),
             cl::init(true));
 
+    cl::opt<unsigned>
+    MaxTbFunctions("max-tb-functions",
+            cl::desc("Evict the least recently used LLVM functions of translation blocks"
+                     " when there are more than this number of them (0 = no limit)"),
+            cl::init(20000));
+
+    cl::opt<bool>
+    FlushChangedCodePagesOnly("flush-changed-code-pages-only",
+            cl::desc("When flushing translation blocks on state switches, keep those of the code pages"
+                     " that have the same content in both states"),
+            cl::init(true));
+
     //The default is true for two reasons:
     //1. Symbolic addresses are very expensive to handle
     //2. There is lazy forking which will eventually enumerate
@@ -172,6 +205,42 @@ namespace {
             cl::desc("Faster TLB, but forces single path execution"),
             cl::init(false));
 
+    cl::opt<unsigned>
+    SpeculativeForkSolvers("speculative-fork-solvers",
+            cl::desc("Check the feasibility of the other side of symbolic branches on up to this many "
+                     "background solvers while the current state keeps running (0 disables)"),
+            cl::init(0));
+
+    cl::opt<unsigned>
+    PageDedupInterval("page-dedup-interval",
+            cl::desc("Merge identical concrete memory pages of inactive states every N seconds (0 disables)"),
+            cl::init(0));
+
+    cl::opt<unsigned>
+    StateSwapIdleTime("state-swap-idle-time",
+            cl::desc("Move the memory pages of states that did not run for N seconds to a swap file (0 disables)"),
+            cl::init(0));
+
+    cl::opt<unsigned>
+    StateSwapInterval("state-swap-interval",
+            cl::desc("Look for states to swap out every N seconds"),
+            cl::init(10));
+
+    cl::opt<std::string>
+    StateSwapDirectory("state-swap-dir",
+            cl::desc("Directory of the swap file (default: the output directory)"),
+            cl::init(""));
+
+    cl::opt<unsigned>
+    StateSwapMaxSize("state-swap-max-size",
+            cl::desc("Maximum size of the swap file in MB"),
+            cl::init(65536));
+
+cl::opt<bool>
+    ConcreteTbsWithSymbolicRegs("concrete-tbs-with-symbolic-regs",
+            cl::desc("Run translation blocks natively when they do not access symbolic registers"),
+            cl::init(true));
+
     cl::opt<bool> NoTruncateSourceLines("no-truncate-source-lines",
                                     cl::desc("Don't truncate long lines in the output source"));
 
@@ -247,12 +316,34 @@ namespace s2e {
 /* Global array to hold tb function arguments */
 volatile void *tb_function_args[3];
 
+/* Activity to restore after a natively run translation block, which may exit with a longjmp */
+static klee::Activity s_fastTbCallerActivity;
+static bool s_inFastTb;
+
+/// Execution signals are the host pointers that differ between blocks with the same code.
+/// The translator loads them at run time through tcg_llvm_get_relocation.
+static int getTbRelocationIndex(TranslationBlock *tb, uint64_t value) {
+    auto se_tb = static_cast<S2ETranslationBlock *>(tb->se_tb);
+    auto &signals = se_tb->executionSignals;
+    for (unsigned i = 0; i < signals.size(); ++i) {
+        if ((uintptr_t) signals[i] == value) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 S2EExecutor::S2EExecutor(S2E *s2e, TCGLLVMTranslator *translator)
     : Executor(translator->getContext()), m_s2e(s2e), m_llvmTranslator(translator), m_executeAlwaysKlee(false),
-      m_forkProcTerminateCurrentState(false), m_inLoadBalancing(false) {
+      m_forkProcTerminateCurrentState(false), m_inLoadBalancing(false), m_instanceLoad(0), m_lastLoadBalancingTick(0),
+      m_loadBalanceBackoff(0), m_stopLoadPublisher(false), m_waitForDeferredForks(false), m_lastPageDedup(0),
+      m_swapPolicy(nullptr), m_lastStateSwap(0), m_tlbEpoch(0), m_tbFunctionClock(0),
+      m_tbFunctionEvictionPending(false), m_lastSwitchSavedBytes(0), m_lastSwitchRestoredBytes(0) {
     delete externalDispatcher;
     externalDispatcher = new S2EExternalDispatcher();
 
+    m_llvmTranslator->setRelocations(getTbRelocationIndex);
+
     LLVMContext &ctx = m_llvmTranslator->getContext();
 
 /* Define globally accessible functions */
@@ -271,6 +362,7 @@ S2EExecutor::S2EExecutor(S2E *s2e, TCGLLVMTranslator *translator)
 
     __DEFINE_EXT_VARIABLE(g_s2e_before_memory_access_signals_count)
     __DEFINE_EXT_VARIABLE(g_s2e_after_memory_access_signals_count)
+    __DEFINE_EXT_VARIABLE(g_s2e_watched_memory_access_signals_count)
     __DEFINE_EXT_VARIABLE(g_s2e_on_translate_block_start_signals_count)
     __DEFINE_EXT_VARIABLE(g_s2e_on_translate_block_end_signals_count)
     __DEFINE_EXT_VARIABLE(g_s2e_on_translate_instruction_start_signals_count)
@@ -446,6 +538,10 @@ S2EExecutor::S2EExecutor(S2E *s2e, TCGLLVMTranslator *translator)
         s2e->getWarningsStream() << "S2E will run in single path mode. Forking and symbolic execution not allowed.\n";
     }
 
+    if (StateSwapIdleTime) {
+        m_swapPolicy = new IdleStateSwapPolicy(StateSwapIdleTime * 1000ll);
+    }
+
     if (OutputModule) {
         if (auto os = s2e->openOutputFile("module.bc")) {
             kmodule->outputModule(*os);
@@ -463,7 +559,22 @@ void S2EExecutor::flushTb() {
     tb_flush(env); // release references to TB functions
 }
 
+void S2EExecutor::flushTlbs(S2EExecutionState *activeState) {
+    tlb_flush(env, 1);
+#if defined(SE_ENABLE_PHYSRAM_TLB)
+    activeState->m_tlb.clearRamTlb();
+#endif
+
+    // Inactive states flush their TLB when they are resumed
+    ++m_tlbEpoch;
+    activeState->m_tlbEpoch = m_tlbEpoch;
+}
+
 S2EExecutor::~S2EExecutor() {
+    stopLoadPublisher();
+
+    // Translation blocks release their functions, which needs m_tbFunctions
+    m_s2eTbs.clear();
 }
 
 S2EExecutionState *S2EExecutor::createInitialState() {
@@ -471,10 +582,22 @@ S2EExecutionState *S2EExecutor::createInitialState() {
     S2EExecutionState *state = new S2EExecutionState(m_dummyMain);
 
     auto factory = klee::DefaultSolverFactory::create(g_s2e->getOutputDirectory());
+
+    // Instances are forked from this one and inherit the descriptor of the cache file,
+    // so whatever one of them solves becomes a cache hit for all the others.
+    if (ShareQueryCache && m_s2e->getMaxInstances() > 1) {
+        std::static_pointer_cast<klee::DefaultSolverFactory>(factory)->setDefaultPersistentCache(
+            m_s2e->getOutputDirectoryBase() + "/query-cache.bin");
+    }
+
     auto endSolver = factory->createEndSolver();
     auto solver = factory->decorateSolver(endSolver);
     state->setSolver(solver);
 
+    for (unsigned i = 0; i < SpeculativeForkSolvers; ++i) {
+        m_idleForkSolvers.push_back(factory->createBackgroundSolver());
+    }
+
     state->m_runningConcrete = true;
     state->m_active = true;
     state->setForking(EnableForking);
@@ -657,7 +780,68 @@ void S2EExecutor::computeNewStateGuids(std::unordered_map<ExecutionState *, uint
     }
 }
 
+void S2EExecutor::startLoadPublisher() {
+    if (!LoadBalanceBusiestFirst || m_s2e->getMaxInstances() < 2 || m_loadPublisher.joinable()) {
+        return;
+    }
+
+    m_stopLoadPublisher = false;
+    m_loadPublisher = std::thread(&S2EExecutor::runLoadPublisher, this);
+}
+
+void S2EExecutor::stopLoadPublisher() {
+    if (!m_loadPublisher.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_loadPublisherLock);
+        m_stopLoadPublisher = true;
+        m_loadPublisherCond.notify_all();
+    }
+
+    m_loadPublisher.join();
+}
+
+/// Publishes the load computed by the last load balancing tick every 100 ms.
+/// The execution loop cannot fork while it is busy (e.g., in a long solver query)
+/// or after a failed fork, the instance publishes no load then, so that a free slot
+/// goes to another instance.
+void S2EExecutor::runLoadPublisher() {
+    std::unique_lock<std::mutex> lock(m_loadPublisherLock);
+    while (!m_stopLoadPublisher) {
+        uint64_t now = S2EShared::getLoadTime();
+        unsigned load = m_instanceLoad;
+        if (now > m_lastLoadBalancingTick + LoadBalanceLoadExpiry / 2 || now < m_loadBalanceBackoff) {
+            load = 0;
+        }
+
+        m_s2e->publishInstanceLoad(load);
+        m_loadPublisherCond.wait_for(lock, std::chrono::milliseconds(100));
+    }
+}
+
 void S2EExecutor::doLoadBalancing() {
+    if (LoadBalanceBusiestFirst && m_s2e->getMaxInstances() > 1) {
+        // Publish how much work we could give away, so that a free slot goes to the
+        // instance that has the most of it instead of whoever's timer fires first.
+        unsigned load = 0;
+        for (auto state : states) {
+            auto s2estate = static_cast<S2EExecutionState *>(state);
+            if (!s2estate->isZombie() && !s2estate->isPinned()) {
+                ++load;
+            }
+        }
+
+        uint64_t now = S2EShared::getLoadTime();
+        m_instanceLoad = load < 2 ? 0 : load;
+        m_lastLoadBalancingTick = now;
+
+        if (now < m_loadBalanceBackoff || !m_s2e->isBusiestInstance(LoadBalanceLoadExpiry)) {
+            return;
+        }
+    }
+
     if (states.size() < 2) {
         return;
     }
@@ -667,6 +851,17 @@ void S2EExecutor::doLoadBalancing() {
         return;
     }
 
+    // Solver threads do not survive the process fork. Deferred forks can only be
+    // completed at the start of a translation block, try again at the next tick.
+    if (!m_deferredForks.empty()) {
+        m_waitForDeferredForks = true;
+        return;
+    }
+
+    for (auto &solver : m_idleForkSolvers) {
+        solver->stopChecks();
+    }
+
     std::vector<S2EExecutionState *> allStates;
 
     foreach2 (it, states.begin(), states.end()) {
@@ -686,6 +881,8 @@ void S2EExecutor::doLoadBalancing() {
     m_s2e->getCorePlugin()->onProcessForkDecide.emit(&proceed);
     if (!proceed) {
         g_s2e->getDebugStream() << "LoadBalancing: a plugin stopped load balancing\n";
+        // Let the next busiest instance take the free slot
+        m_loadBalanceBackoff = S2EShared::getLoadTime() + LoadBalanceLoadExpiry;
         return;
     }
 
@@ -706,10 +903,16 @@ void S2EExecutor::doLoadBalancing() {
 
     unsigned parentId = m_s2e->getCurrentInstanceId();
     m_s2e->getCorePlugin()->onProcessFork.emit(true, false, -1);
+
+    // The publisher may hold the lock of the shared instance data
+    stopLoadPublisher();
     int child = m_s2e->fork();
+    startLoadPublisher();
+
     if (child < 0) {
         // Fork did not succeed
         m_s2e->getCorePlugin()->onProcessFork.emit(false, false, -1);
+        m_loadBalanceBackoff = S2EShared::getLoadTime() + LoadBalanceLoadExpiry;
         m_inLoadBalancing = false;
         return;
     }
@@ -773,13 +976,79 @@ void S2EExecutor::stateSwitchTimerCallback(void *opaque) {
 void S2EExecutor::initializeStateSwitchTimer() {
     m_stateSwitchTimer = libcpu_new_timer_ms(host_clock, &stateSwitchTimerCallback, this);
     libcpu_mod_timer(m_stateSwitchTimer, libcpu_get_clock_ms(host_clock) + 100);
+    startLoadPublisher();
 }
 
 void S2EExecutor::resetStateSwitchTimer() {
     libcpu_mod_timer(m_stateSwitchTimer, libcpu_get_clock_ms(host_clock));
 }
 
+/// Returns non-zero if the guest page at the given host address differs between the two states
+static int codePageChanged(void *opaque, uintptr_t hostPage) {
+    auto states = static_cast<std::pair<S2EExecutionState *, S2EExecutionState *> *>(opaque);
+
+    // The page may be covered by several objects if it was split
+    for (auto addr = hostPage; addr < hostPage + TARGET_PAGE_SIZE;) {
+        auto oldOS = states->first->addressSpace.findObject(addr);
+        auto newOS = states->second->addressSpace.findObject(addr);
+
+        if (!oldOS || !newOS) {
+            return 1;
+        }
+
+        // Objects can only be compared if the page is split the same way in both states
+        if (oldOS->getAddress() != newOS->getAddress() || oldOS->getSize() != newOS->getSize()) {
+            return 1;
+        }
+
+        addr = oldOS->getAddress() + oldOS->getSize();
+
+        // Pages that were not written since the fork or that were merged are shared
+        if (oldOS == newOS) {
+            continue;
+        }
+
+        if (!oldOS->isAllConcrete() || !newOS->isAllConcrete()) {
+            return 1;
+        }
+
+        if (oldOS->getConcreteBufferPtr() == newOS->getConcreteBufferPtr()) {
+            continue;
+        }
+
+        if (memcmp(oldOS->getConcreteBuffer(), newOS->getConcreteBuffer(), oldOS->getSize())) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/// Copies the host memory of shared concrete objects to the object states of the given state.
+/// Objects whose content did not change since they were last saved or restored are skipped,
+/// so that they stay shared with the other states instead of being copied on write.
+/// Returns the number of bytes copied.
+uint64_t S2EExecutor::saveSharedConcreteObjects(S2EExecutionState *state) {
+    uint64_t copied = 0;
+
+    for (auto &mo : m_saveOnContextSwitch) {
+        auto os = state->addressSpace.findObject(mo.address);
+        if (!memcmp(os->getConcreteBuffer(), (uint8_t *) mo.address, mo.size)) {
+            continue;
+        }
+
+        auto wos = state->addressSpace.getWriteable(os);
+        uint8_t *store = wos->getConcreteBuffer();
+        assert(store);
+        memcpy(store, (uint8_t *) mo.address, mo.size);
+        copied += mo.size;
+    }
+
+    return copied;
+}
+
 void S2EExecutor::doStateSwitch(S2EExecutionState *oldState, S2EExecutionState *newState) {
+    klee::ActivityScope activity(klee::Activity::StateSwitch);
     assert(oldState || newState);
     assert(!oldState || oldState->m_active);
     assert(!newState || !newState->m_active);
@@ -799,6 +1068,7 @@ void S2EExecutor::doStateSwitch(S2EExecutionState *oldState, S2EExecutionState *
     m_s2e->getInfoStream(oldState) << "Switching from state " << (oldState ? oldState->getID() : -1) << " to state "
                                    << (newState ? newState->getID() : -1) << '\n';
 
+    uint64_t savedBytes = 0;
     uint64_t totalCopied = 0;
     uint64_t objectsCopied = 0;
 
@@ -811,13 +1081,7 @@ void S2EExecutor::doStateSwitch(S2EExecutionState *oldState, S2EExecutionState *
             oldState->switchToSymbolic();
         }
 
-        for (auto &mo : m_saveOnContextSwitch) {
-            auto oldOS = oldState->addressSpace.findObject(mo.address);
-            auto oldWOS = oldState->addressSpace.getWriteable(oldOS);
-            uint8_t *oldStore = oldWOS->getConcreteBuffer();
-            assert(oldStore);
-            memcpy(oldStore, (uint8_t *) mo.address, mo.size);
-        }
+        savedBytes = saveSharedConcreteObjects(oldState);
 
         // XXX: specify which state should be used
         s2e_kvm_save_device_state();
@@ -858,6 +1122,16 @@ void S2EExecutor::doStateSwitch(S2EExecutionState *oldState, S2EExecutionState *
 
         for (auto &mo : m_saveOnContextSwitch) {
             auto newOS = newState->addressSpace.findObject(mo.address);
+
+            // Host memory holds what was just saved to the old state. Objects that
+            // were not modified since the two states forked share the same buffer.
+            if (oldState) {
+                auto oldOS = oldState->addressSpace.findObject(mo.address);
+                if (oldOS == newOS || oldOS->getConcreteBufferPtr() == newOS->getConcreteBufferPtr()) {
+                    continue;
+                }
+            }
+
             const uint8_t *newStore = newOS->getConcreteBuffer();
             assert(newStore);
             memcpy((uint8_t *) mo.address, newStore, mo.size);
@@ -868,21 +1142,205 @@ void S2EExecutor::doStateSwitch(S2EExecutionState *oldState, S2EExecutionState *
 
     cpu_enable_ticks();
 
+    m_lastSwitchSavedBytes = savedBytes;
+    m_lastSwitchRestoredBytes = totalCopied;
+
     if (VerboseStateSwitching) {
-        s2e_debug_print("Copied %d (count=%d)\n", totalCopied, objectsCopied);
+        s2e_debug_print("Saved %d, copied %d (count=%d)\n", savedBytes, totalCopied, objectsCopied);
     }
 
     if (FlushTBsOnStateSwitch) {
-        se_tb_safe_flush();
+        // Translation blocks only depend on the content of their code pages, which is usually
+        // the same in states that forked from each other. Code pages translated while the new
+        // state was inactive are write-protected in its dirty mask and restored TLB.
+        if (FlushChangedCodePagesOnly && oldState && newState) {
+            auto states = std::make_pair(oldState, newState);
+            unsigned count = se_tb_invalidate_code_pages(env, codePageChanged, &states);
+            if (VerboseStateSwitching) {
+                s2e_debug_print("Invalidated %u code pages\n", count);
+            }
+        } else {
+            se_tb_safe_flush();
+        }
     }
 
     assert(env->current_tb == nullptr);
 
     g_se_disable_tlb_flush = 0;
 
+    // The TLB of the new state is restored with its registers, unless restoring
+    // devices required a flush.
+    if (newState) {
+        newState->m_flushTlbOnFinalize = g_se_tlb_flush_skipped;
+    }
+    g_se_tlb_flush_skipped = 0;
+
+    // The saved TLB may point to pages that were swapped out since the state last ran,
+    // or miss the trace flags of newly watched memory ranges
+    if (newState && newState->m_tlbEpoch != m_tlbEpoch) {
+        tlb_flush(env, 1);
+#if defined(SE_ENABLE_PHYSRAM_TLB)
+        newState->m_tlb.clearRamTlb();
+#endif
+        newState->m_tlbEpoch = m_tlbEpoch;
+        newState->m_flushTlbOnFinalize = false;
+    }
+
     // m_s2e->getCorePlugin()->onStateSwitch.emit(oldState, newState);
 }
 
+/// Makes inactive states share their identical concrete RAM pages.
+///
+/// Forked states often have private copies of a page with the same contents,
+/// e.g., after zeroing it. All copies are replaced by one object state that
+/// no state owns, so that the next write to it goes through copy-on-write.
+/// Pages that the saved TLB of a state references are left alone, because
+/// the TLB points directly to their concrete buffer.
+void S2EExecutor::deduplicatePages(S2EExecutionState *activeState) {
+    struct Page {
+        ObjectStateConstPtr os;
+        S2EExecutionState *state;
+        bool shared;
+    };
+
+    std::unordered_map<uint64_t, Page> pages;
+    std::unordered_set<const ObjectState *> visited;
+    uint64_t merged = 0, scanned = 0;
+
+    for (auto es : states) {
+        auto state = static_cast<S2EExecutionState *>(es);
+        if (state == activeState || state->m_active) {
+            continue;
+        }
+
+        // The address space changes while iterating over it, collect the candidates first
+        std::vector<ObjectStateConstPtr> candidates;
+        for (auto it = state->addressSpace.objects.begin(), ie = state->addressSpace.objects.end(); it != ie; ++it) {
+            const ObjectStateConstPtr os = it->second;
+            if (!os->isMemoryPage() || os->isSharedConcrete() || os->isReadOnly()) {
+                continue;
+            }
+
+            if (os->getSize() != SE_RAM_OBJECT_SIZE || os->getBitArraySize() != SE_RAM_OBJECT_SIZE) {
+                continue;
+            }
+
+            // Comparing would read the page back from the swap file
+            if (os->getConcreteBufferPtr()->isSwappedOut()) {
+                continue;
+            }
+
+            if (visited.insert(os.get()).second && os->isAllConcrete()) {
+                candidates.push_back(os);
+            }
+        }
+
+        for (auto &os : candidates) {
+            if (state->m_tlb.isReferenced(os)) {
+                continue;
+            }
+
+            ++scanned;
+            auto buffer = os->getConcreteBuffer();
+            auto hash = std::hash<std::string_view>()(std::string_view((const char *) buffer, SE_RAM_OBJECT_SIZE));
+            hash ^= os->getAddress() * 0x9e3779b97f4a7c15ull;
+
+            auto res = pages.insert({hash, {os, state, false}});
+            if (res.second) {
+                continue;
+            }
+
+            auto &page = res.first->second;
+            if (page.os->getKey() != os->getKey() || memcmp(page.os->getConcreteBuffer(), buffer, SE_RAM_OBJECT_SIZE)) {
+                continue;
+            }
+
+            if (page.os->isSplittable() != os->isSplittable() ||
+                page.os->notifyOnConcretenessChange() != os->notifyOnConcretenessChange()) {
+                continue;
+            }
+
+            // The first copy becomes the shared one, its state must not write to it anymore
+            auto shared = ObjectStatePtr(const_cast<ObjectState *>(page.os.get()));
+            if (!page.shared) {
+                shared->setOwnerId(0);
+                page.shared = true;
+            }
+
+            state->addressSpace.shareObject(os, shared);
+            ++merged;
+        }
+    }
+
+    if (merged) {
+        m_s2e->getInfoStream(activeState) << "Merged " << merged << " of " << scanned
+                                          << " concrete memory pages of inactive states\n";
+    }
+}
+
+/// Moves the concrete memory pages of an inactive state to the swap file.
+///
+/// Pages stay in the address space and are read back on the next access.
+/// Their buffers may be shared with other states, whose saved TLBs are
+/// flushed when they are activated again. Pages that the TLB of the state
+/// or of the active state references are left in memory.
+unsigned S2EExecutor::swapOutState(S2EExecutionState *state, S2EExecutionState *activeState) {
+    unsigned count = 0;
+
+    for (auto it = state->addressSpace.objects.begin(), ie = state->addressSpace.objects.end(); it != ie; ++it) {
+        const ObjectStateConstPtr &os = it->second;
+        if (!os->isMemoryPage() || os->isSharedConcrete() || os->getSize() != SE_RAM_OBJECT_SIZE) {
+            continue;
+        }
+
+        auto &buffer = os->getConcreteBufferPtr();
+        if (buffer->size() != SE_RAM_OBJECT_SIZE || buffer->isSwappedOut()) {
+            continue;
+        }
+
+        if (state->m_tlb.isReferenced(os) || activeState->m_tlb.isReferenced(os)) {
+            continue;
+        }
+
+        if (!buffer->swapOut()) {
+            break;
+        }
+
+        ++count;
+    }
+
+    return count;
+}
+
+void S2EExecutor::swapOutIdleStates(S2EExecutionState *activeState) {
+    // The TLB cache is not maintained in single path mode
+    if (g_s2e_single_path_mode) {
+        return;
+    }
+
+    if (!klee::PageSwap::get()) {
+        auto dir = StateSwapDirectory.empty() ? m_s2e->getOutputDirectory() : StateSwapDirectory;
+        klee::PageSwap::initialize(dir, StateSwapMaxSize * 1024ull * 1024);
+    }
+
+    std::vector<S2EExecutionState *> toSwap;
+    m_swapPolicy->selectStates(states, toSwap);
+
+    uint64_t swapped = 0;
+    for (auto state : toSwap) {
+        assert(state != activeState && !state->m_active);
+        swapped += swapOutState(state, activeState);
+    }
+
+    if (swapped) {
+        ++m_tlbEpoch;
+        activeState->m_tlbEpoch = m_tlbEpoch;
+        m_s2e->getInfoStream(activeState) << "Swapped out " << swapped << " memory pages of " << toSwap.size()
+                                          << " idle states, " << klee::PageSwap::get()->getSwappedPages()
+                                          << " pages are in the swap file\n";
+    }
+}
+
 ExecutionState *S2EExecutor::selectSearcherState(S2EExecutionState *state) {
     ExecutionState *newState = nullptr;
 
@@ -913,6 +1371,14 @@ ExecutionState *S2EExecutor::selectSearcherState(S2EExecutionState *state) {
 
 S2EExecutionState *S2EExecutor::selectNextState(S2EExecutionState *state) {
     assert(state->m_active);
+
+    // Plugins must be notified of the deferred forks while their parent is active
+    if (!m_deferredForks.empty()) {
+        m_waitForDeferredForks = true;
+        return state;
+    }
+
+    m_waitForDeferredForks = false;
     updateStates(state);
 
     /* Prevent state switching */
@@ -947,6 +1413,10 @@ S2EExecutionState *S2EExecutor::selectNextState(S2EExecutionState *state) {
     if (newState != state) {
         doStateSwitch(state, newState);
         g_s2e->getCorePlugin()->onStateSwitch.emit(state, newState);
+
+        if (m_swapPolicy) {
+            m_swapPolicy->activate(newState);
+        }
     }
 
     // We can't free the state immediately if it is the current state.
@@ -954,10 +1424,29 @@ S2EExecutionState *S2EExecutor::selectNextState(S2EExecutionState *state) {
     foreach2 (it, m_deletedStates.begin(), m_deletedStates.end()) {
         S2EExecutionState *s = *it;
         assert(s != newState);
+        if (m_swapPolicy) {
+            m_swapPolicy->remove(s);
+        }
         delete s;
     }
     m_deletedStates.clear();
 
+    if (PageDedupInterval && newState != state) {
+        auto now = libcpu_get_clock_ms(host_clock);
+        if (now - m_lastPageDedup >= PageDedupInterval * 1000ll) {
+            deduplicatePages(newState);
+            m_lastPageDedup = libcpu_get_clock_ms(host_clock);
+        }
+    }
+
+    if (m_swapPolicy && newState != state) {
+        auto now = libcpu_get_clock_ms(host_clock);
+        if (now - m_lastStateSwap >= StateSwapInterval * 1000ll) {
+            swapOutIdleStates(newState);
+            m_lastStateSwap = libcpu_get_clock_ms(host_clock);
+        }
+    }
+
     updateConcreteFastPath(newState);
 
     return newState;
@@ -967,6 +1456,7 @@ S2EExecutionState *S2EExecutor::selectNextState(S2EExecutionState *state) {
 void S2EExecutor::prepareFunctionExecution(S2EExecutionState *state, llvm::Function *function,
                                            const std::vector<klee::ref<klee::Expr>> &args) {
     auto kf = kmodule->bindFunctionConstants(globalAddresses, function);
+    countFunctionCall(kf);
 
     /* Emulate call to a TB function */
     state->prevPC = state->pc;
@@ -1053,7 +1543,10 @@ bool S2EExecutor::finalizeTranslationBlockExec(S2EExecutionState *state) {
      * Memory topology may change on state switches.
      * Ensure that there are no bad mappings left.
      */
-    tlb_flush(env, 1);
+    if (state->m_flushTlbOnFinalize) {
+        state->m_flushTlbOnFinalize = false;
+        tlb_flush(env, 1);
+    }
 
     return ret;
 }
@@ -1088,12 +1581,16 @@ void S2EExecutor::updateConcreteFastPath(S2EExecutionState *state) {
                                      //(CPU register access from concrete code depend on g_s2e_fast_concrete_invocation)
                                      (state->stack.size() == 1) &&
 
-                                     (m_executeAlwaysKlee == false) && (state->isRunningConcrete());
+                                     (m_executeAlwaysKlee == false) && (state->isRunningConcrete()) &&
+
+                                     // Deferred forks are completed in executeTranslationBlock()
+                                     m_deferredForks.empty();
 
     g_s2e_running_exception_emulation_code = (char *) &state->m_runningExceptionEmulationCode;
 
     if (g_s2e_fast_concrete_invocation) {
         env->generate_llvm = 0;
+        env->se_symbolic_regs = 0;
     }
 
     updateClockScaling();
@@ -1104,12 +1601,19 @@ uintptr_t S2EExecutor::executeTranslationBlockKlee(S2EExecutionState *state, Tra
     assert(state->stack.size() == 1);
     assert(state->pc == m_dummyMain->getInstructions());
 
+    klee::ActivityScope activity(klee::Activity::SymbolicCode);
+
     if (!tb->llvm_function) {
         abort();
     }
 
     state->m_lastS2ETb = S2ETranslationBlockPtr(static_cast<S2ETranslationBlock *>(tb->se_tb));
 
+    auto tbFunction = m_tbFunctions.find(static_cast<Function *>(tb->llvm_function));
+    if (tbFunction != m_tbFunctions.end()) {
+        tbFunction->second.lastUse = ++m_tbFunctionClock;
+    }
+
     /* Prepare function execution */
     std::vector<klee::ref<Expr>> args;
     args.push_back(klee::ConstantExpr::create((uint64_t) env, Expr::Int64));
@@ -1131,6 +1635,7 @@ uintptr_t S2EExecutor::executeTranslationBlockKlee(S2EExecutionState *state, Tra
 uintptr_t S2EExecutor::executeTranslationBlockConcrete(S2EExecutionState *state, TranslationBlock *tb) {
     assert(state->isActive() && state->isRunningConcrete());
 
+    klee::ActivityScope activity(klee::Activity::ConcreteCode);
     uintptr_t ret = 0;
     S2EExternalDispatcher::saveJmpBuf();
 
@@ -1166,7 +1671,16 @@ uintptr_t S2EExecutor::executeTranslationBlockFast(struct CPUX86State *env1, str
             assert(g_s2e_fast_concrete_invocation);
             g_s2e_state->switchToConcrete();
         }
-        return tcg_libcpu_tb_exec(env, tb->tc.ptr);
+
+        // Not a scope, the TB may exit with a longjmp. cleanupTranslationBlock
+        // restores the activity in that case.
+        s_fastTbCallerActivity = klee::g_activity.load(std::memory_order_relaxed);
+        s_inFastTb = true;
+        klee::g_activity.store(klee::Activity::ConcreteCode, std::memory_order_relaxed);
+        uintptr_t ret = tcg_libcpu_tb_exec(env, tb->tc.ptr);
+        klee::g_activity.store(s_fastTbCallerActivity, std::memory_order_relaxed);
+        s_inFastTb = false;
+        return ret;
     } else {
         return executeTranslationBlockSlow(env, tb);
     }
@@ -1175,6 +1689,10 @@ uintptr_t S2EExecutor::executeTranslationBlockFast(struct CPUX86State *env1, str
 uintptr_t S2EExecutor::executeTranslationBlock(S2EExecutionState *state, TranslationBlock *tb) {
     assert(state->isActive());
 
+    if (unlikely(!m_deferredForks.empty())) {
+        resolveDeferredForks(m_waitForDeferredForks);
+    }
+
     updateConcreteFastPath(state);
 
     bool executeKlee = m_executeAlwaysKlee;
@@ -1203,14 +1721,18 @@ uintptr_t S2EExecutor::executeTranslationBlock(S2EExecutionState *state, Transla
         }
     }
 
-    // If the CPU state has symbolic registers, run in KLEE.
-    // In theory, we could check which registers are symbolic and decide whether
-    // the TB should be ran symbolically if it accesses symbolic registers.
-    // In practice, the implementation complexity of this check is just too high
-    // and it doesn't give a lot of speedup anyway.
-    auto allConcrete = state->regs()->allConcrete();
-    if (!allConcrete) {
-        executeKlee = true;
+    // If the CPU state has symbolic registers, run in KLEE, unless the TB
+    // does not access any of them. The translator computes which parts of the
+    // register file the TB reads and writes. Helper calls count as accessing all
+    // registers, because helpers may access the whole CPU state through env.
+    uint64_t symbolicRegs = 0;
+    if (!state->regs()->allConcrete()) {
+        if (ConcreteTbsWithSymbolicRegs) {
+            symbolicRegs = state->regs()->getSymbolicRegistersMask();
+            executeKlee |= (symbolicRegs & (tb->se_reg_rmask | tb->se_reg_wmask)) != 0;
+        } else {
+            executeKlee = true;
+        }
     }
 
     if (executeKlee && !tb->llvm_function) {
@@ -1223,6 +1745,7 @@ uintptr_t S2EExecutor::executeTranslationBlock(S2EExecutionState *state, Transla
             state->switchToSymbolic();
         }
 
+        env->se_symbolic_regs = 0;
         return executeTranslationBlockKlee(state, tb);
     } else {
         env->generate_llvm = 0;
@@ -1231,6 +1754,8 @@ uintptr_t S2EExecutor::executeTranslationBlock(S2EExecutionState *state, Transla
             state->switchToConcrete();
         }
 
+        // Chained TBs that access symbolic registers exit back to this function
+        env->se_symbolic_regs = symbolicRegs;
         return executeTranslationBlockConcrete(state, tb);
     }
 }
@@ -1238,6 +1763,12 @@ uintptr_t S2EExecutor::executeTranslationBlock(S2EExecutionState *state, Transla
 void S2EExecutor::cleanupTranslationBlock(S2EExecutionState *state) {
     assert(state->m_active);
 
+    // A longjmp back to the CPU loop skips the code that restores the activity
+    if (s_inFastTb) {
+        klee::g_activity.store(s_fastTbCallerActivity, std::memory_order_relaxed);
+        s_inFastTb = false;
+    }
+
     if (state->m_forkAborted) {
         return;
     }
@@ -1299,6 +1830,15 @@ void S2EExecutor::notifyFork(ExecutionState &originalState, klee::ref<Expr> &con
         return;
     }
 
+    // Plugins learn about a deferred fork once it is known to be feasible
+    for (auto &fork : m_deferredForks) {
+        if (fork.child == targets.first || fork.child == targets.second) {
+            fork.forkCondition = condition;
+            fork.childIsTrue = fork.child == targets.first;
+            return;
+        }
+    }
+
     std::vector<S2EExecutionState *> newStates(2);
     std::vector<klee::ref<Expr>> newConditions(2);
 
@@ -1310,6 +1850,7 @@ void S2EExecutor::notifyFork(ExecutionState &originalState, klee::ref<Expr> &con
     newConditions[1] = klee::NotExpr::create(condition);
 
     try {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         m_s2e->getCorePlugin()->onStateFork.emit(state, newStates, newConditions);
     } catch (CpuExitException e) {
         if (state->stack.size() != 1) {
@@ -1347,16 +1888,16 @@ Executor::StatePair S2EExecutor::forkAndConcretize(S2EExecutionState *state, kle
 }
 
 S2EExecutor::StatePair S2EExecutor::fork(ExecutionState &current, const klee::ref<Expr> &condition,
-                                         bool keepConditionTrueInCurrentState) {
-    return doFork(current, condition, keepConditionTrueInCurrentState);
+                                         bool keepConditionTrueInCurrentState, bool deferrable) {
+    return doFork(current, condition, keepConditionTrueInCurrentState, deferrable);
 }
 
 S2EExecutor::StatePair S2EExecutor::fork(ExecutionState &current) {
-    return doFork(current, nullptr, false);
+    return doFork(current, nullptr, false, false);
 }
 
 S2EExecutor::StatePair S2EExecutor::doFork(ExecutionState &current, const klee::ref<Expr> &condition,
-                                           bool keepConditionTrueInCurrentState) {
+                                           bool keepConditionTrueInCurrentState, bool deferrable) {
     S2EExecutionState *currentState = dynamic_cast<S2EExecutionState *>(&current);
     assert(currentState);
     assert(!currentState->isRunningConcrete());
@@ -1374,7 +1915,10 @@ S2EExecutor::StatePair S2EExecutor::doFork(ExecutionState &current, const klee::
             g_s2e->getDebugStream(currentState) << "fork disabled at " << hexval(currentState->regs()->getPc()) << "\n";
         }
 
-        g_s2e->getCorePlugin()->onStateForkDecide.emit(currentState, condition, forkOk);
+        {
+            klee::ActivityScope activity(klee::Activity::PluginCallback);
+            g_s2e->getCorePlugin()->onStateForkDecide.emit(currentState, condition, forkOk);
+        }
         if (!forkOk) {
             g_s2e->getDebugStream(currentState) << "fork prevented by request from plugin\n";
         }
@@ -1386,7 +1930,7 @@ S2EExecutor::StatePair S2EExecutor::doFork(ExecutionState &current, const klee::
     }
 
     if (condition) {
-        res = Executor::fork(current, condition, keepConditionTrueInCurrentState);
+        res = Executor::fork(current, condition, keepConditionTrueInCurrentState, deferrable);
     } else {
         res = Executor::fork(current);
     }
@@ -1397,30 +1941,15 @@ S2EExecutor::StatePair S2EExecutor::doFork(ExecutionState &current, const klee::
         return res;
     }
 
-    llvm::SmallVector<S2EExecutionState *, 2> newStates(2);
-    llvm::SmallVector<klee::ref<Expr>, 2> newConditions(2);
-
-    newStates[0] = static_cast<S2EExecutionState *>(res.first);
-    newStates[1] = static_cast<S2EExecutionState *>(res.second);
-
-    if (condition) {
-        newConditions[0] = condition;
-        newConditions[1] = klee::NotExpr::create(condition);
+    // Deferred forks are logged once the branched state is known to be feasible
+    if (!isDeferredChild(res.first) && !isDeferredChild(res.second)) {
+        printFork(currentState, currentState->regs()->getPc(), currentState->regs()->getPageDir(), res, condition);
     }
 
-    llvm::raw_ostream &out = m_s2e->getInfoStream(currentState);
-    out << "Forking state " << currentState->getID() << " at pc = " << hexval(currentState->regs()->getPc())
-        << " at pagedir = " << hexval(currentState->regs()->getPageDir()) << '\n';
+    S2EExecutionState *newStates[] = {static_cast<S2EExecutionState *>(res.first),
+                                      static_cast<S2EExecutionState *>(res.second)};
 
     for (unsigned i = 0; i < 2; ++i) {
-        if (newStates[i]) {
-            out << "    state " << newStates[i]->getID();
-            if (VerboseFork && condition) {
-                out << " with condition " << newConditions[i];
-            }
-            out << '\n';
-        }
-
         // Handled in ::branch
         if (newStates[i] != currentState) {
             newStates[i]->m_needFinalizeTBExec = true;
@@ -1437,6 +1966,22 @@ S2EExecutor::StatePair S2EExecutor::doFork(ExecutionState &current, const klee::
     return res;
 }
 
+void S2EExecutor::printFork(S2EExecutionState *state, uint64_t pc, uint64_t pageDir, const StatePair &targets,
+                            const klee::ref<Expr> &condition) {
+    llvm::raw_ostream &out = m_s2e->getInfoStream(state);
+    out << "Forking state " << state->getID() << " at pc = " << hexval(pc) << " at pagedir = " << hexval(pageDir)
+        << '\n';
+
+    ExecutionState *newStates[] = {targets.first, targets.second};
+    for (unsigned i = 0; i < 2; ++i) {
+        out << "    state " << static_cast<S2EExecutionState *>(newStates[i])->getID();
+        if (VerboseFork && condition) {
+            out << " with condition " << (i == 0 ? condition : klee::NotExpr::create(condition));
+        }
+        out << '\n';
+    }
+}
+
 /// \brief Fork state
 ///
 /// Fork current state and return states in which condition
@@ -1458,6 +2003,125 @@ S2EExecutor::StatePair S2EExecutor::forkCondition(S2EExecutionState *state, klee
     return sp;
 }
 
+/// Only branch instructions request deferrable forks. Other forks are
+/// requested by plugins, which expect to get both states back.
+bool S2EExecutor::canDeferFork(ExecutionState &current) {
+    return !m_idleForkSolvers.empty() && !m_inLoadBalancing && !m_waitForDeferredForks;
+}
+
+void S2EExecutor::deferFork(ExecutionState &current, ExecutionState *branchedState,
+                            const klee::ConstraintManager &constraints, const klee::ref<Expr> &condition) {
+    assert(&current == g_s2e_state);
+
+    DeferredFork fork;
+    fork.parent = static_cast<S2EExecutionState *>(&current);
+    fork.child = static_cast<S2EExecutionState *>(branchedState);
+    fork.childCondition = condition;
+    fork.childIsTrue = false;
+    fork.pc = fork.parent->regs()->getPc();
+    fork.pageDir = fork.parent->regs()->getPageDir();
+    fork.solver = m_idleForkSolvers.back();
+    m_idleForkSolvers.pop_back();
+
+    fork.solver->startCheck(Query(constraints, klee::ConstantExpr::alloc(0, Expr::Bool)));
+    m_deferredForks.push_back(fork);
+}
+
+/// Adds the branched states of completed fork checks to the state set, or
+/// deletes them if they are infeasible. Waits for all checks if \p wait is set.
+///
+/// All deferred forks belong to the active state, which cannot be switched out
+/// while they are pending. This is called at the start of its translation blocks,
+/// where plugins may exit the cpu loop from onStateFork like at any other fork.
+/// Plugins see the parent at the start of the block that follows the branch.
+void S2EExecutor::resolveDeferredForks(bool wait) {
+    while (!m_deferredForks.empty()) {
+        auto it = m_deferredForks.begin();
+        if (!wait) {
+            it = std::find_if(m_deferredForks.begin(), m_deferredForks.end(),
+                              [](DeferredFork &fork) { return fork.solver->isCheckDone(); });
+            if (it == m_deferredForks.end()) {
+                return;
+            }
+        }
+
+        // Forks that are not completed yet stay in the list if a plugin exits the cpu loop
+        DeferredFork fork = *it;
+        m_deferredForks.erase(it);
+        completeDeferredFork(fork);
+    }
+
+    // Let the state switch or load balancing proceed
+    if (wait) {
+        resetStateSwitchTimer();
+    }
+}
+
+void S2EExecutor::completeDeferredFork(DeferredFork &fork) {
+    S2EExecutionState *child = fork.child;
+    assert(fork.parent == g_s2e_state);
+
+    std::vector<std::vector<unsigned char>> values;
+    bool hasSolution = false;
+    bool success;
+    {
+        // Waits for the background check if it is not done yet
+        klee::ActivityScope activity(klee::Activity::Solver);
+        success = fork.solver->finishCheck(child->symbolics, values, hasSolution);
+    }
+    m_idleForkSolvers.push_back(fork.solver);
+
+    if (!success || !hasSolution) {
+        m_s2e->getDebugStream(fork.parent) << "Dropping infeasible state " << child->getID() << "\n";
+        delete child;
+        return;
+    }
+
+    child->concolics = Assignment::create(child->symbolics, values);
+    if (!child->addConstraint(fork.childCondition)) {
+        abort();
+    }
+
+    addedStates.insert(child);
+    *klee::stats::forks += 1;
+
+    StatePair targets = fork.childIsTrue ? StatePair(child, fork.parent) : StatePair(fork.parent, child);
+    printFork(fork.parent, fork.pc, fork.pageDir, targets, fork.forkCondition);
+
+    if (fork.forkCondition) {
+        notifyFork(*fork.parent, fork.forkCondition, targets);
+    }
+}
+
+/// Deletes the branched states of all pending forks, e.g., when their parent
+/// is killed before the forks could be announced.
+void S2EExecutor::dropDeferredForks() {
+    for (auto &fork : m_deferredForks) {
+        std::vector<std::vector<unsigned char>> values;
+        bool hasSolution;
+        {
+            // The solver can only be reused once its check is over
+            klee::ActivityScope activity(klee::Activity::Solver);
+            fork.solver->finishCheck(fork.child->symbolics, values, hasSolution);
+        }
+        m_idleForkSolvers.push_back(fork.solver);
+
+        m_s2e->getDebugStream(fork.parent) << "Dropping state " << fork.child->getID() << " of killed parent\n";
+        delete fork.child;
+    }
+
+    m_deferredForks.clear();
+}
+
+bool S2EExecutor::isDeferredChild(ExecutionState *state) const {
+    for (auto &fork : m_deferredForks) {
+        if (fork.child == state) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /// \brief Fork state for each value
 ///
 /// For every value from \p values: fork a new state with constraint
@@ -1535,13 +2199,7 @@ void S2EExecutor::notifyBranch(ExecutionState &state) {
      * These objects must be saved before the cpu state, because
      * getWritable() may modify the TLB.
      */
-    for (auto &mo : m_saveOnContextSwitch) {
-        auto os = s2eState->addressSpace.findObject(mo.address);
-        auto wos = s2eState->addressSpace.getWriteable(os);
-        uint8_t *store = wos->getConcreteBuffer();
-        assert(store);
-        memcpy(store, (uint8_t *) mo.address, mo.size);
-    }
+    saveSharedConcreteObjects(s2eState);
 
 #if defined(SE_ENABLE_PHYSRAM_TLB)
     s2eState->m_tlb.clearRamTlb();
@@ -1599,6 +2257,7 @@ bool S2EExecutor::merge(klee::ExecutionState &_base, klee::ExecutionState &_othe
     }
 
     if (result) {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
         g_s2e->getCorePlugin()->onStateMerge.emit(&base, &other);
     }
 
@@ -1614,7 +2273,27 @@ void S2EExecutor::terminateState(klee::ExecutionState &state, const std::string
 void S2EExecutor::terminateState(ExecutionState &s) {
     S2EExecutionState &state = static_cast<S2EExecutionState &>(s);
 
-    m_s2e->getCorePlugin()->onStateKill.emit(&state);
+    // Announce the deferred forks while their parent still exists. The state
+    // exits the cpu loop below anyway, so plugins exiting it from onStateFork
+    // do not stop the remaining forks from being resolved. If a plugin killed
+    // the state meanwhile, its remaining forks have no parent to announce them.
+    if (&state == g_s2e_state) {
+        while (!m_deferredForks.empty()) {
+            try {
+                resolveDeferredForks(true);
+            } catch (CpuExitException &) {
+                if (state.isZombie()) {
+                    dropDeferredForks();
+                    throw;
+                }
+            }
+        }
+    }
+
+    {
+        klee::ActivityScope activity(klee::Activity::PluginCallback);
+        m_s2e->getCorePlugin()->onStateKill.emit(&state);
+    }
 
     Executor::terminateState(state);
     state.zombify();
@@ -1746,6 +2425,104 @@ S2ETranslationBlock *S2EExecutor::allocateS2ETb() {
 
 void S2EExecutor::flushS2ETBs() {
     m_s2eTbs.clear();
+
+    // Only the translation blocks of states that stopped in the middle of one still use their functions
+    if (m_tbFunctionEvictionPending) {
+        evictTbFunctions();
+    }
+}
+
+void S2EExecutor::registerTbFunction(llvm::Function *function) {
+    auto &tbFunction = m_tbFunctions[function];
+    tbFunction.lastUse = ++m_tbFunctionClock;
+    ++tbFunction.users;
+
+    // Translation blocks point to their functions, so evict them when libcpu flushes its cache
+    if (MaxTbFunctions && m_tbFunctions.size() > MaxTbFunctions && !m_tbFunctionEvictionPending) {
+        m_tbFunctionEvictionPending = true;
+        se_tb_safe_flush();
+    }
+}
+
+/// Called when a translation block that uses the function is deleted.
+/// The function stays cached for blocks that are translated again later,
+/// until it is evicted.
+void S2EExecutor::releaseTbFunction(llvm::Function *function) {
+    auto it = m_tbFunctions.find(function);
+    assert(it != m_tbFunctions.end() && it->second.users > 0);
+    --it->second.users;
+}
+
+void S2EExecutor::eraseTbFunctions(const std::unordered_set<Function *> &functions) {
+    std::unordered_set<Function *> prepared;
+
+    for (auto function : functions) {
+        m_tbFunctions.erase(function);
+        m_llvmTranslator->forgetFunction(function);
+        globalAddresses.erase(function);
+
+        // Functions that never ran in KLEE have no KFunction
+        if (kmodule->getKFunction(function)) {
+            prepared.insert(function);
+        } else {
+            function->eraseFromParent();
+        }
+    }
+
+    if (!prepared.empty()) {
+        kmodule->removeFunctions(prepared);
+    }
+}
+
+/// Evicts the least recently used functions until half of the maximum remain.
+/// Functions of live translation blocks and functions on the stack of a state
+/// (e.g., a state that forked in the middle of a translation block), including
+/// states that are not yet in the state set, are kept.
+void S2EExecutor::evictTbFunctions() {
+    m_tbFunctionEvictionPending = false;
+
+    std::unordered_set<Function *> inUse;
+    auto addFrames = [&](const klee::ExecutionState *state) {
+        for (auto &frame : state->stack) {
+            inUse.insert(frame.kf->getFunction());
+        }
+    };
+
+    for (auto state : states) {
+        addFrames(state);
+    }
+
+    // States forked since the last update and the branched states of deferred forks
+    // are not in the state set yet.
+    for (auto state : addedStates) {
+        addFrames(state);
+    }
+
+    for (auto &fork : m_deferredForks) {
+        addFrames(fork.child);
+    }
+
+    std::vector<std::pair<uint64_t, Function *>> candidates;
+    for (auto &it : m_tbFunctions) {
+        if (!it.second.users && !inUse.count(it.first) && it.first->use_empty()) {
+            candidates.push_back(std::make_pair(it.second.lastUse, it.first));
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+
+    std::unordered_set<Function *> evicted;
+    for (auto &it : candidates) {
+        if (m_tbFunctions.size() - evicted.size() <= MaxTbFunctions / 2) {
+            break;
+        }
+
+        evicted.insert(it.second);
+    }
+
+    eraseTbFunctions(evicted);
+
+    m_s2e->getDebugStream() << "Evicted " << evicted.size() << " translation block functions\n";
 }
 
 void S2EExecutor::updateStates(klee::ExecutionState *current) {
@@ -1826,11 +2603,21 @@ int s2e_is_tb_instrumented(void *se_tb) {
     return tb->executionSignals.size() > 1;
 }
 
-// XXX: this assumes that libcpu never deletes generated LLVM functions
 void s2e_set_tb_function(void *se_tb, void *llvmFunction) {
     auto tb = static_cast<S2ETranslationBlock *>(se_tb);
-    tb->translationBlock = static_cast<llvm::Function *>(llvmFunction);
+    auto function = static_cast<llvm::Function *>(llvmFunction);
+    if (tb->translationBlock == function) {
+        return;
+    }
+
+    auto executor = g_s2e->getExecutor();
+    if (tb->translationBlock) {
+        executor->releaseTbFunction(tb->translationBlock);
+    }
+
+    tb->translationBlock = function;
     *klee::stats::translatedBlocksLLVMCount += 1;
+    executor->registerTbFunction(function);
 }
 
 void s2e_flush_tb_cache() {
@@ -29,17 +29,9 @@
 namespace s2e {
 
 S2ETranslationBlock::~S2ETranslationBlock() {
+    // The function may be shared with other blocks, the executor decides when to erase it
     if (translationBlock) {
-        auto executor = g_s2e->getExecutor();
-
-        auto kmodule = executor->getModule();
-
-        // We may have generated LLVM code that was never executed
-        if (kmodule->getKFunction(translationBlock)) {
-            kmodule->removeFunction(translationBlock);
-        } else {
-            translationBlock->eraseFromParent();
-        }
+        g_s2e->getExecutor()->releaseTbFunction(translationBlock);
     }
 
     for (auto it : executionSignals) {
@@ -0,0 +1,59 @@
+///
+/// Copyright (C) 2020, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#include <s2e/S2EExecutionState.h>
+#include <s2e/StateSwapPolicy.h>
+#include <s2e/s2e_libcpu.h>
+
+#include <timer.h>
+
+namespace s2e {
+
+void IdleStateSwapPolicy::activate(S2EExecutionState *state) {
+    m_states[state] = {libcpu_get_clock_ms(host_clock), false};
+}
+
+void IdleStateSwapPolicy::remove(S2EExecutionState *state) {
+    m_states.erase(state);
+}
+
+void IdleStateSwapPolicy::selectStates(const klee::StateSet &states, std::vector<S2EExecutionState *> &toSwap) {
+    auto now = libcpu_get_clock_ms(host_clock);
+
+    for (auto es : states) {
+        auto state = static_cast<S2EExecutionState *>(es);
+        if (state->isActive()) {
+            continue;
+        }
+
+        // States that never ran since they were forked start idling now
+        auto res = m_states.insert({state, {now, false}});
+        auto &info = res.first->second;
+        if (!info.swapped && now - info.lastActive >= m_idleTime) {
+            info.swapped = true;
+            toSwap.push_back(state);
+        }
+    }
+}
+
+} // namespace s2e
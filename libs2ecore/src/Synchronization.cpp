@@ -30,7 +30,9 @@
 #include <unistd.h>
 
 #include <errno.h>
+#include <linux/futex.h>
 #include <semaphore.h>
+#include <sys/syscall.h>
 
 #include <s2e/S2E.h>
 #include <s2e/Synchronization.h>
@@ -43,8 +45,28 @@ struct SyncHeader {
     unsigned inited;
 };
 
-#define SYNCHEADER_FREE   1
-#define SYNCHEADER_LOCKED 0
+#define SYNCHEADER_FREE      1
+#define SYNCHEADER_LOCKED    0
+#define SYNCHEADER_CONTENDED 2
+
+// Number of attempts to take the lock before sleeping in the kernel.
+// The lock is held for a few instructions, so spinning a bit is usually enough.
+#define SYNCHEADER_SPIN_COUNT 100
+
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// The lock lives in memory shared between processes, so the futex must not be private
+static void futexWait(unsigned *addr, unsigned value) {
+    syscall(SYS_futex, addr, FUTEX_WAIT, value, nullptr, nullptr, 0);
+}
+
+static void futexWake(unsigned *addr, int count) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, count, nullptr, nullptr, 0);
+}
 
 /// \brief Create synchronized object
 ///
@@ -103,8 +125,8 @@ void *S2ESynchronizedObjectInternal::tryAcquire() {
     SyncHeader *hdr = (SyncHeader *) m_sharedBuffer;
 
     unsigned expected = SYNCHEADER_FREE; // this variable will contain actual value after call
-    if (!__atomic_compare_exchange_n(&hdr->lock, &expected, SYNCHEADER_LOCKED, false, __ATOMIC_SEQ_CST,
-                                     __ATOMIC_SEQ_CST)) {
+    if (!__atomic_compare_exchange_n(&hdr->lock, &expected, SYNCHEADER_LOCKED, false, __ATOMIC_ACQUIRE,
+                                     __ATOMIC_RELAXED)) {
         return nullptr;
     }
 
@@ -113,24 +135,39 @@ void *S2ESynchronizedObjectInternal::tryAcquire() {
 
 /// \brief Acquire synchronization lock
 ///
-/// Call \ref tryAquire until it succeeds
+/// Spins on \ref tryAcquire for a while, then marks the lock as contended
+/// and sleeps on a futex until the owner releases it.
 ///
 /// \returns pointer to shared memory
 ///
 void *S2ESynchronizedObjectInternal::acquire() {
-    while (true) {
+    for (unsigned i = 0; i < SYNCHEADER_SPIN_COUNT; ++i) {
         void *ret = tryAcquire();
         if (ret != nullptr) {
             return ret;
         }
+        cpuRelax();
     }
+
+    SyncHeader *hdr = (SyncHeader *) m_sharedBuffer;
+
+    // Once contended, the lock stays so until the owner releases it, even if
+    // we get it right away. We can't know whether other waiters are sleeping.
+    while (__atomic_exchange_n(&hdr->lock, SYNCHEADER_CONTENDED, __ATOMIC_ACQUIRE) != SYNCHEADER_FREE) {
+        futexWait(&hdr->lock, SYNCHEADER_CONTENDED);
+    }
+
+    return ((uint8_t *) m_sharedBuffer + m_headerSize);
 }
 
 /// \brief Release previously acquired lock
 void S2ESynchronizedObjectInternal::release() {
     SyncHeader *hdr = (SyncHeader *) m_sharedBuffer;
 
-    assert(__atomic_load_n(&hdr->lock, __ATOMIC_SEQ_CST) == SYNCHEADER_LOCKED && "Lock was not acquired");
-    __atomic_store_n(&hdr->lock, SYNCHEADER_FREE, __ATOMIC_SEQ_CST);
+    unsigned prev = __atomic_exchange_n(&hdr->lock, SYNCHEADER_FREE, __ATOMIC_RELEASE);
+    assert(prev != SYNCHEADER_FREE && "Lock was not acquired");
+    if (prev == SYNCHEADER_CONTENDED) {
+        futexWake(&hdr->lock, 1);
+    }
 }
 } // namespace s2e
@@ -0,0 +1,382 @@
+///
+/// Copyright (C) 2020, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#include <algorithm>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fstream>
+#include <pthread.h>
+#include <sstream>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include <s2e/ConfigFile.h>
+#include <s2e/S2E.h>
+#include <s2e/Utils.h>
+#include <s2e/cpu.h>
+
+#include <s2e/Plugins/OSMonitors/Support/ModuleMap.h>
+
+#include "HostProfiler.h"
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace s2e {
+namespace plugins {
+
+S2E_DEFINE_PLUGIN(HostProfiler, "Samples where the execution thread spends its time", "", );
+
+static const char *s_activityNames[] = {"other", "concrete", "symbolic", "solver", "plugin", "state-switch"};
+
+static_assert(sizeof(s_activityNames) / sizeof(s_activityNames[0]) == (unsigned) klee::Activity::Count,
+              "Missing activity name");
+
+HostProfiler *HostProfiler::s_profiler = nullptr;
+
+HostProfiler::HostProfiler(S2E *s2e)
+    : Plugin(s2e), m_modules(nullptr), m_frequency(0), m_writeInterval(0), m_timerTicks(0), m_timerArmed(false),
+      m_stackLow(0), m_stackHigh(0), m_head(0), m_tail(0), m_dropped(0), m_activityCounts() {
+}
+
+HostProfiler::~HostProfiler() {
+    onEngineShutdown();
+}
+
+void HostProfiler::initialize() {
+    ConfigFile *cfg = s2e()->getConfig();
+
+    m_frequency = cfg->getInt(getConfigKey() + ".samplingFrequency", 1000);
+    m_writeInterval = cfg->getInt(getConfigKey() + ".writeInterval", 10);
+
+    if (!m_frequency || m_frequency > 1000000) {
+        getWarningsStream() << "samplingFrequency must be between 1 and 1000000 Hz\n";
+        exit(-1);
+    }
+
+    if (!m_writeInterval) {
+        m_writeInterval = 1;
+    }
+
+    // Guest modules are reported when the plugin is available
+    m_modules = s2e()->getPlugin<ModuleMap>();
+
+    m_ring.resize(RingSize);
+
+    s_profiler = this;
+
+    struct sigaction action = {};
+    action.sa_sigaction = &HostProfiler::onSignal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, nullptr) < 0) {
+        getWarningsStream() << "Could not install SIGPROF handler: " << strerror(errno) << "\n";
+        exit(-1);
+    }
+
+    // The timer is armed lazily from onTimer, which runs on the execution thread
+    s2e()->getCorePlugin()->onTimer.connect(sigc::mem_fun(*this, &HostProfiler::onTimer));
+    s2e()->getCorePlugin()->onProcessFork.connect(sigc::mem_fun(*this, &HostProfiler::onProcessFork));
+    s2e()->getCorePlugin()->onEngineShutdown.connect(sigc::mem_fun(*this, &HostProfiler::onEngineShutdown));
+}
+
+///
+/// \brief Records one sample
+///
+/// This runs in signal context on the execution thread. It must not allocate
+/// or take locks, so it only copies a few values into the ring buffer.
+/// backtrace() is not async-signal-safe, so the handler walks the frame
+/// pointers of the interrupted code instead.
+///
+void HostProfiler::onSignal(int signum, siginfo_t *info, void *context) {
+    auto profiler = s_profiler;
+    if (!profiler) {
+        return;
+    }
+
+    int savedErrno = errno;
+
+    auto head = profiler->m_head.load(std::memory_order_relaxed);
+    if (head - profiler->m_tail.load(std::memory_order_acquire) >= RingSize) {
+        profiler->m_dropped.fetch_add(1, std::memory_order_relaxed);
+        errno = savedErrno;
+        return;
+    }
+
+    auto &sample = profiler->m_ring[head % RingSize];
+    sample.activity = (uint8_t) klee::g_activity.load(std::memory_order_relaxed);
+    sample.pc = env ? env->eip : 0;
+    sample.pageDir = env ? env->cr[3] : 0;
+    sample.frameCount = profiler->unwind(context, sample.frames);
+
+    profiler->m_head.store(head + 1, std::memory_order_release);
+    errno = savedErrno;
+}
+
+///
+/// \brief Walks the frame pointer chain of the interrupted code
+///
+/// Every frame pointer is checked against the bounds of the execution thread's
+/// stack before it is read. The walk stops at the first frame that does not
+/// maintain a frame pointer (e.g., translated code, which uses the register for
+/// the CPU state), so host code built without frame pointers shows shorter stacks.
+/// The caller of a function that was interrupted before it set up its frame, or
+/// that does not set one up at all (e.g., a leaf), is missing from the sample.
+///
+/// \return the number of frames, starting with the interrupted program counter
+///
+unsigned HostProfiler::unwind(const void *context, void **frames) const {
+    auto &mcontext = static_cast<const ucontext_t *>(context)->uc_mcontext;
+    unsigned count = 0;
+
+    frames[count++] = (void *) mcontext.gregs[REG_RIP];
+
+    auto fp = (uintptr_t) mcontext.gregs[REG_RBP];
+    while (count < MaxFrames) {
+        if (fp < m_stackLow || fp > m_stackHigh - 2 * sizeof(uintptr_t) || (fp & (sizeof(uintptr_t) - 1))) {
+            break;
+        }
+
+        // The saved frame pointer of the caller, followed by the return address
+        auto frame = (const uintptr_t *) fp;
+        if (!frame[1]) {
+            break;
+        }
+
+        frames[count++] = (void *) frame[1];
+
+        // Callers are higher on the stack, this also stops loops
+        if (frame[0] <= fp) {
+            break;
+        }
+
+        fp = frame[0];
+    }
+
+    return count;
+}
+
+bool HostProfiler::armTimer() {
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr)) {
+        return false;
+    }
+
+    void *stack;
+    size_t stackSize;
+    int ret = pthread_attr_getstack(&attr, &stack, &stackSize);
+    pthread_attr_destroy(&attr);
+    if (ret) {
+        return false;
+    }
+
+    m_stackLow = (uintptr_t) stack;
+    m_stackHigh = m_stackLow + stackSize;
+
+    // Wall time, so that the execution thread also gets samples while it waits for
+    // solver threads. Only the execution thread gets the signal.
+    struct sigevent event = {};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = syscall(SYS_gettid);
+
+    if (timer_create(CLOCK_MONOTONIC, &event, &m_timer) < 0) {
+        return false;
+    }
+
+    uint64_t period = 1000000000ull / m_frequency;
+    struct itimerspec spec = {};
+    spec.it_interval.tv_sec = period / 1000000000ull;
+    spec.it_interval.tv_nsec = period % 1000000000ull;
+    spec.it_value = spec.it_interval;
+
+    if (timer_settime(m_timer, 0, &spec, nullptr) < 0) {
+        timer_delete(m_timer);
+        return false;
+    }
+
+    m_timerArmed = true;
+    return true;
+}
+
+void HostProfiler::disarmTimer() {
+    if (m_timerArmed) {
+        timer_delete(m_timer);
+        m_timerArmed = false;
+    }
+}
+
+const std::string &HostProfiler::getSymbol(void *address) {
+    auto it = m_symbols.find(address);
+    if (it != m_symbols.end()) {
+        return it->second;
+    }
+
+    std::stringstream ss;
+    Dl_info info;
+    bool found = dladdr(address, &info);
+
+    if (found && info.dli_sname) {
+        int status;
+        char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        ss << (demangled && !status ? demangled : info.dli_sname);
+        free(demangled);
+    } else if (found && info.dli_fname) {
+        // Static functions have no dynamic symbol, report the offset in the library instead
+        std::string path = info.dli_fname;
+        ss << path.substr(path.rfind('/') + 1) << "+" << hexval((uintptr_t) address - (uintptr_t) info.dli_fbase);
+    } else {
+        ss << hexval((uintptr_t) address);
+    }
+
+    // Semicolons separate frames in the folded format
+    auto name = ss.str();
+    std::replace(name.begin(), name.end(), ';', ':');
+    return m_symbols[address] = name;
+}
+
+std::string HostProfiler::getGuestFrame(const Sample &sample) {
+    std::stringstream ss;
+    ss << "guest:";
+
+    // Modules can only be looked up in the address space of the current state
+    auto state = g_s2e_state;
+    if (m_modules && state && state->regs()->getPageDir() == sample.pageDir) {
+        auto module = m_modules->getModule(state, sample.pc);
+        if (module) {
+            ss << module->Name;
+            return ss.str();
+        }
+    }
+
+    ss << hexval(sample.pageDir);
+    return ss.str();
+}
+
+void HostProfiler::processSamples() {
+    auto head = m_head.load(std::memory_order_acquire);
+    auto tail = m_tail.load(std::memory_order_relaxed);
+    std::string stack;
+
+    for (; tail != head; ++tail) {
+        const auto &sample = m_ring[tail % RingSize];
+        ++m_activityCounts[sample.activity];
+
+        // Folded stacks list frames from the outermost to the innermost one
+        stack = s_activityNames[sample.activity];
+        stack += ";";
+        stack += getGuestFrame(sample);
+
+        for (int i = (int) sample.frameCount - 1; i >= 0; --i) {
+            stack += ";";
+            stack += getSymbol(sample.frames[i]);
+        }
+
+        ++m_stacks[stack];
+    }
+
+    m_tail.store(tail, std::memory_order_release);
+}
+
+void HostProfiler::writeProfile() {
+    auto path = s2e()->getOutputFilename("HostProfiler.folded");
+    std::ofstream ofs(path, std::ios::trunc);
+    if (!ofs.is_open()) {
+        getWarningsStream() << "Could not open " << path << "\n";
+        return;
+    }
+
+    for (const auto &it : m_stacks) {
+        ofs << it.first << " " << it.second << "\n";
+    }
+}
+
+void HostProfiler::onTimer() {
+    if (s_profiler != this) {
+        return;
+    }
+
+    if (!m_timerArmed && !armTimer()) {
+        getWarningsStream() << "Could not create profiling timer: " << strerror(errno) << "\n";
+        s_profiler = nullptr;
+        return;
+    }
+
+    processSamples();
+
+    if (++m_timerTicks % m_writeInterval == 0) {
+        writeProfile();
+    }
+}
+
+void HostProfiler::onProcessFork(bool preFork, bool isChild, unsigned parentProcId) {
+    if (preFork) {
+        // Timers are not inherited by the child, both processes re-arm their own from onTimer
+        disarmTimer();
+        processSamples();
+        writeProfile();
+        return;
+    }
+
+    if (isChild) {
+        // The child writes its own profile to its own output directory
+        m_stacks.clear();
+        std::fill(std::begin(m_activityCounts), std::end(m_activityCounts), 0);
+        m_dropped = 0;
+        m_timerTicks = 0;
+    }
+}
+
+void HostProfiler::onEngineShutdown() {
+    if (s_profiler != this) {
+        return;
+    }
+
+    disarmTimer();
+    s_profiler = nullptr;
+
+    processSamples();
+    writeProfile();
+
+    uint64_t total = 0;
+    for (auto count : m_activityCounts) {
+        total += count;
+    }
+
+    if (!total) {
+        return;
+    }
+
+    auto &os = getInfoStream();
+    os << "Collected " << total << " samples (" << m_dropped << " dropped):";
+    for (unsigned i = 0; i < (unsigned) klee::Activity::Count; ++i) {
+        os << " " << s_activityNames[i] << "=" << (m_activityCounts[i] * 100 / total) << "%";
+    }
+    os << "\n";
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,114 @@
+///
+/// Copyright (C) 2020, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+#ifndef S2E_PLUGINS_HOSTPROFILER_H
+#define S2E_PLUGINS_HOSTPROFILER_H
+
+#include <atomic>
+#include <signal.h>
+#include <time.h>
+#include <unordered_map>
+#include <vector>
+
+#include <klee/util/Activity.h>
+#include <s2e/Plugin.h>
+
+namespace s2e {
+namespace plugins {
+
+class ModuleMap;
+
+///
+/// \brief Samples where the execution thread spends its time
+///
+/// A wall-clock timer raises SIGPROF on the execution thread at the configured
+/// frequency. The signal handler records the current activity (concrete code,
+/// symbolic code, solver, plugin callback, state switch), the guest program
+/// counter and the innermost host frames into a ring buffer. The periodic
+/// timer folds the samples into a flame graph compatible file.
+///
+class HostProfiler : public Plugin {
+    S2E_PLUGIN
+
+public:
+    HostProfiler(S2E *s2e);
+    ~HostProfiler();
+
+    void initialize();
+
+private:
+    static const unsigned MaxFrames = 32;
+    static const unsigned RingSize = 4096;
+
+    struct Sample {
+        uint8_t activity;
+        uint8_t frameCount;
+        uint64_t pc;
+        uint64_t pageDir;
+        void *frames[MaxFrames];
+    };
+
+    static HostProfiler *s_profiler;
+
+    ModuleMap *m_modules;
+    unsigned m_frequency;
+    unsigned m_writeInterval;
+    unsigned m_timerTicks;
+
+    timer_t m_timer;
+    bool m_timerArmed;
+
+    /// Stack of the execution thread, which bounds the frame pointer walk
+    uintptr_t m_stackLow;
+    uintptr_t m_stackHigh;
+
+    /// The signal handler is the only producer and onTimer the only consumer
+    std::vector<Sample> m_ring;
+    std::atomic<uint64_t> m_head;
+    std::atomic<uint64_t> m_tail;
+    std::atomic<uint64_t> m_dropped;
+
+    /// Sample counts of folded stacks, e.g., "solver;klee::Executor::fork;..."
+    std::unordered_map<std::string, uint64_t> m_stacks;
+    std::unordered_map<void *, std::string> m_symbols;
+    uint64_t m_activityCounts[(unsigned) klee::Activity::Count];
+
+    static void onSignal(int signum, siginfo_t *info, void *context);
+    unsigned unwind(const void *context, void **frames) const;
+
+    bool armTimer();
+    void disarmTimer();
+
+    const std::string &getSymbol(void *address);
+    std::string getGuestFrame(const Sample &sample);
+    void processSamples();
+    void writeProfile();
+
+    void onTimer();
+    void onProcessFork(bool preFork, bool isChild, unsigned parentProcId);
+    void onEngineShutdown();
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif // S2E_PLUGINS_HOSTPROFILER_H
@@ -0,0 +1,143 @@
+///
+/// Copyright (C) 2020, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#ifndef S2E_PLUGINS_BACKGROUNDWRITER_H
+#define S2E_PLUGINS_BACKGROUNDWRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace s2e {
+namespace plugins {
+
+///
+/// \brief Writes queued items on a separate thread
+///
+/// The execution thread only hands the items over, e.g., trace chunks or test
+/// case files. The thread does not survive a process fork: plugins must stop
+/// the writer before the fork and start it again in both processes.
+///
+template <typename T> class BackgroundWriter {
+public:
+    /// \param maxPending the number of queued items above which push() blocks
+    /// \param write writes an item, on the writer thread
+    /// \param idle called on the writer thread each time the queue becomes empty
+    BackgroundWriter(size_t maxPending, std::function<void(const T &)> write, std::function<void()> idle = nullptr)
+        : m_maxPending(maxPending), m_write(write), m_idle(idle), m_writing(false), m_stop(false) {
+    }
+
+    ~BackgroundWriter() {
+        stop();
+    }
+
+    void start() {
+        m_stop = false;
+        m_thread = std::thread(&BackgroundWriter::run, this);
+    }
+
+    ///
+    /// \brief Waits until all pending items are written and stops the writer thread
+    ///
+    void stop() {
+        if (!m_thread.joinable()) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_stop = true;
+            m_cond.notify_all();
+        }
+
+        m_thread.join();
+    }
+
+    ///
+    /// \brief Queues an item, waiting while the queue is full
+    ///
+    void push(T &&item) {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_cond.wait(lock, [this] { return m_pending.size() < m_maxPending; });
+        m_pending.push_back(std::move(item));
+        m_cond.notify_all();
+    }
+
+    ///
+    /// \brief Waits until all pending items are written
+    ///
+    void wait() {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_cond.wait(lock, [this] { return m_pending.empty() && !m_writing; });
+    }
+
+private:
+    size_t m_maxPending;
+    std::function<void(const T &)> m_write;
+    std::function<void()> m_idle;
+
+    std::thread m_thread;
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::deque<T> m_pending;
+    bool m_writing;
+    bool m_stop;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(m_lock);
+
+        while (true) {
+            m_cond.wait(lock, [this] { return m_stop || !m_pending.empty(); });
+            if (m_pending.empty()) {
+                break;
+            }
+
+            auto item = std::move(m_pending.front());
+            m_pending.pop_front();
+            m_writing = true;
+            m_cond.notify_all();
+
+            lock.unlock();
+            m_write(item);
+            lock.lock();
+
+            // The item stays marked as being written until the idle callback
+            // returns, so that wait() also waits for the flush
+            if (m_pending.empty() && m_idle) {
+                lock.unlock();
+                m_idle();
+                lock.lock();
+            }
+
+            m_writing = false;
+            m_cond.notify_all();
+        }
+    }
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
@@ -27,6 +27,7 @@
 #include <s2e/Utils.h>
 
 #include <TraceEntries.pb.h>
+#include <zlib.h>
 
 #include "ExecutionTracer.h"
 
@@ -35,9 +36,45 @@ namespace plugins {
 
 S2E_DEFINE_PLUGIN(ExecutionTracer, "ExecutionTracer plugin", "", );
 
+// Entries are written out in chunks of this size
+static const size_t TraceChunkSize = 1024 * 1024;
+
+// Don't let the queue grow without bounds if the disk can't keep up
+static const size_t MaxPendingChunks = 64;
+
+ExecutionTracer::ExecutionTracer(S2E *s2e)
+    : Plugin(s2e), m_logFile(nullptr), m_gzFile(nullptr), m_currentIndex(0), m_monitor(nullptr), m_streamOffset(0),
+      m_indexFile(nullptr), m_writeInBackground(false),
+      m_writer(MaxPendingChunks,
+               [this](const PendingChunk &chunk) {
+                   if (!writeChunk(chunk)) {
+                       m_writeFailed = true;
+                   }
+               },
+               [this] { flushTraceFile(); }),
+      m_writeFailed(false), m_writeFailureReported(false) {
+}
+
 void ExecutionTracer::initialize() {
+    ConfigFile *cfg = s2e()->getConfig();
+
+    // Compressed traces must be decompressed with gunzip before processing
+    m_fileName = cfg->getBool(getConfigKey() + ".compress", false) ? "ExecutionTracer.dat.gz" : "ExecutionTracer.dat";
+    m_writeInBackground = cfg->getBool(getConfigKey() + ".writeInBackground", false);
+
+    m_header.reset(new s2e_trace::PbTraceItemHeader());
+    m_buffer.reserve(TraceChunkSize);
+
+    if (cfg->getBool(getConfigKey() + ".writeIndex", false)) {
+        m_index.reset(new TraceIndex());
+    }
+
     createNewTraceFile(false);
 
+    if (m_writeInBackground) {
+        m_writer.start();
+    }
+
     // Execution tracers must have the highest signal priority.
     // That's because others plugins might kill states. If these other plugins have
     // a higher priority, the tracer's handlers won't be calle and the execution
@@ -71,74 +108,230 @@ ExecutionTracer::~ExecutionTracer() {
 }
 
 void ExecutionTracer::onStateKill(S2EExecutionState *state) {
-    flush();
+    // States are killed often, waiting for the writer here would stall
+    // execution. The writer flushes the file once it catches up.
+    if (m_writeInBackground) {
+        submitBuffer();
+    } else {
+        flush();
+    }
 }
 
 void ExecutionTracer::onEngineShutdown() {
-    if (m_logFile) {
-        fclose(m_logFile);
-        m_logFile = nullptr;
+    if (!m_logFile && !m_gzFile) {
+        return;
     }
+
+    submitBuffer();
+    m_writer.stop();
+    closeTraceFile(true);
+    m_writeInBackground = false;
 }
 
 void ExecutionTracer::createNewTraceFile(bool append) {
-
-    if (append) {
-        assert(m_fileName.size() > 0);
-        m_logFile = fopen(m_fileName.c_str(), "a");
+    // The child of a process fork writes to its own output folder
+    auto path = s2e()->getOutputFilename(m_fileName);
+
+    // Appending to a compressed trace adds a new gzip member, which gunzip concatenates
+    if (m_fileName.size() > 3 && m_fileName.compare(m_fileName.size() - 3, 3, ".gz") == 0) {
+        m_gzFile = gzopen(path.c_str(), append ? "ab1" : "wb1");
+        if (m_gzFile) {
+            gzbuffer(m_gzFile, TraceChunkSize);
+        }
     } else {
-        m_fileName = s2e()->getOutputFilename("ExecutionTracer.dat");
-        m_logFile = fopen(m_fileName.c_str(), "wb");
+        m_logFile = fopen(path.c_str(), append ? "ab" : "wb");
     }
 
-    if (!m_logFile) {
-        getWarningsStream() << "Could not create ExecutionTracer.dat" << '\n';
+    if (!m_logFile && !m_gzFile) {
+        getWarningsStream() << "Could not create " << path << '\n';
         exit(-1);
     }
     m_currentIndex = 0;
+
+    if (!append) {
+        m_streamOffset = 0;
+    }
+
+    if (m_index) {
+        auto indexPath = s2e()->getOutputFilename("ExecutionTracer.idx");
+        m_indexFile = fopen(indexPath.c_str(), append ? "ab" : "wb");
+        if (!m_indexFile) {
+            getWarningsStream() << "Could not create " << indexPath << '\n';
+            exit(-1);
+        }
+
+        if (!append) {
+            m_index->reset();
+        }
+    }
 }
 
-void ExecutionTracer::onTimer() {
+///
+/// \brief Closes the trace and index files
+///
+/// \param terminate whether to write the footer of the index
+///
+void ExecutionTracer::closeTraceFile(bool terminate) {
+    if (m_indexFile) {
+        if (terminate) {
+            std::string footer;
+            m_index->serializeFooter(footer);
+            if (fwrite(footer.data(), footer.size(), 1, m_indexFile) != 1) {
+                getWarningsStream() << "Could not write the footer of the trace index\n";
+            }
+        }
+
+        fclose(m_indexFile);
+        m_indexFile = nullptr;
+    }
+
     if (m_logFile) {
-        fflush(m_logFile);
+        fclose(m_logFile);
+        m_logFile = nullptr;
+    }
+
+    if (m_gzFile) {
+        gzclose(m_gzFile);
+        m_gzFile = nullptr;
     }
 }
 
-bool ExecutionTracer::appendToTraceFile(const s2e_trace::PbTraceItemHeader &header, const void *data, unsigned size) {
-    std::string headerStr;
-    if (!header.AppendToString(&headerStr)) {
+void ExecutionTracer::onTimer() {
+    // Let the trace be read while S2E runs. The background writer flushes
+    // the file once it has no more chunks to write.
+    if (m_writeInBackground) {
+        submitBuffer();
+    } else {
+        flush();
+    }
+}
+
+///
+/// \brief Warns once after a chunk could not be written
+///
+/// The writer thread does not use the log streams, so the failure is reported
+/// the next time the execution thread appends an entry or flushes the trace.
+///
+/// \return true if a write failed
+///
+bool ExecutionTracer::checkWriteFailed() {
+    if (!m_writeFailed) {
         return false;
     }
 
+    if (!m_writeFailureReported) {
+        m_writeFailureReported = true;
+        getWarningsStream() << "Could not write to the trace file, dropping all further entries\n";
+    }
+
+    return true;
+}
+
+///
+/// \brief Appends an entry to the current chunk
+///
+/// Entries are dropped after a write failure, so that the trace is truncated
+/// instead of containing holes.
+///
+void ExecutionTracer::appendToTraceFile(const s2e_trace::PbTraceItemHeader &header, const void *data, unsigned size) {
+    if (checkWriteFailed()) {
+        return;
+    }
+
+    uint32_t headerSize = header.ByteSizeLong();
+
     // Start each trace entry (header + item) with a magic number
     // in order to easily spot corruptions during trace processing.
-    uint32_t prefix[] = {0xdeaddead, (uint32_t) headerStr.size()};
+    uint32_t prefix[] = {0xdeaddead, headerSize};
 
-    if (fwrite(&prefix[0], sizeof(prefix), 1, m_logFile) != 1) {
-        return false;
+    auto offset = m_buffer.size();
+    m_buffer.resize(offset + sizeof(prefix) + headerSize + sizeof(size) + size);
+
+    if (m_index) {
+        m_index->add(m_streamOffset + offset, header.state_id(), header.type(), header.pc(), header.address_space(),
+                     header.timestamp());
     }
 
-    if (fwrite(headerStr.c_str(), headerStr.size(), 1, m_logFile) != 1) {
-        return false;
+    auto ptr = (uint8_t *) &m_buffer[offset];
+    memcpy(ptr, prefix, sizeof(prefix));
+    ptr += sizeof(prefix);
+
+    ptr = header.SerializeWithCachedSizesToArray(ptr);
+
+    memcpy(ptr, &size, sizeof(size));
+    ptr += sizeof(size);
+
+    if (size) {
+        memcpy(ptr, data, size);
     }
 
-    if (fwrite(&size, sizeof(size), 1, m_logFile) != 1) {
-        return false;
+    if (m_buffer.size() >= TraceChunkSize) {
+        submitBuffer();
     }
+}
 
-    if (size) {
-        if (fwrite(data, size, 1, m_logFile) != 1) {
-            return false;
+///
+/// \brief Hands the current chunk to the writer thread, or writes it directly
+///
+void ExecutionTracer::submitBuffer() {
+    if (m_buffer.empty()) {
+        return;
+    }
+
+    m_streamOffset += m_buffer.size();
+
+    PendingChunk chunk;
+    if (m_index) {
+        m_index->serializeBlock(chunk.index);
+    }
+
+    if (!m_writeInBackground) {
+        chunk.trace.swap(m_buffer);
+        if (!writeChunk(chunk)) {
+            m_writeFailed = true;
+            checkWriteFailed();
         }
+        m_buffer.swap(chunk.trace);
+        m_buffer.clear();
+        return;
     }
 
-    return true;
+    chunk.trace.reserve(TraceChunkSize);
+    chunk.trace.swap(m_buffer);
+    m_writer.push(std::move(chunk));
+}
+
+bool ExecutionTracer::writeChunk(const PendingChunk &chunk) {
+    if (m_indexFile && fwrite(chunk.index.data(), chunk.index.size(), 1, m_indexFile) != 1) {
+        return false;
+    }
+
+    if (m_gzFile) {
+        return gzwrite(m_gzFile, chunk.trace.data(), chunk.trace.size()) == (int) chunk.trace.size();
+    }
+
+    return fwrite(chunk.trace.data(), chunk.trace.size(), 1, m_logFile) == 1;
+}
+
+void ExecutionTracer::flushTraceFile() {
+    if (m_logFile) {
+        fflush(m_logFile);
+    }
+
+    if (m_gzFile) {
+        gzflush(m_gzFile, Z_SYNC_FLUSH);
+    }
+
+    if (m_indexFile) {
+        fflush(m_indexFile);
+    }
 }
 
 uint32_t ExecutionTracer::writeData(S2EExecutionState *state, const void *data, unsigned size, uint32_t type) {
-    assert(m_logFile);
+    assert(m_logFile || m_gzFile);
 
-    s2e_trace::PbTraceItemHeader header;
+    s2e_trace::PbTraceItemHeader &header = *m_header;
+    header.Clear();
 
     header.set_address_space(state->regs()->getPageDir());
     header.set_pc(state->regs()->getPc());
@@ -156,7 +349,7 @@ uint32_t ExecutionTracer::writeData(S2EExecutionState *state, const void *data,
 
 uint32_t ExecutionTracer::writeData(S2EExecutionState *state, s2e_trace::PbTraceItemHeader &header, const void *data,
                                     unsigned size, uint32_t type /* s2e_trace::PbTraceItemHeaderType */) {
-    assert(m_logFile);
+    assert(m_logFile || m_gzFile);
 
     // We must take the guid instead of the id, because duplicate ids
     // across multiple traces will confuse the execution trace reader.
@@ -166,30 +359,45 @@ uint32_t ExecutionTracer::writeData(S2EExecutionState *state, s2e_trace::PbTrace
     header.set_timestamp(us);
     header.set_type(s2e_trace::PbTraceItemHeaderType(type));
 
-    if (!appendToTraceFile(header, data, size)) {
-        getWarningsStream(state) << "Could not write to trace file\n";
-        exit(-1);
-    }
+    appendToTraceFile(header, data, size);
 
     return ++m_currentIndex;
 }
 
 void ExecutionTracer::flush() {
-    if (m_logFile) {
-        fflush(m_logFile);
+    if (!m_logFile && !m_gzFile) {
+        return;
     }
+
+    submitBuffer();
+
+    if (!m_writeInBackground) {
+        flushTraceFile();
+        return;
+    }
+
+    // The writer flushes the file once it has written the last chunk
+    m_writer.wait();
+    checkWriteFailed();
 }
 
 void ExecutionTracer::onProcessFork(bool preFork, bool isChild, unsigned parentProcId) {
+    // The writer thread does not survive the fork
     if (preFork) {
-        fclose(m_logFile);
-        m_logFile = nullptr;
+        submitBuffer();
+        m_writer.stop();
+        closeTraceFile(false);
+        return;
+    }
+
+    if (isChild) {
+        createNewTraceFile(false);
     } else {
-        if (isChild) {
-            createNewTraceFile(false);
-        } else {
-            createNewTraceFile(true);
-        }
+        createNewTraceFile(true);
+    }
+
+    if (m_writeInBackground) {
+        m_writer.start();
     }
 }
 
@@ -210,6 +418,10 @@ void ExecutionTracer::onStateGuidAssignment(S2EExecutionState *state, uint64_t n
     s2e_trace::PbTraceItemFork item;
     item.add_children(state->getGuid());
     item.add_children(newGuid);
+
+    if (m_index) {
+        m_index->addFork(state->getGuid(), newGuid);
+    }
     writeData(state, item, s2e_trace::PbTraceItemHeaderType::TRACE_FORK);
 }
 
@@ -221,6 +433,9 @@ void ExecutionTracer::onFork(S2EExecutionState *state, const std::vector<S2EExec
 
     for (unsigned i = 0; i < newStates.size(); i++) {
         item.add_children(newStates[i]->getGuid());
+        if (m_index) {
+            m_index->addFork(state->getGuid(), newStates[i]->getGuid());
+        }
     }
 
     writeData(state, item, s2e_trace::PbTraceItemHeaderType::TRACE_FORK);
@@ -29,8 +29,15 @@
 #include <s2e/Plugins/OSMonitors/ModuleDescriptor.h>
 #include <s2e/S2EExecutionState.h>
 
+#include <atomic>
+#include <memory>
 #include <stdio.h>
 
+#include "BackgroundWriter.h"
+#include "TraceIndex.h"
+
+struct gzFile_s;
+
 namespace s2e_trace {
 class PbTraceItemHeader;
 }
@@ -48,13 +55,44 @@ class ExecutionTracer : public Plugin {
 private:
     std::string m_fileName;
     FILE *m_logFile;
+    gzFile_s *m_gzFile;
     uint32_t m_currentIndex;
     OSMonitor *m_monitor;
 
+    /// Reused between entries so that tracing does not allocate on the execution thread
+    std::unique_ptr<s2e_trace::PbTraceItemHeader> m_header;
+    std::string m_item;
+
+    /// Entries are serialized into this chunk, which is written out once full
+    std::string m_buffer;
+
+    /// Offset of m_buffer in the uncompressed trace
+    uint64_t m_streamOffset;
+
+    /// Null unless the columnar index is enabled
+    std::unique_ptr<TraceIndex> m_index;
+    FILE *m_indexFile;
+
+    struct PendingChunk {
+        std::string trace;
+        std::string index;
+    };
+
+    bool m_writeInBackground;
+    BackgroundWriter<PendingChunk> m_writer;
+    std::atomic<bool> m_writeFailed;
+    bool m_writeFailureReported;
+
     void onTimer();
     void createNewTraceFile(bool append);
+    void closeTraceFile(bool terminate);
 
-    bool appendToTraceFile(const s2e_trace::PbTraceItemHeader &header, const void *data, unsigned size);
+    bool checkWriteFailed();
+    void appendToTraceFile(const s2e_trace::PbTraceItemHeader &header, const void *data, unsigned size);
+
+    void submitBuffer();
+    bool writeChunk(const PendingChunk &chunk);
+    void flushTraceFile();
 
     void onStateKill(S2EExecutionState *state);
 
@@ -70,28 +108,27 @@ private:
     void onEngineShutdown();
 
 public:
-    ExecutionTracer(S2E *s2e) : Plugin(s2e) {
-    }
+    ExecutionTracer(S2E *s2e);
     ~ExecutionTracer();
     void initialize();
 
     template <typename T>
     uint32_t writeData(S2EExecutionState *state, s2e_trace::PbTraceItemHeader &header, const T &item, uint32_t type) {
-        std::string data;
-        if (!item.AppendToString(&data)) {
+        m_item.clear();
+        if (!item.AppendToString(&m_item)) {
             getWarningsStream(state) << "Could not serialize protobuf data\n";
             exit(-1);
         }
-        return writeData(state, header, data.c_str(), data.size(), type);
+        return writeData(state, header, m_item.data(), m_item.size(), type);
     }
 
     template <typename T> uint32_t writeData(S2EExecutionState *state, const T &item, uint32_t type) {
-        std::string data;
-        if (!item.AppendToString(&data)) {
+        m_item.clear();
+        if (!item.AppendToString(&m_item)) {
             getWarningsStream(state) << "Could not serialize protobuf data\n";
             exit(-1);
         }
-        return writeData(state, data.c_str(), data.size(), type);
+        return writeData(state, m_item.data(), m_item.size(), type);
     }
 
     uint32_t writeData(S2EExecutionState *state, s2e_trace::PbTraceItemHeader &header, const void *data, unsigned size,
@@ -100,6 +137,7 @@ public:
     uint32_t writeData(S2EExecutionState *state, const void *data, unsigned size,
                        uint32_t type /* s2e_trace::PbTraceItemHeaderType */);
 
+    /// Writes all pending entries to the trace file
     void flush();
 };
 
@@ -115,6 +115,8 @@ void MemoryTracer::initialize() {
     getDebugStream() << "MonitorMemory: " << m_traceMemory << " PageFaults: " << m_tracePageFaults
                      << " TlbMisses: " << m_traceTlbMisses << '\n';
 
+    initializeWatchedRanges();
+
     s2e()->getCorePlugin()->onTranslateBlockStart.connect(sigc::mem_fun(*this, &MemoryTracer::onTranslateBlockStart));
 
     s2e()->getCorePlugin()->onInitializationComplete.connect(
@@ -123,14 +125,51 @@ void MemoryTracer::initialize() {
     s2e()->getCorePlugin()->onAfterSymbolicDataMemoryAccess.connect(
         sigc::mem_fun(*this, &MemoryTracer::onAfterSymbolicDataMemoryAccess));
 
-    s2e()->getCorePlugin()->onConcreteDataMemoryAccess.connect(
-        sigc::mem_fun(*this, &MemoryTracer::onConcreteDataMemoryAccess));
+    // Accesses to the pages without watched ranges stay on the fast path
+    if (m_traceWatchedRanges) {
+        s2e()->getCorePlugin()->onWatchedConcreteDataMemoryAccess.connect(
+            sigc::mem_fun(*this, &MemoryTracer::onConcreteDataMemoryAccess));
+    } else {
+        s2e()->getCorePlugin()->onConcreteDataMemoryAccess.connect(
+            sigc::mem_fun(*this, &MemoryTracer::onConcreteDataMemoryAccess));
+    }
 
     s2e()->getCorePlugin()->onTlbMiss.connect(sigc::mem_fun(*this, &MemoryTracer::onTlbMiss));
 
     s2e()->getCorePlugin()->onPageFault.connect(sigc::mem_fun(*this, &MemoryTracer::onPageFault));
 }
 
+void MemoryTracer::initializeWatchedRanges() {
+    ConfigFile *cfg = s2e()->getConfig();
+    ConfigFile::string_list keys = cfg->getListKeys(getConfigKey() + ".watchedRanges");
+
+    m_traceWatchedRanges = !keys.empty();
+
+    for (const auto &key : keys) {
+        std::string rangeKey = getConfigKey() + ".watchedRanges." + key;
+
+        bool hasStart, hasSize;
+        uint64_t start = cfg->getInt(rangeKey + ".start", 0, &hasStart);
+        uint64_t size = cfg->getInt(rangeKey + ".size", 0, &hasSize);
+        if (!hasStart || !hasSize || !size) {
+            getWarningsStream() << rangeKey << " must have a start and a non-zero size\n";
+            exit(-1);
+        }
+
+        // A page directory of 0 watches the range in all address spaces.
+        // The key is optional, getInt would warn about its absence.
+        uint64_t pageDir = 0;
+        if (cfg->hasKey(rangeKey + ".pageDir")) {
+            pageDir = cfg->getInt(rangeKey + ".pageDir");
+        }
+
+        getDebugStream() << "Watching " << hexval(start) << " size " << hexval(size) << " pageDir " << hexval(pageDir)
+                         << "\n";
+
+        s2e()->getCorePlugin()->addMemoryWatch(nullptr, start, size, pageDir);
+    }
+}
+
 void MemoryTracer::onInitializationComplete(S2EExecutionState *state) {
     DECLARE_PLUGINSTATE(MemoryTracerState, state);
     plgState->override(MemoryTracer::MEMORY, m_traceMemory);
@@ -274,6 +313,15 @@ void MemoryTracer::onAfterSymbolicDataMemoryAccess(S2EExecutionState *state, kle
         return;
     }
 
+    // Accesses with a symbolic address are always traced
+    if (m_traceWatchedRanges && isa<klee::ConstantExpr>(address)) {
+        uint64_t concreteAddress = cast<klee::ConstantExpr>(address)->getZExtValue();
+        if (!s2e()->getCorePlugin()->isMemoryWatched(state, concreteAddress,
+                                                     klee::Expr::getMinBytesForWidth(value->getWidth()))) {
+            return;
+        }
+    }
+
     traceSymbolicDataMemoryAccess(state, address, hostAddress, value, flags);
 }
 
@@ -57,10 +57,15 @@ private:
     bool m_traceHostAddresses;
     bool m_debugObjectStates;
 
+    /// Only trace the accesses to the configured watched ranges
+    bool m_traceWatchedRanges;
+
     ExecutionTracer *m_tracer;
 
     ITracker *m_tracker;
 
+    void initializeWatchedRanges();
+
     void onTlbMiss(S2EExecutionState *state, uint64_t addr, bool is_write);
     void onPageFault(S2EExecutionState *state, uint64_t addr, bool is_write);
 
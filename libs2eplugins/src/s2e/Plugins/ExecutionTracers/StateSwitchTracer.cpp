@@ -21,6 +21,7 @@
 ///
 
 #include <s2e/S2E.h>
+#include <s2e/S2EExecutor.h>
 
 #include <TraceEntries.pb.h>
 
@@ -40,6 +41,10 @@ void StateSwitchTracer::initialize() {
 void StateSwitchTracer::onStateSwitch(S2EExecutionState *currentState, S2EExecutionState *nextState) {
     s2e_trace::PbTraceStateSwitch item;
     item.set_new_state(nextState->getID());
+
+    auto executor = s2e()->getExecutor();
+    item.set_saved_bytes(executor->getLastSwitchSavedBytes());
+    item.set_restored_bytes(executor->getLastSwitchRestoredBytes());
     m_tracer->writeData(currentState, item, s2e_trace::TRACE_STATE_SWITCH);
 }
 
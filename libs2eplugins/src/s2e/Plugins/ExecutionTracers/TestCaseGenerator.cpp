@@ -24,6 +24,7 @@
 #include <cctype>
 #include <fstream>
 #include <iomanip>
+#include <time.h>
 
 #include <boost/regex.hpp>
 #include <klee/Internal/ADT/ImmutableMap.h>
@@ -99,11 +100,37 @@ bool operator&(TestCaseType a, TestCaseType b) {
 
 S2E_DEFINE_PLUGIN(TestCaseGenerator, "TestCaseGenerator plugin", "TestCaseGenerator");
 
-TestCaseGenerator::TestCaseGenerator(S2E *s2e) : Plugin(s2e) {
+// Don't let the queue grow without bounds if the disk can't keep up
+static const unsigned MaxPendingTestCases = 256;
+
+TestCaseGenerator::TestCaseGenerator(S2E *s2e)
+    : Plugin(s2e), m_writeInBackground(false),
+      m_writer(MaxPendingTestCases, [this](const PendingTestCase &tc) { writeTestCase(tc); }), m_writeFailed(false),
+      m_writeFailureReported(false), m_archive(nullptr) {
+}
+
+TestCaseGenerator::~TestCaseGenerator() {
+    m_writer.stop();
+    closeArchive(true);
 }
 
 void TestCaseGenerator::initialize() {
     m_tracer = s2e()->getPlugin<ExecutionTracer>();
+
+    ConfigFile *cfg = s2e()->getConfig();
+    m_writeInBackground = cfg->getBool(getConfigKey() + ".writeInBackground", false);
+
+    if (cfg->getBool(getConfigKey() + ".archive", false)) {
+        openArchive();
+    }
+
+    if (m_writeInBackground) {
+        m_writer.start();
+    }
+
+    s2e()->getCorePlugin()->onProcessFork.connect(sigc::mem_fun(*this, &TestCaseGenerator::onProcessFork));
+    s2e()->getCorePlugin()->onEngineShutdown.connect(sigc::mem_fun(*this, &TestCaseGenerator::onEngineShutdown));
+
     enable();
 }
 
@@ -428,20 +455,183 @@ void TestCaseGenerator::assembleTestCaseToFiles(const ConcreteInputs &inputs, co
     TestCaseData data;
     assembleTestCaseToFiles(inputs, templates, data);
 
-    for (const auto &it : data) {
+    PendingTestCase tc;
+    for (auto &it : data) {
         const std::string &name = it.first;
-        const auto &tcData = it.second;
 
         std::stringstream ss;
         ss << prefix << "-" << name;
-        std::string outputFileName = s2e()->getOutputFilename(ss.str());
-        fileNames.push_back(outputFileName);
+        fileNames.push_back(m_archive ? ss.str() : s2e()->getOutputFilename(ss.str()));
+        tc.files.push_back(std::make_pair(ss.str(), std::move(it.second)));
+    }
+
+    if (!m_writeInBackground) {
+        writeTestCase(tc);
+    } else {
+        m_writer.push(std::move(tc));
+    }
+
+    checkWriteFailed();
+}
+
+///
+/// \brief Writes the files of a test case, on the writer thread if writing in the background
+///
+/// The writer thread does not use the log streams, failures are reported by checkWriteFailed().
+///
+void TestCaseGenerator::writeTestCase(const PendingTestCase &tc) {
+    for (const auto &it : tc.files) {
+        const std::string &name = it.first;
+        const auto &tcData = it.second;
+
+        if (m_archive) {
+            if (!appendToArchive(name, tcData)) {
+                m_writeFailed = true;
+            }
+            continue;
+        }
+
+        std::string outputFileName = s2e()->getOutputFilename(name);
         std::ofstream ofs(outputFileName.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
         ofs.write((const char *) &tcData[0], tcData.size());
         ofs.close();
+        if (!ofs) {
+            m_writeFailed = true;
+        }
+    }
+}
+
+///
+/// \brief Warns once after a test case file could not be written
+///
+void TestCaseGenerator::checkWriteFailed() {
+    if (m_writeFailed && !m_writeFailureReported) {
+        m_writeFailureReported = true;
+        getWarningsStream() << "Could not write some test case files\n";
+    }
+}
+
+static const unsigned TarBlockSize = 512;
+
+///
+/// \brief Fills a ustar header for an entry of the given type and size
+///
+static void fillTarHeader(uint8_t *header, const std::string &name, uint64_t size, char type) {
+    char *h = (char *) header;
+    memset(h, 0, TarBlockSize);
+
+    memcpy(h, name.c_str(), std::min<size_t>(name.size(), 99));
+    snprintf(h + 100, 8, "%07o", 0644);
+    snprintf(h + 108, 8, "%07o", 0);
+    snprintf(h + 116, 8, "%07o", 0);
+    snprintf(h + 124, 12, "%011llo", (unsigned long long) size);
+    snprintf(h + 136, 12, "%011llo", (unsigned long long) time(nullptr));
+    h[156] = type;
+    memcpy(h + 257, "ustar", 6);
+    memcpy(h + 263, "00", 2);
+
+    // The checksum is computed with its own field filled with spaces
+    memset(h + 148, ' ', 8);
+    unsigned sum = 0;
+    for (unsigned i = 0; i < TarBlockSize; ++i) {
+        sum += header[i];
+    }
+    snprintf(h + 148, 8, "%06o", sum);
+}
+
+static void appendTarData(std::vector<uint8_t> &out, const void *data, size_t size) {
+    auto bytes = (const uint8_t *) data;
+    out.insert(out.end(), bytes, bytes + size);
+    out.resize(out.size() + (TarBlockSize - size % TarBlockSize) % TarBlockSize, 0);
+}
+
+void TestCaseGenerator::openArchive() {
+    auto path = s2e()->getOutputFilename("testcases.tar");
+    m_archive = fopen(path.c_str(), "ab");
+    if (!m_archive) {
+        getWarningsStream() << "Could not open " << path << ", writing test cases to separate files\n";
+    }
+}
+
+///
+/// \brief Closes the archive, terminating it with the end-of-archive marker if requested
+///
+/// A forked process must not terminate the archive of its parent.
+///
+void TestCaseGenerator::closeArchive(bool terminate) {
+    if (!m_archive) {
+        return;
+    }
+
+    if (terminate) {
+        uint8_t zero[TarBlockSize * 2] = {0};
+        fwrite(zero, sizeof(zero), 1, m_archive);
+    }
+
+    fclose(m_archive);
+    m_archive = nullptr;
+}
+
+///
+/// \brief Appends a file to the archive with a single write
+///
+/// Names that do not fit in the ustar header are stored in a pax extended header.
+///
+/// \return false if the file could not be written
+///
+bool TestCaseGenerator::appendToArchive(const std::string &name, const Data &data) {
+    std::vector<uint8_t> out;
+    uint8_t header[TarBlockSize];
+
+    if (name.size() > 99) {
+        // The record length includes its own digits
+        std::string record = " path=" + name + "\n";
+        size_t length = record.size() + 1;
+        while (std::to_string(length).size() + record.size() != length) {
+            length = std::to_string(length).size() + record.size();
+        }
+        record = std::to_string(length) + record;
+
+        fillTarHeader(header, "PaxHeader", record.size(), 'x');
+        appendTarData(out, header, sizeof(header));
+        appendTarData(out, record.data(), record.size());
+    }
+
+    fillTarHeader(header, name, data.size(), '0');
+    appendTarData(out, header, sizeof(header));
+    appendTarData(out, data.data(), data.size());
+
+    if (fwrite(out.data(), out.size(), 1, m_archive) != 1) {
+        return false;
+    }
+
+    return fflush(m_archive) == 0;
+}
+
+void TestCaseGenerator::onProcessFork(bool preFork, bool isChild, unsigned parentProcId) {
+    // The writer thread does not survive the fork
+    if (preFork) {
+        m_writer.stop();
+        return;
+    }
+
+    // The child has its own output folder
+    if (isChild && m_archive) {
+        closeArchive(false);
+        openArchive();
+    }
+
+    if (m_writeInBackground) {
+        m_writer.start();
     }
 }
 
+void TestCaseGenerator::onEngineShutdown() {
+    m_writer.stop();
+    closeArchive(true);
+    m_writeInBackground = false;
+}
+
 void TestCaseGenerator::assembleTestCaseToFiles(const ConcreteInputs &inputs, const ConcreteFileTemplates &templates,
                                                 TestCaseData &data) {
     TestCaseFiles files;
@@ -24,6 +24,8 @@
 #ifndef S2E_PLUGINS_TCGEN_H
 #define S2E_PLUGINS_TCGEN_H
 
+#include <atomic>
+#include <stdio.h>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -31,6 +33,7 @@
 #include <llvm/Support/raw_ostream.h>
 
 #include <s2e/Plugin.h>
+#include <s2e/Plugins/ExecutionTracers/BackgroundWriter.h>
 #include <s2e/Plugins/ExecutionTracers/ExecutionTracer.h>
 #include <s2e/Plugins/OSMonitors/Windows/WindowsCrashMonitor.h>
 #include <s2e/test_case_generator/commands.h>
@@ -180,6 +183,17 @@ typedef klee::ImmutableMap<std::string, Data> ConcreteFileTemplates;
 ///
 /// - When using partial symbolic files, the chunk size must be one.
 ///
+/// Writing test case files
+/// =======================
+///
+/// Each concrete file is written to its own file in the output folder by default.
+/// The following options reduce the time the execution thread spends on this:
+///
+/// - writeInBackground: files are written by a separate thread. The execution
+///   thread only computes their content.
+/// - archive: files are appended to testcases.tar in the output folder instead
+///   of being created individually.
+///
 class TestCaseGenerator : public Plugin, public IPluginInvoker {
     S2E_PLUGIN
 
@@ -189,6 +203,7 @@ private:
 
 public:
     TestCaseGenerator(S2E *s2e);
+    ~TestCaseGenerator();
 
     void initialize();
 
@@ -253,6 +268,30 @@ private:
 
     ExecutionTracer *m_tracer;
 
+    /// Test case files that wait for the background writer
+    struct PendingTestCase {
+        std::vector<std::pair<std::string, Data>> files;
+    };
+
+    bool m_writeInBackground;
+    BackgroundWriter<PendingTestCase> m_writer;
+
+    /// Set by the writer thread, reported by the execution thread
+    std::atomic<bool> m_writeFailed;
+    bool m_writeFailureReported;
+
+    FILE *m_archive;
+
+    void writeTestCase(const PendingTestCase &tc);
+    void checkWriteFailed();
+
+    void openArchive();
+    void closeArchive(bool terminate);
+    bool appendToArchive(const std::string &name, const Data &data);
+
+    void onProcessFork(bool preFork, bool isChild, unsigned parentProcId);
+    void onEngineShutdown();
+
     void onStateFork(S2EExecutionState *state, const std::vector<S2EExecutionState *> &newStates,
                      const std::vector<klee::ref<klee::Expr>> &newConditions);
     void onStateKill(S2EExecutionState *state);
@@ -0,0 +1,280 @@
+///
+/// Copyright (C) 2020, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#include "TraceIndex.h"
+
+#include <string.h>
+
+namespace s2e {
+namespace plugins {
+
+template <typename T> static void appendValue(std::string &out, T value) {
+    out.append((const char *) &value, sizeof(value));
+}
+
+template <typename T> static void appendColumn(std::string &out, const std::vector<T> &column) {
+    out.append((const char *) column.data(), column.size() * sizeof(T));
+}
+
+void TraceIndex::reset() {
+    m_offsets.clear();
+    m_timestamps.clear();
+    m_pcs.clear();
+    m_addressSpaces.clear();
+    m_stateIds.clear();
+    m_types.clear();
+
+    m_blockCount = 0;
+    m_size = 0;
+    m_stateBlocks.clear();
+    m_forks.clear();
+    m_hasLastStateId = false;
+}
+
+void TraceIndex::add(uint64_t offset, uint32_t stateId, uint32_t type, uint64_t pc, uint64_t addressSpace,
+                     uint64_t timestamp) {
+    m_offsets.push_back(offset);
+    m_timestamps.push_back(timestamp);
+    m_pcs.push_back(pc);
+    m_addressSpaces.push_back(addressSpace);
+    m_stateIds.push_back(stateId);
+    m_types.push_back(type);
+
+    // Consecutive entries usually come from the same state
+    if (m_hasLastStateId && m_lastStateId == stateId) {
+        return;
+    }
+
+    auto &blocks = m_stateBlocks[stateId];
+    if (blocks.empty() || blocks.back() != m_blockCount) {
+        blocks.push_back(m_blockCount);
+    }
+
+    m_lastStateId = stateId;
+    m_hasLastStateId = true;
+}
+
+void TraceIndex::serializeBlock(std::string &out) {
+    auto start = out.size();
+
+    appendValue(out, BlockMagic);
+    appendValue(out, (uint32_t) m_offsets.size());
+    appendColumn(out, m_offsets);
+    appendColumn(out, m_timestamps);
+    appendColumn(out, m_pcs);
+    appendColumn(out, m_addressSpaces);
+    appendColumn(out, m_stateIds);
+    appendColumn(out, m_types);
+
+    m_offsets.clear();
+    m_timestamps.clear();
+    m_pcs.clear();
+    m_addressSpaces.clear();
+    m_stateIds.clear();
+    m_types.clear();
+
+    m_size += out.size() - start;
+    ++m_blockCount;
+    m_hasLastStateId = false;
+}
+
+void TraceIndex::serializeFooter(std::string &out) {
+    auto start = out.size();
+
+    appendValue(out, FooterMagic);
+    appendValue(out, (uint32_t) m_stateBlocks.size());
+    for (const auto &it : m_stateBlocks) {
+        appendValue(out, it.first);
+        appendValue(out, (uint32_t) it.second.size());
+        appendColumn(out, it.second);
+    }
+
+    appendValue(out, (uint32_t) m_forks.size());
+    for (const auto &it : m_forks) {
+        appendValue(out, it.first);
+        appendValue(out, it.second);
+    }
+
+    appendValue(out, m_size);
+    appendValue(out, TrailerMagic);
+
+    m_size += out.size() - start;
+}
+
+namespace {
+
+/// Reads values from a buffer, failing instead of reading past its end
+class IndexParser {
+    const uint8_t *m_data;
+    size_t m_size;
+    size_t m_pos;
+
+public:
+    IndexParser(const uint8_t *data, size_t size) : m_data(data), m_size(size), m_pos(0) {
+    }
+
+    bool atEnd() const {
+        return m_pos == m_size;
+    }
+
+    template <typename T> bool read(T &value) {
+        if (m_size - m_pos < sizeof(T)) {
+            return false;
+        }
+
+        memcpy(&value, m_data + m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return true;
+    }
+
+    template <typename T> bool readColumn(std::vector<T> &column, uint32_t count) {
+        if ((m_size - m_pos) / sizeof(T) < count) {
+            return false;
+        }
+
+        // Columns are not aligned in the file
+        column.resize(count);
+        if (count) {
+            memcpy(column.data(), m_data + m_pos, count * sizeof(T));
+        }
+        m_pos += count * sizeof(T);
+        return true;
+    }
+};
+
+} // namespace
+
+bool TraceIndexReader::parse(const void *data, size_t size) {
+    m_blocks.clear();
+    m_stateBlocks.clear();
+    m_forks.clear();
+    m_hasFooter = false;
+
+    auto bytes = (const uint8_t *) data;
+
+    // The trailer is the footer offset followed by its magic
+    uint64_t footerOffset;
+    uint32_t magic;
+    const size_t trailerSize = sizeof(footerOffset) + sizeof(magic);
+    if (size >= trailerSize) {
+        memcpy(&footerOffset, bytes + size - trailerSize, sizeof(footerOffset));
+        memcpy(&magic, bytes + size - sizeof(magic), sizeof(magic));
+        m_hasFooter = magic == TraceIndex::TrailerMagic && footerOffset <= size - trailerSize;
+    }
+
+    if (!m_hasFooter) {
+        if (!parseBlocks(bytes, size, true)) {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < m_blocks.size(); ++i) {
+            for (auto stateId : m_blocks[i].stateIds) {
+                auto &blocks = m_stateBlocks[stateId];
+                if (blocks.empty() || blocks.back() != i) {
+                    blocks.push_back(i);
+                }
+            }
+        }
+        return true;
+    }
+
+    if (!parseBlocks(bytes, footerOffset, false) || !parseFooter(bytes + footerOffset, size - trailerSize - footerOffset)) {
+        return false;
+    }
+
+    // The footer must agree with the blocks
+    for (const auto &it : m_stateBlocks) {
+        for (auto block : it.second) {
+            if (block >= m_blocks.size()) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/// \param truncated whether the last block may be incomplete
+bool TraceIndexReader::parseBlocks(const uint8_t *data, size_t size, bool truncated) {
+    IndexParser parser(data, size);
+
+    while (!parser.atEnd()) {
+        uint32_t magic, count;
+        if (!parser.read(magic) || magic != TraceIndex::BlockMagic) {
+            return false;
+        }
+
+        Block block;
+        if (!parser.read(count) || !parser.readColumn(block.offsets, count) ||
+            !parser.readColumn(block.timestamps, count) || !parser.readColumn(block.pcs, count) ||
+            !parser.readColumn(block.addressSpaces, count) || !parser.readColumn(block.stateIds, count) ||
+            !parser.readColumn(block.types, count)) {
+            return truncated;
+        }
+
+        m_blocks.push_back(std::move(block));
+    }
+
+    return true;
+}
+
+bool TraceIndexReader::parseFooter(const uint8_t *data, size_t size) {
+    IndexParser parser(data, size);
+
+    uint32_t magic, stateCount;
+    if (!parser.read(magic) || magic != TraceIndex::FooterMagic || !parser.read(stateCount)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < stateCount; ++i) {
+        uint32_t stateId, blockCount;
+        if (!parser.read(stateId) || !parser.read(blockCount) ||
+            !parser.readColumn(m_stateBlocks[stateId], blockCount)) {
+            return false;
+        }
+    }
+
+    uint32_t forkCount;
+    if (!parser.read(forkCount)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < forkCount; ++i) {
+        std::pair<uint32_t, uint32_t> fork;
+        if (!parser.read(fork.first) || !parser.read(fork.second)) {
+            return false;
+        }
+        m_forks.push_back(fork);
+    }
+
+    return parser.atEnd();
+}
+
+const std::vector<uint32_t> &TraceIndexReader::getStateBlocks(uint32_t stateId) const {
+    static const std::vector<uint32_t> none;
+    auto it = m_stateBlocks.find(stateId);
+    return it == m_stateBlocks.end() ? none : it->second;
+}
+
+} // namespace plugins
+} // namespace s2e
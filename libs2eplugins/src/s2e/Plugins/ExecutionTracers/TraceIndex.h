@@ -0,0 +1,167 @@
+///
+/// Copyright (C) 2020, Vitaly Chipounov
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#ifndef S2E_PLUGINS_TRACEINDEX_H
+#define S2E_PLUGINS_TRACEINDEX_H
+
+#include <inttypes.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace s2e {
+namespace plugins {
+
+///
+/// \brief Builds a columnar index of the execution trace
+///
+/// The index lets offline tools select the entries of a state, or of a given type,
+/// without decoding every protobuf record of the trace. It is a sequence of blocks,
+/// one per trace chunk, followed by a footer. All integers are little-endian.
+///
+/// Block:
+///   - uint32 BlockMagic, uint32 count
+///   - uint64 offset[count]: offset of the entry in the uncompressed trace
+///   - uint64 timestamp[count]
+///   - uint64 pc[count]
+///   - uint64 address_space[count]
+///   - uint32 state_id[count]
+///   - uint32 type[count]
+///
+/// Footer, written when S2E terminates:
+///   - uint32 FooterMagic, uint32 state count
+///   - for each state: uint32 state_id, uint32 block count, uint32 block[block count]
+///   - uint32 fork count, then (uint32 parent, uint32 child) state id pairs
+///   - uint64 offset of the footer in the index, uint32 TrailerMagic
+///
+/// Readers find the footer from the trailer at the end of the file. If S2E was
+/// killed before writing it, they can still scan the blocks. TraceIndexReader
+/// parses the index this way.
+///
+class TraceIndex {
+public:
+    static const uint32_t BlockMagic = 0x4b4c4249;
+    static const uint32_t FooterMagic = 0x544f4f46;
+    static const uint32_t TrailerMagic = 0x58444953;
+
+private:
+    std::vector<uint64_t> m_offsets;
+    std::vector<uint64_t> m_timestamps;
+    std::vector<uint64_t> m_pcs;
+    std::vector<uint64_t> m_addressSpaces;
+    std::vector<uint32_t> m_stateIds;
+    std::vector<uint32_t> m_types;
+
+    /// Number of blocks and bytes already in the index file
+    uint32_t m_blockCount;
+    uint64_t m_size;
+
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_stateBlocks;
+    std::vector<std::pair<uint32_t, uint32_t>> m_forks;
+
+    uint32_t m_lastStateId;
+    bool m_hasLastStateId;
+
+public:
+    TraceIndex() {
+        reset();
+    }
+
+    /// Starts a new index file
+    void reset();
+
+    void add(uint64_t offset, uint32_t stateId, uint32_t type, uint64_t pc, uint64_t addressSpace,
+             uint64_t timestamp);
+
+    void addFork(uint32_t parent, uint32_t child) {
+        m_forks.push_back(std::make_pair(parent, child));
+    }
+
+    bool empty() const {
+        return m_offsets.empty();
+    }
+
+    /// Appends a block with the entries added since the previous one
+    void serializeBlock(std::string &out);
+
+    void serializeFooter(std::string &out);
+};
+
+///
+/// \brief Parses an index written by TraceIndex
+///
+class TraceIndexReader {
+public:
+    struct Block {
+        std::vector<uint64_t> offsets;
+        std::vector<uint64_t> timestamps;
+        std::vector<uint64_t> pcs;
+        std::vector<uint64_t> addressSpaces;
+        std::vector<uint32_t> stateIds;
+        std::vector<uint32_t> types;
+    };
+
+private:
+    std::vector<Block> m_blocks;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_stateBlocks;
+    std::vector<std::pair<uint32_t, uint32_t>> m_forks;
+    bool m_hasFooter;
+
+    bool parseBlocks(const uint8_t *data, size_t size, bool truncated);
+    bool parseFooter(const uint8_t *data, size_t size);
+
+public:
+    TraceIndexReader() : m_hasFooter(false) {
+    }
+
+    ///
+    /// \brief Parses the content of an index file
+    ///
+    /// Without a footer, the state blocks are computed from the blocks and
+    /// there are no forks. The last block may then be incomplete, it is ignored.
+    ///
+    /// \return false if the index is malformed
+    ///
+    bool parse(const void *data, size_t size);
+
+    const std::vector<Block> &getBlocks() const {
+        return m_blocks;
+    }
+
+    /// Returns the blocks that contain entries of the given state, in increasing order
+    const std::vector<uint32_t> &getStateBlocks(uint32_t stateId) const;
+
+    const std::vector<std::pair<uint32_t, uint32_t>> &getForks() const {
+        return m_forks;
+    }
+
+    bool hasFooter() const {
+        return m_hasFooter;
+    }
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
@@ -137,6 +137,11 @@ struct TranslationBlock {
     /* Indicates whether there are execution handlers attached */
     int instrumented;
 
+    /* Parts of the symbolic CPU state read and written by the block,
+       see tcg_calc_tb_regmask() */
+    uint64_t se_reg_rmask;
+    uint64_t se_reg_wmask;
+
 #ifdef STATIC_TRANSLATOR
     /* pc after which to stop the translation */
     target_ulong last_pc;
@@ -45,6 +45,8 @@ void *tcg_llvm_gen_code(void *llvmTranslator, struct TCGContext *s, struct Trans
 
 #ifdef __cplusplus
 
+#include <array>
+#include <cstring>
 #include <unordered_map>
 
 // External interface for C++ code
@@ -144,6 +146,40 @@ private:
     typedef llvm::DenseMap<std::pair<unsigned, unsigned>, llvm::Instruction *> GepMap;
     GepMap m_registers;
 
+#ifndef STATIC_TRANSLATOR
+    typedef std::array<uint8_t, 16> TbDigest;
+
+    struct TbDigestHash {
+        size_t operator()(const TbDigest &d) const {
+            size_t ret;
+            memcpy(&ret, d.data(), sizeof(ret));
+            return ret;
+        }
+    };
+
+    /* Functions generated so far, indexed by the digest of their ops.
+       Translation blocks are retranslated after cache flushes and invalidations,
+       this lets them reuse the existing function instead of generating a new one. */
+    std::unordered_map<TbDigest, llvm::Function *, TbDigestHash> m_tbCache;
+    std::unordered_map<llvm::Function *, TbDigest> m_tbDigests;
+
+    TbDigest getTbDigest(TCGContext *s, TranslationBlock *tb) const;
+
+public:
+    /* Returns the index of a host pointer that belongs to the given block
+       (e.g., one of its execution signals), or -1 if the value is not one. */
+    typedef int (*RelocationIndex)(TranslationBlock *tb, uint64_t value);
+
+private:
+    RelocationIndex m_relocationIndex;
+
+    int getRelocationIndex(TranslationBlock *tb, uint64_t value) const {
+        return m_relocationIndex ? m_relocationIndex(tb, value) : -1;
+    }
+
+    llvm::Value *getConstant(int bits, uint64_t value);
+#endif
+
     std::string generateName();
 
     TCGLLVMTranslator(const std::string &bitcodeLibraryPath, std::unique_ptr<llvm::Module> module);
@@ -172,6 +208,18 @@ public:
 
     bool isInstrumented(llvm::Function *tb);
 
+#ifndef STATIC_TRANSLATOR
+    /* Must be called before deleting a function returned by generateCode */
+    void forgetFunction(llvm::Function *tb);
+
+    /* Host pointers of a block are not embedded in its function, the function gets them
+       at run time by calling tcg_llvm_get_relocation with their index. This lets blocks
+       whose ops only differ by these pointers share their function. */
+    void setRelocations(RelocationIndex index) {
+        m_relocationIndex = index;
+    }
+#endif
+
     /* Shortcuts */
     llvm::Type *intType(int w) {
         return llvm::IntegerType::get(getContext(), w);
@@ -1550,6 +1550,11 @@ void tcg_target_force_tb_exit(uintptr_t gen_code, uintptr_t max_addr);
 
 #ifdef CONFIG_SYMBEX
 void tcg_calc_regmask(TCGContext *s, uint64_t *rmask, uint64_t *wmask, uint64_t *accesses_mem);
+
+/* Size of the part of the CPU state covered by one bit of the masks computed by tcg_calc_tb_regmask */
+#define TCG_REGMASK_SLOT_SIZE TARGET_LONG_SIZE
+
+void tcg_calc_tb_regmask(TCGContext *s, intptr_t limit, uint64_t *rmask, uint64_t *wmask);
 #endif
 
 void tcg_register_helper(void *func, const char *name, int param_count, ...);
@@ -53,6 +53,7 @@ extern "C" {
 
 #include <llvm/Support/DynamicLibrary.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
 #include <llvm/Support/raw_ostream.h>
 
 #include <llvm-c/Core.h>
@@ -93,6 +94,9 @@ TCGLLVMTranslator::TCGLLVMTranslator(const std::string &bitcodeLibraryPath, std:
     m_cpuState = NULL;
     m_eip = NULL;
     m_ccop = NULL;
+#ifndef STATIC_TRANSLATOR
+    m_relocationIndex = NULL;
+#endif
 
     initializeNativeCpuState();
     initializeHelpers();
@@ -754,7 +758,11 @@ int TCGLLVMTranslator::generateOperation(const TCGOp *op) {
         } break;
 
         case INDEX_op_movi_i32:
+#ifdef STATIC_TRANSLATOR
             setValue(op->args[0], ConstantInt::get(intType(32), op->args[1]));
+#else
+            setValue(op->args[0], getConstant(32, op->args[1]));
+#endif
             break;
 
         case INDEX_op_mov_i32:
@@ -765,7 +773,11 @@ int TCGLLVMTranslator::generateOperation(const TCGOp *op) {
 
 #if TCG_TARGET_REG_BITS == 64
         case INDEX_op_movi_i64:
+#ifdef STATIC_TRANSLATOR
             setValue(op->args[0], ConstantInt::get(intType(64), op->args[1]));
+#else
+            setValue(op->args[0], getConstant(64, op->args[1]));
+#endif
             break;
 
         case INDEX_op_mov_i64:
@@ -1122,6 +1134,124 @@ void TCGLLVMTranslator::removeInterruptExit() {
     bb.getInstList().push_back(newBr);
 }
 
+#ifndef STATIC_TRANSLATOR
+///
+/// Computes a digest of everything that determines the code generated for the
+/// current translation block: the ops with their arguments, and the fields of the
+/// translation block used by generateCode. Temps and labels are identified by
+/// their index rather than by their address.
+///
+/// Host pointers that belong to the block (e.g., its execution signals) are
+/// hashed by their index, the function loads them at run time (see getConstant).
+/// Other constants are hashed by value, so a function is only reused when the
+/// guest code, the cpu flags that affect translation and the instrumentation
+/// produce the same ops.
+///
+TCGLLVMTranslator::TbDigest TCGLLVMTranslator::getTbDigest(TCGContext *s, TranslationBlock *tb) const {
+    llvm::MD5 hash;
+
+    auto update = [&](uint64_t value) {
+        hash.update(ArrayRef<uint8_t>((const uint8_t *) &value, sizeof(value)));
+    };
+
+    update(tb->cs_base);
+    update(tb->cflags & CF_HAS_INTERRUPT_EXIT);
+
+    const TCGOp *op;
+    QTAILQ_FOREACH (op, &s->ops, link) {
+        const TCGOpDef *def = &tcg_op_defs[op->opc];
+        unsigned nb_oargs, nb_iargs;
+
+        if (op->opc == INDEX_op_call) {
+            nb_oargs = TCGOP_CALLO(op);
+            nb_iargs = TCGOP_CALLI(op);
+        } else {
+            nb_oargs = def->nb_oargs;
+            nb_iargs = def->nb_iargs;
+        }
+
+        update(op->opc);
+        update(op->param1);
+        update(op->param2);
+
+        for (unsigned i = 0; i < nb_oargs + nb_iargs; ++i) {
+            TCGArg arg = op->args[i];
+            if (arg == TCG_CALL_DUMMY_ARG) {
+                update(-1);
+                continue;
+            }
+
+            TCGTemp *ts = arg_temp(arg);
+            update(temp_idx(ts));
+            update(ts->type);
+            update(ts->temp_local);
+        }
+
+        for (unsigned i = 0; i < def->nb_cargs; ++i) {
+            TCGArg arg = op->args[nb_oargs + nb_iargs + i];
+
+            switch (op->opc) {
+                case INDEX_op_br:
+                case INDEX_op_set_label:
+                    arg = arg_label(arg)->id;
+                    break;
+                case INDEX_op_brcond_i32:
+                case INDEX_op_brcond_i64:
+                    if (i == 1) {
+                        arg = arg_label(arg)->id;
+                    }
+                    break;
+                case INDEX_op_exit_tb:
+                    // Points to the translation block, the value is not used when running in KLEE
+                    arg = 0;
+                    break;
+                case INDEX_op_movi_i32:
+                case INDEX_op_movi_i64: {
+                    int index = getRelocationIndex(tb, arg);
+                    if (index >= 0) {
+                        update(-2);
+                        arg = index;
+                    }
+                } break;
+                default:
+                    break;
+            }
+
+            update(arg);
+        }
+    }
+
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    return result.Bytes;
+}
+
+///
+/// Returns the value of a movi op. Host pointers that belong to the current block
+/// are loaded at run time, so that blocks with the same ops can share the function.
+///
+Value *TCGLLVMTranslator::getConstant(int bits, uint64_t value) {
+    int index = getRelocationIndex(m_tb, value);
+    if (index < 0) {
+        return ConstantInt::get(intType(bits), value);
+    }
+
+    // Implemented by the executor, like the other tcg_llvm_* functions
+    auto getRelocation =
+        m_module->getOrInsertFunction("tcg_llvm_get_relocation", FunctionType::get(intType(64), {intType(64)}, false));
+    Value *pointer = m_builder.CreateCall(getRelocation, ConstantInt::get(intType(64), index));
+    return m_builder.CreateZExtOrTrunc(pointer, intType(bits));
+}
+
+void TCGLLVMTranslator::forgetFunction(Function *tb) {
+    auto it = m_tbDigests.find(tb);
+    if (it != m_tbDigests.end()) {
+        m_tbCache.erase(it->second);
+        m_tbDigests.erase(it);
+    }
+}
+#endif
+
 Function *TCGLLVMTranslator::generateCode(TCGContext *s, TranslationBlock *tb) {
 #ifdef STATIC_TRANSLATOR
     m_info.clear();
@@ -1139,6 +1269,14 @@ Function *TCGLLVMTranslator::generateCode(TCGContext *s, TranslationBlock *tb) {
         return existingTb;
     }
 
+#ifndef STATIC_TRANSLATOR
+    auto digest = getTbDigest(s, tb);
+    auto cached = m_tbCache.find(digest);
+    if (cached != m_tbCache.end()) {
+        return cached->second;
+    }
+#endif
+
     m_tbFunction = createTbFunction(name);
     m_tbFunction->addFnAttr(Attribute::AlwaysInline);
 
@@ -1232,6 +1370,9 @@ Function *TCGLLVMTranslator::generateCode(TCGContext *s, TranslationBlock *tb) {
 
 #ifdef STATIC_TRANSLATOR
     computeStaticBranchTargets();
+#else
+    m_tbCache[digest] = m_tbFunction;
+    m_tbDigests[m_tbFunction] = digest;
 #endif
 
 // KLEE will optimize the function later
@@ -3942,4 +3942,148 @@ void tcg_calc_regmask(TCGContext *s, uint64_t *rmask, uint64_t *wmask, uint64_t
         }
     }
 }
+
+// Sets the bits of the mask that cover the given range of the CPU state
+static void tcg_regmask_add(uint64_t *mask, intptr_t offset, intptr_t size, intptr_t limit) {
+    intptr_t first, last, slot;
+
+    if (offset >= limit || offset + size <= 0) {
+        return;
+    }
+
+    first = offset < 0 ? 0 : offset / TCG_REGMASK_SLOT_SIZE;
+    last = (MIN(offset + size, limit) - 1) / TCG_REGMASK_SLOT_SIZE;
+
+    // The last bit covers everything that does not fit in the mask
+    for (slot = first; slot <= last && slot < 63; ++slot) {
+        *mask |= 1ull << slot;
+    }
+
+    if (last >= 63) {
+        *mask |= 1ull << 63;
+    }
+}
+
+// Returns the number of bytes accessed by a load/store to a host address, or 0 for other opcodes
+static int tcg_regmask_access_size(TCGOpcode c, bool *store) {
+    *store = false;
+
+    switch (c) {
+        case INDEX_op_ld8u_i32:
+        case INDEX_op_ld8s_i32:
+        case INDEX_op_ld8u_i64:
+        case INDEX_op_ld8s_i64:
+            return 1;
+        case INDEX_op_ld16u_i32:
+        case INDEX_op_ld16s_i32:
+        case INDEX_op_ld16u_i64:
+        case INDEX_op_ld16s_i64:
+            return 2;
+        case INDEX_op_ld_i32:
+        case INDEX_op_ld32u_i64:
+        case INDEX_op_ld32s_i64:
+            return 4;
+        case INDEX_op_ld_i64:
+            return 8;
+        case INDEX_op_st8_i32:
+        case INDEX_op_st8_i64:
+            *store = true;
+            return 1;
+        case INDEX_op_st16_i32:
+        case INDEX_op_st16_i64:
+            *store = true;
+            return 2;
+        case INDEX_op_st_i32:
+        case INDEX_op_st32_i64:
+            *store = true;
+            return 4;
+        case INDEX_op_st_i64:
+            *store = true;
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+// Adds the part of the CPU state backing the given temp to the mask
+static void tcg_regmask_add_temp(TCGContext *s, TCGTemp *ts, intptr_t limit, uint64_t *mask, uint64_t *rmask,
+                                 uint64_t *wmask) {
+    if (temp_idx(ts) >= s->nb_globals) {
+        return;
+    }
+
+    if (ts->fixed_reg) {
+        // The env pointer escapes (e.g., to compute the address of a vector register),
+        // the op may access any part of the CPU state.
+        *rmask = *wmask = -1;
+        return;
+    }
+
+    if (ts->indirect_reg || !ts->mem_base || !ts->mem_base->fixed_reg) {
+        *mask = -1;
+        return;
+    }
+
+    tcg_regmask_add(mask, ts->mem_offset, ts->type == TCG_TYPE_I32 ? 4 : 8, limit);
+}
+
+// Computes which parts of the CPU state the ops of the current translation block read and write.
+// Bit i of the masks covers the bytes [i * TCG_REGMASK_SLOT_SIZE, (i + 1) * TCG_REGMASK_SLOT_SIZE)
+// of the CPU state, the last bit covers everything between the end of bit 62 and limit.
+// Accesses above limit are ignored. Helper calls that may access globals are assumed to
+// access the whole state.
+void tcg_calc_tb_regmask(TCGContext *s, intptr_t limit, uint64_t *rmask, uint64_t *wmask) {
+    const TCGOp *op;
+    const TCGOpDef *def;
+    int c, i, size, nb_oargs, nb_iargs;
+    bool store;
+
+    *rmask = *wmask = 0;
+
+    QTAILQ_FOREACH(op, &s->ops, link) {
+        c = op->opc;
+        def = &tcg_op_defs[c];
+        size = 0;
+
+        if (c == INDEX_op_call) {
+            int flags;
+
+            nb_oargs = TCGOP_CALLO(op);
+            nb_iargs = TCGOP_CALLI(op);
+            flags = op->args[nb_oargs + nb_iargs + 1];
+
+            if (!(flags & TCG_CALL_NO_READ_GLOBALS)) {
+                *rmask = -1;
+                if (!(flags & TCG_CALL_NO_WRITE_GLOBALS)) {
+                    *wmask = -1;
+                }
+            }
+        } else {
+            nb_oargs = def->nb_oargs;
+            nb_iargs = def->nb_iargs;
+            size = tcg_regmask_access_size(c, &store);
+        }
+
+        // Direct load/store to the CPU state
+        if (size && arg_temp(op->args[1])->fixed_reg) {
+            tcg_regmask_add(store ? wmask : rmask, op->args[2], size, limit);
+        } else {
+            size = 0;
+        }
+
+        for (i = 0; i < nb_iargs; i++) {
+            TCGArg arg = op->args[nb_oargs + i];
+
+            if (arg == TCG_CALL_DUMMY_ARG || (size && nb_oargs + i == 1)) {
+                continue;
+            }
+
+            tcg_regmask_add_temp(s, arg_temp(arg), limit, rmask, rmask, wmask);
+        }
+
+        for (i = 0; i < nb_oargs; i++) {
+            tcg_regmask_add_temp(s, arg_temp(op->args[i]), limit, wmask, rmask, wmask);
+        }
+    }
+}
 #endif
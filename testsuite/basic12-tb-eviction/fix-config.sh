@@ -0,0 +1,10 @@
+#!/bin/sh
+set -e
+
+echo "Patching s2e-config.lua..."
+
+PROJECT_NAME="$(basename $PROJECT_DIR)"
+
+# Evict often while the other sides of the branches are still checked in the background,
+# so that evictions happen while forks are deferred.
+sed -i 's/kleeArgs = {/kleeArgs = { "--max-tb-functions=256", "--speculative-fork-solvers=2"/g' "$PROJECT_DIR/s2e-config.lua"
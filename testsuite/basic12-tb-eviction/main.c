@@ -0,0 +1,63 @@
+// Copyright (c) 2023, Vitaly Chipounov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <s2e/s2e.h>
+
+// Each call translates new code in every state, which fills the
+// translation block cache and triggers evictions.
+#define DEFINE_STEP(n)                          \
+    static int step##n(int value) {             \
+        if (value & (1 << ((n) % 8))) {         \
+            return value * (n) + 1;             \
+        }                                       \
+        return value ^ ((n) << 3);              \
+    }
+
+DEFINE_STEP(0)
+DEFINE_STEP(1)
+DEFINE_STEP(2)
+DEFINE_STEP(3)
+DEFINE_STEP(4)
+DEFINE_STEP(5)
+DEFINE_STEP(6)
+DEFINE_STEP(7)
+
+static int (*steps[])(int) = {step0, step1, step2, step3, step4, step5, step6, step7};
+
+int main(int argc, char **argv) {
+    unsigned char input[6];
+    int value = 0;
+
+    s2e_make_symbolic(input, sizeof(input), "input");
+
+    // Forks on every byte. With background solvers, the state keeps running
+    // and translating code while the other side of the branch is checked.
+    for (int i = 0; i < sizeof(input); ++i) {
+        if (input[i] == 'a' + i) {
+            value = steps[i % 8](value + i);
+        } else {
+            value = steps[(i + 3) % 8](value - i);
+        }
+    }
+
+    s2e_printf("value=%d", value);
+    s2e_kill_state(0, "Terminated tb-eviction path");
+    return 0;
+}
@@ -0,0 +1,13 @@
+#!/bin/bash
+
+{% include 'common-run.sh.tpl' %}
+
+s2e run -n {{ project_name }}
+
+# The test is only meaningful if functions were evicted
+grep -q "Evicted [0-9]* translation block functions" $S2E_LAST/debug.txt
+
+PATH_COUNT=$(grep "Terminated tb-eviction path" $S2E_LAST/debug.txt | wc -l)
+if [ $PATH_COUNT -ne 64 ]; then
+    exit 1
+fi
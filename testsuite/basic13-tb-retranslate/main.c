@@ -0,0 +1,52 @@
+// Copyright (c) 2023, Vitaly Chipounov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <s2e/s2e.h>
+
+// Runs in KLEE when its input is symbolic
+static unsigned mix(unsigned x) {
+    x ^= x >> 7;
+    x *= 0x9e3779b1u;
+    x += x << 3;
+    return x ^ (x >> 11);
+}
+
+int main(int argc, char **argv) {
+    unsigned x = 0, first = 0;
+    s2e_make_symbolic(&x, sizeof(x), "x");
+
+    // Every iteration flushes the translation block cache, so the same code
+    // is translated again and must get a valid function.
+    for (int i = 0; i < 16; ++i) {
+        unsigned r = mix(x);
+        s2e_concretize(&r, sizeof(r));
+
+        if (i == 0) {
+            first = r;
+        } else if (r != first) {
+            s2e_kill_state(1, "Retranslated block computed a different value");
+        }
+
+        s2e_flush_tbs();
+    }
+
+    s2e_kill_state(0, "Retranslated blocks ok");
+    return 0;
+}
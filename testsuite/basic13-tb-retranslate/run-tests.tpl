@@ -0,0 +1,7 @@
+#!/bin/bash
+
+{% include 'common-run.sh.tpl' %}
+
+s2e run -n {{ project_name }}
+
+grep -q "Retranslated blocks ok" $S2E_LAST/debug.txt
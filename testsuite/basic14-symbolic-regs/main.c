@@ -0,0 +1,61 @@
+// Copyright (c) 2023, Vitaly Chipounov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <s2e/s2e.h>
+
+// Keeps a symbolic value in ebx while the loop runs natively, because its blocks
+// do not access ebx. Interrupts that arrive during the loop read and write registers
+// in concrete mode. cpuid then overwrites the symbolic ebx with a concrete value,
+// which the following blocks must see.
+static unsigned cpuid_with_symbolic_ebx(unsigned value) {
+    unsigned a, b, c, d;
+
+    __asm__ __volatile__("mov %4, %%ebx\n"
+                         "mov $10000000, %%ecx\n"
+                         "1: dec %%ecx\n"
+                         "jnz 1b\n"
+                         "xor %%eax, %%eax\n"
+                         "cpuid\n"
+                         : "=a"(a), "=b"(b), "=c"(c), "=d"(d)
+                         : "m"(value));
+
+    return a ^ b ^ c ^ d;
+}
+
+static unsigned cpuid_concrete(void) {
+    unsigned a, b, c, d;
+    __asm__ __volatile__("cpuid\n" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(0));
+    return a ^ b ^ c ^ d;
+}
+
+int main(int argc, char **argv) {
+    unsigned expected = cpuid_concrete();
+    unsigned value = 0;
+
+    s2e_make_symbolic(&value, sizeof(value), "value");
+
+    // The result does not depend on the symbolic value, so there is no fork
+    if (cpuid_with_symbolic_ebx(value) != expected) {
+        s2e_kill_state(1, "ebx has a stale value");
+    }
+
+    s2e_kill_state(0, "Symbolic registers ok");
+    return 0;
+}
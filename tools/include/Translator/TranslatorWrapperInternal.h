@@ -95,6 +95,10 @@ static void after_memory_access(uint64_t vaddr, uint64_t value, unsigned size, u
     return;
 }
 
+static int is_memory_watched(uint64_t vaddr, uint64_t size) {
+    return 0;
+}
+
 static void trace_port_access(uint64_t port, uint64_t value, unsigned bits, int isWrite, void *retaddr) {
     return;
 }
@@ -173,6 +177,7 @@ struct se_libcpu_interface_t g_sqi = {
     .events = {
         .before_memory_access_signals_count = &s_count,
         .after_memory_access_signals_count = &s_count,
+        .watched_memory_access_signals_count = &s_count,
         .on_translate_soft_interrupt_signals_count = &s_count,
         .on_translate_block_start_signals_count = &s_count,
         .on_translate_block_end_signals_count = &s_count,
@@ -196,6 +201,7 @@ struct se_libcpu_interface_t g_sqi = {
         .on_page_fault = on_page_fault,
         .on_tlb_miss = on_tlb_miss,
         .after_memory_access = after_memory_access,
+        .is_memory_watched = is_memory_watched,
         .trace_port_access = trace_port_access,
         .tcg_execution_handler = tcg_execution_handler,
         .tcg_custom_instruction_handler = tcg_custom_instruction_handler,